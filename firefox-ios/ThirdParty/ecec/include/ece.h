@@ -45,6 +45,8 @@ extern "C" {
 #define ECE_ERROR_INVALID_AUTH_SECRET -20
 #define ECE_ERROR_GENERATE_KEYS -21
 #define ECE_ERROR_DECRYPT_TRUNCATED -22
+#define ECE_ERROR_ALLOCATOR -23
+#define ECE_ERROR_INVALID_BASE64URL -24
 
 // Annotates a variable or parameter as unused to avoid compiler warnings.
 #define ECE_UNUSED(x) (void) (x)
@@ -112,6 +114,41 @@ ece_webpush_generate_keys(uint8_t* rawRecvPrivKey, size_t rawRecvPrivKeyLen,
                           uint8_t* rawRecvPubKey, size_t rawRecvPubKeyLen,
                           uint8_t* authSecret, size_t authSecretLen);
 
+/*!
+ * Generates key pairs and authentication secrets for `count` Web Push
+ * subscriptions at once. This is faster than calling
+ * `ece_webpush_generate_keys` in a loop: the generator multiples come from a
+ * shared fixed-base table, and the public keys are converted to affine
+ * coordinates in batches, sharing one field inversion per batch.
+ *
+ * The key pairs are written back to back. The private key for subscription `i`
+ * starts at `rawRecvPrivKeys[i * ECE_WEBPUSH_PRIVATE_KEY_LENGTH]`, and likewise
+ * for the public keys and secrets. On failure, the outputs are zeroed.
+ *
+ * \sa                           ece_webpush_generate_keys()
+ *
+ * \param count[in]              The number of subscriptions.
+ * \param rawRecvPrivKeys[out]   The subscription private keys.
+ * \param rawRecvPrivKeysLen[in] The length of the private keys array. Must be
+ *                               `count * ECE_WEBPUSH_PRIVATE_KEY_LENGTH`.
+ * \param rawRecvPubKeys[out]    The subscription public keys, in uncompressed
+ *                               form.
+ * \param rawRecvPubKeysLen[in]  The length of the public keys array. Must be
+ *                               `count * ECE_WEBPUSH_PUBLIC_KEY_LENGTH`.
+ * \param authSecrets[out]       The authentication secrets.
+ * \param authSecretsLen[in]     The length of the secrets array. Must be
+ *                               `count * ECE_WEBPUSH_AUTH_SECRET_LENGTH`.
+ *
+ * \return                       `ECE_OK` on success, or an error code if key
+ *                               generation fails.
+ */
+int
+ece_webpush_generate_keys_bulk(size_t count, uint8_t* rawRecvPrivKeys,
+                               size_t rawRecvPrivKeysLen,
+                               uint8_t* rawRecvPubKeys,
+                               size_t rawRecvPubKeysLen, uint8_t* authSecrets,
+                               size_t authSecretsLen);
+
 /*!
  * Calculates the maximum "aes128gcm" plaintext length. The caller should
  * allocate and pass an array of this length to the "aes128gcm" decryption
@@ -187,6 +224,364 @@ ece_webpush_aes128gcm_decrypt(const uint8_t* rawRecvPrivKey,
                               const uint8_t* payload, size_t payloadLen,
                               uint8_t* plaintext, size_t* plaintextLen);
 
+/*!
+ * Decrypts a Web Push message encrypted using the "aes128gcm" scheme in place.
+ * The plaintext overwrites the records in `payload`, so the caller doesn't
+ * need a separate plaintext buffer.
+ *
+ * \sa                            ece_webpush_aes128gcm_decrypt()
+ *
+ * \param rawRecvPrivKey[in]      The subscription private key.
+ * \param rawRecvPrivKeyLen[in]   The length of the subscription private key.
+ *                                Must be `ECE_WEBPUSH_PRIVATE_KEY_LENGTH`.
+ * \param authSecret[in]          The authentication secret.
+ * \param authSecretLen[in]       The length of the authentication secret. Must
+ *                                be `ECE_WEBPUSH_AUTH_SECRET_LENGTH`.
+ * \param payload[in,out]         The encrypted payload. On error, the contents
+ *                                are unspecified.
+ * \param payloadLen[in]          The length of the encrypted payload.
+ * \param plaintextOffset[out]    On success, set to the offset of the
+ *                                plaintext in `payload`. This is the length of
+ *                                the payload header.
+ * \param plaintextLen[out]       On success, set to the plaintext length.
+ *                                `payload[plaintextOffset..plaintextOffset +
+ *                                plaintextLen]` contains the plaintext.
+ *
+ * \return                        `ECE_OK` on success, or an error code if
+ *                                the payload is empty or malformed.
+ */
+int
+ece_webpush_aes128gcm_decrypt_in_place(const uint8_t* rawRecvPrivKey,
+                                       size_t rawRecvPrivKeyLen,
+                                       const uint8_t* authSecret,
+                                       size_t authSecretLen, uint8_t* payload,
+                                       size_t payloadLen,
+                                       size_t* plaintextOffset,
+                                       size_t* plaintextLen);
+
+/*!
+ * Calculates the maximum plaintext length for a Base64url-encoded "aes128gcm"
+ * payload. This decodes only the payload header.
+ *
+ * \sa                   ece_webpush_aes128gcm_decrypt_base64url()
+ *
+ * \param payload[in]    The Base64url-encoded payload.
+ * \param payloadLen[in] The length of the encoded payload.
+ *
+ * \return               The maximum plaintext length, or 0 if the payload
+ *                       header is truncated, invalid, or not valid Base64url.
+ */
+size_t
+ece_aes128gcm_plaintext_max_length_base64url(const char* payload,
+                                             size_t payloadLen);
+
+/*!
+ * Decrypts a Base64url-encoded Web Push message encrypted using the
+ * "aes128gcm" scheme. This is equivalent to calling `ece_base64url_decode`,
+ * then `ece_webpush_aes128gcm_decrypt`, but decodes the payload one record at
+ * a time, and decrypts each record while it's still in cache. Only the
+ * plaintext and a single record are written, so the caller doesn't need to
+ * allocate a buffer for the decoded payload.
+ *
+ * \sa                          ece_aes128gcm_plaintext_max_length_base64url()
+ *
+ * \param rawRecvPrivKey[in]    The subscription private key.
+ * \param rawRecvPrivKeyLen[in] The length of the subscription private key. Must
+ *                              be `ECE_WEBPUSH_PRIVATE_KEY_LENGTH`.
+ * \param authSecret[in]        The authentication secret.
+ * \param authSecretLen[in]     The length of the authentication secret. Must be
+ *                              `ECE_WEBPUSH_AUTH_SECRET_LENGTH`.
+ * \param payload[in]           The Base64url-encoded payload.
+ * \param payloadLen[in]        The length of the encoded payload.
+ * \param paddingPolicy[in]     The policy for handling "=" padding in the
+ *                              encoded payload.
+ * \param plaintext[in]         An empty array. Must be large enough to hold the
+ *                              full plaintext.
+ * \param plaintextLen[in,out]  The input is the length of the empty `plaintext`
+ *                              array. On success, the output is set to the
+ *                              actual plaintext length, and
+ *                              `[0..plaintextLen]` contains the plaintext.
+ *
+ * \return                      `ECE_OK` on success;
+ *                              `ECE_ERROR_INVALID_BASE64URL` if the payload
+ *                              isn't valid Base64url; or another error code if
+ *                              the decoded payload is empty or malformed.
+ *                              Errors are reported in payload order, so a
+ *                              record that fails to decrypt is reported before
+ *                              an encoding error after it.
+ */
+int
+ece_webpush_aes128gcm_decrypt_base64url(
+  const uint8_t* rawRecvPrivKey, size_t rawRecvPrivKeyLen,
+  const uint8_t* authSecret, size_t authSecretLen, const char* payload,
+  size_t payloadLen, ece_base64url_decode_policy_t paddingPolicy,
+  uint8_t* plaintext, size_t* plaintextLen);
+
+/*!
+ * A buffer segment, for functions that read or write data that isn't
+ * contiguous in memory. This has the same members as POSIX `struct iovec`.
+ */
+typedef struct ece_iovec_s {
+  void* base;
+  size_t len;
+} ece_iovec_t;
+
+/*!
+ * Decrypts an "aes128gcm" message with a symmetric key, reading the payload
+ * from a list of segments and writing the plaintext to another. Records may
+ * straddle segment boundaries. This is equivalent to `ece_aes128gcm_decrypt`
+ * with the segments concatenated, but doesn't copy the payload into one
+ * buffer.
+ *
+ * \sa                          ece_aes128gcm_decrypt()
+ *
+ * \param ikm[in]               The input keying material.
+ * \param ikmLen[in]            The length of the IKM.
+ * \param payload[in]           The segments of the encrypted payload.
+ * \param payloadCount[in]      The number of payload segments.
+ * \param plaintext[in]         Empty segments to hold the plaintext. Their
+ *                              total length must be large enough to hold the
+ *                              full plaintext; use
+ *                              `ece_aes128gcm_plaintext_max_length`.
+ * \param plaintextCount[in]    The number of plaintext segments.
+ * \param plaintextLen[out]     On success, set to the plaintext length. The
+ *                              plaintext fills the first `plaintextLen` bytes
+ *                              of the segments, in order.
+ *
+ * \return                      `ECE_OK` on success, or an error code if
+ *                              the payload is empty or malformed.
+ */
+int
+ece_aes128gcm_decrypt_iov(const uint8_t* ikm, size_t ikmLen,
+                          const ece_iovec_t* payload, size_t payloadCount,
+                          const ece_iovec_t* plaintext, size_t plaintextCount,
+                          size_t* plaintextLen);
+
+/*!
+ * Decrypts a Web Push message encrypted using the "aes128gcm" scheme, reading
+ * the payload from a list of segments and writing the plaintext to another.
+ * This is the scatter-gather equivalent of `ece_webpush_aes128gcm_decrypt`.
+ *
+ * \sa                          ece_aes128gcm_decrypt_iov()
+ */
+int
+ece_webpush_aes128gcm_decrypt_iov(const uint8_t* rawRecvPrivKey,
+                                  size_t rawRecvPrivKeyLen,
+                                  const uint8_t* authSecret,
+                                  size_t authSecretLen,
+                                  const ece_iovec_t* payload,
+                                  size_t payloadCount,
+                                  const ece_iovec_t* plaintext,
+                                  size_t plaintextCount,
+                                  size_t* plaintextLen);
+
+/*!
+ * Decrypts a batch of Web Push messages encrypted using the "aes128gcm" scheme
+ * for the same subscription. This imports the subscription private key once,
+ * instead of for each call to `ece_webpush_aes128gcm_decrypt`. Records from
+ * different messages are decrypted together, several at a time, using AES-NI
+ * and PCLMULQDQ if the CPU supports them. Each message is decrypted
+ * independently; a failure doesn't stop the rest of the batch.
+ *
+ * \sa                          ece_webpush_aes128gcm_decrypt()
+ *
+ * \param rawRecvPrivKey[in]    The subscription private key.
+ * \param rawRecvPrivKeyLen[in] The length of the subscription private key. Must
+ *                              be `ECE_WEBPUSH_PRIVATE_KEY_LENGTH`.
+ * \param authSecret[in]        The authentication secret.
+ * \param authSecretLen[in]     The length of the authentication secret. Must be
+ *                              `ECE_WEBPUSH_AUTH_SECRET_LENGTH`.
+ * \param count[in]             The number of messages in the batch.
+ * \param payloads[in]          An array of `count` encrypted payloads.
+ * \param payloadLens[in]       The lengths of the encrypted payloads.
+ * \param plaintexts[in]        An array of `count` empty arrays. Each must be
+ *                              at least `ece_aes128gcm_plaintext_max_length`
+ *                              bytes for its payload.
+ * \param plaintextLens[in,out] The input values are the lengths of the empty
+ *                              `plaintexts` arrays. On success, each output is
+ *                              set to the actual plaintext length.
+ * \param errs[out]             An array of `count` status codes. Each is set to
+ *                              `ECE_OK` if the message was decrypted, or the
+ *                              error that `ece_webpush_aes128gcm_decrypt` would
+ *                              return for it.
+ *
+ * \return                      `ECE_OK` if every message was decrypted, or the
+ *                              error for the first message that failed.
+ */
+int
+ece_webpush_aes128gcm_decrypt_batch(
+  const uint8_t* rawRecvPrivKey, size_t rawRecvPrivKeyLen,
+  const uint8_t* authSecret, size_t authSecretLen, size_t count,
+  const uint8_t* const* payloads, const size_t* payloadLens,
+  uint8_t* const* plaintexts, size_t* plaintextLens, int* errs);
+
+/*!
+ * An incremental "aes128gcm" decryption context. The context accepts the
+ * payload in arbitrary-sized chunks, and emits the plaintext one record at a
+ * time. It only buffers the payload header and at most one record, so memory
+ * use doesn't depend on the payload length. Despite its name, the context can
+ * also decrypt an "aesgcm" ciphertext, if it's initialized with
+ * `ece_webpush_aesgcm_decrypt_init`.
+ */
+typedef struct ece_aes128gcm_decrypt_ctx_s ece_aes128gcm_decrypt_ctx_t;
+
+/*!
+ * Allocates an "aes128gcm" decryption context. The context must be initialized
+ * with `ece_aes128gcm_decrypt_init` or `ece_webpush_aes128gcm_decrypt_init`
+ * before use, and can be reinitialized to decrypt another payload.
+ *
+ * \sa     ece_aes128gcm_decrypt_ctx_free()
+ *
+ * \return The context, or `NULL` if allocation fails.
+ */
+ece_aes128gcm_decrypt_ctx_t*
+ece_aes128gcm_decrypt_ctx_new(void);
+
+/*!
+ * Frees an "aes128gcm" decryption context. `ctx` may be `NULL`.
+ */
+void
+ece_aes128gcm_decrypt_ctx_free(ece_aes128gcm_decrypt_ctx_t* ctx);
+
+/*!
+ * Initializes an "aes128gcm" decryption context with a symmetric key. This is
+ * the streaming equivalent of `ece_aes128gcm_decrypt`.
+ *
+ * \sa               ece_aes128gcm_decrypt_update()
+ *
+ * \param ctx[in]    The decryption context.
+ * \param ikm[in]    The input keying material (IKM) for the content encryption
+ *                   key and nonce.
+ * \param ikmLen[in] The length of the IKM.
+ *
+ * \return           `ECE_OK` on success, or an error code if allocation fails.
+ */
+int
+ece_aes128gcm_decrypt_init(ece_aes128gcm_decrypt_ctx_t* ctx,
+                           const uint8_t* ikm, size_t ikmLen);
+
+/*!
+ * Initializes an "aes128gcm" decryption context for a Web Push message. This
+ * is the streaming equivalent of `ece_webpush_aes128gcm_decrypt`.
+ *
+ * \sa                          ece_aes128gcm_decrypt_update()
+ *
+ * \param ctx[in]               The decryption context.
+ * \param rawRecvPrivKey[in]    The subscription private key.
+ * \param rawRecvPrivKeyLen[in] The length of the subscription private key. Must
+ *                              be `ECE_WEBPUSH_PRIVATE_KEY_LENGTH`.
+ * \param authSecret[in]        The authentication secret.
+ * \param authSecretLen[in]     The length of the authentication secret. Must be
+ *                              `ECE_WEBPUSH_AUTH_SECRET_LENGTH`.
+ *
+ * \return                      `ECE_OK` on success, or an error code if the
+ *                              private key or auth secret is invalid.
+ */
+int
+ece_webpush_aes128gcm_decrypt_init(ece_aes128gcm_decrypt_ctx_t* ctx,
+                                   const uint8_t* rawRecvPrivKey,
+                                   size_t rawRecvPrivKeyLen,
+                                   const uint8_t* authSecret,
+                                   size_t authSecretLen);
+
+/*!
+ * Initializes a decryption context for a Web Push message encrypted using the
+ * "aesgcm" scheme. This is the streaming equivalent of
+ * `ece_webpush_aesgcm_decrypt`. Since the salt and sender key come from the
+ * headers, this function derives the key immediately, and the chunks passed
+ * to `ece_aes128gcm_decrypt_update` contain only the ciphertext.
+ *
+ * \sa                           ece_aes128gcm_decrypt_update()
+ *
+ * \param ctx[in]                The decryption context.
+ * \param rawRecvPrivKey[in]     The subscription private key.
+ * \param rawRecvPrivKeyLen[in]  The length of the subscription private key.
+ *                               Must be `ECE_WEBPUSH_PRIVATE_KEY_LENGTH`.
+ * \param authSecret[in]         The authentication secret.
+ * \param authSecretLen[in]      The length of the authentication secret. Must
+ *                               be `ECE_WEBPUSH_AUTH_SECRET_LENGTH`.
+ * \param salt[in]               The salt, from the `Encryption` header.
+ * \param saltLen[in]            The length of the salt. Must be
+ *                               `ECE_SALT_LENGTH`.
+ * \param rawSenderPubKey[in]    The sender public key, in uncompressed form,
+ *                               from the `Crypto-Key` header.
+ * \param rawSenderPubKeyLen[in] The length of the sender public key. Must be
+ *                               `ECE_WEBPUSH_PUBLIC_KEY_LENGTH`.
+ * \param rs[in]                 The record size. Must be at least
+ *                               `ECE_AESGCM_MIN_RS`.
+ *
+ * \return                       `ECE_OK` on success, or an error code if the
+ *                               keys, salt, or record size are invalid.
+ */
+int
+ece_webpush_aesgcm_decrypt_init(
+  ece_aes128gcm_decrypt_ctx_t* ctx, const uint8_t* rawRecvPrivKey,
+  size_t rawRecvPrivKeyLen, const uint8_t* authSecret, size_t authSecretLen,
+  const uint8_t* salt, size_t saltLen, const uint8_t* rawSenderPubKey,
+  size_t rawSenderPubKeyLen, uint32_t rs);
+
+/*!
+ * Calculates the maximum plaintext length that the next call to
+ * `ece_aes128gcm_decrypt_update` can produce. Pass 0 for `payloadLen` to size
+ * the buffer for `ece_aes128gcm_decrypt_final`.
+ *
+ * \param ctx[in]        The decryption context.
+ * \param payloadLen[in] The length of the next payload chunk.
+ *
+ * \return               The maximum plaintext length.
+ */
+size_t
+ece_aes128gcm_decrypt_update_max_length(const ece_aes128gcm_decrypt_ctx_t* ctx,
+                                        size_t payloadLen);
+
+/*!
+ * Decrypts the next chunk of an "aes128gcm" payload. Chunks can be any size,
+ * and don't need to line up with the header or record boundaries. The last
+ * record is held back until `ece_aes128gcm_decrypt_final`, because only the
+ * end of the payload tells us that a record is the last one.
+ *
+ * \sa                          ece_aes128gcm_decrypt_update_max_length(),
+ *                              ece_aes128gcm_decrypt_final()
+ *
+ * \param ctx[in]               The decryption context.
+ * \param payload[in]           The next chunk of the encrypted payload.
+ * \param payloadLen[in]        The length of the chunk.
+ * \param plaintext[in]         An empty array. Must be large enough to hold
+ *                              the plaintext for all records completed by this
+ *                              chunk.
+ * \param plaintextLen[in,out]  The input is the length of the empty `plaintext`
+ *                              array. On success, the output is set to the
+ *                              number of plaintext bytes written, which may be
+ *                              0.
+ *
+ * \return                      `ECE_OK` on success, or an error code if the
+ *                              payload is malformed. Errors are sticky: once
+ *                              an update fails, the context must be
+ *                              reinitialized.
+ */
+int
+ece_aes128gcm_decrypt_update(ece_aes128gcm_decrypt_ctx_t* ctx,
+                             const uint8_t* payload, size_t payloadLen,
+                             uint8_t* plaintext, size_t* plaintextLen);
+
+/*!
+ * Finishes decrypting an "aes128gcm" payload, and writes the plaintext for the
+ * last record.
+ *
+ * \param ctx[in]               The decryption context.
+ * \param plaintext[in]         An empty array. Must be large enough to hold
+ *                              the plaintext for the last record.
+ * \param plaintextLen[in,out]  The input is the length of the empty `plaintext`
+ *                              array. On success, the output is set to the
+ *                              number of plaintext bytes written.
+ *
+ * \return                      `ECE_OK` on success, or an error code if the
+ *                              payload is empty, truncated, or malformed.
+ */
+int
+ece_aes128gcm_decrypt_final(ece_aes128gcm_decrypt_ctx_t* ctx,
+                            uint8_t* plaintext, size_t* plaintextLen);
+
 /*!
  * Calculates the maximum "aes128gcm" encrypted payload length. The caller
  * should allocate and pass an array of this length to the "aes128gcm"
@@ -295,6 +690,71 @@ ece_webpush_aes128gcm_encrypt_with_keys(
   uint32_t rs, size_t padLen, const uint8_t* plaintext, size_t plaintextLen,
   uint8_t* payload, size_t* payloadLen);
 
+/*!
+ * Calculates the exact length of a Base64url-encoded "aes128gcm" payload. The
+ * caller should allocate and pass an array of this length to
+ * `ece_webpush_aes128gcm_encrypt_base64url`.
+ *
+ * \sa                      ece_webpush_aes128gcm_encrypt_base64url()
+ *
+ * \param rs[in]            The record size. Must be at least
+ *                          `ECE_AES128GCM_MIN_RS`.
+ * \param padLen[in]        The length of additional padding.
+ * \param plaintextLen[in]  The length of the plaintext.
+ * \param paddingPolicy[in] The policy for padding the encoded payload.
+ *
+ * \return                  The encoded payload length, or 0 if `rs` is too
+ *                          small, `plaintextLen` is 0, or the padding can't
+ *                          be spread over the records.
+ */
+size_t
+ece_aes128gcm_payload_length_base64url(
+  uint32_t rs, size_t padLen, size_t plaintextLen,
+  ece_base64url_encode_policy_t paddingPolicy);
+
+/*!
+ * Encrypts a Web Push message using the "aes128gcm" scheme, and encodes the
+ * payload as Base64url. Each record is encoded as soon as it's sealed, so the
+ * binary payload is never held in memory. The output is identical to calling
+ * `ece_webpush_aes128gcm_encrypt`, then `ece_base64url_encode`. Like
+ * `ece_webpush_aes128gcm_encrypt`, this function generates an ephemeral ECDH
+ * key pair and a random salt.
+ *
+ * \sa                         ece_aes128gcm_payload_length_base64url(),
+ *                             ece_encrypt_base64url()
+ *
+ * \param rawRecvPubKey[in]    The subscription public key, in uncompressed
+ *                             form.
+ * \param rawRecvPubKeyLen[in] The length of the subscription public key. Must
+ *                             be `ECE_WEBPUSH_PUBLIC_KEY_LENGTH`.
+ * \param authSecret[in]       The authentication secret.
+ * \param authSecretLen[in]    The length of the authentication secret. Must be
+ *                             `ECE_WEBPUSH_AUTH_SECRET_LENGTH`.
+ * \param rs[in]               The record size. Must be at least
+ *                             `ECE_AES128GCM_MIN_RS`.
+ * \param padLen[in]           The length of additional padding to include in
+ *                             the ciphertext, if any.
+ * \param plaintext[in]        The plaintext to encrypt.
+ * \param plaintextLen[in]     The length of the plaintext.
+ * \param paddingPolicy[in]    The policy for padding the encoded payload.
+ * \param payload[in]          An empty array. Must be at least as long as
+ *                             `ece_aes128gcm_payload_length_base64url`. This
+ *                             function does *not* null-terminate `payload`.
+ * \param payloadLen[in,out]   The input is the length of the empty `payload`
+ *                             array. On success, the output is set to the
+ *                             encoded payload length.
+ *
+ * \return                     `ECE_OK` on success, or an error code if
+ *                             encryption fails.
+ */
+int
+ece_webpush_aes128gcm_encrypt_base64url(
+  const uint8_t* rawRecvPubKey, size_t rawRecvPubKeyLen,
+  const uint8_t* authSecret, size_t authSecretLen, uint32_t rs, size_t padLen,
+  const uint8_t* plaintext, size_t plaintextLen,
+  ece_base64url_encode_policy_t paddingPolicy, char* payload,
+  size_t* payloadLen);
+
 /*!
  * Calculates the maximum "aesgcm" ciphertext length. The caller should allocate
  * and pass an array of this length to `ece_webpush_aesgcm_encrypt_with_keys`.
@@ -402,76 +862,1009 @@ ece_webpush_aesgcm_encrypt_with_keys(
   uint8_t* ciphertext, size_t* ciphertextLen);
 
 /*!
- * Calculates the maximum "aesgcm" plaintext length. The caller should allocate
- * and pass an array of this length to `ece_webpush_aesgcm_decrypt`.
+ * An opaque worker pool, used to encrypt and decrypt the records of large
+ * messages in parallel. Each record has its own IV, so records can be sealed
+ * and opened independently. A pool can be shared between threads, but only
+ * runs one message at a time.
+ */
+typedef struct ece_pool_s ece_pool_t;
+
+/*!
+ * Creates a worker pool.
  *
- * \sa                      ece_webpush_aesgcm_decrypt()
+ * \sa                  ece_pool_free()
  *
- * \param rs[in]            The record size. Must be at least
- *                          `ECE_AESGCM_MIN_RS`.
- * \param ciphertextLen[in] The ciphertext length.
+ * \param numWorkers[in] The number of workers, including the calling thread,
+ *                       which also encrypts and decrypts records. A pool with
+ *                       `n` workers starts `n - 1` threads. If the library is
+ *                       built without thread support, all records are
+ *                       processed on the calling thread.
  *
- * \return                  The maximum plaintext length.
+ * \return               The pool, or `NULL` if `numWorkers` is 0 or the
+ *                       threads can't be started.
  */
-size_t
-ece_aesgcm_plaintext_max_length(uint32_t rs, size_t ciphertextLen);
+ece_pool_t*
+ece_pool_new(size_t numWorkers);
 
 /*!
- * Decrypts a Web Push message encrypted using the "aesgcm" scheme.
- *
- * \sa                           ece_aesgcm_plaintext_max_length()
+ * Stops the worker threads and frees a pool. `pool` may be `NULL`.
+ */
+void
+ece_pool_free(ece_pool_t* pool);
+
+/*!
+ * An opaque streaming encryption context, used to encrypt a message in chunks
+ * with either scheme. Records are encrypted as soon as enough plaintext is
+ * available, so the context only needs to hold one record at a time.
+ */
+typedef struct ece_encrypt_ctx_s ece_encrypt_ctx_t;
+
+/*!
+ * Creates a streaming encryption context. The context must be initialized with
+ * one of the `ece_webpush_*_encrypt_init` functions before use, and can be
+ * reinitialized to encrypt another message.
  *
- * \param rawRecvPrivKey[in]     The subscription private key.
- * \param rawRecvPrivKeyLen[in]  The length of the subscription private key.
- *                               Must be `ECE_WEBPUSH_PRIVATE_KEY_LENGTH`.
- * \param authSecret[in]         The authentication secret.
- * \param authSecretLen[in]      The length of the authentication secret. Must
- *                               be `ECE_WEBPUSH_AUTH_SECRET_LENGTH`.
- * \param salt[in]
- * \param salt[in]               The salt, from the `Encryption` header.
- * \param saltLen[in]            The length of the salt. Must be
- *                               `ECE_SALT_LENGTH`.
- * \param rawSenderPubKey[in]    The sender public key, in uncompressed form,
- *                               from the `Crypto-Key` header.
- * \param rawSenderPubKeyLen[in] The length of the sender public key. Must be
- *                               `ECE_WEBPUSH_PUBLIC_KEY_LENGTH`.
- * \param rs[in]                 The record size. Must be at least
- *                               `ECE_AESGCM_MIN_RS`.
- * \param ciphertext[in]         The ciphertext.
- * \param ciphertextLen[in]      The length of the ciphertext.
- * \param plaintext[in]          An empty array. Must be large enough to hold
- *                               the full plaintext.
- * \param plaintextLen[in,out]   The input is the length of the empty
- *                               `plaintext` array. On success, the output is
- *                               set to the actual plaintext length, and
- *                               `[0..plaintextLen]` contains the plaintext.
+ * \sa     ece_encrypt_ctx_free()
  *
- * \return                       `ECE_OK` on success, or an error code if the
- *                               headers or ciphertext are malformed.
+ * \return The context, or `NULL` if allocation fails.
  */
-int
-ece_webpush_aesgcm_decrypt(const uint8_t* rawRecvPrivKey,
-                           size_t rawRecvPrivKeyLen, const uint8_t* authSecret,
-                           size_t authSecretLen, const uint8_t* salt,
-                           size_t saltLen, const uint8_t* rawSenderPubKey,
-                           size_t rawSenderPubKeyLen, uint32_t rs,
-                           const uint8_t* ciphertext, size_t ciphertextLen,
-                           uint8_t* plaintext, size_t* plaintextLen);
+ece_encrypt_ctx_t*
+ece_encrypt_ctx_new(void);
 
 /*!
- * Extracts "aes128gcm" decryption parameters from an encrypted payload.
- * `salt`, `keyId`, and `ciphertext` are pointers into `payload`, and must not
- * outlive it.
+ * Frees a streaming encryption context. `ctx` may be `NULL`.
+ */
+void
+ece_encrypt_ctx_free(ece_encrypt_ctx_t* ctx);
+
+/*!
+ * Initializes a streaming encryption context for a Web Push message using the
+ * "aes128gcm" scheme. This is the streaming equivalent of
+ * `ece_webpush_aes128gcm_encrypt`, and generates an ephemeral sender key pair
+ * and a random salt. The payload header is written by the first call to
+ * `ece_encrypt_update` or `ece_encrypt_final`.
  *
- * \sa                       ece_aes128gcm_decrypt()
+ * \sa                         ece_encrypt_update()
  *
- * \param payload[in]        The encrypted payload.
- * \param payloadLen[in]     The length of the encrypted payload.
- * \param salt[out]          The encryption salt.
- * \param saltLen[out]       The length of the salt.
- * \param keyId[out]         An identifier for the keying material.
- * \param keyIdLen[out]      The length of the key ID.
- * \param rs[out]            The record size.
+ * \param ctx[in]              The encryption context.
+ * \param rawRecvPubKey[in]    The subscription public key, in uncompressed
+ *                             form.
+ * \param rawRecvPubKeyLen[in] The length of the subscription public key. Must
+ *                             be `ECE_WEBPUSH_PUBLIC_KEY_LENGTH`.
+ * \param authSecret[in]       The authentication secret.
+ * \param authSecretLen[in]    The length of the authentication secret. Must be
+ *                             `ECE_WEBPUSH_AUTH_SECRET_LENGTH`.
+ * \param rs[in]               The record size. Must be at least
+ *                             `ECE_AES128GCM_MIN_RS`.
+ * \param padLen[in]           The length of additional padding to include in
+ *                             the ciphertext, if any.
+ *
+ * \return                     `ECE_OK` on success, or an error code if the
+ *                             keys or record size are invalid.
+ */
+int
+ece_webpush_aes128gcm_encrypt_init(ece_encrypt_ctx_t* ctx,
+                                   const uint8_t* rawRecvPubKey,
+                                   size_t rawRecvPubKeyLen,
+                                   const uint8_t* authSecret,
+                                   size_t authSecretLen, uint32_t rs,
+                                   size_t padLen);
+
+/*!
+ * Initializes a streaming "aes128gcm" encryption context with an explicit
+ * sender key and salt.
+ *
+ * \warning In general, you should only use this function for testing.
+ *          `ece_webpush_aes128gcm_encrypt_init` is safer because it doesn't
+ *          risk accidental salt reuse.
+ *
+ * \sa      ece_webpush_aes128gcm_encrypt_with_keys()
+ */
+int
+ece_webpush_aes128gcm_encrypt_init_with_keys(
+  ece_encrypt_ctx_t* ctx, const uint8_t* rawSenderPrivKey,
+  size_t rawSenderPrivKeyLen, const uint8_t* authSecret, size_t authSecretLen,
+  const uint8_t* salt, size_t saltLen, const uint8_t* rawRecvPubKey,
+  size_t rawRecvPubKeyLen, uint32_t rs, size_t padLen);
+
+/*!
+ * Initializes a streaming encryption context for a Web Push message using the
+ * "aesgcm" scheme. Like `ece_webpush_aesgcm_encrypt`, this function generates
+ * a sender key pair and salt, which the caller should send in the
+ * `Crypto-Key` and `Encryption` headers.
+ *
+ * \sa                           ece_encrypt_update()
+ *
+ * \param ctx[in]                The encryption context.
+ * \param rawRecvPubKey[in]      The subscription public key, in uncompressed
+ *                               form.
+ * \param rawRecvPubKeyLen[in]   The length of the subscription public key. Must
+ *                               be `ECE_WEBPUSH_PUBLIC_KEY_LENGTH`.
+ * \param authSecret[in]         The authentication secret.
+ * \param authSecretLen[in]      The length of the authentication secret. Must
+ *                               be `ECE_WEBPUSH_AUTH_SECRET_LENGTH`.
+ * \param rs[in]                 The record size. Must be at least
+ *                               `ECE_AESGCM_MIN_RS`.
+ * \param padLen[in]             The length of additional padding to include in
+ *                               the ciphertext, if any.
+ * \param salt[in]               An empty array to hold the salt.
+ * \param saltLen[in]            The length of the empty `salt` array. Must be
+ *                               `ECE_SALT_LENGTH`.
+ * \param rawSenderPubKey[in]    An empty array to hold the sender public key.
+ * \param rawSenderPubKeyLen[in] The length of the empty `rawSenderPubKey`
+ *                               array. Must be `ECE_WEBPUSH_PUBLIC_KEY_LENGTH`.
+ *
+ * \return                       `ECE_OK` on success, or an error code if the
+ *                               keys or record size are invalid.
+ */
+int
+ece_webpush_aesgcm_encrypt_init(ece_encrypt_ctx_t* ctx,
+                                const uint8_t* rawRecvPubKey,
+                                size_t rawRecvPubKeyLen,
+                                const uint8_t* authSecret, size_t authSecretLen,
+                                uint32_t rs, size_t padLen, uint8_t* salt,
+                                size_t saltLen, uint8_t* rawSenderPubKey,
+                                size_t rawSenderPubKeyLen);
+
+/*!
+ * Initializes a streaming "aesgcm" encryption context with explicit keys.
+ *
+ * \warning `ece_webpush_aesgcm_encrypt_init` is safer because it doesn't risk
+ *          accidental salt reuse.
+ *
+ * \sa      ece_webpush_aesgcm_encrypt_with_keys()
+ */
+int
+ece_webpush_aesgcm_encrypt_init_with_keys(
+  ece_encrypt_ctx_t* ctx, const uint8_t* rawSenderPrivKey,
+  size_t rawSenderPrivKeyLen, const uint8_t* authSecret, size_t authSecretLen,
+  const uint8_t* salt, size_t saltLen, const uint8_t* rawRecvPubKey,
+  size_t rawRecvPubKeyLen, uint32_t rs, size_t padLen);
+
+/*!
+ * Calculates the maximum output length for the next call to
+ * `ece_encrypt_update` with `plaintextLen` bytes of plaintext. Pass 0 to get
+ * the maximum output length for `ece_encrypt_final`.
+ *
+ * \param ctx[in]          The encryption context.
+ * \param plaintextLen[in] The length of the next plaintext chunk.
+ *
+ * \return                 The maximum output length, or 0 if the context
+ *                         isn't initialized or failed.
+ */
+size_t
+ece_encrypt_update_max_length(const ece_encrypt_ctx_t* ctx,
+                              size_t plaintextLen);
+
+/*!
+ * Encrypts the next chunk of plaintext. The output contains the "aes128gcm"
+ * header if it hasn't been written yet, followed by all records that can be
+ * sealed. The last full record is held until more plaintext arrives or
+ * `ece_encrypt_final` is called, because "aes128gcm" pads the last record
+ * differently. Once an error occurs, all subsequent calls return the same
+ * error.
+ *
+ * \sa                          ece_encrypt_update_max_length()
+ *
+ * \param ctx[in]               The encryption context.
+ * \param plaintext[in]         The next chunk of the plaintext.
+ * \param plaintextLen[in]      The length of the chunk.
+ * \param ciphertext[in]        An empty array. Must be large enough to hold the
+ *                              encrypted output.
+ * \param ciphertextLen[in,out] The input is the length of the empty
+ *                              `ciphertext` array. On success, the output is
+ *                              set to the number of bytes written, which may
+ *                              be 0.
+ *
+ * \return                      `ECE_OK` on success, or an error code if
+ *                              encryption fails.
+ */
+int
+ece_encrypt_update(ece_encrypt_ctx_t* ctx, const uint8_t* plaintext,
+                   size_t plaintextLen, uint8_t* ciphertext,
+                   size_t* ciphertextLen);
+
+/*!
+ * Encrypts the remaining plaintext and padding, and writes the last record.
+ * For "aesgcm", this also writes a padding-only trailer record if the
+ * ciphertext would otherwise end on a record boundary.
+ *
+ * \param ctx[in]               The encryption context.
+ * \param ciphertext[in]        An empty array. Must be large enough to hold the
+ *                              remaining records.
+ * \param ciphertextLen[in,out] The input is the length of the empty
+ *                              `ciphertext` array. On success, the output is
+ *                              set to the number of bytes written.
+ *
+ * \return                      `ECE_OK` on success, or an error code if the
+ *                              plaintext is empty, or the padding can't be
+ *                              spread over the records.
+ */
+int
+ece_encrypt_final(ece_encrypt_ctx_t* ctx, uint8_t* ciphertext,
+                  size_t* ciphertextLen);
+
+/*!
+ * Encrypts a complete message with an initialized context, splitting the
+ * records between the workers in `pool`. The output is identical to calling
+ * `ece_encrypt_update` and `ece_encrypt_final` with the same plaintext. If
+ * `pool` is `NULL`, or the context has already encrypted some plaintext, the
+ * records are encrypted on the calling thread.
+ *
+ * As with `ece_encrypt_final`, the context must be initialized again before
+ * encrypting another message.
+ *
+ * \param ctx[in]               The initialized encryption context.
+ * \param pool[in]              The worker pool, or `NULL`.
+ * \param plaintext[in]         The plaintext to encrypt.
+ * \param plaintextLen[in]      The length of the plaintext.
+ * \param ciphertext[in]        An empty array. Must be large enough to hold the
+ *                              header and all records; use
+ *                              `ece_encrypt_update_max_length` to find the
+ *                              maximum length.
+ * \param ciphertextLen[in,out] The input is the length of the empty
+ *                              `ciphertext` array. On success, the output is
+ *                              set to the number of bytes written.
+ *
+ * \return                      `ECE_OK` on success, or an error code if
+ *                              encryption fails. If several records fail, the
+ *                              error is the one for the first failing record.
+ */
+int
+ece_encrypt_parallel(ece_encrypt_ctx_t* ctx, ece_pool_t* pool,
+                     const uint8_t* plaintext, size_t plaintextLen,
+                     uint8_t* ciphertext, size_t* ciphertextLen);
+
+/*!
+ * Encrypts a complete message in place, with an initialized context. The
+ * caller writes the plaintext to the end of `buffer`, at offset `bufferLen -
+ * plaintextLen`, and this function replaces it with the header and records,
+ * starting at offset 0. The output is identical to calling
+ * `ece_encrypt_update` and `ece_encrypt_final` with the same plaintext, but
+ * needs only one buffer.
+ *
+ * The context must be freshly initialized, and must be initialized again
+ * before encrypting another message.
+ *
+ * \param ctx[in]               The initialized encryption context.
+ * \param buffer[in,out]        The buffer holding the plaintext. Must be large
+ *                              enough to hold the header and all records; use
+ *                              `ece_encrypt_update_max_length` to find the
+ *                              maximum length.
+ * \param bufferLen[in]         The length of `buffer`.
+ * \param plaintextLen[in]      The length of the plaintext at the end of
+ *                              `buffer`.
+ * \param ciphertextLen[out]    On success, set to the number of bytes written.
+ *                              `buffer[0..ciphertextLen]` contains the
+ *                              ciphertext. On error, the contents of `buffer`
+ *                              are unspecified.
+ *
+ * \return                      `ECE_OK` on success, or an error code if
+ *                              encryption fails.
+ */
+int
+ece_encrypt_in_place(ece_encrypt_ctx_t* ctx, uint8_t* buffer, size_t bufferLen,
+                     size_t plaintextLen, size_t* ciphertextLen);
+
+/*!
+ * Encrypts a complete message with an initialized context, reading the
+ * plaintext from a list of segments and writing the header and records to
+ * another. Records may straddle segment boundaries. The output is identical to
+ * calling `ece_encrypt_update` and `ece_encrypt_final` with the segments
+ * concatenated.
+ *
+ * The context must be freshly initialized, and must be initialized again
+ * before encrypting another message.
+ *
+ * \param ctx[in]               The initialized encryption context.
+ * \param plaintext[in]         The segments of the plaintext.
+ * \param plaintextCount[in]    The number of plaintext segments.
+ * \param ciphertext[in]        Empty segments to hold the ciphertext. Their
+ *                              total length must be large enough to hold the
+ *                              header and all records; use
+ *                              `ece_encrypt_update_max_length`.
+ * \param ciphertextCount[in]   The number of ciphertext segments.
+ * \param ciphertextLen[out]    On success, set to the number of bytes written.
+ *
+ * \return                      `ECE_OK` on success, or an error code if
+ *                              encryption fails.
+ */
+int
+ece_encrypt_iov(ece_encrypt_ctx_t* ctx, const ece_iovec_t* plaintext,
+                size_t plaintextCount, const ece_iovec_t* ciphertext,
+                size_t ciphertextCount, size_t* ciphertextLen);
+
+/*!
+ * Calculates the exact length of a complete message encrypted with
+ * `ece_encrypt_base64url`, including the header.
+ *
+ * \param ctx[in]           The initialized encryption context.
+ * \param plaintextLen[in]  The length of the plaintext.
+ * \param paddingPolicy[in] The policy for padding the encoded output.
+ *
+ * \return                  The encoded length, or 0 if the context isn't
+ *                          freshly initialized, `plaintextLen` is 0, or the
+ *                          padding can't be spread over the records.
+ */
+size_t
+ece_encrypt_base64url_length(const ece_encrypt_ctx_t* ctx, size_t plaintextLen,
+                             ece_base64url_encode_policy_t paddingPolicy);
+
+/*!
+ * Encrypts a complete message with an initialized context, and encodes the
+ * header and records as Base64url. Each record is sealed in the context's
+ * pending block, and encoded while it's still in cache. The output is
+ * identical to calling `ece_encrypt_update` and `ece_encrypt_final`, then
+ * `ece_base64url_encode`, but needs no buffer for the binary ciphertext.
+ *
+ * The context must be freshly initialized, and must be initialized again
+ * before encrypting another message.
+ *
+ * \param ctx[in]            The initialized encryption context.
+ * \param plaintext[in]      The plaintext to encrypt.
+ * \param plaintextLen[in]   The length of the plaintext.
+ * \param paddingPolicy[in]  The policy for padding the encoded output.
+ * \param base64[in]         An empty array. Must be at least as long as
+ *                           `ece_encrypt_base64url_length`. This function
+ *                           does *not* null-terminate `base64`.
+ * \param base64Len[in,out]  The input is the length of the empty `base64`
+ *                           array. On success, the output is set to the
+ *                           number of characters written. On error, the
+ *                           contents of `base64` are unspecified.
+ *
+ * \return                   `ECE_OK` on success, or an error code if
+ *                           encryption fails.
+ */
+int
+ece_encrypt_base64url(ece_encrypt_ctx_t* ctx, const uint8_t* plaintext,
+                      size_t plaintextLen,
+                      ece_base64url_encode_policy_t paddingPolicy,
+                      char* base64, size_t* base64Len);
+
+/*!
+ * Calculates the maximum "aesgcm" plaintext length. The caller should allocate
+ * and pass an array of this length to `ece_webpush_aesgcm_decrypt`.
+ *
+ * \sa                      ece_webpush_aesgcm_decrypt()
+ *
+ * \param rs[in]            The record size. Must be at least
+ *                          `ECE_AESGCM_MIN_RS`.
+ * \param ciphertextLen[in] The ciphertext length.
+ *
+ * \return                  The maximum plaintext length.
+ */
+size_t
+ece_aesgcm_plaintext_max_length(uint32_t rs, size_t ciphertextLen);
+
+/*!
+ * Decrypts a Web Push message encrypted using the "aesgcm" scheme.
+ *
+ * \sa                           ece_aesgcm_plaintext_max_length()
+ *
+ * \param rawRecvPrivKey[in]     The subscription private key.
+ * \param rawRecvPrivKeyLen[in]  The length of the subscription private key.
+ *                               Must be `ECE_WEBPUSH_PRIVATE_KEY_LENGTH`.
+ * \param authSecret[in]         The authentication secret.
+ * \param authSecretLen[in]      The length of the authentication secret. Must
+ *                               be `ECE_WEBPUSH_AUTH_SECRET_LENGTH`.
+ * \param salt[in]
+ * \param salt[in]               The salt, from the `Encryption` header.
+ * \param saltLen[in]            The length of the salt. Must be
+ *                               `ECE_SALT_LENGTH`.
+ * \param rawSenderPubKey[in]    The sender public key, in uncompressed form,
+ *                               from the `Crypto-Key` header.
+ * \param rawSenderPubKeyLen[in] The length of the sender public key. Must be
+ *                               `ECE_WEBPUSH_PUBLIC_KEY_LENGTH`.
+ * \param rs[in]                 The record size. Must be at least
+ *                               `ECE_AESGCM_MIN_RS`.
+ * \param ciphertext[in]         The ciphertext.
+ * \param ciphertextLen[in]      The length of the ciphertext.
+ * \param plaintext[in]          An empty array. Must be large enough to hold
+ *                               the full plaintext.
+ * \param plaintextLen[in,out]   The input is the length of the empty
+ *                               `plaintext` array. On success, the output is
+ *                               set to the actual plaintext length, and
+ *                               `[0..plaintextLen]` contains the plaintext.
+ *
+ * \return                       `ECE_OK` on success, or an error code if the
+ *                               headers or ciphertext are malformed.
+ */
+int
+ece_webpush_aesgcm_decrypt(const uint8_t* rawRecvPrivKey,
+                           size_t rawRecvPrivKeyLen, const uint8_t* authSecret,
+                           size_t authSecretLen, const uint8_t* salt,
+                           size_t saltLen, const uint8_t* rawSenderPubKey,
+                           size_t rawSenderPubKeyLen, uint32_t rs,
+                           const uint8_t* ciphertext, size_t ciphertextLen,
+                           uint8_t* plaintext, size_t* plaintextLen);
+
+/*!
+ * Decrypts a Web Push message encrypted using the "aesgcm" scheme in place.
+ * The plaintext overwrites `ciphertext`, starting at offset 0.
+ *
+ * \sa                           ece_webpush_aesgcm_decrypt()
+ *
+ * \param rawRecvPrivKey[in]     The subscription private key.
+ * \param rawRecvPrivKeyLen[in]  The length of the subscription private key.
+ *                               Must be `ECE_WEBPUSH_PRIVATE_KEY_LENGTH`.
+ * \param authSecret[in]         The authentication secret.
+ * \param authSecretLen[in]      The length of the authentication secret. Must
+ *                               be `ECE_WEBPUSH_AUTH_SECRET_LENGTH`.
+ * \param salt[in]               The salt, from the `Encryption` header.
+ * \param saltLen[in]            The length of the salt. Must be
+ *                               `ECE_SALT_LENGTH`.
+ * \param rawSenderPubKey[in]    The sender public key, in uncompressed form,
+ *                               from the `Crypto-Key` header.
+ * \param rawSenderPubKeyLen[in] The length of the sender public key. Must be
+ *                               `ECE_WEBPUSH_PUBLIC_KEY_LENGTH`.
+ * \param rs[in]                 The record size. Must be at least
+ *                               `ECE_AESGCM_MIN_RS`.
+ * \param ciphertext[in,out]     The ciphertext. On error, the contents are
+ *                               unspecified.
+ * \param ciphertextLen[in]      The length of the ciphertext.
+ * \param plaintextLen[out]      On success, set to the plaintext length, and
+ *                               `ciphertext[0..plaintextLen]` contains the
+ *                               plaintext.
+ *
+ * \return                       `ECE_OK` on success, or an error code if the
+ *                               headers or ciphertext are malformed.
+ */
+int
+ece_webpush_aesgcm_decrypt_in_place(
+  const uint8_t* rawRecvPrivKey, size_t rawRecvPrivKeyLen,
+  const uint8_t* authSecret, size_t authSecretLen, const uint8_t* salt,
+  size_t saltLen, const uint8_t* rawSenderPubKey, size_t rawSenderPubKeyLen,
+  uint32_t rs, uint8_t* ciphertext, size_t ciphertextLen,
+  size_t* plaintextLen);
+
+/*!
+ * Decrypts a Web Push message encrypted using the "aesgcm" scheme, reading the
+ * ciphertext from a list of segments and writing the plaintext to another.
+ * This is the scatter-gather equivalent of `ece_webpush_aesgcm_decrypt`. The
+ * total length of the plaintext segments must be at least
+ * `ece_aesgcm_plaintext_max_length`.
+ *
+ * \sa                          ece_aes128gcm_decrypt_iov()
+ */
+int
+ece_webpush_aesgcm_decrypt_iov(
+  const uint8_t* rawRecvPrivKey, size_t rawRecvPrivKeyLen,
+  const uint8_t* authSecret, size_t authSecretLen, const uint8_t* salt,
+  size_t saltLen, const uint8_t* rawSenderPubKey, size_t rawSenderPubKeyLen,
+  uint32_t rs, const ece_iovec_t* ciphertext, size_t ciphertextCount,
+  const ece_iovec_t* plaintext, size_t plaintextCount, size_t* plaintextLen);
+
+/*!
+ * An opaque subscription key context. The context holds the imported
+ * subscription key pair and auth secret, so that decrypting a message doesn't
+ * need to inflate the raw private key again. A subscription is immutable once
+ * created, and can be shared between threads.
+ */
+typedef struct ece_subscription_s ece_subscription_t;
+
+/*!
+ * Creates a subscription key context from the raw subscription private key and
+ * auth secret.
+ *
+ * \sa                          ece_subscription_destroy()
+ *
+ * \param rawRecvPrivKey[in]    The subscription private key.
+ * \param rawRecvPrivKeyLen[in] The length of the subscription private key. Must
+ *                              be `ECE_WEBPUSH_PRIVATE_KEY_LENGTH`.
+ * \param authSecret[in]        The authentication secret.
+ * \param authSecretLen[in]     The length of the authentication secret. Must be
+ *                              `ECE_WEBPUSH_AUTH_SECRET_LENGTH`.
+ * \param sub[out]              On success, set to the new context. The caller
+ *                              must free it with `ece_subscription_destroy`.
+ *
+ * \return                      `ECE_OK` on success, or an error code if the
+ *                              private key or auth secret is invalid.
+ */
+int
+ece_subscription_create(const uint8_t* rawRecvPrivKey, size_t rawRecvPrivKeyLen,
+                        const uint8_t* authSecret, size_t authSecretLen,
+                        ece_subscription_t** sub);
+
+/*!
+ * Frees a subscription key context. `sub` may be `NULL`.
+ */
+void
+ece_subscription_destroy(ece_subscription_t* sub);
+
+/*!
+ * Decrypts a Web Push message encrypted using the "aes128gcm" scheme, with a
+ * subscription key context. This is equivalent to
+ * `ece_webpush_aes128gcm_decrypt`.
+ *
+ * \sa                          ece_aes128gcm_plaintext_max_length()
+ *
+ * \param sub[in]               The subscription key context.
+ * \param payload[in]           The encrypted payload.
+ * \param payloadLen[in]        The length of the encrypted payload.
+ * \param plaintext[in]         An empty array. Must be large enough to hold the
+ *                              full plaintext.
+ * \param plaintextLen[in,out]  The input is the length of the empty `plaintext`
+ *                              array. On success, the output is set to the
+ *                              actual plaintext length, and
+ *                              `plaintext[0..plaintextLen]` contains the
+ *                              plaintext.
+ *
+ * \return                      `ECE_OK` on success, or an error code if
+ *                              the payload is empty or malformed.
+ */
+int
+ece_subscription_aes128gcm_decrypt(const ece_subscription_t* sub,
+                                   const uint8_t* payload, size_t payloadLen,
+                                   uint8_t* plaintext, size_t* plaintextLen);
+
+/*!
+ * Decrypts a Web Push message encrypted using the "aesgcm" scheme, with a
+ * subscription key context. This is equivalent to
+ * `ece_webpush_aesgcm_decrypt`.
+ *
+ * \sa                           ece_aesgcm_plaintext_max_length()
+ *
+ * \param sub[in]                The subscription key context.
+ * \param salt[in]               The salt, from the `Encryption` header.
+ * \param saltLen[in]            The length of the salt.
+ * \param rawSenderPubKey[in]    The sender public key, in uncompressed form,
+ *                               from the `Crypto-Key` header.
+ * \param rawSenderPubKeyLen[in] The length of the sender public key.
+ * \param rs[in]                 The record size, from the `Encryption` header.
+ * \param ciphertext[in]         The encrypted message.
+ * \param ciphertextLen[in]      The length of the encrypted message.
+ * \param plaintext[in]          An empty array. Must be large enough to hold
+ *                               the full plaintext.
+ * \param plaintextLen[in,out]   The input is the length of the empty
+ *                               `plaintext` array. On success, the output is
+ *                               set to the actual plaintext length, and
+ *                               `plaintext[0..plaintextLen]` contains the
+ *                               plaintext.
+ *
+ * \return                       `ECE_OK` on success, or an error code if the
+ *                               ciphertext is empty or malformed.
+ */
+int
+ece_subscription_aesgcm_decrypt(const ece_subscription_t* sub,
+                                const uint8_t* salt, size_t saltLen,
+                                const uint8_t* rawSenderPubKey,
+                                size_t rawSenderPubKeyLen, uint32_t rs,
+                                const uint8_t* ciphertext, size_t ciphertextLen,
+                                uint8_t* plaintext, size_t* plaintextLen);
+
+/*!
+ * Decrypts an "aes128gcm" message for a subscription, splitting the records
+ * between the workers in `pool`. The result is the same as
+ * `ece_subscription_aes128gcm_decrypt`; if several records fail, the error is
+ * the one for the first failing record.
+ *
+ * Each worker decrypts its records in place before the plaintext is
+ * compacted, so the records are only decrypted in parallel if `plaintext` has
+ * room for `ece_aes128gcm_plaintext_max_length` bytes. Otherwise, or if `pool`
+ * is `NULL`, they're decrypted on the calling thread.
+ */
+int
+ece_subscription_aes128gcm_decrypt_parallel(const ece_subscription_t* sub,
+                                            ece_pool_t* pool,
+                                            const uint8_t* payload,
+                                            size_t payloadLen,
+                                            uint8_t* plaintext,
+                                            size_t* plaintextLen);
+
+/*!
+ * Decrypts an "aesgcm" message for a subscription, splitting the records
+ * between the workers in `pool`. This is the "aesgcm" equivalent of
+ * `ece_subscription_aes128gcm_decrypt_parallel`, and needs room for
+ * `ece_aesgcm_plaintext_max_length` bytes to decrypt in parallel.
+ */
+int
+ece_subscription_aesgcm_decrypt_parallel(
+  const ece_subscription_t* sub, ece_pool_t* pool, const uint8_t* salt,
+  size_t saltLen, const uint8_t* rawSenderPubKey, size_t rawSenderPubKeyLen,
+  uint32_t rs, const uint8_t* ciphertext, size_t ciphertextLen,
+  uint8_t* plaintext, size_t* plaintextLen);
+
+/*!
+ * Decrypts an "aes128gcm" message for a subscription in place. This is
+ * equivalent to `ece_webpush_aes128gcm_decrypt_in_place`.
+ */
+int
+ece_subscription_aes128gcm_decrypt_in_place(const ece_subscription_t* sub,
+                                            uint8_t* payload,
+                                            size_t payloadLen,
+                                            size_t* plaintextOffset,
+                                            size_t* plaintextLen);
+
+/*!
+ * Decrypts an "aesgcm" message for a subscription in place. This is
+ * equivalent to `ece_webpush_aesgcm_decrypt_in_place`.
+ */
+int
+ece_subscription_aesgcm_decrypt_in_place(
+  const ece_subscription_t* sub, const uint8_t* salt, size_t saltLen,
+  const uint8_t* rawSenderPubKey, size_t rawSenderPubKeyLen, uint32_t rs,
+  uint8_t* ciphertext, size_t ciphertextLen, size_t* plaintextLen);
+
+/*!
+ * An opaque recipient context, used by app servers to encrypt messages to a
+ * subscription. The context holds the validated subscription public key and
+ * auth secret, so that repeated sends don't need to decode and check the raw
+ * public key again.
+ */
+typedef struct ece_recipient_s ece_recipient_t;
+
+/*!
+ * Creates a recipient context from the raw subscription public key and auth
+ * secret.
+ *
+ * \sa                         ece_recipient_destroy()
+ *
+ * \param rawRecvPubKey[in]    The subscription public key, in uncompressed
+ *                             form.
+ * \param rawRecvPubKeyLen[in] The length of the subscription public key. Must
+ *                             be `ECE_WEBPUSH_PUBLIC_KEY_LENGTH`.
+ * \param authSecret[in]       The authentication secret.
+ * \param authSecretLen[in]    The length of the authentication secret. Must be
+ *                             `ECE_WEBPUSH_AUTH_SECRET_LENGTH`.
+ * \param recipient[out]       On success, set to the new context. The caller
+ *                             must release it with `ece_recipient_destroy`.
+ *
+ * \return                     `ECE_OK` on success, or an error code if the
+ *                             public key or auth secret is invalid.
+ */
+int
+ece_recipient_create(const uint8_t* rawRecvPubKey, size_t rawRecvPubKeyLen,
+                     const uint8_t* authSecret, size_t authSecretLen,
+                     ece_recipient_t** recipient);
+
+/*!
+ * Releases a recipient context returned from `ece_recipient_create` or
+ * `ece_recipient_cache_get`. `recipient` may be `NULL`. A cached recipient
+ * stays alive until it's released by the caller and evicted from the cache.
+ * Handles are reference-counted atomically, so a thread may release its
+ * handle without holding the lock that guards the cache, even while another
+ * thread evicts the same recipient.
+ */
+void
+ece_recipient_destroy(ece_recipient_t* recipient);
+
+/*!
+ * Encrypts a Web Push message to a recipient using the "aes128gcm" scheme. This
+ * is equivalent to `ece_webpush_aes128gcm_encrypt`, and generates an ephemeral
+ * sender key pair and a random salt for each message.
+ *
+ * \sa                       ece_aes128gcm_payload_max_length()
+ *
+ * \param recipient[in]      The recipient context.
+ * \param rs[in]             The record size. Must be at least
+ *                           `ECE_AES128GCM_MIN_RS`.
+ * \param padLen[in]         The length of additional padding to include in the
+ *                           ciphertext, if any.
+ * \param plaintext[in]      The plaintext to encrypt.
+ * \param plaintextLen[in]   The length of the plaintext.
+ * \param payload[in]        An empty array. Must be large enough to hold the
+ *                           full payload.
+ * \param payloadLen[in,out] The input is the length of the empty `payload`
+ *                           array. On success, the output is set to the actual
+ *                           payload length.
+ *
+ * \return                   `ECE_OK` on success, or an error code if
+ *                           encryption fails.
+ */
+int
+ece_recipient_aes128gcm_encrypt(const ece_recipient_t* recipient, uint32_t rs,
+                                size_t padLen, const uint8_t* plaintext,
+                                size_t plaintextLen, uint8_t* payload,
+                                size_t* payloadLen);
+
+/*!
+ * Encrypts a Web Push message to a recipient using the "aesgcm" scheme. This is
+ * equivalent to `ece_webpush_aesgcm_encrypt`.
+ *
+ * \sa                           ece_aesgcm_ciphertext_max_length()
+ *
+ * \param recipient[in]          The recipient context.
+ * \param rs[in]                 The record size. Must be at least
+ *                               `ECE_AESGCM_MIN_RS`.
+ * \param padLen[in]             The length of additional padding to include in
+ *                               the ciphertext, if any.
+ * \param plaintext[in]          The plaintext to encrypt.
+ * \param plaintextLen[in]       The length of the plaintext.
+ * \param salt[in]               An empty array to hold the salt.
+ * \param saltLen[in]            The length of the empty `salt` array. Must be
+ *                               `ECE_SALT_LENGTH`.
+ * \param rawSenderPubKey[in]    An empty array to hold the sender public key.
+ * \param rawSenderPubKeyLen[in] The length of the empty `rawSenderPubKey`
+ *                               array. Must be `ECE_WEBPUSH_PUBLIC_KEY_LENGTH`.
+ * \param ciphertext[in]         An empty array to hold the ciphertext.
+ * \param ciphertextLen[in,out]  The input is the length of the empty
+ *                               `ciphertext` array. On success, the output is
+ *                               set to the actual ciphertext length.
+ *
+ * \return                       `ECE_OK` on success, or an error code if
+ *                               encryption fails.
+ */
+int
+ece_recipient_aesgcm_encrypt(const ece_recipient_t* recipient, uint32_t rs,
+                             size_t padLen, const uint8_t* plaintext,
+                             size_t plaintextLen, uint8_t* salt,
+                             size_t saltLen, uint8_t* rawSenderPubKey,
+                             size_t rawSenderPubKeyLen, uint8_t* ciphertext,
+                             size_t* ciphertextLen);
+
+/*!
+ * A bounded least-recently-used cache of recipient contexts, keyed by the raw
+ * subscription public key. The cache isn't thread-safe; callers that share a
+ * cache between threads must synchronize access to it. The recipients that it
+ * returns may be used and released without that synchronization.
+ */
+typedef struct ece_recipient_cache_s ece_recipient_cache_t;
+
+/*!
+ * Creates a recipient cache that holds up to `capacity` recipients.
+ *
+ * \return The cache, or `NULL` if `capacity` is 0 or allocation fails.
+ */
+ece_recipient_cache_t*
+ece_recipient_cache_new(size_t capacity);
+
+/*!
+ * Frees a recipient cache, and releases its references to the cached
+ * recipients. `cache` may be `NULL`.
+ */
+void
+ece_recipient_cache_free(ece_recipient_cache_t* cache);
+
+/*!
+ * Looks up the recipient for a subscription public key, creating and caching
+ * it on a miss. If the cached recipient has a different auth secret, it's
+ * replaced. When the cache is full, the least recently used recipient is
+ * evicted.
+ *
+ * \param cache[in]            The recipient cache.
+ * \param rawRecvPubKey[in]    The subscription public key, in uncompressed
+ *                             form.
+ * \param rawRecvPubKeyLen[in] The length of the subscription public key.
+ * \param authSecret[in]       The authentication secret.
+ * \param authSecretLen[in]    The length of the authentication secret.
+ * \param recipient[out]       On success, set to the recipient. The caller
+ *                             must release it with `ece_recipient_destroy`.
+ *
+ * \return                     `ECE_OK` on success, or an error code if the
+ *                             public key or auth secret is invalid.
+ */
+int
+ece_recipient_cache_get(ece_recipient_cache_t* cache,
+                        const uint8_t* rawRecvPubKey, size_t rawRecvPubKeyLen,
+                        const uint8_t* authSecret, size_t authSecretLen,
+                        ece_recipient_t** recipient);
+
+/*!
+ * Returns the number of lookups that found a cached recipient, and the number
+ * that had to create one.
+ */
+void
+ece_recipient_cache_stats(const ece_recipient_cache_t* cache, uint64_t* hits,
+                          uint64_t* misses);
+
+/*!
+ * The sender key pairs used when encrypting one message to many subscribers.
+ */
+typedef enum ece_sender_key_policy_e {
+  /*! Generates an ephemeral sender key pair for each subscriber. */
+  ECE_SENDER_KEY_PER_RECIPIENT,
+
+  /*!
+   * Generates one ephemeral sender key pair, and uses it for all subscribers
+   * in the call. Each payload still has its own random salt, so each
+   * subscriber gets a different content encryption key and nonce. RFC 8291,
+   * section 3.1 permits this, though it lets the push service link the
+   * messages.
+   */
+  ECE_SENDER_KEY_PER_CALL,
+} ece_sender_key_policy_t;
+
+/*!
+ * Encrypts the same plaintext to many Web Push subscribers using the
+ * "aes128gcm" scheme. Each payload is equivalent to one from
+ * `ece_webpush_aes128gcm_encrypt`, with its own random salt. The subscribers
+ * are split between the workers in `pool`, and each worker reuses one
+ * encryption context for its subscribers. Each subscriber is encrypted
+ * independently; a failure doesn't stop the rest.
+ *
+ * \sa                          ece_webpush_aes128gcm_encrypt(),
+ *                              ece_aes128gcm_payload_max_length()
+ *
+ * \param pool[in]              The worker pool, or `NULL` to encrypt on the
+ *                              calling thread.
+ * \param senderKeyPolicy[in]   Whether to generate a sender key pair for each
+ *                              subscriber, or one for the whole call.
+ * \param rs[in]                The record size. Must be at least
+ *                              `ECE_AES128GCM_MIN_RS`.
+ * \param padLen[in]            The length of additional padding to include in
+ *                              each payload, if any.
+ * \param plaintext[in]         The plaintext to encrypt.
+ * \param plaintextLen[in]      The length of the plaintext.
+ * \param count[in]             The number of subscribers.
+ * \param rawRecvPubKeys[in]    An array of `count` subscription public keys,
+ *                              each `ECE_WEBPUSH_PUBLIC_KEY_LENGTH` bytes, in
+ *                              uncompressed form.
+ * \param authSecrets[in]       An array of `count` authentication secrets,
+ *                              each `ECE_WEBPUSH_AUTH_SECRET_LENGTH` bytes.
+ * \param payloads[in]          An array of `count` empty arrays. Each must be
+ *                              large enough to hold the full payload.
+ * \param payloadLens[in,out]   The input values are the lengths of the empty
+ *                              `payloads` arrays. On success, each output is
+ *                              set to the actual payload length.
+ * \param errs[out]             An array of `count` status codes. Each is set
+ *                              to `ECE_OK` if the payload was encrypted, or
+ *                              the error that `ece_webpush_aes128gcm_encrypt`
+ *                              would return for it.
+ *
+ * \return                      `ECE_OK` if every payload was encrypted, or the
+ *                              error for the first subscriber that failed.
+ */
+int
+ece_webpush_aes128gcm_encrypt_fanout(
+  ece_pool_t* pool, ece_sender_key_policy_t senderKeyPolicy, uint32_t rs,
+  size_t padLen, const uint8_t* plaintext, size_t plaintextLen, size_t count,
+  const uint8_t* const* rawRecvPubKeys, const uint8_t* const* authSecrets,
+  uint8_t* const* payloads, size_t* payloadLens, int* errs);
+
+/*!
+ * Calculates the exact length of a Web Push request built with
+ * `ece_webpush_aes128gcm_encrypt_request`.
+ *
+ * \param rs[in]           The record size.
+ * \param padLen[in]       The length of additional padding.
+ * \param plaintextLen[in] The length of the plaintext.
+ * \param ttl[in]          The message lifetime, in seconds.
+ *
+ * \return                 The request length, or 0 if `plaintextLen` is 0, the
+ *                         record size is invalid, or the padding can't be
+ *                         spread over the records.
+ */
+size_t
+ece_webpush_aes128gcm_request_length(uint32_t rs, size_t padLen,
+                                     size_t plaintextLen, uint32_t ttl);
+
+/*!
+ * Encrypts a Web Push message using the "aes128gcm" scheme, and writes the
+ * HTTP/1.1 header fields and body of the push request into one buffer. The
+ * header block is:
+ *
+ *     Content-Encoding: aes128gcm\r\n
+ *     TTL: <ttl>\r\n
+ *     Content-Length: <payload length>\r\n
+ *     \r\n
+ *
+ * followed by the encrypted payload. The caller writes the request line, and
+ * any other header fields like `Authorization` or `Urgency`, before this
+ * buffer; for example, as the first element of a `writev` call.
+ *
+ * The context is initialized with a new sender key and salt, so one context
+ * can be reused to build many requests without allocating.
+ *
+ * \sa                          ece_webpush_aes128gcm_request_length()
+ *
+ * \param ctx[in]               The encryption context.
+ * \param rawRecvPubKey[in]     The subscription public key, in uncompressed
+ *                              form.
+ * \param rawRecvPubKeyLen[in]  The length of the subscription public key. Must
+ *                              be `ECE_WEBPUSH_PUBLIC_KEY_LENGTH`.
+ * \param authSecret[in]        The authentication secret.
+ * \param authSecretLen[in]     The length of the authentication secret. Must
+ *                              be `ECE_WEBPUSH_AUTH_SECRET_LENGTH`.
+ * \param rs[in]                The record size. Must be at least
+ *                              `ECE_AES128GCM_MIN_RS`.
+ * \param padLen[in]            The length of additional padding, if any.
+ * \param ttl[in]               The message lifetime, in seconds.
+ * \param plaintext[in]         The plaintext.
+ * \param plaintextLen[in]      The length of the plaintext.
+ * \param request[in]           An empty array. Must be large enough to hold the
+ *                              whole request; use
+ *                              `ece_webpush_aes128gcm_request_length` to find
+ *                              the exact length.
+ * \param requestLen[in,out]    The input is the length of the empty `request`
+ *                              array. On success, the output is set to the
+ *                              number of bytes written.
+ *
+ * \return                      `ECE_OK` on success, or an error code if
+ *                              encryption fails. Returns
+ *                              `ECE_ERROR_OUT_OF_MEMORY` if `request` is too
+ *                              short.
+ */
+int
+ece_webpush_aes128gcm_encrypt_request(
+  ece_encrypt_ctx_t* ctx, const uint8_t* rawRecvPubKey, size_t rawRecvPubKeyLen,
+  const uint8_t* authSecret, size_t authSecretLen, uint32_t rs, size_t padLen,
+  uint32_t ttl, const uint8_t* plaintext, size_t plaintextLen,
+  uint8_t* request, size_t* requestLen);
+
+/*!
+ * Calculates the exact length of a Web Push request built with
+ * `ece_webpush_aesgcm_encrypt_request`.
+ *
+ * \param rs[in]           The record size.
+ * \param padLen[in]       The length of additional padding.
+ * \param plaintextLen[in] The length of the plaintext.
+ * \param ttl[in]          The message lifetime, in seconds.
+ *
+ * \return                 The request length, or 0 if `plaintextLen` is 0, the
+ *                         record size is invalid, or the padding can't be
+ *                         spread over the records.
+ */
+size_t
+ece_webpush_aesgcm_request_length(uint32_t rs, size_t padLen,
+                                  size_t plaintextLen, uint32_t ttl);
+
+/*!
+ * Encrypts a Web Push message using the "aesgcm" scheme, and writes the
+ * HTTP/1.1 header fields and body of the push request into one buffer. This
+ * is like `ece_webpush_aes128gcm_encrypt_request`, but the header block also
+ * carries the sender public key and salt:
+ *
+ *     Content-Encoding: aesgcm\r\n
+ *     Crypto-Key: dh=<sender public key>\r\n
+ *     Encryption: rs=<rs>;salt=<salt>\r\n
+ *     TTL: <ttl>\r\n
+ *     Content-Length: <ciphertext length>\r\n
+ *     \r\n
+ *
+ * Senders that must add other parameters to `Crypto-Key`, like a VAPID
+ * `p256ecdsa` key, should use `ece_webpush_aesgcm_encrypt_init` and
+ * `ece_webpush_aesgcm_headers_from_params` instead.
+ *
+ * \sa                          ece_webpush_aesgcm_request_length()
+ *
+ * \param ctx[in]               The encryption context.
+ * \param rawRecvPubKey[in]     The subscription public key, in uncompressed
+ *                              form.
+ * \param rawRecvPubKeyLen[in]  The length of the subscription public key. Must
+ *                              be `ECE_WEBPUSH_PUBLIC_KEY_LENGTH`.
+ * \param authSecret[in]        The authentication secret.
+ * \param authSecretLen[in]     The length of the authentication secret. Must
+ *                              be `ECE_WEBPUSH_AUTH_SECRET_LENGTH`.
+ * \param rs[in]                The record size. Must be at least
+ *                              `ECE_AESGCM_MIN_RS`.
+ * \param padLen[in]            The length of additional padding, if any.
+ * \param ttl[in]               The message lifetime, in seconds.
+ * \param plaintext[in]         The plaintext.
+ * \param plaintextLen[in]      The length of the plaintext.
+ * \param request[in]           An empty array. Must be large enough to hold the
+ *                              whole request; use
+ *                              `ece_webpush_aesgcm_request_length` to find the
+ *                              exact length.
+ * \param requestLen[in,out]    The input is the length of the empty `request`
+ *                              array. On success, the output is set to the
+ *                              number of bytes written.
+ *
+ * \return                      `ECE_OK` on success, or an error code if
+ *                              encryption fails. Returns
+ *                              `ECE_ERROR_OUT_OF_MEMORY` if `request` is too
+ *                              short.
+ */
+int
+ece_webpush_aesgcm_encrypt_request(
+  ece_encrypt_ctx_t* ctx, const uint8_t* rawRecvPubKey, size_t rawRecvPubKeyLen,
+  const uint8_t* authSecret, size_t authSecretLen, uint32_t rs, size_t padLen,
+  uint32_t ttl, const uint8_t* plaintext, size_t plaintextLen,
+  uint8_t* request, size_t* requestLen);
+
+/*!
+ * Extracts "aes128gcm" decryption parameters from an encrypted payload.
+ * `salt`, `keyId`, and `ciphertext` are pointers into `payload`, and must not
+ * outlive it.
+ *
+ * \sa                       ece_aes128gcm_decrypt()
+ *
+ * \param payload[in]        The encrypted payload.
+ * \param payloadLen[in]     The length of the encrypted payload.
+ * \param salt[out]          The encryption salt.
+ * \param saltLen[out]       The length of the salt.
+ * \param keyId[out]         An identifier for the keying material.
+ * \param keyIdLen[out]      The length of the key ID.
+ * \param rs[out]            The record size.
  * \param ciphertext[out]    The ciphertext.
  * \param ciphertextLen[out] The length of the ciphertext.
  *
@@ -516,6 +1909,48 @@ ece_webpush_aesgcm_headers_extract_params(const char* cryptoKeyHeader,
                                           size_t rawSenderPubKeyLen,
                                           uint32_t* rs);
 
+/*!
+ * Extracts "aesgcm" decryption parameters from slices of the `Crypto-Key` and
+ * `Encryption` headers. The headers are passed with explicit lengths, and
+ * don't need to be null-terminated, so they can point straight into an HTTP
+ * parser's buffer. This function doesn't allocate, reads each header once,
+ * and decodes the salt and public key directly into the output arrays.
+ *
+ * The headers are parsed and checked exactly like
+ * `ece_webpush_aesgcm_headers_extract_params`. A null byte inside a slice is
+ * a syntax error, rather than the end of the header.
+ *
+ * \sa                            ece_webpush_aesgcm_headers_extract_params()
+ *
+ * \param cryptoKeyHeader[in]     The value of the `Crypto-Key` HTTP header.
+ * \param cryptoKeyHeaderLen[in]  The length of the `Crypto-Key` header.
+ * \param encryptionHeader[in]    The value of the `Encryption` HTTP header.
+ * \param encryptionHeaderLen[in] The length of the `Encryption` header.
+ * \param salt[in]                An empty array to hold the encryption salt,
+ *                                extracted from the `Encryption` header.
+ * \param saltLen[in]             The length of the empty `salt` array. Must be
+ *                                `ECE_SALT_LENGTH`.
+ * \param rawSenderPubKey[in]     An empty array to hold the sender public key,
+ *                                in uncompressed form, extracted from the
+ *                                `Crypto-Key` header.
+ * \param rawSenderPubKeyLen[in]  The length of the empty `rawSenderPubKey`
+ *                                array. Must be
+ *                                `ECE_WEBPUSH_PUBLIC_KEY_LENGTH`.
+ * \param rs[out]                 The record size. Values too small for a
+ *                                record, or too large to hold the
+ *                                authentication tag, are rejected with
+ *                                `ECE_ERROR_INVALID_RS`.
+ *
+ * \return                        `ECE_OK` on success, or an error code if the
+ *                                headers are malformed.
+ */
+int
+ece_webpush_aesgcm_headers_extract_params_slices(
+  const char* cryptoKeyHeader, size_t cryptoKeyHeaderLen,
+  const char* encryptionHeader, size_t encryptionHeaderLen, uint8_t* salt,
+  size_t saltLen, uint8_t* rawSenderPubKey, size_t rawSenderPubKeyLen,
+  uint32_t* rs);
+
 /*!
  * Builds the `Crypto-Key` and `Encryption` headers from the "aesgcm"
  * encryption parameters.
@@ -619,6 +2054,453 @@ ece_base64url_decode(const char* base64, size_t base64Len,
                      ece_base64url_decode_policy_t paddingPolicy,
                      uint8_t* binary, size_t binaryLen);
 
+/*!
+ * An incremental Base64url encoder. The encoder accepts the input in
+ * arbitrary-sized fragments, and carries up to 2 bytes of an incomplete group
+ * between calls. The fields are private; the struct is public so that callers
+ * can declare encoders on the stack.
+ */
+typedef struct ece_base64url_encoder_s {
+  ece_base64url_encode_policy_t paddingPolicy;
+  uint8_t pending[2];
+  size_t pendingLen;
+} ece_base64url_encoder_t;
+
+/*!
+ * Initializes or resets an incremental encoder.
+ *
+ * \param encoder[in]       The encoder.
+ * \param paddingPolicy[in] The policy for padding the encoded output.
+ */
+void
+ece_base64url_encoder_init(ece_base64url_encoder_t* encoder,
+                           ece_base64url_encode_policy_t paddingPolicy);
+
+/*!
+ * Returns the maximum number of characters that
+ * `ece_base64url_encode_update` can write for `binaryLen` more bytes of
+ * input. `ece_base64url_encode_final` writes at most 4 more characters.
+ */
+size_t
+ece_base64url_encode_update_max_length(const ece_base64url_encoder_t* encoder,
+                                       size_t binaryLen);
+
+/*!
+ * Encodes the next fragment of the input.
+ *
+ * \param encoder[in]       The encoder.
+ * \param binary[in]        The next fragment. May be `NULL` if `binaryLen` is
+ *                          0.
+ * \param binaryLen[in]     The length of the fragment.
+ * \param base64[in]        An array to hold the encoded characters. This
+ *                          function does *not* null-terminate `base64`.
+ * \param base64Len[in,out] The length of the `base64` array. On success, set
+ *                          to the number of characters written.
+ *
+ * \return                  `ECE_OK` on success, or `ECE_ERROR_OUT_OF_MEMORY`
+ *                          if `base64` is too short. The encoder is unchanged
+ *                          on failure.
+ */
+int
+ece_base64url_encode_update(ece_base64url_encoder_t* encoder,
+                            const void* binary, size_t binaryLen, char* base64,
+                            size_t* base64Len);
+
+/*!
+ * Encodes the last incomplete group, and appends padding if the encoder's
+ * policy includes it. The encoder must be reinitialized before reuse.
+ *
+ * \param encoder[in]       The encoder.
+ * \param base64[in]        An array to hold the encoded characters.
+ * \param base64Len[in,out] The length of the `base64` array. On success, set
+ *                          to the number of characters written, at most 4.
+ *
+ * \return                  `ECE_OK` on success, or `ECE_ERROR_OUT_OF_MEMORY`
+ *                          if `base64` is too short.
+ */
+int
+ece_base64url_encode_final(ece_base64url_encoder_t* encoder, char* base64,
+                           size_t* base64Len);
+
+/*!
+ * An incremental Base64url decoder. The decoder accepts the input in
+ * arbitrary-sized fragments, including fragments that split a 4-character
+ * quantum, and carries up to 3 characters of an incomplete quantum between
+ * calls. Padding is checked against the policy when the decoder is finalized,
+ * so the decoder accepts exactly the same inputs as `ece_base64url_decode`.
+ * The fields are private.
+ */
+typedef struct ece_base64url_decoder_s {
+  ece_base64url_decode_policy_t paddingPolicy;
+  char pending[4];
+  size_t pendingLen;
+  size_t dataLen;
+  size_t padLen;
+  int err;
+} ece_base64url_decoder_t;
+
+/*!
+ * Initializes or resets an incremental decoder.
+ *
+ * \param decoder[in]       The decoder.
+ * \param paddingPolicy[in] The policy for handling "=" padding in the encoded
+ *                          input.
+ */
+void
+ece_base64url_decoder_init(ece_base64url_decoder_t* decoder,
+                           ece_base64url_decode_policy_t paddingPolicy);
+
+/*!
+ * Returns the maximum number of bytes that `ece_base64url_decode_update` can
+ * write for `base64Len` more characters of input.
+ * `ece_base64url_decode_final` writes at most 2 more bytes.
+ */
+size_t
+ece_base64url_decode_update_max_length(const ece_base64url_decoder_t* decoder,
+                                       size_t base64Len);
+
+/*!
+ * Decodes the next fragment of the input. Once decoding fails, all later calls
+ * fail with the same error.
+ *
+ * \param decoder[in]       The decoder.
+ * \param base64[in]        The next fragment. May be `NULL` if `base64Len` is
+ *                          0.
+ * \param base64Len[in]     The length of the fragment.
+ * \param binary[in]        An array to hold the decoded bytes.
+ * \param binaryLen[in,out] The length of the `binary` array. On success, set
+ *                          to the number of bytes written.
+ *
+ * \return                  `ECE_OK` on success; `ECE_ERROR_OUT_OF_MEMORY` if
+ *                          `binary` is too short, in which case the decoder is
+ *                          unchanged; or `ECE_ERROR_INVALID_BASE64URL` if the
+ *                          fragment contains a character outside the
+ *                          alphabet, or data after padding.
+ */
+int
+ece_base64url_decode_update(ece_base64url_decoder_t* decoder,
+                            const char* base64, size_t base64Len,
+                            uint8_t* binary, size_t* binaryLen);
+
+/*!
+ * Decodes the last incomplete quantum, and checks the padding and length of
+ * the full input against the decoder's policy. The decoder must be
+ * reinitialized before reuse.
+ *
+ * \param decoder[in]       The decoder.
+ * \param binary[in]        An array to hold the decoded bytes.
+ * \param binaryLen[in,out] The length of the `binary` array. On success, set
+ *                          to the number of bytes written, at most 2.
+ *
+ * \return                  `ECE_OK` on success; `ECE_ERROR_OUT_OF_MEMORY` if
+ *                          `binary` is too short; or
+ *                          `ECE_ERROR_INVALID_BASE64URL` if the input is
+ *                          truncated, or its padding doesn't match the policy.
+ */
+int
+ece_base64url_decode_final(ece_base64url_decoder_t* decoder, uint8_t* binary,
+                           size_t* binaryLen);
+
+/*!
+ * Memory allocation callbacks. Each callback receives `opaque` as its first
+ * argument. `realloc` is called with a `NULL` pointer to allocate, and `free`
+ * is never called with a `NULL` pointer.
+ */
+typedef struct ece_allocator_s {
+  void* (*alloc)(void* opaque, size_t size);
+  void* (*realloc)(void* opaque, void* ptr, size_t size);
+  void (*free)(void* opaque, void* ptr);
+  void* opaque;
+} ece_allocator_t;
+
+/*!
+ * Sets the allocator for all memory that this library allocates, including
+ * contexts, caches, pools, and record buffers. Memory must be freed with the
+ * same allocator that allocated it, so this should be called before creating
+ * any objects, or after all objects are freed.
+ *
+ * If the library is built with `ECE_NO_HEAP`, the default allocator always
+ * fails, and functions that need memory return `ECE_ERROR_OUT_OF_MEMORY`
+ * until an allocator is set.
+ *
+ * \sa                  ece_set_thread_allocator(), ece_arena_allocator()
+ *
+ * \param allocator[in] The allocator, which is copied. If `NULL`, restores the
+ *                      default allocator.
+ */
+void
+ece_set_allocator(const ece_allocator_t* allocator);
+
+/*!
+ * Overrides the allocator for the calling thread. This is useful for giving
+ * each thread its own arena. Objects allocated with a thread's allocator must
+ * be freed on the same thread, with the same allocator still set.
+ *
+ * \param allocator[in] The allocator, which is copied. If `NULL`, the thread
+ *                      uses the allocator from `ece_set_allocator()`.
+ */
+void
+ece_set_thread_allocator(const ece_allocator_t* allocator);
+
+/*!
+ * Routes OpenSSL's own allocations, like cipher contexts and EC keys, through
+ * `allocator`. OpenSSL only allows this before its first allocation, and
+ * shares its allocator across all threads, so this must be called at startup,
+ * before any other OpenSSL or library function. `allocator` must outlive all
+ * OpenSSL objects.
+ *
+ * \param allocator[in] The allocator, which is copied. Unlike
+ *                      `ece_set_allocator()`, this can't be `NULL`: OpenSSL's
+ *                      allocator can only be set once, so there's no default
+ *                      to restore.
+ *
+ * \return              `ECE_OK` on success, or `ECE_ERROR_ALLOCATOR` if
+ *                      `allocator` is `NULL` or OpenSSL has already allocated
+ *                      memory.
+ */
+int
+ece_set_openssl_allocator(const ece_allocator_t* allocator);
+
+/*!
+ * A bump allocator over caller-provided scratch memory. Freeing the most
+ * recent allocation returns its space to the arena; other frees are no-ops
+ * until the arena is reset.
+ */
+typedef struct ece_arena_s {
+  uint8_t* buffer;
+  size_t len;
+  size_t used;
+  /*! The largest `used` value since the arena was initialized. */
+  size_t peak;
+} ece_arena_t;
+
+/*!
+ * Initializes an arena over `buffer`.
+ *
+ * \param arena[in]  The arena to initialize.
+ * \param buffer[in] The scratch memory. The arena aligns allocations itself,
+ *                   so `buffer` doesn't need any particular alignment.
+ * \param len[in]    The length of `buffer`.
+ */
+void
+ece_arena_init(ece_arena_t* arena, void* buffer, size_t len);
+
+/*!
+ * Frees all allocations from `arena`, keeping the peak usage.
+ */
+void
+ece_arena_reset(ece_arena_t* arena);
+
+/*!
+ * Returns an allocator that allocates from `arena`. The arena isn't
+ * synchronized, so it should only be used by one thread at a time.
+ *
+ * \param arena[in]      The arena.
+ * \param allocator[out] The allocator.
+ */
+void
+ece_arena_allocator(ece_arena_t* arena, ece_allocator_t* allocator);
+
+/*!
+ * Returns the scratch size, in bytes, that an arena needs for any single call
+ * to a function in this header, or for the lifetime of one encryption or
+ * decryption context. Recipient caches and thread pools need scratch for each
+ * entry and worker, and the parallel functions need scratch for each worker.
+ * This only covers memory that this library allocates; OpenSSL's allocations
+ * use its own allocator unless `ece_set_openssl_allocator()` is called.
+ *
+ * \param rs[in]     The largest record size that will be encrypted or
+ *                   decrypted.
+ * \param ikmLen[in] The length of the input keying material passed to
+ *                   `ece_aes128gcm_decrypt_init()`, or 0.
+ *
+ * \return           The scratch size.
+ */
+size_t
+ece_scratch_size(uint32_t rs, size_t ikmLen);
+
+/*!
+ * Reuse counters for the calling thread's cipher context pool. Decrypting
+ * reuses an initialized AES-GCM context from the pool, and only re-expands the
+ * key schedule when the content encryption key changes. Streaming contexts
+ * own their cipher context, and don't use the pool.
+ */
+typedef struct ece_cipher_pool_stats_s {
+  /*! The number of contexts taken from the pool. */
+  uint64_t acquires;
+  /*! Acquires that found a context with the same key, and skipped keying. */
+  uint64_t hits;
+  /*! Acquires that initialized a context with a new key. */
+  uint64_t rekeys;
+  /*! The number of contexts allocated. */
+  uint64_t allocs;
+  /*!
+   * Acquires that found every pooled context in use, and used a temporary
+   * context instead.
+   */
+  uint64_t overflows;
+} ece_cipher_pool_stats_t;
+
+/*!
+ * Returns the calling thread's cipher context pool counters.
+ *
+ * \param stats[out] The counters.
+ */
+void
+ece_cipher_pool_get_stats(ece_cipher_pool_stats_t* stats);
+
+/*!
+ * Resets the calling thread's cipher context pool counters to zero.
+ */
+void
+ece_cipher_pool_reset_stats(void);
+
+/*!
+ * Frees the calling thread's pooled cipher contexts, and clears their keys.
+ * When built with pthreads, each thread's pool is freed automatically when the
+ * thread exits; other threads should call this before exiting.
+ *
+ * Pooled contexts keep the expanded key schedules for the last few content
+ * encryption keys, so that decrypting with the same key again is cheaper.
+ * Each schedule stays in memory until its context is re-keyed for a different
+ * key, this function is called, or the thread exits. Callers that want key
+ * material cleared as soon as a message is decrypted should call this
+ * afterward.
+ */
+void
+ece_cipher_pool_flush(void);
+
+/*!
+ * The stages of encryption and decryption that are timed when runtime
+ * statistics are enabled.
+ */
+typedef enum ece_stats_stage_e {
+  /*! Importing a raw ECDH private or public key. */
+  ECE_STATS_STAGE_IMPORT_KEY,
+  /*!
+   * Computing the ECDH shared secret, and deriving the content encryption key
+   * and nonce with HKDF.
+   */
+  ECE_STATS_STAGE_DERIVE_KEY,
+  /*! Encrypting and sealing a record with AES-GCM. */
+  ECE_STATS_STAGE_ENCRYPT_RECORD,
+  /*!
+   * Decrypting and authenticating a record with AES-GCM. A batch of records
+   * decrypted together counts as one call.
+   */
+  ECE_STATS_STAGE_DECRYPT_RECORD,
+  /*! Scanning a decrypted record for its padding, and removing it. */
+  ECE_STATS_STAGE_UNPAD,
+} ece_stats_stage_t;
+
+#define ECE_STATS_STAGES 5
+
+/*!
+ * The number of latency histogram buckets for each stage. Bucket `i` counts
+ * calls that took at least `2^i` and less than `2^(i + 1)` nanoseconds. The
+ * first bucket also counts calls that took less than 1 nanosecond, and the
+ * last counts all calls that took longer.
+ */
+#define ECE_STATS_HISTOGRAM_BUCKETS 32
+
+/*!
+ * The number of error counters. `errors[i]` counts the error code `-i`. Error
+ * codes that don't fit are counted in `errors[0]`.
+ */
+#define ECE_STATS_ERROR_CODES 32
+
+/*!
+ * Counters for one stage.
+ */
+typedef struct ece_stats_stage_counters_s {
+  /*! The number of calls. */
+  uint64_t calls;
+  /*! The number of input bytes processed, including failed calls. */
+  uint64_t bytes;
+  /*! The number of calls that failed. */
+  uint64_t errors;
+  /*! The total time spent in the stage, in nanoseconds. */
+  uint64_t ns;
+  /*! The latency histogram. */
+  uint64_t histogram[ECE_STATS_HISTOGRAM_BUCKETS];
+} ece_stats_stage_counters_t;
+
+/*!
+ * A snapshot of the runtime statistics, aggregated over all threads.
+ */
+typedef struct ece_stats_s {
+  /*! The counters for each stage, indexed by `ece_stats_stage_t`. */
+  ece_stats_stage_counters_t stages[ECE_STATS_STAGES];
+  /*! The number of times each stage failed with each error code. */
+  uint64_t errors[ECE_STATS_ERROR_CODES];
+} ece_stats_t;
+
+/*!
+ * Enables or disables runtime statistics for all threads. Statistics are
+ * disabled by default. While they're disabled, each stage only checks a flag;
+ * while they're enabled, each stage reads the monotonic clock twice, and
+ * updates counters that belong to the calling thread.
+ *
+ * \param enabled[in] Whether to collect statistics.
+ */
+void
+ece_stats_enable(bool enabled);
+
+/*!
+ * Indicates if runtime statistics are enabled.
+ *
+ * \return `true` if statistics are enabled.
+ */
+bool
+ece_stats_enabled(void);
+
+/*!
+ * Sums the counters of all threads, including threads that have exited,
+ * since the last call to `ece_stats_reset`. Counters that other threads are
+ * updating at the same time may be slightly behind. When built without
+ * pthreads, this only includes the calling thread's counters.
+ *
+ * \param stats[out] The counters.
+ */
+void
+ece_stats_snapshot(ece_stats_t* stats);
+
+/*!
+ * Resets all counters to zero. Later snapshots only include calls that
+ * finish after the reset.
+ */
+void
+ece_stats_reset(void);
+
+/*!
+ * A source of random bytes for salts and sender keys. `fill` receives
+ * `opaque` as its first argument, and returns `true` if it filled all `len`
+ * bytes of `bytes`.
+ */
+typedef struct ece_rand_source_s {
+  bool (*fill)(void* opaque, uint8_t* bytes, size_t len);
+  void* opaque;
+} ece_rand_source_t;
+
+/*!
+ * Sets the source of random bytes for encryption salts, ephemeral sender
+ * keys, and bulk-generated subscription keys. The default source is OpenSSL's
+ * RNG. A deterministic source makes payloads reproducible, which is useful
+ * for benchmarks and tests, but must never be used in production.
+ *
+ * Each thread draws from the source in large blocks, and buffers the bytes
+ * until they're used. Setting a source discards the buffered bytes on every
+ * thread, so that later draws come from the new source. A child process
+ * discards the bytes that it inherits from its parent after `fork`. The
+ * source is shared by all threads, so this should be called before
+ * encrypting on other threads.
+ *
+ * \param source[in] The source, which is copied. If `NULL`, restores the
+ *                   default source.
+ */
+void
+ece_set_rand_source(const ece_rand_source_t* source);
+
 #ifdef __cplusplus
 }
 #endif
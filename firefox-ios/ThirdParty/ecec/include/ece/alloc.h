@@ -0,0 +1,55 @@
+#ifndef ECE_ALLOC_H
+#define ECE_ALLOC_H
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "ece.h"
+
+// Declares thread-local storage. C99 doesn't have `_Thread_local`, so we use
+// the compiler extensions.
+#ifdef _MSC_VER
+#define ECE_THREAD_LOCAL __declspec(thread)
+#else
+#define ECE_THREAD_LOCAL __thread
+#endif
+
+// Fails to compile if `cond` is false.
+#define ECE_STATIC_ASSERT(cond, name) typedef char name[(cond) ? 1 : -1]
+
+// The largest context that we allocate. Each context type asserts that it
+// fits, so that `ece_scratch_size` stays an upper bound.
+#define ECE_MAX_CONTEXT_LENGTH 1024
+
+// The most contexts that are allocated at once during a single call, or over
+// the lifetime of one encryption or decryption context. Encrypting for a
+// recipient allocates the recipient, its encryption context, and a temporary
+// subscription or context.
+#define ECE_MAX_CONTEXTS 3
+
+// The arena space needed for one allocation of `len` bytes, including its
+// header and alignment.
+#define ECE_ARENA_ALLOCATION_LENGTH(len) ((len) + 32)
+
+// Allocates memory with the calling thread's allocator, or the global
+// allocator if the thread doesn't have one.
+void*
+ece_malloc(size_t size);
+
+// Like `ece_malloc`, but zeroes the memory. Returns `NULL` if `count * size`
+// overflows.
+void*
+ece_calloc(size_t count, size_t size);
+
+void*
+ece_realloc(void* ptr, size_t size);
+
+// Frees memory from `ece_malloc`, `ece_calloc`, or `ece_realloc`. Does nothing
+// if `ptr` is `NULL`.
+void
+ece_free(void* ptr);
+
+#ifdef __cplusplus
+}
+#endif
+#endif /* ECE_ALLOC_H */
@@ -0,0 +1,97 @@
+#ifndef ECE_BASE64URL_H
+#define ECE_BASE64URL_H
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "ece.h"
+
+typedef enum ece_base64url_impl_e {
+  // Encodes and decodes one quantum at a time.
+  ECE_BASE64URL_IMPL_SCALAR,
+  // Encodes 12 bytes, or decodes 16 characters, at a time with SSE4.1.
+  ECE_BASE64URL_IMPL_SSE41,
+  // Encodes 24 bytes, or decodes 32 characters, at a time with AVX2.
+  ECE_BASE64URL_IMPL_AVX2,
+  // Encodes 48 bytes, or decodes 64 characters, at a time with NEON.
+  ECE_BASE64URL_IMPL_NEON,
+} ece_base64url_impl_t;
+
+// Indicates if `impl` can run on this CPU.
+bool
+ece_base64url_impl_supported(ece_base64url_impl_t impl);
+
+// Returns the fastest implementation for this CPU. The CPU is only probed
+// once.
+ece_base64url_impl_t
+ece_base64url_best_impl(void);
+
+// Encodes all complete 3-byte groups in `binary` with `impl`, writing 4
+// characters to `base64` for each group. Returns the number of bytes encoded,
+// which is `binaryLen` rounded down to a multiple of 3. The caller encodes the
+// remaining bytes and any padding.
+size_t
+ece_base64url_encode_blocks_impl(ece_base64url_impl_t impl,
+                                 const uint8_t* binary, size_t binaryLen,
+                                 char* base64);
+
+// Decodes complete 4-character quanta from `base64` with `impl`, writing 3
+// bytes to `binary` for each quantum. Stops before the first quantum that
+// contains a character outside the Base64url alphabet, including "=". Returns
+// the number of characters decoded, which is always a multiple of 4. The
+// caller decodes the rest, and reports any errors.
+size_t
+ece_base64url_decode_blocks_impl(ece_base64url_impl_t impl,
+                                 const char* base64, size_t base64Len,
+                                 uint8_t* binary);
+
+// Encodes complete groups with the best implementation for this CPU.
+size_t
+ece_base64url_encode_blocks(const uint8_t* binary, size_t binaryLen,
+                            char* base64);
+
+// Decodes complete quanta with the best implementation for this CPU.
+size_t
+ece_base64url_decode_blocks(const char* base64, size_t base64Len,
+                            uint8_t* binary);
+
+// Decodes a Base64url string a few bytes at a time, for callers that consume
+// the decoded bytes in units that don't line up with 3-byte groups. Whole
+// groups are decoded straight into the caller's buffer; the bytes of a group
+// that straddles two reads are carried over to the next read.
+typedef struct ece_base64url_reader_s {
+  ece_base64url_decoder_t decoder;
+  const char* base64;
+  size_t base64Len;
+  uint8_t carry[3];
+  size_t carryStart;
+  size_t carryLen;
+  bool done;
+} ece_base64url_reader_t;
+
+// Initializes `reader` to decode `base64`, which must outlive the reader.
+void
+ece_base64url_reader_init(ece_base64url_reader_t* reader, const char* base64,
+                          size_t base64Len,
+                          ece_base64url_decode_policy_t paddingPolicy);
+
+// Decodes up to `len` bytes into `bytes`, and sets `readLen` to the number of
+// bytes decoded. `readLen` is only less than `len` at the end of the input,
+// after the padding has been checked. Returns `ECE_ERROR_INVALID_BASE64URL`
+// if the input is malformed.
+int
+ece_base64url_read(ece_base64url_reader_t* reader, uint8_t* bytes, size_t len,
+                   size_t* readLen);
+
+// Returns the maximum decoded length of a `base64Len`-character string.
+size_t
+ece_base64url_decode_max_length(size_t base64Len);
+
+// Returns the maximum number of bytes left to read from `reader`.
+size_t
+ece_base64url_reader_max_remaining(const ece_base64url_reader_t* reader);
+
+#ifdef __cplusplus
+}
+#endif
+#endif /* ECE_BASE64URL_H */
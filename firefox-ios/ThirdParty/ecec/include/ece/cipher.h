@@ -0,0 +1,33 @@
+#ifndef ECE_CIPHER_H
+#define ECE_CIPHER_H
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "ece.h"
+#include "ece/keys.h"
+
+#include <openssl/evp.h>
+
+// The number of cipher contexts that each thread keeps. Most calls only need
+// one context at a time, but keeping a few lets a thread alternate between
+// messages, or between encrypting and decrypting, without re-keying.
+#define ECE_CIPHER_POOL_SIZE 4
+
+// Takes an AES-128-GCM context from the calling thread's pool, initialized for
+// `mode` with `key`. If a pooled context already has the same key and mode, it
+// is returned as-is, and only the IV needs to be set for each record. The
+// context must be returned with `ece_cipher_ctx_release` on the same thread.
+int
+ece_cipher_ctx_acquire(ece_mode_t mode, const uint8_t* key,
+                       EVP_CIPHER_CTX** ctx);
+
+// Returns a context to the calling thread's pool. Does nothing if `ctx` is
+// `NULL`.
+void
+ece_cipher_ctx_release(EVP_CIPHER_CTX* ctx);
+
+#ifdef __cplusplus
+}
+#endif
+#endif /* ECE_CIPHER_H */
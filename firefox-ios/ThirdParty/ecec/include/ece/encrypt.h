@@ -0,0 +1,55 @@
+#ifndef ECE_ENCRYPT_H
+#define ECE_ENCRYPT_H
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "ece.h"
+#include "ece/keys.h"
+
+// Generates an ephemeral P-256 sender key pair. Returns `NULL` on error.
+EC_KEY*
+ece_encrypt_generate_key(void);
+
+// Initializes a streaming "aes128gcm" encryption context with imported keys.
+int
+ece_webpush_aes128gcm_encrypt_init_keys(ece_encrypt_ctx_t* ctx,
+                                        EC_KEY* senderPrivKey,
+                                        EC_KEY* recvPubKey,
+                                        const uint8_t* authSecret,
+                                        size_t authSecretLen,
+                                        const uint8_t* salt, size_t saltLen,
+                                        uint32_t rs, size_t padLen);
+
+// Initializes a streaming "aesgcm" encryption context with imported keys.
+int
+ece_webpush_aesgcm_encrypt_init_keys(ece_encrypt_ctx_t* ctx,
+                                     EC_KEY* senderPrivKey, EC_KEY* recvPubKey,
+                                     const uint8_t* authSecret,
+                                     size_t authSecretLen, const uint8_t* salt,
+                                     size_t saltLen, uint32_t rs,
+                                     size_t padLen);
+
+// Returns the exact length of a Web Push "aes128gcm" payload, including the
+// header, or 0 if the parameters are invalid.
+size_t
+ece_webpush_aes128gcm_payload_length(uint32_t rs, size_t padLen,
+                                     size_t plaintextLen);
+
+// Returns the exact length of a Web Push "aesgcm" ciphertext, or 0 if the
+// parameters are invalid.
+size_t
+ece_webpush_aesgcm_ciphertext_length(uint32_t rs, size_t padLen,
+                                     size_t plaintextLen);
+
+// Encrypts a complete message with an initialized context, writing the header
+// and all records to `ciphertext`.
+int
+ece_encrypt_all(ece_encrypt_ctx_t* ctx, const uint8_t* plaintext,
+                size_t plaintextLen, uint8_t* ciphertext,
+                size_t* ciphertextLen);
+
+#ifdef __cplusplus
+}
+#endif
+#endif /* ECE_ENCRYPT_H */
@@ -0,0 +1,68 @@
+#ifndef ECE_GCM_H
+#define ECE_GCM_H
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "ece.h"
+#include "ece/keys.h"
+
+#include <stdbool.h>
+
+// The number of records that the multi-buffer kernel encrypts or decrypts in
+// lockstep. Each lane can use a different key, so the records may come from
+// different messages.
+#define ECE_GCM_LANES 4
+
+// A single AES-128-GCM record operation. For decryption, `in` is the encrypted
+// record with the authentication tag at the end, and `out` receives `inLen -
+// ECE_TAG_LENGTH` bytes. For encryption, `in` is the padded block, and `out`
+// receives `inLen + ECE_TAG_LENGTH` bytes. `out` may be the same as `in`.
+typedef struct ece_gcm_job_s {
+  const uint8_t* key;
+  uint8_t iv[ECE_NONCE_LENGTH];
+  const uint8_t* in;
+  size_t inLen;
+  uint8_t* out;
+  // Set to `ECE_OK` on success, or the same error that `ece_record_decrypt` or
+  // `ece_record_encrypt` would return for the record.
+  int err;
+} ece_gcm_job_t;
+
+typedef enum ece_gcm_impl_e {
+  // Encrypts and decrypts one record at a time with OpenSSL.
+  ECE_GCM_IMPL_PORTABLE,
+  // Interleaves `ECE_GCM_LANES` records using AES-NI and PCLMULQDQ.
+  ECE_GCM_IMPL_CLMUL,
+} ece_gcm_impl_t;
+
+// Indicates if `impl` can run on this CPU.
+bool
+ece_gcm_impl_supported(ece_gcm_impl_t impl);
+
+// Returns the fastest implementation for this CPU. The CPU is only probed
+// once.
+ece_gcm_impl_t
+ece_gcm_best_impl(void);
+
+// Decrypts and authenticates `count` records with `impl`. On authentication
+// failure, the job's output is cleared.
+void
+ece_gcm_open_impl(ece_gcm_impl_t impl, ece_gcm_job_t* jobs, size_t count);
+
+// Encrypts `count` records with `impl`, appending the tag to each record.
+void
+ece_gcm_seal_impl(ece_gcm_impl_t impl, ece_gcm_job_t* jobs, size_t count);
+
+// Decrypts `count` records with the best implementation for this CPU.
+void
+ece_gcm_open(ece_gcm_job_t* jobs, size_t count);
+
+// Encrypts `count` records with the best implementation for this CPU.
+void
+ece_gcm_seal(ece_gcm_job_t* jobs, size_t count);
+
+#ifdef __cplusplus
+}
+#endif
+#endif /* ECE_GCM_H */
@@ -0,0 +1,53 @@
+#ifndef ECE_IOV_H
+#define ECE_IOV_H
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "ece.h"
+
+// A position in a list of buffer segments. Empty segments are skipped.
+typedef struct ece_iov_cursor_s {
+  const ece_iovec_t* iov;
+  size_t count;
+  size_t index;
+  size_t offset;
+} ece_iov_cursor_t;
+
+// Returns the total length of all segments.
+size_t
+ece_iov_length(const ece_iovec_t* iov, size_t count);
+
+// Positions `cursor` at the start of the first segment.
+void
+ece_iov_cursor_init(ece_iov_cursor_t* cursor, const ece_iovec_t* iov,
+                    size_t count);
+
+// Returns the contiguous bytes at `cursor`, without advancing it, and sets
+// `len` to their length. Returns `NULL` and sets `len` to 0 at the end.
+uint8_t*
+ece_iov_peek(ece_iov_cursor_t* cursor, size_t* len);
+
+// Returns up to `maxLen` contiguous bytes at `cursor`, and advances past them.
+// Sets `len` to the number of bytes returned.
+uint8_t*
+ece_iov_next(ece_iov_cursor_t* cursor, size_t maxLen, size_t* len);
+
+// Advances `cursor` by up to `len` bytes. Returns the number of bytes skipped.
+size_t
+ece_iov_skip(ece_iov_cursor_t* cursor, size_t len);
+
+// Copies up to `len` bytes from the segments into `bytes`. Returns the number
+// of bytes copied.
+size_t
+ece_iov_read(ece_iov_cursor_t* cursor, uint8_t* bytes, size_t len);
+
+// Copies up to `len` bytes from `bytes` into the segments. Returns the number
+// of bytes copied.
+size_t
+ece_iov_write(ece_iov_cursor_t* cursor, const uint8_t* bytes, size_t len);
+
+#ifdef __cplusplus
+}
+#endif
+#endif /* ECE_IOV_H */
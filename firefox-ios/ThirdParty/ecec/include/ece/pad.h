@@ -0,0 +1,49 @@
+#ifndef ECE_PAD_H
+#define ECE_PAD_H
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "ece.h"
+
+typedef enum ece_pad_impl_e {
+  // Checks one byte at a time.
+  ECE_PAD_IMPL_SCALAR,
+  // Checks 16 bytes at a time with SSE2.
+  ECE_PAD_IMPL_SSE2,
+  // Checks 32 bytes at a time with AVX2.
+  ECE_PAD_IMPL_AVX2,
+  // Checks 16 bytes at a time with NEON.
+  ECE_PAD_IMPL_NEON,
+} ece_pad_impl_t;
+
+// Indicates if `impl` can run on this CPU.
+bool
+ece_pad_impl_supported(ece_pad_impl_t impl);
+
+// Returns the fastest implementation for this CPU. The CPU is only probed
+// once.
+ece_pad_impl_t
+ece_pad_best_impl(void);
+
+// Scans `block` backward with `impl`, and returns its length without trailing
+// zero bytes. Returns 0 if the block is all zeros.
+size_t
+ece_pad_trim_zeros_impl(ece_pad_impl_t impl, const uint8_t* block, size_t len);
+
+// Indicates if all `len` bytes of `block` are zero, checking with `impl`.
+bool
+ece_pad_is_zero_impl(ece_pad_impl_t impl, const uint8_t* block, size_t len);
+
+// Trims trailing zero bytes with the best implementation for this CPU.
+size_t
+ece_pad_trim_zeros(const uint8_t* block, size_t len);
+
+// Checks for zero bytes with the best implementation for this CPU.
+bool
+ece_pad_is_zero(const uint8_t* block, size_t len);
+
+#ifdef __cplusplus
+}
+#endif
+#endif /* ECE_PAD_H */
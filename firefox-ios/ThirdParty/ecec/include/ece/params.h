@@ -0,0 +1,74 @@
+#ifndef ECE_PARAMS_H
+#define ECE_PARAMS_H
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "ece.h"
+
+// The default "aesgcm" record size, if the `Encryption` header doesn't have
+// an `rs` pair.
+#define ECE_HEADER_DEFAULT_RS 4096
+
+// Each `Crypto-Key` and `Encryption` header is a list of params separated by
+// commas, and each param is a list of `name=value` pairs separated by
+// semicolons. Values may be quoted. Whitespace is allowed around names,
+// values, and separators.
+//
+// The tokenizer walks a header slice once, returning one pair at a time as
+// pointers into the slice, so that it doesn't need to allocate or copy. Both
+// header parsers use it, so they accept the same grammar.
+
+// The separator that follows a pair.
+typedef enum ece_header_sep_e {
+  // A `;`; the next pair is in the same param.
+  ECE_HEADER_SEP_PAIR,
+  // A `,`; the next pair starts a new param.
+  ECE_HEADER_SEP_PARAM,
+  // The end of the header.
+  ECE_HEADER_SEP_END,
+} ece_header_sep_t;
+
+typedef struct ece_header_tokenizer_s {
+  const char* p;
+  const char* end;
+} ece_header_tokenizer_t;
+
+typedef struct ece_header_slice_s {
+  const char* value;
+  size_t len;
+} ece_header_slice_t;
+
+typedef struct ece_header_pair_s {
+  ece_header_slice_t name;
+  ece_header_slice_t value;
+  ece_header_sep_t sep;
+} ece_header_pair_t;
+
+// Initializes `tokenizer` to walk `header[0..headerLen]`.
+void
+ece_header_tokenizer_init(ece_header_tokenizer_t* tokenizer,
+                          const char* header, size_t headerLen);
+
+// Consumes the next pair and its separator. Returns false on a syntax error,
+// including an empty header or a trailing separator.
+bool
+ece_header_next_pair(ece_header_tokenizer_t* tokenizer,
+                     ece_header_pair_t* pair);
+
+// Parses a decimal "aesgcm" record size. Returns false if the value isn't a
+// number, or is out of range.
+bool
+ece_header_parse_rs(ece_header_slice_t value, uint32_t* rs);
+
+// Decodes an unpadded Base64url value that must decode to exactly
+// `binaryLen` bytes. Returns false if the value is malformed, or has a
+// different length.
+bool
+ece_header_decode(ece_header_slice_t value, uint8_t* binary,
+                  size_t binaryLen);
+
+#ifdef __cplusplus
+}
+#endif
+#endif /* ECE_PARAMS_H */
@@ -0,0 +1,28 @@
+#ifndef ECE_POOL_H
+#define ECE_POOL_H
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "ece.h"
+
+// A task run by the pool. `index` is in `[0, count)`, and each index is run
+// exactly once per `ece_pool_run` call.
+typedef void (*ece_pool_task_t)(void* arg, size_t index);
+
+// Returns the number of workers in the pool, including the calling thread.
+// Returns 1 if `pool` is `NULL`.
+size_t
+ece_pool_size(const ece_pool_t* pool);
+
+// Runs `task` for each index in `[0, count)`, and waits for all tasks to
+// finish. The calling thread also runs tasks. Concurrent calls on the same
+// pool are serialized. If `pool` is `NULL`, all tasks run on the calling
+// thread.
+void
+ece_pool_run(ece_pool_t* pool, size_t count, ece_pool_task_t task, void* arg);
+
+#ifdef __cplusplus
+}
+#endif
+#endif /* ECE_POOL_H */
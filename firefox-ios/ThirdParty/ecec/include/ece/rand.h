@@ -0,0 +1,29 @@
+#ifndef ECE_RAND_H
+#define ECE_RAND_H
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "ece.h"
+
+#include <openssl/bn.h>
+
+// The number of random bytes that each thread buffers. Each salt or scalar
+// uses 16 or 32 bytes, so one refill covers over a hundred encryptions.
+#define ECE_RAND_BUFFER_LENGTH 4096
+
+// Fills `bytes` with random bytes from the calling thread's buffer, refilling
+// it from the source if needed. Requests larger than a quarter of the buffer
+// are filled directly from the source. Returns `false` if the source fails.
+bool
+ece_rand_bytes(uint8_t* bytes, size_t len);
+
+// Sets `scalar` to a uniformly random value in `[1, order)`, where `order` is
+// a 256-bit group order like P-256's. Returns `false` if the source fails.
+bool
+ece_rand_scalar(const BIGNUM* order, BIGNUM* scalar);
+
+#ifdef __cplusplus
+}
+#endif
+#endif /* ECE_RAND_H */
@@ -0,0 +1,30 @@
+#ifndef ECE_RECIPIENT_H
+#define ECE_RECIPIENT_H
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "ece.h"
+#include "ece/keys.h"
+
+struct ece_recipient_s {
+  // The validated subscription public key, and the raw bytes it was imported
+  // from. The cache uses the raw bytes as the lookup key.
+  EC_KEY* recvPubKey;
+  uint8_t rawRecvPubKey[ECE_WEBPUSH_PUBLIC_KEY_LENGTH];
+  size_t rawRecvPubKeyLen;
+  uint8_t authSecret[ECE_WEBPUSH_AUTH_SECRET_LENGTH];
+
+  // The number of references to this recipient. The handle returned from
+  // `ece_recipient_create` holds one reference, and a cache holds one more
+  // for as long as the recipient stays cached. Callers may release handles
+  // on any thread while the cache evicts the same recipient on another, so
+  // the count is only changed with atomic operations. It's a `long` because
+  // that's what the Windows interlocked functions take.
+  long refs;
+};
+
+#ifdef __cplusplus
+}
+#endif
+#endif /* ECE_RECIPIENT_H */
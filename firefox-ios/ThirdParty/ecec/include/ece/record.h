@@ -0,0 +1,122 @@
+#ifndef ECE_RECORD_H
+#define ECE_RECORD_H
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "ece.h"
+
+#include <openssl/evp.h>
+
+// The padding delimiters for "aes128gcm" records. The last record must use
+// `ECE_AES128GCM_LAST_DELIMITER`; all preceding records must use
+// `ECE_AES128GCM_DELIMITER`.
+#define ECE_AES128GCM_DELIMITER 1
+#define ECE_AES128GCM_LAST_DELIMITER 2
+
+typedef int (*unpad_t)(uint8_t* block, bool isLastRecord, size_t* blockLen);
+
+typedef void (*pad_t)(uint8_t* block, size_t blockPadLen, size_t dataLen,
+                      bool isLastRecord);
+
+// Reads an unsigned 16-bit integer in big-endian order from `bytes`.
+static inline uint16_t
+ece_read_uint16_be(const uint8_t* bytes) {
+  return (uint16_t)(((uint16_t) bytes[0] << 8) | bytes[1]);
+}
+
+// Reads an unsigned 32-bit integer in big-endian order from `bytes`.
+static inline uint32_t
+ece_read_uint32_be(const uint8_t* bytes) {
+  return ((uint32_t) bytes[0] << 24) | ((uint32_t) bytes[1] << 16) |
+         ((uint32_t) bytes[2] << 8) | (uint32_t) bytes[3];
+}
+
+// Sets the content encryption key for all records decrypted with `ctx`. This
+// expands the AES key schedule once; `ece_record_decrypt` then only resets the
+// IV for each record.
+int
+ece_record_decrypt_init(EVP_CIPHER_CTX* ctx, const uint8_t* key);
+
+// Decrypts and authenticates a single record, using a context initialized with
+// `ece_record_decrypt_init`. `block` must have room for `recordLen -
+// ECE_TAG_LENGTH` bytes, and may be the same as `record`.
+int
+ece_record_decrypt(EVP_CIPHER_CTX* ctx, const uint8_t* iv,
+                   const uint8_t* record, size_t recordLen, uint8_t* block);
+
+// Decrypts and unpads all records in `ciphertext`, using a context initialized
+// with `ece_record_decrypt_init`. `rs` is the encrypted record size. Each
+// record is decrypted straight into `plaintext`, so the input value of
+// `plaintextLen` must leave room for the padding of the last record.
+int
+ece_record_decrypt_all(EVP_CIPHER_CTX* ctx, const uint8_t* nonce, uint32_t rs,
+                       const uint8_t* ciphertext, size_t ciphertextLen,
+                       unpad_t unpad, uint8_t* plaintext,
+                       size_t* plaintextLen);
+
+// Decrypts and unpads all records in `ciphertext`, overwriting the records
+// with the plaintext. On success, the plaintext is at the start of
+// `ciphertext`, and `plaintextLen` is set to its length. On error, the
+// contents of `ciphertext` are unspecified.
+int
+ece_record_decrypt_all_in_place(EVP_CIPHER_CTX* ctx, const uint8_t* nonce,
+                                uint32_t rs, uint8_t* ciphertext,
+                                size_t ciphertextLen, unpad_t unpad,
+                                size_t* plaintextLen);
+
+// Like `ece_record_decrypt_all`, but splits the records into runs, and
+// decrypts the runs in parallel on `pool`. Each worker uses a copy of `ctx`.
+// If `plaintextLen` is too small to hold every decrypted block before
+// unpadding, or there's only one record, this falls back to
+// `ece_record_decrypt_all`. On error, returns the error for the first failing
+// record, as `ece_record_decrypt_all` does.
+int
+ece_record_decrypt_all_parallel(ece_pool_t* pool, EVP_CIPHER_CTX* ctx,
+                                const uint8_t* nonce, uint32_t rs,
+                                const uint8_t* ciphertext,
+                                size_t ciphertextLen, unpad_t unpad,
+                                uint8_t* plaintext, size_t* plaintextLen);
+
+// Sets the content encryption key for all records encrypted with `ctx`.
+int
+ece_record_encrypt_init(EVP_CIPHER_CTX* ctx, const uint8_t* key);
+
+// Encrypts a single padded block, using a context initialized with
+// `ece_record_encrypt_init`. Writes `blockLen + ECE_TAG_LENGTH` bytes to
+// `record`, which may be the same as `block`.
+int
+ece_record_encrypt(EVP_CIPHER_CTX* ctx, const uint8_t* iv,
+                   const uint8_t* block, size_t blockLen, uint8_t* record);
+
+// Pads an "aes128gcm" block. The block contents are at the start of `block`,
+// and are followed by the padding delimiter and `blockPadLen` zero bytes.
+void
+ece_aes128gcm_pad(uint8_t* block, size_t blockPadLen, size_t dataLen,
+                  bool isLastRecord);
+
+// Pads an "aesgcm" block. The block contents must already be at offset
+// `ECE_AESGCM_PAD_SIZE + blockPadLen`; this writes the padding length and
+// zero bytes before them.
+void
+ece_aesgcm_pad(uint8_t* block, size_t blockPadLen, size_t dataLen,
+               bool isLastRecord);
+
+// Removes padding from a decrypted "aes128gcm" block. On success, `blockLen`
+// is set to the length of the unpadded contents at the start of `block`.
+int
+ece_aes128gcm_unpad(uint8_t* block, bool isLastRecord, size_t* blockLen);
+
+// Removes padding from a decrypted "aesgcm" block, and moves the unpadded
+// contents to the start of `block`.
+int
+ece_aesgcm_unpad(uint8_t* block, bool isLastRecord, size_t* blockLen);
+
+#ifdef __cplusplus
+}
+#endif
+#endif /* ECE_RECORD_H */
@@ -0,0 +1,33 @@
+#ifndef ECE_STATS_H
+#define ECE_STATS_H
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "ece.h"
+#include "ece/keys.h"
+
+// Returns the start time of a stage, or 0 if statistics are disabled. The
+// caller passes the time to `ece_stats_end` when the stage finishes.
+uint64_t
+ece_stats_begin(void);
+
+// Records a call to `stage` that started at `start`, processed `bytes` bytes,
+// and returned `err`. Does nothing if `start` is 0.
+void
+ece_stats_end(ece_stats_stage_t stage, uint64_t start, size_t bytes, int err);
+
+// Like `ece_import_private_key`, but records the call in
+// `ECE_STATS_STAGE_IMPORT_KEY`.
+EC_KEY*
+ece_stats_import_private_key(const uint8_t* rawKey, size_t rawKeyLen);
+
+// Like `ece_import_public_key`, but records the call in
+// `ECE_STATS_STAGE_IMPORT_KEY`.
+EC_KEY*
+ece_stats_import_public_key(const uint8_t* rawKey, size_t rawKeyLen);
+
+#ifdef __cplusplus
+}
+#endif
+#endif /* ECE_STATS_H */
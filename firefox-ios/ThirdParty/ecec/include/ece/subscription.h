@@ -0,0 +1,50 @@
+#ifndef ECE_SUBSCRIPTION_H
+#define ECE_SUBSCRIPTION_H
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "ece.h"
+#include "ece/keys.h"
+#include "ece/record.h"
+
+#include <openssl/evp.h>
+
+struct ece_subscription_s {
+  // The subscription key pair, with the public key recovered from the private
+  // key at creation time.
+  EC_KEY* recvPrivKey;
+  uint8_t authSecret[ECE_WEBPUSH_AUTH_SECRET_LENGTH];
+};
+
+// Imports the sender public key, and derives the content encryption key and
+// nonce for a message to `sub`.
+int
+ece_subscription_derive_key_and_nonce(const ece_subscription_t* sub,
+                                      const uint8_t* salt, size_t saltLen,
+                                      const uint8_t* rawSenderPubKey,
+                                      size_t rawSenderPubKeyLen,
+                                      derive_key_and_nonce_t deriveKeyAndNonce,
+                                      uint8_t* key, uint8_t* nonce);
+
+// Derives the content encryption key and nonce for a message to `sub`, and
+// decrypts all records into `plaintext` using a pooled cipher context. `rs` is
+// the encrypted record size. The caller must check the ciphertext length and
+// trailer first. If `pool` isn't `NULL`, the records are decrypted in
+// parallel.
+int
+ece_subscription_decrypt_records(ece_pool_t* pool,
+                                 const ece_subscription_t* sub,
+                                 const uint8_t* salt, size_t saltLen,
+                                 const uint8_t* rawSenderPubKey,
+                                 size_t rawSenderPubKeyLen, uint32_t rs,
+                                 const uint8_t* ciphertext,
+                                 size_t ciphertextLen,
+                                 derive_key_and_nonce_t deriveKeyAndNonce,
+                                 unpad_t unpad, uint8_t* plaintext,
+                                 size_t* plaintextLen);
+
+#ifdef __cplusplus
+}
+#endif
+#endif /* ECE_SUBSCRIPTION_H */
@@ -0,0 +1,56 @@
+#ifndef ECE_TRACE_H
+#define ECE_TRACE_H
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Static tracepoints for `bpftrace`, `perf`, and other USDT consumers. They're
+// only compiled in when the library is built with `-DECE_USDT=ON`; otherwise,
+// they expand to nothing, and their arguments aren't evaluated.
+//
+// Each stage fires a `*_start` probe on entry, and a `*_done` probe on exit.
+// All probes use the `ece` provider:
+//
+//   import_key_start(keyLen)
+//   import_key_done(keyLen, err)
+//   derive_key_start(saltLen)
+//   derive_key_done(saltLen, err)
+//   header_parse_start(payloadLen)
+//   header_parse_done(payloadLen, rs, err)
+//   record_seal_start(index, blockLen, rs)
+//   record_seal_done(index, blockLen, err)
+//   record_open_start(index, recordLen, rs)
+//   record_open_done(index, recordLen, err)
+//   unpad_start(blockLen, isLastRecord)
+//   unpad_done(blockLen, err)
+//
+// `index` is the record's sequence number within its message, `rs` is the
+// message's record size, and `err` is 0 or an `ECE_ERROR_*` code. The header
+// probes see an `rs` of 0 if the header is too short to include it. Streaming
+// decryption parses the header as it arrives, so its `payloadLen` is the
+// length of the chunk that starts the header, and then the header length.
+// A record's `unpad_*` probes fire on the same thread, after its
+// `record_open_done`. Batch decryption opens its queued records together, so
+// it fires all their `record_open_start` probes before the first
+// `record_open_done`.
+
+#ifdef ECE_HAVE_USDT
+
+#include <sys/sdt.h>
+
+#define ECE_TRACE1(name, a) DTRACE_PROBE1(ece, name, a)
+#define ECE_TRACE2(name, a, b) DTRACE_PROBE2(ece, name, a, b)
+#define ECE_TRACE3(name, a, b, c) DTRACE_PROBE3(ece, name, a, b, c)
+
+#else
+
+#define ECE_TRACE1(name, a) ((void) 0)
+#define ECE_TRACE2(name, a, b) ((void) 0)
+#define ECE_TRACE3(name, a, b, c) ((void) 0)
+
+#endif /* ECE_HAVE_USDT */
+
+#ifdef __cplusplus
+}
+#endif
+#endif /* ECE_TRACE_H */
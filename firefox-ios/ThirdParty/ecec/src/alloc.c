@@ -0,0 +1,290 @@
+#include "ece/alloc.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <openssl/crypto.h>
+
+// Arena allocations are aligned for any type, and prefixed with a header.
+#define ECE_ARENA_ALIGNMENT 16
+
+// The header before each arena allocation. `prevUsed` is the arena's `used`
+// value before the allocation, so that freeing the most recent allocation can
+// also reclaim its alignment padding.
+typedef struct ece_arena_header_s {
+  size_t prevUsed;
+  size_t size;
+} ece_arena_header_t;
+
+ECE_STATIC_ASSERT(sizeof(ece_arena_header_t) <= ECE_ARENA_ALIGNMENT,
+                  ece_arena_header_fits);
+ECE_STATIC_ASSERT(ECE_ARENA_ALLOCATION_LENGTH(0) >=
+                    ECE_ARENA_ALIGNMENT * 2 - 1,
+                  ece_arena_allocation_length_fits);
+
+#ifdef ECE_NO_HEAP
+
+static void*
+ece_default_alloc(void* opaque, size_t size) {
+  ECE_UNUSED(opaque);
+  ECE_UNUSED(size);
+  return NULL;
+}
+
+static void*
+ece_default_realloc(void* opaque, void* ptr, size_t size) {
+  ECE_UNUSED(opaque);
+  ECE_UNUSED(ptr);
+  ECE_UNUSED(size);
+  return NULL;
+}
+
+static void
+ece_default_free(void* opaque, void* ptr) {
+  ECE_UNUSED(opaque);
+  ECE_UNUSED(ptr);
+}
+
+#else
+
+static void*
+ece_default_alloc(void* opaque, size_t size) {
+  ECE_UNUSED(opaque);
+  return malloc(size);
+}
+
+static void*
+ece_default_realloc(void* opaque, void* ptr, size_t size) {
+  ECE_UNUSED(opaque);
+  return realloc(ptr, size);
+}
+
+static void
+ece_default_free(void* opaque, void* ptr) {
+  ECE_UNUSED(opaque);
+  free(ptr);
+}
+
+#endif /* ECE_NO_HEAP */
+
+static const ece_allocator_t ece_default_allocator = {
+  .alloc = &ece_default_alloc,
+  .realloc = &ece_default_realloc,
+  .free = &ece_default_free,
+  .opaque = NULL,
+};
+
+static ece_allocator_t ece_global_allocator = {
+  .alloc = &ece_default_alloc,
+  .realloc = &ece_default_realloc,
+  .free = &ece_default_free,
+  .opaque = NULL,
+};
+
+static ECE_THREAD_LOCAL bool ece_has_thread_allocator = false;
+static ECE_THREAD_LOCAL ece_allocator_t ece_thread_allocator;
+
+// OpenSSL's allocator, set once at startup.
+static ece_allocator_t ece_openssl_allocator;
+
+static inline const ece_allocator_t*
+ece_current_allocator(void) {
+  return ece_has_thread_allocator ? &ece_thread_allocator
+                                  : &ece_global_allocator;
+}
+
+void
+ece_set_allocator(const ece_allocator_t* allocator) {
+  ece_global_allocator = allocator ? *allocator : ece_default_allocator;
+}
+
+void
+ece_set_thread_allocator(const ece_allocator_t* allocator) {
+  if (!allocator) {
+    ece_has_thread_allocator = false;
+    return;
+  }
+  ece_thread_allocator = *allocator;
+  ece_has_thread_allocator = true;
+}
+
+static void*
+ece_openssl_malloc(size_t size, const char* file, int line) {
+  ECE_UNUSED(file);
+  ECE_UNUSED(line);
+  return ece_openssl_allocator.alloc(ece_openssl_allocator.opaque, size);
+}
+
+static void*
+ece_openssl_realloc(void* ptr, size_t size, const char* file, int line) {
+  ECE_UNUSED(file);
+  ECE_UNUSED(line);
+  return ece_openssl_allocator.realloc(ece_openssl_allocator.opaque, ptr,
+                                       size);
+}
+
+static void
+ece_openssl_free(void* ptr, const char* file, int line) {
+  ECE_UNUSED(file);
+  ECE_UNUSED(line);
+  if (ptr) {
+    ece_openssl_allocator.free(ece_openssl_allocator.opaque, ptr);
+  }
+}
+
+int
+ece_set_openssl_allocator(const ece_allocator_t* allocator) {
+  // Unlike our own allocators, OpenSSL's can only be set once, so there's no
+  // default for `NULL` to restore.
+  if (!allocator) {
+    return ECE_ERROR_ALLOCATOR;
+  }
+  ece_allocator_t prevAllocator = ece_openssl_allocator;
+  ece_openssl_allocator = *allocator;
+  if (CRYPTO_set_mem_functions(&ece_openssl_malloc, &ece_openssl_realloc,
+                               &ece_openssl_free) != 1) {
+    ece_openssl_allocator = prevAllocator;
+    return ECE_ERROR_ALLOCATOR;
+  }
+  return ECE_OK;
+}
+
+void*
+ece_malloc(size_t size) {
+  const ece_allocator_t* allocator = ece_current_allocator();
+  return allocator->alloc(allocator->opaque, size);
+}
+
+void*
+ece_calloc(size_t count, size_t size) {
+  if (size && count > SIZE_MAX / size) {
+    return NULL;
+  }
+  void* ptr = ece_malloc(count * size);
+  if (ptr) {
+    memset(ptr, 0, count * size);
+  }
+  return ptr;
+}
+
+void*
+ece_realloc(void* ptr, size_t size) {
+  const ece_allocator_t* allocator = ece_current_allocator();
+  return allocator->realloc(allocator->opaque, ptr, size);
+}
+
+void
+ece_free(void* ptr) {
+  if (!ptr) {
+    return;
+  }
+  const ece_allocator_t* allocator = ece_current_allocator();
+  allocator->free(allocator->opaque, ptr);
+}
+
+void
+ece_arena_init(ece_arena_t* arena, void* buffer, size_t len) {
+  arena->buffer = buffer;
+  arena->len = len;
+  arena->used = 0;
+  arena->peak = 0;
+}
+
+void
+ece_arena_reset(ece_arena_t* arena) {
+  arena->used = 0;
+}
+
+static inline ece_arena_header_t*
+ece_arena_header(void* ptr) {
+  return (ece_arena_header_t*) ((uint8_t*) ptr - ECE_ARENA_ALIGNMENT);
+}
+
+// Indicates if `ptr` is the most recent allocation, which can be resized or
+// freed in place.
+static inline bool
+ece_arena_is_last(const ece_arena_t* arena, void* ptr) {
+  const ece_arena_header_t* header = ece_arena_header(ptr);
+  return (uint8_t*) ptr + header->size == &arena->buffer[arena->used];
+}
+
+static void*
+ece_arena_alloc(void* opaque, size_t size) {
+  ece_arena_t* arena = opaque;
+  // Leave room for the header, then round the allocation's address up.
+  uintptr_t address = (uintptr_t) &arena->buffer[arena->used];
+  size_t offset = ECE_ARENA_ALIGNMENT +
+                  ((ECE_ARENA_ALIGNMENT - address % ECE_ARENA_ALIGNMENT) %
+                   ECE_ARENA_ALIGNMENT);
+  size_t available = arena->len - arena->used;
+  if (offset > available || size > available - offset) {
+    return NULL;
+  }
+  uint8_t* ptr = &arena->buffer[arena->used + offset];
+  ece_arena_header_t* header = ece_arena_header(ptr);
+  header->prevUsed = arena->used;
+  header->size = size;
+  arena->used += offset + size;
+  if (arena->used > arena->peak) {
+    arena->peak = arena->used;
+  }
+  return ptr;
+}
+
+static void
+ece_arena_free(void* opaque, void* ptr) {
+  ece_arena_t* arena = opaque;
+  if (ece_arena_is_last(arena, ptr)) {
+    arena->used = ece_arena_header(ptr)->prevUsed;
+  }
+}
+
+static void*
+ece_arena_realloc(void* opaque, void* ptr, size_t size) {
+  ece_arena_t* arena = opaque;
+  if (!ptr) {
+    return ece_arena_alloc(opaque, size);
+  }
+  ece_arena_header_t* header = ece_arena_header(ptr);
+  if (ece_arena_is_last(arena, ptr)) {
+    // Grow or shrink the most recent allocation in place.
+    size_t start = (size_t) ((uint8_t*) ptr - arena->buffer);
+    if (size > arena->len - start) {
+      return NULL;
+    }
+    header->size = size;
+    arena->used = start + size;
+    if (arena->used > arena->peak) {
+      arena->peak = arena->used;
+    }
+    return ptr;
+  }
+  if (size <= header->size) {
+    header->size = size;
+    return ptr;
+  }
+  void* newPtr = ece_arena_alloc(opaque, size);
+  if (!newPtr) {
+    return NULL;
+  }
+  memcpy(newPtr, ptr, header->size);
+  return newPtr;
+}
+
+void
+ece_arena_allocator(ece_arena_t* arena, ece_allocator_t* allocator) {
+  allocator->alloc = &ece_arena_alloc;
+  allocator->realloc = &ece_arena_realloc;
+  allocator->free = &ece_arena_free;
+  allocator->opaque = arena;
+}
+
+size_t
+ece_scratch_size(uint32_t rs, size_t ikmLen) {
+  // The contexts, the input keying material, and a record buffer. For
+  // "aesgcm", the encrypted record size includes the tag.
+  return ECE_MAX_CONTEXTS *
+           ECE_ARENA_ALLOCATION_LENGTH(ECE_MAX_CONTEXT_LENGTH) +
+         ECE_ARENA_ALLOCATION_LENGTH(ikmLen ? ikmLen : 1) +
+         ECE_ARENA_ALLOCATION_LENGTH((size_t) rs + ECE_TAG_LENGTH);
+}
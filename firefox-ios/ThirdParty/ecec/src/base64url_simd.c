@@ -0,0 +1,562 @@
+#include "ece/base64url.h"
+
+#include <string.h>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define ECE_BASE64URL_HAVE_X86
+#endif
+
+#if defined(__aarch64__) || defined(_M_ARM64)
+#define ECE_BASE64URL_HAVE_NEON
+#endif
+
+#ifdef ECE_BASE64URL_HAVE_X86
+#ifdef _MSC_VER
+#include <intrin.h>
+#include <immintrin.h>
+#define ECE_BASE64URL_TARGET_SSE41
+#define ECE_BASE64URL_TARGET_AVX2
+#else
+#include <cpuid.h>
+#include <immintrin.h>
+// The kernels are compiled for SSE4.1 and AVX2 even if the rest of the library
+// isn't, and only called if the CPU supports them.
+#define ECE_BASE64URL_TARGET_SSE41 __attribute__((target("sse4.1")))
+#define ECE_BASE64URL_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif /* ECE_BASE64URL_HAVE_X86 */
+
+#ifdef ECE_BASE64URL_HAVE_NEON
+#include <arm_neon.h>
+#endif
+
+static const char ece_base64url_alphabet[] =
+  "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-_";
+
+// Returns the 6-bit value of a Base64url character, or -1 if the character
+// isn't in the alphabet.
+static inline int
+ece_base64url_value(char c) {
+  if (c >= 'A' && c <= 'Z') {
+    return c - 'A';
+  }
+  if (c >= 'a' && c <= 'z') {
+    return c - 'a' + 26;
+  }
+  if (c >= '0' && c <= '9') {
+    return c - '0' + 52;
+  }
+  if (c == '-') {
+    return 62;
+  }
+  if (c == '_') {
+    return 63;
+  }
+  return -1;
+}
+
+static size_t
+ece_base64url_encode_scalar(const uint8_t* binary, size_t binaryLen,
+                            char* base64) {
+  size_t i = 0;
+  for (; binaryLen - i >= 3; i += 3) {
+    uint32_t group = ((uint32_t) binary[i] << 16) |
+                     ((uint32_t) binary[i + 1] << 8) | binary[i + 2];
+    *base64++ = ece_base64url_alphabet[(group >> 18) & 0x3f];
+    *base64++ = ece_base64url_alphabet[(group >> 12) & 0x3f];
+    *base64++ = ece_base64url_alphabet[(group >> 6) & 0x3f];
+    *base64++ = ece_base64url_alphabet[group & 0x3f];
+  }
+  return i;
+}
+
+static size_t
+ece_base64url_decode_scalar(const char* base64, size_t base64Len,
+                            uint8_t* binary) {
+  size_t i = 0;
+  for (; base64Len - i >= 4; i += 4) {
+    int a = ece_base64url_value(base64[i]);
+    int b = ece_base64url_value(base64[i + 1]);
+    int c = ece_base64url_value(base64[i + 2]);
+    int d = ece_base64url_value(base64[i + 3]);
+    if ((a | b | c | d) < 0) {
+      break;
+    }
+    uint32_t quantum = ((uint32_t) a << 18) | ((uint32_t) b << 12) |
+                       ((uint32_t) c << 6) | (uint32_t) d;
+    *binary++ = (uint8_t)(quantum >> 16);
+    *binary++ = (uint8_t)(quantum >> 8);
+    *binary++ = (uint8_t) quantum;
+  }
+  return i;
+}
+
+#ifdef ECE_BASE64URL_HAVE_X86
+
+// Probes for SSE4.1, and for AVX2 with OS support for the YMM registers.
+static void
+ece_base64url_cpu_features(bool* hasSse41, bool* hasAvx2) {
+  unsigned int ecx, ebx7;
+#ifdef _MSC_VER
+  int info[4];
+  __cpuid(info, 0);
+  int maxLeaf = info[0];
+  __cpuid(info, 1);
+  ecx = (unsigned int) info[2];
+  ebx7 = 0;
+  if (maxLeaf >= 7) {
+    __cpuidex(info, 7, 0);
+    ebx7 = (unsigned int) info[1];
+  }
+#else
+  unsigned int eax, ebx, edx;
+  if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx)) {
+    *hasSse41 = false;
+    *hasAvx2 = false;
+    return;
+  }
+  ebx7 = 0;
+  if (__get_cpuid_max(0, NULL) >= 7) {
+    unsigned int eax7, ecx7, edx7;
+    __cpuid_count(7, 0, eax7, ebx7, ecx7, edx7);
+    ECE_UNUSED(eax7);
+    ECE_UNUSED(ecx7);
+    ECE_UNUSED(edx7);
+  }
+#endif
+  // SSSE3 is bit 9, and SSE4.1 is bit 19.
+  *hasSse41 = (ecx & (1u << 9)) && (ecx & (1u << 19));
+  // AVX2 is bit 5 of leaf 7. The OS must also save the YMM registers: OSXSAVE
+  // is bit 27 of leaf 1, AVX is bit 28, and XCR0 must enable SSE and AVX state.
+  *hasAvx2 = false;
+  if ((ebx7 & (1u << 5)) && (ecx & (1u << 27)) && (ecx & (1u << 28))) {
+#ifdef _MSC_VER
+    unsigned long long xcr0 = _xgetbv(0);
+#else
+    unsigned int xcr0Lo, xcr0Hi;
+    __asm__("xgetbv" : "=a"(xcr0Lo), "=d"(xcr0Hi) : "c"(0));
+    ECE_UNUSED(xcr0Hi);
+    unsigned long long xcr0 = xcr0Lo;
+#endif
+    *hasAvx2 = (xcr0 & 6) == 6;
+  }
+}
+
+// Splits each 3-byte group in the low 12 bytes of `in` into four 6-bit
+// values, one per byte.
+ECE_BASE64URL_TARGET_SSE41 static inline __m128i
+ece_base64url_split_sse41(__m128i in) {
+  in = _mm_shuffle_epi8(
+    in, _mm_setr_epi8(1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10));
+  __m128i hi = _mm_mulhi_epu16(_mm_and_si128(in, _mm_set1_epi32(0x0fc0fc00)),
+                               _mm_set1_epi32(0x04000040));
+  __m128i lo = _mm_mullo_epi16(_mm_and_si128(in, _mm_set1_epi32(0x003f03f0)),
+                               _mm_set1_epi32(0x01000010));
+  return _mm_or_si128(hi, lo);
+}
+
+// Maps 6-bit values to Base64url characters. Each value is sorted into one of
+// the alphabet's ranges, and the range selects the offset to add.
+ECE_BASE64URL_TARGET_SSE41 static inline __m128i
+ece_base64url_translate_sse41(__m128i values) {
+  // 0 for "a-z", 1-10 for "0-9", 11 for "-", 12 for "_", and 13 for "A-Z".
+  __m128i ranges = _mm_subs_epu8(values, _mm_set1_epi8(51));
+  __m128i upper = _mm_cmpgt_epi8(_mm_set1_epi8(26), values);
+  ranges = _mm_or_si128(ranges, _mm_and_si128(upper, _mm_set1_epi8(13)));
+  __m128i offsets = _mm_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52,
+                                  '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                                  '0' - 52, '0' - 52, '0' - 52, '-' - 62,
+                                  '_' - 63, 'A', 0, 0);
+  return _mm_add_epi8(values, _mm_shuffle_epi8(offsets, ranges));
+}
+
+// Maps Base64url characters to their 6-bit values. Returns false if any
+// character isn't in the alphabet. Signed comparisons reject characters above
+// 0x7f, since they compare as negative.
+ECE_BASE64URL_TARGET_SSE41 static inline bool
+ece_base64url_lookup_sse41(__m128i in, __m128i* values) {
+  __m128i upper = _mm_and_si128(_mm_cmpgt_epi8(in, _mm_set1_epi8('A' - 1)),
+                                _mm_cmpgt_epi8(_mm_set1_epi8('Z' + 1), in));
+  __m128i lower = _mm_and_si128(_mm_cmpgt_epi8(in, _mm_set1_epi8('a' - 1)),
+                                _mm_cmpgt_epi8(_mm_set1_epi8('z' + 1), in));
+  __m128i digit = _mm_and_si128(_mm_cmpgt_epi8(in, _mm_set1_epi8('0' - 1)),
+                                _mm_cmpgt_epi8(_mm_set1_epi8('9' + 1), in));
+  __m128i dash = _mm_cmpeq_epi8(in, _mm_set1_epi8('-'));
+  __m128i underscore = _mm_cmpeq_epi8(in, _mm_set1_epi8('_'));
+  __m128i valid = _mm_or_si128(_mm_or_si128(upper, lower),
+                               _mm_or_si128(_mm_or_si128(digit, dash),
+                                            underscore));
+  if (_mm_movemask_epi8(valid) != 0xffff) {
+    return false;
+  }
+  __m128i offsets = _mm_or_si128(
+    _mm_or_si128(_mm_and_si128(upper, _mm_set1_epi8(-'A')),
+                 _mm_and_si128(lower, _mm_set1_epi8(26 - 'a'))),
+    _mm_or_si128(_mm_or_si128(_mm_and_si128(digit, _mm_set1_epi8(52 - '0')),
+                              _mm_and_si128(dash, _mm_set1_epi8(62 - '-'))),
+                 _mm_and_si128(underscore, _mm_set1_epi8(63 - '_'))));
+  *values = _mm_add_epi8(in, offsets);
+  return true;
+}
+
+// Packs each group of four 6-bit values into three bytes, in the low 12 bytes
+// of the result.
+ECE_BASE64URL_TARGET_SSE41 static inline __m128i
+ece_base64url_pack_sse41(__m128i values) {
+  __m128i pairs = _mm_maddubs_epi16(values, _mm_set1_epi32(0x01400140));
+  __m128i groups = _mm_madd_epi16(pairs, _mm_set1_epi32(0x00011000));
+  return _mm_shuffle_epi8(groups, _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14,
+                                                13, 12, -1, -1, -1, -1));
+}
+
+// Stores the low 12 bytes of `bytes`.
+ECE_BASE64URL_TARGET_SSE41 static inline void
+ece_base64url_store12_sse41(uint8_t* binary, __m128i bytes) {
+  _mm_storel_epi64((__m128i*) binary, bytes);
+  uint32_t tail = (uint32_t) _mm_cvtsi128_si32(_mm_srli_si128(bytes, 8));
+  memcpy(&binary[8], &tail, sizeof(tail));
+}
+
+ECE_BASE64URL_TARGET_SSE41 static size_t
+ece_base64url_encode_sse41(const uint8_t* binary, size_t binaryLen,
+                           char* base64) {
+  size_t i = 0;
+  // Each iteration loads 16 bytes, but only encodes the first 12.
+  for (; binaryLen - i >= 16; i += 12) {
+    __m128i in = _mm_loadu_si128((const __m128i*) &binary[i]);
+    __m128i out = ece_base64url_translate_sse41(ece_base64url_split_sse41(in));
+    _mm_storeu_si128((__m128i*) base64, out);
+    base64 += 16;
+  }
+  return i;
+}
+
+ECE_BASE64URL_TARGET_SSE41 static size_t
+ece_base64url_decode_sse41(const char* base64, size_t base64Len,
+                           uint8_t* binary) {
+  size_t i = 0;
+  for (; base64Len - i >= 16; i += 16) {
+    __m128i in = _mm_loadu_si128((const __m128i*) &base64[i]);
+    __m128i values;
+    if (!ece_base64url_lookup_sse41(in, &values)) {
+      break;
+    }
+    ece_base64url_store12_sse41(binary, ece_base64url_pack_sse41(values));
+    binary += 12;
+  }
+  return i;
+}
+
+// The AVX2 kernels run the SSE4.1 steps on both 128-bit lanes at once, since
+// the byte shuffles don't cross lanes.
+ECE_BASE64URL_TARGET_AVX2 static inline __m256i
+ece_base64url_split_avx2(__m256i in) {
+  in = _mm256_shuffle_epi8(
+    in, _mm256_setr_epi8(1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10, 1,
+                         0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10));
+  __m256i hi =
+    _mm256_mulhi_epu16(_mm256_and_si256(in, _mm256_set1_epi32(0x0fc0fc00)),
+                       _mm256_set1_epi32(0x04000040));
+  __m256i lo =
+    _mm256_mullo_epi16(_mm256_and_si256(in, _mm256_set1_epi32(0x003f03f0)),
+                       _mm256_set1_epi32(0x01000010));
+  return _mm256_or_si256(hi, lo);
+}
+
+ECE_BASE64URL_TARGET_AVX2 static inline __m256i
+ece_base64url_translate_avx2(__m256i values) {
+  __m256i ranges = _mm256_subs_epu8(values, _mm256_set1_epi8(51));
+  __m256i upper = _mm256_cmpgt_epi8(_mm256_set1_epi8(26), values);
+  ranges =
+    _mm256_or_si256(ranges, _mm256_and_si256(upper, _mm256_set1_epi8(13)));
+  __m256i offsets = _mm256_setr_epi8(
+    'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+    '0' - 52, '0' - 52, '0' - 52, '0' - 52, '-' - 62, '_' - 63, 'A', 0, 0,
+    'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+    '0' - 52, '0' - 52, '0' - 52, '0' - 52, '-' - 62, '_' - 63, 'A', 0, 0);
+  return _mm256_add_epi8(values, _mm256_shuffle_epi8(offsets, ranges));
+}
+
+ECE_BASE64URL_TARGET_AVX2 static inline bool
+ece_base64url_lookup_avx2(__m256i in, __m256i* values) {
+  __m256i upper =
+    _mm256_and_si256(_mm256_cmpgt_epi8(in, _mm256_set1_epi8('A' - 1)),
+                     _mm256_cmpgt_epi8(_mm256_set1_epi8('Z' + 1), in));
+  __m256i lower =
+    _mm256_and_si256(_mm256_cmpgt_epi8(in, _mm256_set1_epi8('a' - 1)),
+                     _mm256_cmpgt_epi8(_mm256_set1_epi8('z' + 1), in));
+  __m256i digit =
+    _mm256_and_si256(_mm256_cmpgt_epi8(in, _mm256_set1_epi8('0' - 1)),
+                     _mm256_cmpgt_epi8(_mm256_set1_epi8('9' + 1), in));
+  __m256i dash = _mm256_cmpeq_epi8(in, _mm256_set1_epi8('-'));
+  __m256i underscore = _mm256_cmpeq_epi8(in, _mm256_set1_epi8('_'));
+  __m256i valid = _mm256_or_si256(_mm256_or_si256(upper, lower),
+                                  _mm256_or_si256(_mm256_or_si256(digit, dash),
+                                                  underscore));
+  if ((uint32_t) _mm256_movemask_epi8(valid) != 0xffffffff) {
+    return false;
+  }
+  __m256i offsets = _mm256_or_si256(
+    _mm256_or_si256(_mm256_and_si256(upper, _mm256_set1_epi8(-'A')),
+                    _mm256_and_si256(lower, _mm256_set1_epi8(26 - 'a'))),
+    _mm256_or_si256(
+      _mm256_or_si256(_mm256_and_si256(digit, _mm256_set1_epi8(52 - '0')),
+                      _mm256_and_si256(dash, _mm256_set1_epi8(62 - '-'))),
+      _mm256_and_si256(underscore, _mm256_set1_epi8(63 - '_'))));
+  *values = _mm256_add_epi8(in, offsets);
+  return true;
+}
+
+ECE_BASE64URL_TARGET_AVX2 static size_t
+ece_base64url_encode_avx2(const uint8_t* binary, size_t binaryLen,
+                          char* base64) {
+  size_t i = 0;
+  // Each lane loads 16 bytes, but only encodes the first 12. The second lane
+  // starts 12 bytes after the first, so each iteration reads 28 bytes.
+  for (; binaryLen - i >= 28; i += 24) {
+    __m256i in = _mm256_inserti128_si256(
+      _mm256_castsi128_si256(_mm_loadu_si128((const __m128i*) &binary[i])),
+      _mm_loadu_si128((const __m128i*) &binary[i + 12]), 1);
+    __m256i out = ece_base64url_translate_avx2(ece_base64url_split_avx2(in));
+    _mm256_storeu_si256((__m256i*) base64, out);
+    base64 += 32;
+  }
+  return i + ece_base64url_encode_sse41(&binary[i], binaryLen - i, base64);
+}
+
+ECE_BASE64URL_TARGET_AVX2 static size_t
+ece_base64url_decode_avx2(const char* base64, size_t base64Len,
+                          uint8_t* binary) {
+  size_t i = 0;
+  for (; base64Len - i >= 32; i += 32) {
+    __m256i in = _mm256_loadu_si256((const __m256i*) &base64[i]);
+    __m256i values;
+    if (!ece_base64url_lookup_avx2(in, &values)) {
+      break;
+    }
+    __m256i pairs =
+      _mm256_maddubs_epi16(values, _mm256_set1_epi32(0x01400140));
+    __m256i groups = _mm256_madd_epi16(pairs, _mm256_set1_epi32(0x00011000));
+    __m256i bytes = _mm256_shuffle_epi8(
+      groups, _mm256_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1,
+                               -1, -1, 2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12,
+                               -1, -1, -1, -1));
+    // Move the 12 bytes from the upper lane next to the 12 from the lower
+    // lane, then store all 24.
+    bytes = _mm256_permutevar8x32_epi32(bytes,
+                                        _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 3,
+                                                          7));
+    _mm_storeu_si128((__m128i*) binary, _mm256_castsi256_si128(bytes));
+    _mm_storel_epi64((__m128i*) &binary[16],
+                     _mm256_extracti128_si256(bytes, 1));
+    binary += 24;
+  }
+  return i + ece_base64url_decode_sse41(&base64[i], base64Len - i, binary);
+}
+
+#endif /* ECE_BASE64URL_HAVE_X86 */
+
+#ifdef ECE_BASE64URL_HAVE_NEON
+
+static size_t
+ece_base64url_encode_neon(const uint8_t* binary, size_t binaryLen,
+                          char* base64) {
+  const uint8_t* alphabet = (const uint8_t*) ece_base64url_alphabet;
+  uint8x16x4_t table;
+  table.val[0] = vld1q_u8(alphabet);
+  table.val[1] = vld1q_u8(&alphabet[16]);
+  table.val[2] = vld1q_u8(&alphabet[32]);
+  table.val[3] = vld1q_u8(&alphabet[48]);
+  uint8x16_t mask = vdupq_n_u8(0x3f);
+  size_t i = 0;
+  for (; binaryLen - i >= 48; i += 48) {
+    // Deinterleave the 16 groups, so that each register holds one byte from
+    // every group.
+    uint8x16x3_t in = vld3q_u8(&binary[i]);
+    uint8x16x4_t out;
+    out.val[0] = vshrq_n_u8(in.val[0], 2);
+    out.val[1] = vandq_u8(
+      vorrq_u8(vshlq_n_u8(in.val[0], 4), vshrq_n_u8(in.val[1], 4)), mask);
+    out.val[2] = vandq_u8(
+      vorrq_u8(vshlq_n_u8(in.val[1], 2), vshrq_n_u8(in.val[2], 6)), mask);
+    out.val[3] = vandq_u8(in.val[2], mask);
+    for (size_t j = 0; j < 4; j++) {
+      out.val[j] = vqtbl4q_u8(table, out.val[j]);
+    }
+    vst4q_u8((uint8_t*) base64, out);
+    base64 += 64;
+  }
+  return i;
+}
+
+// Maps Base64url characters to their 6-bit values, and clears the lanes of
+// `valid` for characters that aren't in the alphabet.
+static inline uint8x16_t
+ece_base64url_lookup_neon(uint8x16_t in, uint8x16_t* valid) {
+  uint8x16_t upper =
+    vandq_u8(vcgeq_u8(in, vdupq_n_u8('A')), vcleq_u8(in, vdupq_n_u8('Z')));
+  uint8x16_t lower =
+    vandq_u8(vcgeq_u8(in, vdupq_n_u8('a')), vcleq_u8(in, vdupq_n_u8('z')));
+  uint8x16_t digit =
+    vandq_u8(vcgeq_u8(in, vdupq_n_u8('0')), vcleq_u8(in, vdupq_n_u8('9')));
+  uint8x16_t dash = vceqq_u8(in, vdupq_n_u8('-'));
+  uint8x16_t underscore = vceqq_u8(in, vdupq_n_u8('_'));
+  *valid = vandq_u8(*valid, vorrq_u8(vorrq_u8(upper, lower),
+                                     vorrq_u8(vorrq_u8(digit, dash),
+                                              underscore)));
+  uint8x16_t offsets = vorrq_u8(
+    vorrq_u8(vandq_u8(upper, vdupq_n_u8((uint8_t)(0 - 'A'))),
+             vandq_u8(lower, vdupq_n_u8((uint8_t)(26 - 'a')))),
+    vorrq_u8(vorrq_u8(vandq_u8(digit, vdupq_n_u8((uint8_t)(52 - '0'))),
+                      vandq_u8(dash, vdupq_n_u8((uint8_t)(62 - '-')))),
+             vandq_u8(underscore, vdupq_n_u8((uint8_t)(63 - '_')))));
+  return vaddq_u8(in, offsets);
+}
+
+static size_t
+ece_base64url_decode_neon(const char* base64, size_t base64Len,
+                          uint8_t* binary) {
+  size_t i = 0;
+  for (; base64Len - i >= 64; i += 64) {
+    uint8x16x4_t in = vld4q_u8((const uint8_t*) &base64[i]);
+    uint8x16_t valid = vdupq_n_u8(0xff);
+    uint8x16_t a = ece_base64url_lookup_neon(in.val[0], &valid);
+    uint8x16_t b = ece_base64url_lookup_neon(in.val[1], &valid);
+    uint8x16_t c = ece_base64url_lookup_neon(in.val[2], &valid);
+    uint8x16_t d = ece_base64url_lookup_neon(in.val[3], &valid);
+    if (vminvq_u8(valid) != 0xff) {
+      break;
+    }
+    uint8x16x3_t out;
+    out.val[0] = vorrq_u8(vshlq_n_u8(a, 2), vshrq_n_u8(b, 4));
+    out.val[1] = vorrq_u8(vshlq_n_u8(b, 4), vshrq_n_u8(c, 2));
+    out.val[2] = vorrq_u8(vshlq_n_u8(c, 6), d);
+    vst3q_u8(binary, out);
+    binary += 48;
+  }
+  return i;
+}
+
+#endif /* ECE_BASE64URL_HAVE_NEON */
+
+bool
+ece_base64url_impl_supported(ece_base64url_impl_t impl) {
+#ifdef ECE_BASE64URL_HAVE_X86
+  bool hasSse41, hasAvx2;
+#endif
+  switch (impl) {
+  case ECE_BASE64URL_IMPL_SCALAR:
+    return true;
+  case ECE_BASE64URL_IMPL_SSE41:
+#ifdef ECE_BASE64URL_HAVE_X86
+    ece_base64url_cpu_features(&hasSse41, &hasAvx2);
+    return hasSse41;
+#else
+    return false;
+#endif
+  case ECE_BASE64URL_IMPL_AVX2:
+#ifdef ECE_BASE64URL_HAVE_X86
+    // The AVX2 kernels finish with the SSE4.1 kernels.
+    ece_base64url_cpu_features(&hasSse41, &hasAvx2);
+    return hasSse41 && hasAvx2;
+#else
+    return false;
+#endif
+  case ECE_BASE64URL_IMPL_NEON:
+#ifdef ECE_BASE64URL_HAVE_NEON
+    // NEON is part of the base AArch64 instruction set.
+    return true;
+#else
+    return false;
+#endif
+  }
+  return false;
+}
+
+ece_base64url_impl_t
+ece_base64url_best_impl(void) {
+  // 0 means we haven't probed the CPU yet. Concurrent first calls may both
+  // probe, but they'll store the same value.
+  static volatile int best = 0;
+  if (!best) {
+    ece_base64url_impl_t impl = ECE_BASE64URL_IMPL_SCALAR;
+    if (ece_base64url_impl_supported(ECE_BASE64URL_IMPL_NEON)) {
+      impl = ECE_BASE64URL_IMPL_NEON;
+    } else if (ece_base64url_impl_supported(ECE_BASE64URL_IMPL_AVX2)) {
+      impl = ECE_BASE64URL_IMPL_AVX2;
+    } else if (ece_base64url_impl_supported(ECE_BASE64URL_IMPL_SSE41)) {
+      impl = ECE_BASE64URL_IMPL_SSE41;
+    }
+    best = (int) impl + 1;
+  }
+  return (ece_base64url_impl_t)(best - 1);
+}
+
+size_t
+ece_base64url_encode_blocks_impl(ece_base64url_impl_t impl,
+                                 const uint8_t* binary, size_t binaryLen,
+                                 char* base64) {
+  size_t i = 0;
+  switch (impl) {
+#ifdef ECE_BASE64URL_HAVE_X86
+  case ECE_BASE64URL_IMPL_SSE41:
+    i = ece_base64url_encode_sse41(binary, binaryLen, base64);
+    break;
+  case ECE_BASE64URL_IMPL_AVX2:
+    i = ece_base64url_encode_avx2(binary, binaryLen, base64);
+    break;
+#endif
+#ifdef ECE_BASE64URL_HAVE_NEON
+  case ECE_BASE64URL_IMPL_NEON:
+    i = ece_base64url_encode_neon(binary, binaryLen, base64);
+    break;
+#endif
+  default:
+    break;
+  }
+  // The kernels leave a tail of fewer than one vector for the scalar code.
+  return i + ece_base64url_encode_scalar(&binary[i], binaryLen - i,
+                                         &base64[i / 3 * 4]);
+}
+
+size_t
+ece_base64url_decode_blocks_impl(ece_base64url_impl_t impl,
+                                 const char* base64, size_t base64Len,
+                                 uint8_t* binary) {
+  size_t i = 0;
+  switch (impl) {
+#ifdef ECE_BASE64URL_HAVE_X86
+  case ECE_BASE64URL_IMPL_SSE41:
+    i = ece_base64url_decode_sse41(base64, base64Len, binary);
+    break;
+  case ECE_BASE64URL_IMPL_AVX2:
+    i = ece_base64url_decode_avx2(base64, base64Len, binary);
+    break;
+#endif
+#ifdef ECE_BASE64URL_HAVE_NEON
+  case ECE_BASE64URL_IMPL_NEON:
+    i = ece_base64url_decode_neon(base64, base64Len, binary);
+    break;
+#endif
+  default:
+    break;
+  }
+  // The kernels stop at the first vector with a character outside the
+  // alphabet, so the scalar code finds the exact quantum where decoding stops.
+  return i + ece_base64url_decode_scalar(&base64[i], base64Len - i,
+                                         &binary[i / 4 * 3]);
+}
+
+size_t
+ece_base64url_encode_blocks(const uint8_t* binary, size_t binaryLen,
+                            char* base64) {
+  return ece_base64url_encode_blocks_impl(ece_base64url_best_impl(), binary,
+                                          binaryLen, base64);
+}
+
+size_t
+ece_base64url_decode_blocks(const char* base64, size_t base64Len,
+                            uint8_t* binary) {
+  return ece_base64url_decode_blocks_impl(ece_base64url_best_impl(), base64,
+                                          base64Len, binary);
+}
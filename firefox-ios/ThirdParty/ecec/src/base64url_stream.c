@@ -0,0 +1,323 @@
+#include "ece/base64url.h"
+
+#include <string.h>
+
+#include <openssl/crypto.h>
+
+// Indicates if `c` is in the Base64url alphabet. "=" is handled separately.
+static inline bool
+ece_base64url_is_alphabet(char c) {
+  return (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z') ||
+         (c >= '0' && c <= '9') || c == '-' || c == '_';
+}
+
+void
+ece_base64url_encoder_init(ece_base64url_encoder_t* encoder,
+                           ece_base64url_encode_policy_t paddingPolicy) {
+  OPENSSL_cleanse(encoder, sizeof(ece_base64url_encoder_t));
+  encoder->paddingPolicy = paddingPolicy;
+}
+
+size_t
+ece_base64url_encode_update_max_length(const ece_base64url_encoder_t* encoder,
+                                       size_t binaryLen) {
+  return (encoder->pendingLen + binaryLen) / 3 * 4;
+}
+
+int
+ece_base64url_encode_update(ece_base64url_encoder_t* encoder,
+                            const void* binary, size_t binaryLen, char* base64,
+                            size_t* base64Len) {
+  if (*base64Len < ece_base64url_encode_update_max_length(encoder, binaryLen)) {
+    return ECE_ERROR_OUT_OF_MEMORY;
+  }
+  if (!binaryLen) {
+    *base64Len = 0;
+    return ECE_OK;
+  }
+  const uint8_t* bytes = binary;
+  size_t i = 0;
+  size_t outLen = 0;
+  if (encoder->pendingLen) {
+    if (encoder->pendingLen + binaryLen < 3) {
+      // Still not enough for a full group.
+      memcpy(&encoder->pending[encoder->pendingLen], bytes, binaryLen);
+      encoder->pendingLen += binaryLen;
+      *base64Len = 0;
+      return ECE_OK;
+    }
+    // Complete the group carried over from the last call.
+    uint8_t group[3];
+    memcpy(group, encoder->pending, encoder->pendingLen);
+    i = 3 - encoder->pendingLen;
+    memcpy(&group[encoder->pendingLen], bytes, i);
+    ece_base64url_encode_blocks(group, 3, base64);
+    outLen = 4;
+    encoder->pendingLen = 0;
+  }
+  size_t encodedLen =
+    ece_base64url_encode_blocks(&bytes[i], binaryLen - i, &base64[outLen]);
+  i += encodedLen;
+  outLen += encodedLen / 3 * 4;
+  encoder->pendingLen = binaryLen - i;
+  memcpy(encoder->pending, &bytes[i], encoder->pendingLen);
+  *base64Len = outLen;
+  return ECE_OK;
+}
+
+int
+ece_base64url_encode_final(ece_base64url_encoder_t* encoder, char* base64,
+                           size_t* base64Len) {
+  if (!encoder->pendingLen) {
+    *base64Len = 0;
+    return ECE_OK;
+  }
+  // 1 byte encodes to 2 characters, and 2 bytes to 3.
+  size_t dataLen = encoder->pendingLen + 1;
+  size_t outLen =
+    encoder->paddingPolicy == ECE_BASE64URL_INCLUDE_PADDING ? 4 : dataLen;
+  if (*base64Len < outLen) {
+    return ECE_ERROR_OUT_OF_MEMORY;
+  }
+  uint8_t group[3] = {0};
+  memcpy(group, encoder->pending, encoder->pendingLen);
+  char quantum[4];
+  ece_base64url_encode_blocks(group, 3, quantum);
+  memcpy(base64, quantum, dataLen);
+  memset(&base64[dataLen], '=', outLen - dataLen);
+  OPENSSL_cleanse(group, sizeof(group));
+  OPENSSL_cleanse(encoder->pending, sizeof(encoder->pending));
+  encoder->pendingLen = 0;
+  *base64Len = outLen;
+  return ECE_OK;
+}
+
+void
+ece_base64url_decoder_init(ece_base64url_decoder_t* decoder,
+                           ece_base64url_decode_policy_t paddingPolicy) {
+  OPENSSL_cleanse(decoder, sizeof(ece_base64url_decoder_t));
+  decoder->paddingPolicy = paddingPolicy;
+}
+
+size_t
+ece_base64url_decode_update_max_length(const ece_base64url_decoder_t* decoder,
+                                       size_t base64Len) {
+  return (decoder->pendingLen + base64Len) / 4 * 3;
+}
+
+int
+ece_base64url_decode_update(ece_base64url_decoder_t* decoder,
+                            const char* base64, size_t base64Len,
+                            uint8_t* binary, size_t* binaryLen) {
+  if (decoder->err) {
+    return decoder->err;
+  }
+  if (*binaryLen < ece_base64url_decode_update_max_length(decoder, base64Len)) {
+    return ECE_ERROR_OUT_OF_MEMORY;
+  }
+  int err = ECE_OK;
+  size_t i = 0;
+  size_t outLen = 0;
+  while (i < base64Len) {
+    if (decoder->padLen) {
+      // Only more padding can follow padding. `ece_base64url_decode` strips at
+      // most 2 trailing "=" characters.
+      if (base64[i] != '=' || decoder->padLen == 2) {
+        err = ECE_ERROR_INVALID_BASE64URL;
+        goto end;
+      }
+      decoder->padLen++;
+      i++;
+      continue;
+    }
+    if (!decoder->pendingLen) {
+      // Decode as many whole quanta as we can without copying. The kernels
+      // stop before the first quantum with padding or an invalid character,
+      // which we handle below.
+      size_t decodedLen = ece_base64url_decode_blocks(
+        &base64[i], base64Len - i, &binary[outLen]);
+      i += decodedLen;
+      outLen += decodedLen / 4 * 3;
+      decoder->dataLen += decodedLen;
+      if (i == base64Len) {
+        break;
+      }
+    }
+    char c = base64[i++];
+    if (c == '=') {
+      if (decoder->paddingPolicy == ECE_BASE64URL_REJECT_PADDING) {
+        err = ECE_ERROR_INVALID_BASE64URL;
+        goto end;
+      }
+      decoder->padLen = 1;
+      continue;
+    }
+    if (!ece_base64url_is_alphabet(c)) {
+      err = ECE_ERROR_INVALID_BASE64URL;
+      goto end;
+    }
+    decoder->pending[decoder->pendingLen++] = c;
+    decoder->dataLen++;
+    if (decoder->pendingLen == 4) {
+      ece_base64url_decode_blocks(decoder->pending, 4, &binary[outLen]);
+      outLen += 3;
+      decoder->pendingLen = 0;
+    }
+  }
+  *binaryLen = outLen;
+
+end:
+  if (err) {
+    OPENSSL_cleanse(decoder->pending, sizeof(decoder->pending));
+    decoder->err = err;
+  }
+  return err;
+}
+
+int
+ece_base64url_decode_final(ece_base64url_decoder_t* decoder, uint8_t* binary,
+                           size_t* binaryLen) {
+  if (decoder->err) {
+    return decoder->err;
+  }
+  int err = ECE_OK;
+  uint8_t group[3];
+
+  // A single trailing character doesn't encode a full byte.
+  if (decoder->pendingLen == 1) {
+    err = ECE_ERROR_INVALID_BASE64URL;
+    goto end;
+  }
+  if (decoder->padLen) {
+    // Padding must complete the last quantum.
+    if ((decoder->dataLen + decoder->padLen) % 4) {
+      err = ECE_ERROR_INVALID_BASE64URL;
+      goto end;
+    }
+  } else if (decoder->paddingPolicy == ECE_BASE64URL_REQUIRE_PADDING &&
+             decoder->pendingLen) {
+    err = ECE_ERROR_INVALID_BASE64URL;
+    goto end;
+  }
+  size_t outLen = decoder->pendingLen ? decoder->pendingLen - 1 : 0;
+  if (*binaryLen < outLen) {
+    // Leave the decoder as is, so that the caller can retry with a larger
+    // buffer.
+    return ECE_ERROR_OUT_OF_MEMORY;
+  }
+  if (outLen) {
+    // Fill the rest of the quantum with zero bits, and keep only the bytes
+    // that the trailing characters encode.
+    memset(&decoder->pending[decoder->pendingLen], 'A',
+           4 - decoder->pendingLen);
+    ece_base64url_decode_blocks(decoder->pending, 4, group);
+    memcpy(binary, group, outLen);
+  }
+  *binaryLen = outLen;
+
+end:
+  OPENSSL_cleanse(group, sizeof(group));
+  OPENSSL_cleanse(decoder->pending, sizeof(decoder->pending));
+  decoder->pendingLen = 0;
+  if (err) {
+    decoder->err = err;
+  }
+  return err;
+}
+
+void
+ece_base64url_reader_init(ece_base64url_reader_t* reader, const char* base64,
+                          size_t base64Len,
+                          ece_base64url_decode_policy_t paddingPolicy) {
+  ece_base64url_decoder_init(&reader->decoder, paddingPolicy);
+  reader->base64 = base64;
+  reader->base64Len = base64Len;
+  reader->carryStart = 0;
+  reader->carryLen = 0;
+  reader->done = false;
+}
+
+int
+ece_base64url_read(ece_base64url_reader_t* reader, uint8_t* bytes, size_t len,
+                   size_t* readLen) {
+  int err = ECE_OK;
+  size_t outLen = 0;
+  while (outLen < len) {
+    if (reader->carryLen) {
+      size_t chunkLen = reader->carryLen;
+      if (chunkLen > len - outLen) {
+        chunkLen = len - outLen;
+      }
+      memcpy(&bytes[outLen], &reader->carry[reader->carryStart], chunkLen);
+      reader->carryStart += chunkLen;
+      reader->carryLen -= chunkLen;
+      outLen += chunkLen;
+      continue;
+    }
+    if (reader->done) {
+      break;
+    }
+    // Decode as many whole groups as fit straight into `bytes`. The decoder
+    // only holds back characters after padding, or at the end of the input,
+    // so these never decode to more than `len - outLen` bytes.
+    size_t groupsLen = (len - outLen) / 3 * 4;
+    if (groupsLen > reader->base64Len / 4 * 4) {
+      groupsLen = reader->base64Len / 4 * 4;
+    }
+    if (groupsLen) {
+      size_t decodedLen = len - outLen;
+      err = ece_base64url_decode_update(&reader->decoder, reader->base64,
+                                        groupsLen, &bytes[outLen], &decodedLen);
+      if (err) {
+        goto end;
+      }
+      reader->base64 += groupsLen;
+      reader->base64Len -= groupsLen;
+      outLen += decodedLen;
+      continue;
+    }
+    // Decode the next group into the carry buffer. This happens when we need
+    // fewer than 3 more bytes, or have fewer than 4 characters left.
+    reader->carryStart = 0;
+    reader->carryLen = sizeof(reader->carry);
+    if (reader->base64Len) {
+      size_t chunkLen = reader->base64Len < 4 ? reader->base64Len : 4;
+      err = ece_base64url_decode_update(&reader->decoder, reader->base64,
+                                        chunkLen, reader->carry,
+                                        &reader->carryLen);
+      reader->base64 += chunkLen;
+      reader->base64Len -= chunkLen;
+    } else {
+      err = ece_base64url_decode_final(&reader->decoder, reader->carry,
+                                       &reader->carryLen);
+      reader->done = true;
+    }
+    if (err) {
+      reader->carryLen = 0;
+      goto end;
+    }
+  }
+  *readLen = outLen;
+
+end:
+  return err;
+}
+
+size_t
+ece_base64url_decode_max_length(size_t base64Len) {
+  // 2 trailing characters encode 1 byte, and 3 encode 2 bytes.
+  size_t tailLen = base64Len % 4;
+  return base64Len / 4 * 3 + (tailLen ? tailLen - 1 : 0);
+}
+
+size_t
+ece_base64url_reader_max_remaining(const ece_base64url_reader_t* reader) {
+  if (reader->done) {
+    return reader->carryLen;
+  }
+  // Include the bytes carried over from the last read, and the characters
+  // that the decoder is holding back.
+  return reader->carryLen +
+         ece_base64url_decode_max_length(reader->decoder.pendingLen +
+                                         reader->base64Len);
+}
@@ -0,0 +1,353 @@
+#ifdef ECE_HAVE_PTHREADS
+// `pthread.h` needs POSIX declarations, which aren't part of strict C99.
+#define _POSIX_C_SOURCE 200112L
+#endif
+
+#include "ece/cipher.h"
+
+#include "ece/alloc.h"
+#include "ece/rand.h"
+#include "ece/record.h"
+
+#include <string.h>
+
+#include <openssl/crypto.h>
+
+#ifdef ECE_HAVE_PTHREADS
+#include <pthread.h>
+#endif
+
+// The length of a key fingerprint, in 64-bit words. Fingerprints are 128
+// bits, like the keys themselves, so a false match is as unlikely as two
+// messages deriving the same key.
+#define ECE_CIPHER_KEY_ID_WORDS 2
+
+#define ECE_CIPHER_ROTL(x, b) (uint64_t)(((x) << (b)) | ((x) >> (64 - (b))))
+
+#define ECE_CIPHER_SIPROUND(v)                                                 \
+  do {                                                                         \
+    v[0] += v[1];                                                              \
+    v[1] = ECE_CIPHER_ROTL(v[1], 13);                                          \
+    v[1] ^= v[0];                                                              \
+    v[0] = ECE_CIPHER_ROTL(v[0], 32);                                          \
+    v[2] += v[3];                                                              \
+    v[3] = ECE_CIPHER_ROTL(v[3], 16);                                          \
+    v[3] ^= v[2];                                                              \
+    v[0] += v[3];                                                              \
+    v[3] = ECE_CIPHER_ROTL(v[3], 21);                                          \
+    v[3] ^= v[0];                                                              \
+    v[2] += v[1];                                                              \
+    v[1] = ECE_CIPHER_ROTL(v[1], 17);                                          \
+    v[1] ^= v[2];                                                              \
+    v[2] = ECE_CIPHER_ROTL(v[2], 32);                                          \
+  } while (0)
+
+// Pooled contexts stay keyed between calls, so that decrypting with the same
+// key again skips the key schedule. Each slot's expanded key stays in memory
+// until the slot is re-keyed for another key, `ece_cipher_pool_flush` is
+// called, or the thread exits; re-keying overwrites the old schedule, and
+// flushing frees the context, which clears it. To find a keyed slot, we
+// compare keyed fingerprints instead of keeping a second copy of each key.
+typedef struct ece_cipher_slot_s {
+  EVP_CIPHER_CTX* ctx;
+  // The fingerprint of the key, and the mode, that `ctx` is initialized
+  // with, if `hasKey` is set.
+  bool hasKey;
+  ece_mode_t mode;
+  uint64_t keyId[ECE_CIPHER_KEY_ID_WORDS];
+  bool inUse;
+  // The pool clock when the slot was last acquired or released. We re-key the
+  // least recently used slot first.
+  uint64_t lastUsed;
+} ece_cipher_slot_t;
+
+typedef struct ece_cipher_pool_s {
+  ece_cipher_slot_t slots[ECE_CIPHER_POOL_SIZE];
+  uint64_t clock;
+  ece_cipher_pool_stats_t stats;
+  // The random SipHash key for this pool's fingerprints, set when the pool
+  // is first used. Each pool has its own, so fingerprints can't be compared
+  // across threads or processes.
+  bool hasIdKey;
+  uint64_t idKey[2];
+} ece_cipher_pool_t;
+
+static uint64_t
+ece_cipher_read_le64(const uint8_t* bytes) {
+  uint64_t value = 0;
+  for (size_t i = 0; i < 8; i++) {
+    value |= (uint64_t) bytes[i] << (i * 8);
+  }
+  return value;
+}
+
+// Sets `keyId` to the 128-bit SipHash-2-4 of `key`, keyed with the pool's
+// `idKey`. SipHash is a PRF, so the fingerprint doesn't reveal the key, and
+// it's much cheaper to compute than re-keying a context.
+static void
+ece_cipher_pool_key_id(const ece_cipher_pool_t* pool, const uint8_t* key,
+                       uint64_t* keyId) {
+  uint64_t v[4] = {
+    0x736f6d6570736575ULL ^ pool->idKey[0],
+    0x646f72616e646f6dULL ^ pool->idKey[1] ^ 0xee,
+    0x6c7967656e657261ULL ^ pool->idKey[0],
+    0x7465646279746573ULL ^ pool->idKey[1],
+  };
+  for (size_t i = 0; i < ECE_AES_KEY_LENGTH; i += 8) {
+    uint64_t m = ece_cipher_read_le64(&key[i]);
+    v[3] ^= m;
+    ECE_CIPHER_SIPROUND(v);
+    ECE_CIPHER_SIPROUND(v);
+    v[0] ^= m;
+  }
+  // The last block holds the input length, with no trailing bytes.
+  uint64_t b = (uint64_t) ECE_AES_KEY_LENGTH << 56;
+  v[3] ^= b;
+  ECE_CIPHER_SIPROUND(v);
+  ECE_CIPHER_SIPROUND(v);
+  v[0] ^= b;
+  v[2] ^= 0xee;
+  for (size_t i = 0; i < 4; i++) {
+    ECE_CIPHER_SIPROUND(v);
+  }
+  keyId[0] = v[0] ^ v[1] ^ v[2] ^ v[3];
+  v[1] ^= 0xdd;
+  for (size_t i = 0; i < 4; i++) {
+    ECE_CIPHER_SIPROUND(v);
+  }
+  keyId[1] = v[0] ^ v[1] ^ v[2] ^ v[3];
+  OPENSSL_cleanse(v, sizeof(v));
+}
+
+// Draws the pool's fingerprint key, if it doesn't have one yet. Returns
+// `false` if the randomness source fails.
+static bool
+ece_cipher_pool_init_id_key(ece_cipher_pool_t* pool) {
+  if (pool->hasIdKey) {
+    return true;
+  }
+  uint8_t idKey[16];
+  if (!ece_rand_bytes(idKey, sizeof(idKey))) {
+    return false;
+  }
+  pool->idKey[0] = ece_cipher_read_le64(idKey);
+  pool->idKey[1] = ece_cipher_read_le64(&idKey[8]);
+  OPENSSL_cleanse(idKey, sizeof(idKey));
+  pool->hasIdKey = true;
+  return true;
+}
+
+// Frees all contexts that aren't in use, and clears their fingerprints.
+static void
+ece_cipher_pool_flush_slots(ece_cipher_pool_t* pool) {
+  for (size_t i = 0; i < ECE_CIPHER_POOL_SIZE; i++) {
+    ece_cipher_slot_t* slot = &pool->slots[i];
+    if (slot->inUse) {
+      continue;
+    }
+    EVP_CIPHER_CTX_free(slot->ctx);
+    OPENSSL_cleanse(slot, sizeof(ece_cipher_slot_t));
+  }
+}
+
+#ifdef ECE_HAVE_PTHREADS
+
+// Each thread's pool is stored in thread-specific data, so that its contexts
+// are freed when the thread exits. The pool itself comes from OpenSSL's
+// allocator, like the contexts it holds: it outlives any single call, so it
+// can't come from an arena that the caller might reset.
+static pthread_once_t ece_cipher_pool_once = PTHREAD_ONCE_INIT;
+static pthread_key_t ece_cipher_pool_key;
+static bool ece_cipher_pool_has_key = false;
+
+static void
+ece_cipher_pool_destroy(void* arg) {
+  ece_cipher_pool_t* pool = arg;
+  ece_cipher_pool_flush_slots(pool);
+  OPENSSL_clear_free(pool, sizeof(ece_cipher_pool_t));
+}
+
+static void
+ece_cipher_pool_create_key(void) {
+  ece_cipher_pool_has_key =
+    !pthread_key_create(&ece_cipher_pool_key, &ece_cipher_pool_destroy);
+}
+
+// Returns the calling thread's pool, creating it if `create` is set. Returns
+// `NULL` if the pool doesn't exist, or can't be created.
+static ece_cipher_pool_t*
+ece_cipher_pool_get(bool create) {
+  pthread_once(&ece_cipher_pool_once, &ece_cipher_pool_create_key);
+  if (!ece_cipher_pool_has_key) {
+    return NULL;
+  }
+  ece_cipher_pool_t* pool = pthread_getspecific(ece_cipher_pool_key);
+  if (pool || !create) {
+    return pool;
+  }
+  pool = OPENSSL_zalloc(sizeof(ece_cipher_pool_t));
+  if (!pool) {
+    return NULL;
+  }
+  if (!ece_cipher_pool_init_id_key(pool) ||
+      pthread_setspecific(ece_cipher_pool_key, pool)) {
+    OPENSSL_clear_free(pool, sizeof(ece_cipher_pool_t));
+    return NULL;
+  }
+  return pool;
+}
+
+#else
+
+// Without pthreads, there's no way to free the contexts when a thread exits.
+// Threads should call `ece_cipher_pool_flush` before exiting instead.
+static ECE_THREAD_LOCAL ece_cipher_pool_t ece_thread_cipher_pool;
+
+static ece_cipher_pool_t*
+ece_cipher_pool_get(bool create) {
+  ece_cipher_pool_t* pool = &ece_thread_cipher_pool;
+  if (create && !ece_cipher_pool_init_id_key(pool)) {
+    return NULL;
+  }
+  return pool;
+}
+
+#endif /* ECE_HAVE_PTHREADS */
+
+// Finds a free slot that's already keyed with the key for `keyId`, and sets
+// `isKeyed`. Otherwise, returns the least recently used free slot, or `NULL`
+// if all slots are in use.
+static ece_cipher_slot_t*
+ece_cipher_pool_find(ece_cipher_pool_t* pool, ece_mode_t mode,
+                     const uint64_t* keyId, bool* isKeyed) {
+  *isKeyed = false;
+  ece_cipher_slot_t* lruSlot = NULL;
+  for (size_t i = 0; i < ECE_CIPHER_POOL_SIZE; i++) {
+    ece_cipher_slot_t* slot = &pool->slots[i];
+    if (slot->inUse) {
+      continue;
+    }
+    if (slot->hasKey && slot->mode == mode && slot->keyId[0] == keyId[0] &&
+        slot->keyId[1] == keyId[1]) {
+      *isKeyed = true;
+      return slot;
+    }
+    if (!lruSlot || slot->lastUsed < lruSlot->lastUsed) {
+      lruSlot = slot;
+    }
+  }
+  return lruSlot;
+}
+
+int
+ece_cipher_ctx_acquire(ece_mode_t mode, const uint8_t* key,
+                       EVP_CIPHER_CTX** ctx) {
+  *ctx = NULL;
+  ece_cipher_pool_t* pool = ece_cipher_pool_get(true);
+  ece_cipher_slot_t* slot = NULL;
+  uint64_t keyId[ECE_CIPHER_KEY_ID_WORDS];
+  if (pool) {
+    pool->stats.acquires++;
+    ece_cipher_pool_key_id(pool, key, keyId);
+    bool isKeyed;
+    slot = ece_cipher_pool_find(pool, mode, keyId, &isKeyed);
+    if (!slot) {
+      // All pooled contexts are in use, so we use a temporary context, and
+      // free it on release.
+      pool->stats.overflows++;
+    } else if (isKeyed) {
+      pool->stats.hits++;
+      slot->inUse = true;
+      slot->lastUsed = ++pool->clock;
+      *ctx = slot->ctx;
+      return ECE_OK;
+    }
+  }
+
+  EVP_CIPHER_CTX* newCtx = slot ? slot->ctx : NULL;
+  if (!newCtx) {
+    newCtx = EVP_CIPHER_CTX_new();
+    if (!newCtx) {
+      return ECE_ERROR_OUT_OF_MEMORY;
+    }
+    if (pool) {
+      pool->stats.allocs++;
+    }
+    if (slot) {
+      slot->ctx = newCtx;
+    }
+  }
+  if (slot) {
+    // Forget the old key first, in case re-keying fails.
+    slot->hasKey = false;
+    OPENSSL_cleanse(slot->keyId, sizeof(slot->keyId));
+  }
+  int err = mode == ECE_MODE_ENCRYPT ? ece_record_encrypt_init(newCtx, key)
+                                     : ece_record_decrypt_init(newCtx, key);
+  if (err) {
+    // The context may still hold the old key schedule, so we free it instead
+    // of keeping it in the slot.
+    EVP_CIPHER_CTX_free(newCtx);
+    if (slot) {
+      slot->ctx = NULL;
+    }
+    return err;
+  }
+  if (pool) {
+    pool->stats.rekeys++;
+  }
+  if (slot) {
+    slot->hasKey = true;
+    slot->mode = mode;
+    memcpy(slot->keyId, keyId, sizeof(keyId));
+    slot->inUse = true;
+    slot->lastUsed = ++pool->clock;
+  }
+  *ctx = newCtx;
+  return ECE_OK;
+}
+
+void
+ece_cipher_ctx_release(EVP_CIPHER_CTX* ctx) {
+  if (!ctx) {
+    return;
+  }
+  ece_cipher_pool_t* pool = ece_cipher_pool_get(false);
+  if (pool) {
+    for (size_t i = 0; i < ECE_CIPHER_POOL_SIZE; i++) {
+      ece_cipher_slot_t* slot = &pool->slots[i];
+      if (slot->inUse && slot->ctx == ctx) {
+        slot->inUse = false;
+        slot->lastUsed = ++pool->clock;
+        return;
+      }
+    }
+  }
+  EVP_CIPHER_CTX_free(ctx);
+}
+
+void
+ece_cipher_pool_get_stats(ece_cipher_pool_stats_t* stats) {
+  ece_cipher_pool_t* pool = ece_cipher_pool_get(false);
+  if (!pool) {
+    memset(stats, 0, sizeof(ece_cipher_pool_stats_t));
+    return;
+  }
+  *stats = pool->stats;
+}
+
+void
+ece_cipher_pool_reset_stats(void) {
+  ece_cipher_pool_t* pool = ece_cipher_pool_get(false);
+  if (pool) {
+    memset(&pool->stats, 0, sizeof(ece_cipher_pool_stats_t));
+  }
+}
+
+void
+ece_cipher_pool_flush(void) {
+  ece_cipher_pool_t* pool = ece_cipher_pool_get(false);
+  if (pool) {
+    ece_cipher_pool_flush_slots(pool);
+  }
+}
@@ -0,0 +1,209 @@
+#include "ece.h"
+#include "ece/alloc.h"
+#include "ece/base64url.h"
+#include "ece/cipher.h"
+#include "ece/subscription.h"
+#include "ece/trace.h"
+
+#include <string.h>
+
+#include <openssl/crypto.h>
+
+// The length of the fixed-size "aes128gcm" header, Base64url-encoded. The
+// header is a multiple of 3 bytes, so it never shares a group with the key ID.
+#define ECE_AES128GCM_HEADER_BASE64URL_LENGTH                                  \
+  (ECE_AES128GCM_HEADER_LENGTH / 3 * 4)
+
+ECE_STATIC_ASSERT(ECE_AES128GCM_HEADER_LENGTH % 3 == 0,
+                  ece_aes128gcm_header_is_whole_groups);
+
+size_t
+ece_aes128gcm_plaintext_max_length_base64url(const char* payload,
+                                             size_t payloadLen) {
+  if (payloadLen < ECE_AES128GCM_HEADER_BASE64URL_LENGTH) {
+    return 0;
+  }
+  uint8_t header[ECE_AES128GCM_HEADER_LENGTH];
+  if (ece_base64url_decode_blocks(payload,
+                                  ECE_AES128GCM_HEADER_BASE64URL_LENGTH,
+                                  header) !=
+      ECE_AES128GCM_HEADER_BASE64URL_LENGTH) {
+    return 0;
+  }
+  uint32_t rs = ece_read_uint32_be(&header[ECE_SALT_LENGTH]);
+  if (rs < ECE_AES128GCM_MIN_RS) {
+    return 0;
+  }
+  size_t headerLen =
+    ECE_AES128GCM_HEADER_LENGTH + header[ECE_AES128GCM_HEADER_LENGTH - 1];
+  // Padding doesn't encode any bytes. Counting it would overestimate the
+  // number of records, and underestimate the plaintext length.
+  for (size_t i = 0; i < 2 && payload[payloadLen - 1] == '='; i++) {
+    payloadLen--;
+  }
+  size_t maxPayloadLen = ece_base64url_decode_max_length(payloadLen);
+  if (maxPayloadLen < headerLen) {
+    return 0;
+  }
+  // Each record, including the last, ends with a tag.
+  size_t ciphertextLen = maxPayloadLen - headerLen;
+  size_t numRecords = ciphertextLen / rs;
+  if (ciphertextLen % rs) {
+    numRecords++;
+  }
+  size_t overhead = numRecords * ECE_TAG_LENGTH;
+  return ciphertextLen > overhead ? ciphertextLen - overhead : 0;
+}
+
+// Reads exactly `len` bytes of the payload header, or fails with
+// `ECE_ERROR_SHORT_HEADER` if the payload ends first.
+static int
+ece_aes128gcm_base64url_read_header(ece_base64url_reader_t* reader,
+                                    uint8_t* header, size_t len) {
+  size_t readLen;
+  int err = ece_base64url_read(reader, header, len, &readLen);
+  if (err) {
+    return err;
+  }
+  if (readLen < len) {
+    return ECE_ERROR_SHORT_HEADER;
+  }
+  return ECE_OK;
+}
+
+int
+ece_webpush_aes128gcm_decrypt_base64url(
+  const uint8_t* rawRecvPrivKey, size_t rawRecvPrivKeyLen,
+  const uint8_t* authSecret, size_t authSecretLen, const char* payload,
+  size_t payloadLen, ece_base64url_decode_policy_t paddingPolicy,
+  uint8_t* plaintext, size_t* plaintextLen) {
+  int err = ECE_OK;
+  ece_subscription_t* sub = NULL;
+  EVP_CIPHER_CTX* ctx = NULL;
+  uint8_t* record = NULL;
+  size_t recordCapacity = 0;
+
+  ece_base64url_reader_t reader;
+  ece_base64url_reader_init(&reader, payload, payloadLen, paddingPolicy);
+
+  // The header is at most 276 bytes, so we decode it onto the stack. We check
+  // the header, auth secret, and first record in the same order as
+  // `ece_webpush_aes128gcm_decrypt`, so that both fail with the same errors.
+  uint8_t header[ECE_AES128GCM_HEADER_LENGTH + ECE_AES128GCM_MAX_KEY_ID_LENGTH];
+  uint32_t rs = 0;
+  size_t keyIdLen = 0;
+  ECE_TRACE1(header_parse_start, payloadLen);
+  err = ece_aes128gcm_base64url_read_header(&reader, header,
+                                            ECE_AES128GCM_HEADER_LENGTH);
+  if (!err) {
+    rs = ece_read_uint32_be(&header[ECE_SALT_LENGTH]);
+    if (rs < ECE_AES128GCM_MIN_RS) {
+      err = ECE_ERROR_INVALID_RS;
+    }
+  }
+  if (!err) {
+    keyIdLen = header[ECE_AES128GCM_HEADER_LENGTH - 1];
+    err = ece_aes128gcm_base64url_read_header(
+      &reader, &header[ECE_AES128GCM_HEADER_LENGTH], keyIdLen);
+  }
+  ECE_TRACE3(header_parse_done, payloadLen, rs, err);
+  if (err) {
+    goto end;
+  }
+  if (authSecretLen != ECE_WEBPUSH_AUTH_SECRET_LENGTH) {
+    err = ECE_ERROR_INVALID_AUTH_SECRET;
+    goto end;
+  }
+
+  // Each record is decoded into a buffer that holds one record and one more
+  // byte, which tells us if there's another record after it. A hostile header
+  // can claim a huge record size, so the buffer is never larger than the
+  // payload.
+  recordCapacity = ece_base64url_reader_max_remaining(&reader);
+  if (recordCapacity > rs) {
+    recordCapacity = rs;
+  }
+  recordCapacity++;
+  record = ece_malloc(recordCapacity);
+  if (!record) {
+    err = ECE_ERROR_OUT_OF_MEMORY;
+    goto end;
+  }
+  size_t recordLen;
+  err = ece_base64url_read(&reader, record, recordCapacity, &recordLen);
+  if (err) {
+    goto end;
+  }
+  if (!recordLen) {
+    err = ECE_ERROR_ZERO_CIPHERTEXT;
+    goto end;
+  }
+
+  err = ece_subscription_create(rawRecvPrivKey, rawRecvPrivKeyLen, authSecret,
+                                authSecretLen, &sub);
+  if (err) {
+    goto end;
+  }
+  uint8_t key[ECE_AES_KEY_LENGTH];
+  uint8_t nonce[ECE_NONCE_LENGTH];
+  err = ece_subscription_derive_key_and_nonce(
+    sub, header, ECE_SALT_LENGTH, &header[ECE_AES128GCM_HEADER_LENGTH],
+    keyIdLen, &ece_webpush_aes128gcm_derive_key_and_nonce, key, nonce);
+  if (err) {
+    goto end;
+  }
+  err = ece_cipher_ctx_acquire(ECE_MODE_DECRYPT, key, &ctx);
+  OPENSSL_cleanse(key, sizeof(key));
+  if (err) {
+    goto end;
+  }
+
+  size_t plaintextStart = 0;
+  for (uint64_t counter = 0;; counter++) {
+    // If we decoded the lookahead byte, this isn't the last record.
+    bool isLastRecord = recordLen < recordCapacity;
+    size_t thisRecordLen = isLastRecord ? recordLen : rs;
+    size_t blockLen =
+      thisRecordLen > ECE_TAG_LENGTH ? thisRecordLen - ECE_TAG_LENGTH : 0;
+    if (blockLen > *plaintextLen - plaintextStart) {
+      err = ECE_ERROR_OUT_OF_MEMORY;
+      goto end;
+    }
+    uint8_t iv[ECE_NONCE_LENGTH];
+    ece_generate_iv(nonce, counter, iv);
+    uint8_t* block = &plaintext[plaintextStart];
+    ECE_TRACE3(record_open_start, counter, thisRecordLen, rs);
+    err = ece_record_decrypt(ctx, iv, record, thisRecordLen, block);
+    ECE_TRACE3(record_open_done, counter, thisRecordLen, err);
+    if (err) {
+      goto end;
+    }
+    err = ece_aes128gcm_unpad(block, isLastRecord, &blockLen);
+    if (err) {
+      goto end;
+    }
+    plaintextStart += blockLen;
+    if (isLastRecord) {
+      break;
+    }
+    // Move the lookahead byte to the start of the buffer, and decode the rest
+    // of the next record after it.
+    record[0] = record[rs];
+    err = ece_base64url_read(&reader, &record[1], recordCapacity - 1,
+                             &recordLen);
+    if (err) {
+      goto end;
+    }
+    recordLen++;
+  }
+  *plaintextLen = plaintextStart;
+
+end:
+  ece_cipher_ctx_release(ctx);
+  ece_subscription_destroy(sub);
+  if (record) {
+    OPENSSL_cleanse(record, recordCapacity);
+    ece_free(record);
+  }
+  return err;
+}
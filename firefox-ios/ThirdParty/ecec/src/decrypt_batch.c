@@ -0,0 +1,236 @@
+#include "ece.h"
+#include "ece/cipher.h"
+#include "ece/gcm.h"
+#include "ece/stats.h"
+#include "ece/subscription.h"
+#include "ece/trace.h"
+
+#include <string.h>
+
+#include <openssl/crypto.h>
+#include <openssl/evp.h>
+
+// The maximum number of records queued for the multi-buffer kernel. Messages
+// with more records than this are decrypted on their own, since a long run of
+// records from one message already keeps the AES pipeline busy.
+#define ECE_BATCH_MAX_RECORDS 64
+
+// A message whose records are queued in the batch.
+typedef struct ece_batch_message_s {
+  size_t index;
+  uint8_t key[ECE_AES_KEY_LENGTH];
+  uint32_t rs;
+  size_t firstJob;
+  size_t numJobs;
+  uint8_t* plaintext;
+  size_t* plaintextLen;
+} ece_batch_message_t;
+
+// Records from several messages, decrypted together. Each message has at
+// least one record, so there are never more messages than jobs.
+typedef struct ece_batch_s {
+  ece_gcm_impl_t impl;
+  ece_gcm_job_t jobs[ECE_BATCH_MAX_RECORDS];
+  size_t numJobs;
+  ece_batch_message_t messages[ECE_BATCH_MAX_RECORDS];
+  size_t numMessages;
+} ece_batch_t;
+
+#ifdef ECE_HAVE_USDT
+// Fires the record probes for all queued records, before or after the kernel
+// opens them.
+static void
+ece_batch_trace(const ece_batch_t* batch, bool isDone) {
+  for (size_t i = 0; i < batch->numMessages; i++) {
+    const ece_batch_message_t* message = &batch->messages[i];
+    for (size_t j = 0; j < message->numJobs; j++) {
+      const ece_gcm_job_t* job = &batch->jobs[message->firstJob + j];
+      if (isDone) {
+        ECE_TRACE3(record_open_done, j, job->inLen, job->err);
+      } else {
+        ECE_TRACE3(record_open_start, j, job->inLen, message->rs);
+      }
+    }
+  }
+}
+#else
+#define ece_batch_trace(batch, isDone) ((void) 0)
+#endif /* ECE_HAVE_USDT */
+
+// Decrypts all queued records, then unpads and compacts each message's
+// records in order. As with `ece_record_decrypt_all`, a message fails with
+// the error for its first failing record.
+static void
+ece_batch_flush(ece_batch_t* batch, int* errs) {
+  ece_batch_trace(batch, false);
+  uint64_t start = ece_stats_begin();
+  ece_gcm_open_impl(batch->impl, batch->jobs, batch->numJobs);
+  ece_batch_trace(batch, true);
+  if (start) {
+    // The kernel decrypts all records at once, so the batch counts as one
+    // call, and fails if any record fails.
+    size_t recordsLen = 0;
+    int firstErr = ECE_OK;
+    for (size_t i = 0; i < batch->numJobs; i++) {
+      recordsLen += batch->jobs[i].inLen;
+      if (!firstErr) {
+        firstErr = batch->jobs[i].err;
+      }
+    }
+    ece_stats_end(ECE_STATS_STAGE_DECRYPT_RECORD, start, recordsLen,
+                  firstErr);
+  }
+  for (size_t i = 0; i < batch->numMessages; i++) {
+    ece_batch_message_t* message = &batch->messages[i];
+    size_t plaintextStart = 0;
+    int err = ECE_OK;
+    for (size_t j = 0; j < message->numJobs; j++) {
+      ece_gcm_job_t* job = &batch->jobs[message->firstJob + j];
+      err = job->err;
+      if (err) {
+        break;
+      }
+      size_t blockLen = job->inLen - ECE_TAG_LENGTH;
+      err = ece_aes128gcm_unpad(job->out, j == message->numJobs - 1, &blockLen);
+      if (err) {
+        break;
+      }
+      memmove(&message->plaintext[plaintextStart], job->out, blockLen);
+      plaintextStart += blockLen;
+    }
+    if (!err) {
+      *message->plaintextLen = plaintextStart;
+    }
+    errs[message->index] = err;
+  }
+  OPENSSL_cleanse(batch->messages, sizeof(batch->messages));
+  batch->numJobs = 0;
+  batch->numMessages = 0;
+}
+
+// Decrypts or queues one message in a batch. `sub` is `NULL` if the
+// subscription couldn't be created, and `subErr` is the reason. We check the
+// payload before the keys, so that each message fails with the same error as
+// `ece_webpush_aes128gcm_decrypt`. Sets `queued` if the message's result will
+// be set when the batch is flushed.
+static int
+ece_webpush_aes128gcm_decrypt_batch_message(
+  ece_batch_t* batch, const ece_subscription_t* sub, int subErr, size_t index,
+  const uint8_t* payload, size_t payloadLen, uint8_t* plaintext,
+  size_t* plaintextLen, int* errs, bool* queued) {
+  const uint8_t* salt;
+  size_t saltLen;
+  const uint8_t* rawSenderPubKey;
+  size_t rawSenderPubKeyLen;
+  uint32_t rs = 0;
+  const uint8_t* ciphertext;
+  size_t ciphertextLen;
+  ECE_TRACE1(header_parse_start, payloadLen);
+  int err = ece_aes128gcm_payload_extract_params(
+    payload, payloadLen, &salt, &saltLen, &rawSenderPubKey,
+    &rawSenderPubKeyLen, &rs, &ciphertext, &ciphertextLen);
+  ECE_TRACE3(header_parse_done, payloadLen, rs, err);
+  if (err) {
+    return err;
+  }
+  if (subErr == ECE_ERROR_INVALID_AUTH_SECRET) {
+    return subErr;
+  }
+  if (!ciphertextLen) {
+    return ECE_ERROR_ZERO_CIPHERTEXT;
+  }
+  if (subErr) {
+    return subErr;
+  }
+  uint8_t key[ECE_AES_KEY_LENGTH];
+  uint8_t nonce[ECE_NONCE_LENGTH];
+  err = ece_subscription_derive_key_and_nonce(
+    sub, salt, saltLen, rawSenderPubKey, rawSenderPubKeyLen,
+    &ece_webpush_aes128gcm_derive_key_and_nonce, key, nonce);
+  if (err) {
+    return err;
+  }
+
+  // Queued records are decrypted in place, so the plaintext buffer must be
+  // large enough to hold every block before unpadding. Long messages, and
+  // messages with smaller buffers, are decrypted serially.
+  size_t numRecords = ciphertextLen / rs;
+  size_t lastRecordLen = ciphertextLen % rs;
+  if (lastRecordLen) {
+    numRecords++;
+  } else {
+    lastRecordLen = rs;
+  }
+  size_t blocksLen = (numRecords - 1) * (rs - ECE_TAG_LENGTH);
+  if (lastRecordLen > ECE_TAG_LENGTH) {
+    blocksLen += lastRecordLen - ECE_TAG_LENGTH;
+  }
+  if (numRecords > ECE_BATCH_MAX_RECORDS || *plaintextLen < blocksLen) {
+    EVP_CIPHER_CTX* ctx;
+    err = ece_cipher_ctx_acquire(ECE_MODE_DECRYPT, key, &ctx);
+    if (err) {
+      return err;
+    }
+    err = ece_record_decrypt_all(ctx, nonce, rs, ciphertext, ciphertextLen,
+                                 &ece_aes128gcm_unpad, plaintext, plaintextLen);
+    ece_cipher_ctx_release(ctx);
+    return err;
+  }
+
+  if (batch->numJobs + numRecords > ECE_BATCH_MAX_RECORDS) {
+    ece_batch_flush(batch, errs);
+  }
+  ece_batch_message_t* message = &batch->messages[batch->numMessages++];
+  message->index = index;
+  message->rs = rs;
+  memcpy(message->key, key, ECE_AES_KEY_LENGTH);
+  message->firstJob = batch->numJobs;
+  message->numJobs = numRecords;
+  message->plaintext = plaintext;
+  message->plaintextLen = plaintextLen;
+  for (size_t i = 0; i < numRecords; i++) {
+    ece_gcm_job_t* job = &batch->jobs[batch->numJobs++];
+    job->key = message->key;
+    ece_generate_iv(nonce, i, job->iv);
+    job->in = &ciphertext[i * rs];
+    job->inLen = i == numRecords - 1 ? lastRecordLen : rs;
+    job->out = &plaintext[i * (rs - ECE_TAG_LENGTH)];
+  }
+  *queued = true;
+  return ECE_OK;
+}
+
+int
+ece_webpush_aes128gcm_decrypt_batch(
+  const uint8_t* rawRecvPrivKey, size_t rawRecvPrivKeyLen,
+  const uint8_t* authSecret, size_t authSecretLen, size_t count,
+  const uint8_t* const* payloads, const size_t* payloadLens,
+  uint8_t* const* plaintexts, size_t* plaintextLens, int* errs) {
+  // Import the subscription key once for the whole batch. If the import fails,
+  // each message reports the error after its payload checks.
+  ece_subscription_t* sub = NULL;
+  int subErr = ece_subscription_create(rawRecvPrivKey, rawRecvPrivKeyLen,
+                                       authSecret, authSecretLen, &sub);
+  ece_batch_t batch;
+  batch.impl = ece_gcm_best_impl();
+  batch.numJobs = 0;
+  batch.numMessages = 0;
+  for (size_t i = 0; i < count; i++) {
+    bool queued = false;
+    int err = ece_webpush_aes128gcm_decrypt_batch_message(
+      &batch, sub, subErr, i, payloads[i], payloadLens[i], plaintexts[i],
+      &plaintextLens[i], errs, &queued);
+    if (!queued) {
+      errs[i] = err;
+    }
+  }
+  ece_batch_flush(&batch, errs);
+  ece_subscription_destroy(sub);
+
+  for (size_t i = 0; i < count; i++) {
+    if (errs[i]) {
+      return errs[i];
+    }
+  }
+  return ECE_OK;
+}
@@ -0,0 +1,81 @@
+#include "ece.h"
+#include "ece/trace.h"
+#include "ece/trailer.h"
+
+int
+ece_webpush_aes128gcm_decrypt_in_place(const uint8_t* rawRecvPrivKey,
+                                       size_t rawRecvPrivKeyLen,
+                                       const uint8_t* authSecret,
+                                       size_t authSecretLen, uint8_t* payload,
+                                       size_t payloadLen,
+                                       size_t* plaintextOffset,
+                                       size_t* plaintextLen) {
+  // Check the payload before importing the subscription key, so that we
+  // return the same errors as `ece_webpush_aes128gcm_decrypt`.
+  const uint8_t* salt;
+  size_t saltLen;
+  const uint8_t* rawSenderPubKey;
+  size_t rawSenderPubKeyLen;
+  uint32_t rs = 0;
+  const uint8_t* ciphertext;
+  size_t ciphertextLen;
+  ECE_TRACE1(header_parse_start, payloadLen);
+  int err = ece_aes128gcm_payload_extract_params(
+    payload, payloadLen, &salt, &saltLen, &rawSenderPubKey,
+    &rawSenderPubKeyLen, &rs, &ciphertext, &ciphertextLen);
+  ECE_TRACE3(header_parse_done, payloadLen, rs, err);
+  if (err) {
+    return err;
+  }
+  if (authSecretLen != ECE_WEBPUSH_AUTH_SECRET_LENGTH) {
+    return ECE_ERROR_INVALID_AUTH_SECRET;
+  }
+  if (!ciphertextLen) {
+    return ECE_ERROR_ZERO_CIPHERTEXT;
+  }
+  ece_subscription_t* sub = NULL;
+  err = ece_subscription_create(rawRecvPrivKey, rawRecvPrivKeyLen, authSecret,
+                                authSecretLen, &sub);
+  if (err) {
+    return err;
+  }
+  err = ece_subscription_aes128gcm_decrypt_in_place(
+    sub, payload, payloadLen, plaintextOffset, plaintextLen);
+  ece_subscription_destroy(sub);
+  return err;
+}
+
+int
+ece_webpush_aesgcm_decrypt_in_place(
+  const uint8_t* rawRecvPrivKey, size_t rawRecvPrivKeyLen,
+  const uint8_t* authSecret, size_t authSecretLen, const uint8_t* salt,
+  size_t saltLen, const uint8_t* rawSenderPubKey, size_t rawSenderPubKeyLen,
+  uint32_t rs, uint8_t* ciphertext, size_t ciphertextLen,
+  size_t* plaintextLen) {
+  if (rs < ECE_AESGCM_MIN_RS || !ece_aesgcm_rs(rs)) {
+    return ECE_ERROR_INVALID_RS;
+  }
+  if (authSecretLen != ECE_WEBPUSH_AUTH_SECRET_LENGTH) {
+    return ECE_ERROR_INVALID_AUTH_SECRET;
+  }
+  if (saltLen != ECE_SALT_LENGTH) {
+    return ECE_ERROR_INVALID_SALT;
+  }
+  if (!ciphertextLen) {
+    return ECE_ERROR_ZERO_CIPHERTEXT;
+  }
+  if (ece_aesgcm_needs_trailer(rs, ciphertextLen)) {
+    return ECE_ERROR_DECRYPT_TRUNCATED;
+  }
+  ece_subscription_t* sub = NULL;
+  int err = ece_subscription_create(rawRecvPrivKey, rawRecvPrivKeyLen,
+                                    authSecret, authSecretLen, &sub);
+  if (err) {
+    return err;
+  }
+  err = ece_subscription_aesgcm_decrypt_in_place(
+    sub, salt, saltLen, rawSenderPubKey, rawSenderPubKeyLen, rs, ciphertext,
+    ciphertextLen, plaintextLen);
+  ece_subscription_destroy(sub);
+  return err;
+}
@@ -0,0 +1,302 @@
+#include "ece.h"
+#include "ece/alloc.h"
+#include "ece/cipher.h"
+#include "ece/iov.h"
+#include "ece/keys.h"
+#include "ece/record.h"
+#include "ece/stats.h"
+#include "ece/subscription.h"
+#include "ece/trace.h"
+#include "ece/trailer.h"
+
+#include <limits.h>
+
+#include <openssl/evp.h>
+
+// Decrypts and authenticates a record that may straddle segments of the
+// ciphertext. Each contiguous piece is passed to OpenSSL as-is, so only the
+// tag is copied.
+static int
+ece_iov_decrypt_record(EVP_CIPHER_CTX* ctx, const uint8_t* iv,
+                       ece_iov_cursor_t* ciphertext, size_t recordLen,
+                       uint8_t* block) {
+  if (recordLen < ECE_TAG_LENGTH) {
+    return ECE_ERROR_DECRYPT;
+  }
+  if (recordLen == ECE_TAG_LENGTH) {
+    return ECE_ERROR_SHORT_BLOCK;
+  }
+  size_t blockLen = recordLen - ECE_TAG_LENGTH;
+  if (blockLen > INT_MAX) {
+    return ECE_ERROR_DECRYPT;
+  }
+  if (EVP_DecryptInit_ex(ctx, NULL, NULL, NULL, iv) != 1) {
+    return ECE_ERROR_DECRYPT;
+  }
+  size_t blockStart = 0;
+  while (blockStart < blockLen) {
+    size_t chunkLen;
+    const uint8_t* chunk =
+      ece_iov_next(ciphertext, blockLen - blockStart, &chunkLen);
+    if (!chunk) {
+      return ECE_ERROR_DECRYPT;
+    }
+    int outLen = -1;
+    if (EVP_DecryptUpdate(ctx, &block[blockStart], &outLen, chunk,
+                          (int) chunkLen) != 1) {
+      return ECE_ERROR_DECRYPT;
+    }
+    blockStart += chunkLen;
+  }
+  uint8_t tag[ECE_TAG_LENGTH];
+  ece_iov_read(ciphertext, tag, ECE_TAG_LENGTH);
+  if (EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_GCM_SET_TAG, ECE_TAG_LENGTH, tag) !=
+      1) {
+    return ECE_ERROR_DECRYPT;
+  }
+  int finalLen = -1;
+  if (EVP_DecryptFinal_ex(ctx, NULL, &finalLen) != 1) {
+    return ECE_ERROR_DECRYPT;
+  }
+  return ECE_OK;
+}
+
+// Decrypts and unpads all records from `ciphertext` into `plaintext`. Blocks
+// that fit in the current plaintext segment are decrypted and unpadded in
+// place; blocks that straddle segments go through a scratch buffer.
+static int
+ece_iov_decrypt(const uint8_t* key, const uint8_t* nonce, uint32_t rs,
+                ece_iov_cursor_t* ciphertext, size_t ciphertextLen,
+                unpad_t unpad, const ece_iovec_t* plaintext,
+                size_t plaintextCount, size_t* plaintextLen) {
+  int err = ECE_OK;
+  uint8_t* scratch = NULL;
+  EVP_CIPHER_CTX* ctx = NULL;
+  err = ece_cipher_ctx_acquire(ECE_MODE_DECRYPT, key, &ctx);
+  if (err) {
+    goto end;
+  }
+  size_t maxPlaintextLen = ece_iov_length(plaintext, plaintextCount);
+  ece_iov_cursor_t output;
+  ece_iov_cursor_init(&output, plaintext, plaintextCount);
+  size_t ciphertextStart = 0;
+  size_t plaintextStart = 0;
+  for (uint64_t counter = 0; ciphertextStart < ciphertextLen; counter++) {
+    size_t recordLen = ciphertextLen - ciphertextStart;
+    if (recordLen > rs) {
+      recordLen = rs;
+    }
+    bool isLastRecord = ciphertextStart + recordLen >= ciphertextLen;
+    size_t blockLen = recordLen > ECE_TAG_LENGTH ? recordLen - ECE_TAG_LENGTH
+                                                 : 0;
+    size_t segmentLen;
+    uint8_t* block = ece_iov_peek(&output, &segmentLen);
+    bool isScattered = segmentLen < blockLen;
+    if (isScattered) {
+      if (!scratch) {
+        scratch = ece_malloc(rs);
+        if (!scratch) {
+          err = ECE_ERROR_OUT_OF_MEMORY;
+          goto end;
+        }
+      }
+      block = scratch;
+    }
+    uint8_t iv[ECE_NONCE_LENGTH];
+    ece_generate_iv(nonce, counter, iv);
+    ECE_TRACE3(record_open_start, counter, recordLen, rs);
+    uint64_t start = ece_stats_begin();
+    err = ece_iov_decrypt_record(ctx, iv, ciphertext, recordLen, block);
+    ece_stats_end(ECE_STATS_STAGE_DECRYPT_RECORD, start, recordLen, err);
+    ECE_TRACE3(record_open_done, counter, recordLen, err);
+    if (err) {
+      goto end;
+    }
+    err = unpad(block, isLastRecord, &blockLen);
+    if (err) {
+      goto end;
+    }
+    if (blockLen > maxPlaintextLen - plaintextStart) {
+      err = ECE_ERROR_OUT_OF_MEMORY;
+      goto end;
+    }
+    if (isScattered) {
+      ece_iov_write(&output, block, blockLen);
+    } else {
+      ece_iov_skip(&output, blockLen);
+    }
+    ciphertextStart += recordLen;
+    plaintextStart += blockLen;
+  }
+  *plaintextLen = plaintextStart;
+
+end:
+  ece_cipher_ctx_release(ctx);
+  ece_free(scratch);
+  return err;
+}
+
+// Reads and parses the "aes128gcm" header from `payload`. The header is short,
+// so it's copied into `header` in case it straddles segments. On success,
+// `payload` is positioned at the first record.
+static int
+ece_iov_extract_params(ece_iov_cursor_t* payload, size_t payloadLen,
+                       uint8_t* header, uint8_t** salt, size_t* saltLen,
+                       uint8_t** keyId, size_t* keyIdLen, uint32_t* rs,
+                       size_t* ciphertextLen) {
+  ECE_TRACE1(header_parse_start, payloadLen);
+  size_t headerLen = ece_iov_read(payload, header, ECE_AES128GCM_HEADER_LENGTH);
+  if (headerLen == ECE_AES128GCM_HEADER_LENGTH) {
+    headerLen += ece_iov_read(payload, &header[headerLen],
+                              header[ECE_AES128GCM_HEADER_LENGTH - 1]);
+  }
+  const uint8_t* constSalt;
+  const uint8_t* constKeyId;
+  const uint8_t* ciphertext;
+  int err = ece_aes128gcm_payload_extract_params(
+    header, headerLen, &constSalt, saltLen, &constKeyId, keyIdLen, rs,
+    &ciphertext, ciphertextLen);
+  ECE_TRACE3(header_parse_done, payloadLen, err ? 0 : *rs, err);
+  if (err) {
+    return err;
+  }
+  *salt = &header[constSalt - header];
+  *keyId = &header[constKeyId - header];
+  *ciphertextLen = payloadLen - headerLen;
+  return ECE_OK;
+}
+
+int
+ece_aes128gcm_decrypt_iov(const uint8_t* ikm, size_t ikmLen,
+                          const ece_iovec_t* payload, size_t payloadCount,
+                          const ece_iovec_t* plaintext, size_t plaintextCount,
+                          size_t* plaintextLen) {
+  uint8_t header[ECE_AES128GCM_HEADER_LENGTH + UINT8_MAX];
+  uint8_t* salt;
+  size_t saltLen;
+  uint8_t* keyId;
+  size_t keyIdLen;
+  uint32_t rs;
+  size_t ciphertextLen;
+  ece_iov_cursor_t ciphertext;
+  ece_iov_cursor_init(&ciphertext, payload, payloadCount);
+  int err = ece_iov_extract_params(
+    &ciphertext, ece_iov_length(payload, payloadCount), header, &salt,
+    &saltLen, &keyId, &keyIdLen, &rs, &ciphertextLen);
+  if (err) {
+    return err;
+  }
+  if (!ciphertextLen) {
+    return ECE_ERROR_ZERO_CIPHERTEXT;
+  }
+  uint8_t key[ECE_AES_KEY_LENGTH];
+  uint8_t nonce[ECE_NONCE_LENGTH];
+  ECE_TRACE1(derive_key_start, saltLen);
+  uint64_t start = ece_stats_begin();
+  err = ece_aes128gcm_derive_key_and_nonce(salt, saltLen, ikm, ikmLen, key,
+                                           nonce);
+  ece_stats_end(ECE_STATS_STAGE_DERIVE_KEY, start, 0, err);
+  ECE_TRACE2(derive_key_done, saltLen, err);
+  if (err) {
+    return err;
+  }
+  return ece_iov_decrypt(key, nonce, rs, &ciphertext, ciphertextLen,
+                         &ece_aes128gcm_unpad, plaintext, plaintextCount,
+                         plaintextLen);
+}
+
+int
+ece_webpush_aes128gcm_decrypt_iov(const uint8_t* rawRecvPrivKey,
+                                  size_t rawRecvPrivKeyLen,
+                                  const uint8_t* authSecret,
+                                  size_t authSecretLen,
+                                  const ece_iovec_t* payload,
+                                  size_t payloadCount,
+                                  const ece_iovec_t* plaintext,
+                                  size_t plaintextCount,
+                                  size_t* plaintextLen) {
+  uint8_t header[ECE_AES128GCM_HEADER_LENGTH + UINT8_MAX];
+  uint8_t* salt;
+  size_t saltLen;
+  uint8_t* rawSenderPubKey;
+  size_t rawSenderPubKeyLen;
+  uint32_t rs;
+  size_t ciphertextLen;
+  ece_iov_cursor_t ciphertext;
+  ece_iov_cursor_init(&ciphertext, payload, payloadCount);
+  int err = ece_iov_extract_params(
+    &ciphertext, ece_iov_length(payload, payloadCount), header, &salt,
+    &saltLen, &rawSenderPubKey, &rawSenderPubKeyLen, &rs, &ciphertextLen);
+  if (err) {
+    return err;
+  }
+  if (authSecretLen != ECE_WEBPUSH_AUTH_SECRET_LENGTH) {
+    return ECE_ERROR_INVALID_AUTH_SECRET;
+  }
+  if (!ciphertextLen) {
+    return ECE_ERROR_ZERO_CIPHERTEXT;
+  }
+  ece_subscription_t* sub = NULL;
+  err = ece_subscription_create(rawRecvPrivKey, rawRecvPrivKeyLen, authSecret,
+                                authSecretLen, &sub);
+  if (err) {
+    return err;
+  }
+  uint8_t key[ECE_AES_KEY_LENGTH];
+  uint8_t nonce[ECE_NONCE_LENGTH];
+  err = ece_subscription_derive_key_and_nonce(
+    sub, salt, saltLen, rawSenderPubKey, rawSenderPubKeyLen,
+    &ece_webpush_aes128gcm_derive_key_and_nonce, key, nonce);
+  ece_subscription_destroy(sub);
+  if (err) {
+    return err;
+  }
+  return ece_iov_decrypt(key, nonce, rs, &ciphertext, ciphertextLen,
+                         &ece_aes128gcm_unpad, plaintext, plaintextCount,
+                         plaintextLen);
+}
+
+int
+ece_webpush_aesgcm_decrypt_iov(
+  const uint8_t* rawRecvPrivKey, size_t rawRecvPrivKeyLen,
+  const uint8_t* authSecret, size_t authSecretLen, const uint8_t* salt,
+  size_t saltLen, const uint8_t* rawSenderPubKey, size_t rawSenderPubKeyLen,
+  uint32_t rs, const ece_iovec_t* ciphertext, size_t ciphertextCount,
+  const ece_iovec_t* plaintext, size_t plaintextCount, size_t* plaintextLen) {
+  if (rs < ECE_AESGCM_MIN_RS || !ece_aesgcm_rs(rs)) {
+    return ECE_ERROR_INVALID_RS;
+  }
+  if (authSecretLen != ECE_WEBPUSH_AUTH_SECRET_LENGTH) {
+    return ECE_ERROR_INVALID_AUTH_SECRET;
+  }
+  if (saltLen != ECE_SALT_LENGTH) {
+    return ECE_ERROR_INVALID_SALT;
+  }
+  size_t ciphertextLen = ece_iov_length(ciphertext, ciphertextCount);
+  if (!ciphertextLen) {
+    return ECE_ERROR_ZERO_CIPHERTEXT;
+  }
+  if (ece_aesgcm_needs_trailer(rs, ciphertextLen)) {
+    return ECE_ERROR_DECRYPT_TRUNCATED;
+  }
+  ece_subscription_t* sub = NULL;
+  int err = ece_subscription_create(rawRecvPrivKey, rawRecvPrivKeyLen,
+                                    authSecret, authSecretLen, &sub);
+  if (err) {
+    return err;
+  }
+  uint8_t key[ECE_AES_KEY_LENGTH];
+  uint8_t nonce[ECE_NONCE_LENGTH];
+  err = ece_subscription_derive_key_and_nonce(
+    sub, salt, saltLen, rawSenderPubKey, rawSenderPubKeyLen,
+    &ece_webpush_aesgcm_derive_key_and_nonce, key, nonce);
+  ece_subscription_destroy(sub);
+  if (err) {
+    return err;
+  }
+  ece_iov_cursor_t input;
+  ece_iov_cursor_init(&input, ciphertext, ciphertextCount);
+  return ece_iov_decrypt(key, nonce, ece_aesgcm_rs(rs), &input, ciphertextLen,
+                         &ece_aesgcm_unpad, plaintext, plaintextCount,
+                         plaintextLen);
+}
@@ -0,0 +1,446 @@
+#include "ece.h"
+#include "ece/alloc.h"
+#include "ece/keys.h"
+#include "ece/record.h"
+#include "ece/stats.h"
+#include "ece/trace.h"
+#include "ece/trailer.h"
+
+#include <string.h>
+
+#include <openssl/evp.h>
+
+// The length of the longest "aes128gcm" header, with a 255-byte key ID.
+#define ECE_AES128GCM_MAX_HEADER_LENGTH                                        \
+  (ECE_AES128GCM_HEADER_LENGTH + ECE_AES128GCM_MAX_KEY_ID_LENGTH)
+
+struct ece_aes128gcm_decrypt_ctx_s {
+  // The subscription key pair and auth secret for Web Push payloads. If
+  // `recvPrivKey` is `NULL`, the payload is decrypted with `ikm` instead.
+  EC_KEY* recvPrivKey;
+  uint8_t authSecret[ECE_WEBPUSH_AUTH_SECRET_LENGTH];
+  uint8_t* ikm;
+  size_t ikmLen;
+
+  // The header is buffered until it's complete. `hasHeader` is set once we've
+  // seen the salt, record size, and full key ID; `hasKey` is set once we've
+  // derived the content encryption key and nonce from them. "aesgcm" payloads
+  // don't have a header, so `ece_webpush_aesgcm_decrypt_init` sets both.
+  uint8_t header[ECE_AES128GCM_MAX_HEADER_LENGTH];
+  size_t headerLen;
+  bool hasHeader;
+  bool hasKey;
+  uint32_t rs;
+
+  uint8_t nonce[ECE_NONCE_LENGTH];
+  EVP_CIPHER_CTX* cipherCtx;
+
+  // The pending record. We can't decrypt a full record until we see at least
+  // one more byte of the payload, because the last record uses a different
+  // padding delimiter.
+  uint8_t* record;
+  size_t recordCapacity;
+  size_t recordLen;
+  uint64_t counter;
+
+  // "aesgcm" records use a different padding scheme, and a ciphertext that
+  // ends on a record boundary is truncated.
+  unpad_t unpad;
+  bool needsTrailer;
+
+  int err;
+};
+
+ECE_STATIC_ASSERT(sizeof(ece_aes128gcm_decrypt_ctx_t) <= ECE_MAX_CONTEXT_LENGTH,
+                  ece_aes128gcm_decrypt_ctx_fits);
+
+ece_aes128gcm_decrypt_ctx_t*
+ece_aes128gcm_decrypt_ctx_new(void) {
+  ece_aes128gcm_decrypt_ctx_t* ctx =
+    ece_calloc(1, sizeof(ece_aes128gcm_decrypt_ctx_t));
+  if (!ctx) {
+    return NULL;
+  }
+  ctx->cipherCtx = EVP_CIPHER_CTX_new();
+  if (!ctx->cipherCtx) {
+    ece_free(ctx);
+    return NULL;
+  }
+  return ctx;
+}
+
+// Discards the keys and payload state, but keeps the cipher context and record
+// buffer so that reinitializing doesn't need to allocate.
+static void
+ece_aes128gcm_decrypt_ctx_reset(ece_aes128gcm_decrypt_ctx_t* ctx) {
+  EC_KEY_free(ctx->recvPrivKey);
+  ctx->recvPrivKey = NULL;
+  ece_free(ctx->ikm);
+  ctx->ikm = NULL;
+  ctx->ikmLen = 0;
+  ctx->headerLen = 0;
+  ctx->hasHeader = false;
+  ctx->hasKey = false;
+  ctx->rs = 0;
+  ctx->recordLen = 0;
+  ctx->counter = 0;
+  ctx->unpad = &ece_aes128gcm_unpad;
+  ctx->needsTrailer = false;
+  ctx->err = ECE_OK;
+}
+
+void
+ece_aes128gcm_decrypt_ctx_free(ece_aes128gcm_decrypt_ctx_t* ctx) {
+  if (!ctx) {
+    return;
+  }
+  ece_aes128gcm_decrypt_ctx_reset(ctx);
+  EVP_CIPHER_CTX_free(ctx->cipherCtx);
+  ece_free(ctx->record);
+  ece_free(ctx);
+}
+
+int
+ece_aes128gcm_decrypt_init(ece_aes128gcm_decrypt_ctx_t* ctx,
+                           const uint8_t* ikm, size_t ikmLen) {
+  ece_aes128gcm_decrypt_ctx_reset(ctx);
+  // Allocators may return `NULL` for 0 bytes, so we always allocate at least
+  // one byte.
+  ctx->ikm = ece_malloc(ikmLen ? ikmLen : 1);
+  if (!ctx->ikm) {
+    ctx->err = ECE_ERROR_OUT_OF_MEMORY;
+    return ctx->err;
+  }
+  memcpy(ctx->ikm, ikm, ikmLen);
+  ctx->ikmLen = ikmLen;
+  return ECE_OK;
+}
+
+int
+ece_webpush_aes128gcm_decrypt_init(ece_aes128gcm_decrypt_ctx_t* ctx,
+                                   const uint8_t* rawRecvPrivKey,
+                                   size_t rawRecvPrivKeyLen,
+                                   const uint8_t* authSecret,
+                                   size_t authSecretLen) {
+  ece_aes128gcm_decrypt_ctx_reset(ctx);
+  if (authSecretLen != ECE_WEBPUSH_AUTH_SECRET_LENGTH) {
+    ctx->err = ECE_ERROR_INVALID_AUTH_SECRET;
+    return ctx->err;
+  }
+  ctx->recvPrivKey =
+    ece_stats_import_private_key(rawRecvPrivKey, rawRecvPrivKeyLen);
+  if (!ctx->recvPrivKey) {
+    ctx->err = ECE_ERROR_INVALID_PRIVATE_KEY;
+    return ctx->err;
+  }
+  memcpy(ctx->authSecret, authSecret, ECE_WEBPUSH_AUTH_SECRET_LENGTH);
+  return ECE_OK;
+}
+
+// Grows the record buffer to hold a full record.
+static int
+ece_aes128gcm_decrypt_reserve_record(ece_aes128gcm_decrypt_ctx_t* ctx) {
+  if (ctx->recordCapacity < ctx->rs) {
+    uint8_t* record = ece_realloc(ctx->record, ctx->rs);
+    if (!record) {
+      return ECE_ERROR_OUT_OF_MEMORY;
+    }
+    ctx->record = record;
+    ctx->recordCapacity = ctx->rs;
+  }
+  return ECE_OK;
+}
+
+int
+ece_webpush_aesgcm_decrypt_init(
+  ece_aes128gcm_decrypt_ctx_t* ctx, const uint8_t* rawRecvPrivKey,
+  size_t rawRecvPrivKeyLen, const uint8_t* authSecret, size_t authSecretLen,
+  const uint8_t* salt, size_t saltLen, const uint8_t* rawSenderPubKey,
+  size_t rawSenderPubKeyLen, uint32_t rs) {
+  ece_aes128gcm_decrypt_ctx_reset(ctx);
+  int err = ECE_OK;
+  EC_KEY* recvPrivKey = NULL;
+  EC_KEY* senderPubKey = NULL;
+  if (rs < ECE_AESGCM_MIN_RS || !ece_aesgcm_rs(rs)) {
+    err = ECE_ERROR_INVALID_RS;
+    goto end;
+  }
+  if (authSecretLen != ECE_WEBPUSH_AUTH_SECRET_LENGTH) {
+    err = ECE_ERROR_INVALID_AUTH_SECRET;
+    goto end;
+  }
+  if (saltLen != ECE_SALT_LENGTH) {
+    err = ECE_ERROR_INVALID_SALT;
+    goto end;
+  }
+  recvPrivKey = ece_stats_import_private_key(rawRecvPrivKey, rawRecvPrivKeyLen);
+  if (!recvPrivKey) {
+    err = ECE_ERROR_INVALID_PRIVATE_KEY;
+    goto end;
+  }
+  senderPubKey =
+    ece_stats_import_public_key(rawSenderPubKey, rawSenderPubKeyLen);
+  if (!senderPubKey) {
+    err = ECE_ERROR_INVALID_PUBLIC_KEY;
+    goto end;
+  }
+  // The salt and sender key come from the headers, so we can derive the key
+  // now, instead of waiting for the first record.
+  uint8_t key[ECE_AES_KEY_LENGTH];
+  ECE_TRACE1(derive_key_start, saltLen);
+  uint64_t start = ece_stats_begin();
+  err = ece_webpush_aesgcm_derive_key_and_nonce(
+    ECE_MODE_DECRYPT, recvPrivKey, senderPubKey, authSecret, authSecretLen,
+    salt, saltLen, key, ctx->nonce);
+  ece_stats_end(ECE_STATS_STAGE_DERIVE_KEY, start, 0, err);
+  ECE_TRACE2(derive_key_done, saltLen, err);
+  if (err) {
+    goto end;
+  }
+  err = ece_record_decrypt_init(ctx->cipherCtx, key);
+  if (err) {
+    goto end;
+  }
+  ctx->rs = ece_aesgcm_rs(rs);
+  err = ece_aes128gcm_decrypt_reserve_record(ctx);
+  if (err) {
+    goto end;
+  }
+  ctx->hasHeader = true;
+  ctx->hasKey = true;
+  ctx->unpad = &ece_aesgcm_unpad;
+  ctx->needsTrailer = true;
+
+end:
+  EC_KEY_free(recvPrivKey);
+  EC_KEY_free(senderPubKey);
+  ctx->err = err;
+  return err;
+}
+
+size_t
+ece_aes128gcm_decrypt_update_max_length(const ece_aes128gcm_decrypt_ctx_t* ctx,
+                                        size_t payloadLen) {
+  // Each record decrypts to fewer bytes than it occupies in the payload, so
+  // the plaintext can't be longer than the pending record and the new chunk.
+  if (payloadLen > SIZE_MAX - ctx->recordLen) {
+    return SIZE_MAX;
+  }
+  return ctx->recordLen + payloadLen;
+}
+
+// Buffers the payload header, and advances `payload` past the header bytes.
+static int
+ece_aes128gcm_decrypt_read_header(ece_aes128gcm_decrypt_ctx_t* ctx,
+                                  const uint8_t** payload, size_t* payloadLen) {
+  while (!ctx->hasHeader && *payloadLen) {
+    if (!ctx->headerLen) {
+      ECE_TRACE1(header_parse_start, *payloadLen);
+    }
+    // We don't know the key ID length until we've read the fixed-size part of
+    // the header.
+    size_t headerLen = ECE_AES128GCM_HEADER_LENGTH;
+    if (ctx->headerLen >= ECE_AES128GCM_HEADER_LENGTH) {
+      headerLen += ctx->header[ECE_AES128GCM_HEADER_LENGTH - 1];
+    }
+    size_t chunkLen = headerLen - ctx->headerLen;
+    if (chunkLen > *payloadLen) {
+      chunkLen = *payloadLen;
+    }
+    memcpy(&ctx->header[ctx->headerLen], *payload, chunkLen);
+    ctx->headerLen += chunkLen;
+    *payload += chunkLen;
+    *payloadLen -= chunkLen;
+
+    if (ctx->headerLen < ECE_AES128GCM_HEADER_LENGTH) {
+      break;
+    }
+    if (!ctx->rs) {
+      ctx->rs = ece_read_uint32_be(&ctx->header[ECE_SALT_LENGTH]);
+      if (ctx->rs < ECE_AES128GCM_MIN_RS) {
+        ECE_TRACE3(header_parse_done, ctx->headerLen, ctx->rs,
+                   ECE_ERROR_INVALID_RS);
+        return ECE_ERROR_INVALID_RS;
+      }
+    }
+    size_t keyIdLen = ctx->header[ECE_AES128GCM_HEADER_LENGTH - 1];
+    ctx->hasHeader =
+      ctx->headerLen == ECE_AES128GCM_HEADER_LENGTH + keyIdLen;
+    if (ctx->hasHeader) {
+      ECE_TRACE3(header_parse_done, ctx->headerLen, ctx->rs, ECE_OK);
+    }
+  }
+  return ECE_OK;
+}
+
+// Derives the content encryption key and nonce from the header, and sets up the
+// cipher context and record buffer.
+static int
+ece_aes128gcm_decrypt_derive_key(ece_aes128gcm_decrypt_ctx_t* ctx) {
+  const uint8_t* salt = ctx->header;
+  const uint8_t* keyId = &ctx->header[ECE_AES128GCM_HEADER_LENGTH];
+  size_t keyIdLen = ctx->header[ECE_AES128GCM_HEADER_LENGTH - 1];
+
+  int err = ECE_OK;
+  uint8_t key[ECE_AES_KEY_LENGTH];
+  uint64_t start;
+  ECE_TRACE1(derive_key_start, ECE_SALT_LENGTH);
+  if (ctx->recvPrivKey) {
+    // For Web Push, the key ID is the sender's public key.
+    EC_KEY* senderPubKey = ece_stats_import_public_key(keyId, keyIdLen);
+    if (!senderPubKey) {
+      ECE_TRACE2(derive_key_done, ECE_SALT_LENGTH,
+                 ECE_ERROR_INVALID_PUBLIC_KEY);
+      return ECE_ERROR_INVALID_PUBLIC_KEY;
+    }
+    start = ece_stats_begin();
+    err = ece_webpush_aes128gcm_derive_key_and_nonce(
+      ECE_MODE_DECRYPT, ctx->recvPrivKey, senderPubKey, ctx->authSecret,
+      ECE_WEBPUSH_AUTH_SECRET_LENGTH, salt, ECE_SALT_LENGTH, key, ctx->nonce);
+    EC_KEY_free(senderPubKey);
+  } else {
+    start = ece_stats_begin();
+    err = ece_aes128gcm_derive_key_and_nonce(salt, ECE_SALT_LENGTH, ctx->ikm,
+                                             ctx->ikmLen, key, ctx->nonce);
+  }
+  ece_stats_end(ECE_STATS_STAGE_DERIVE_KEY, start, 0, err);
+  ECE_TRACE2(derive_key_done, ECE_SALT_LENGTH, err);
+  if (err) {
+    return err;
+  }
+  err = ece_record_decrypt_init(ctx->cipherCtx, key);
+  if (err) {
+    return err;
+  }
+  err = ece_aes128gcm_decrypt_reserve_record(ctx);
+  if (err) {
+    return err;
+  }
+  ctx->hasKey = true;
+  return ECE_OK;
+}
+
+// Decrypts and unpads one record into `plaintext`. The input value of
+// `plaintextLen` is the remaining space in `plaintext`; the output is the
+// length of the unpadded block.
+static int
+ece_aes128gcm_decrypt_record(ece_aes128gcm_decrypt_ctx_t* ctx,
+                             const uint8_t* record, size_t recordLen,
+                             bool isLastRecord, uint8_t* plaintext,
+                             size_t* plaintextLen) {
+  if (recordLen > ECE_TAG_LENGTH &&
+      recordLen - ECE_TAG_LENGTH > *plaintextLen) {
+    return ECE_ERROR_OUT_OF_MEMORY;
+  }
+  uint8_t iv[ECE_NONCE_LENGTH];
+  ece_generate_iv(ctx->nonce, ctx->counter, iv);
+  ECE_TRACE3(record_open_start, ctx->counter, recordLen, ctx->rs);
+  int err =
+    ece_record_decrypt(ctx->cipherCtx, iv, record, recordLen, plaintext);
+  ECE_TRACE3(record_open_done, ctx->counter, recordLen, err);
+  if (err) {
+    return err;
+  }
+  size_t blockLen = recordLen - ECE_TAG_LENGTH;
+  err = ctx->unpad(plaintext, isLastRecord, &blockLen);
+  if (err) {
+    return err;
+  }
+  ctx->counter++;
+  *plaintextLen = blockLen;
+  return ECE_OK;
+}
+
+int
+ece_aes128gcm_decrypt_update(ece_aes128gcm_decrypt_ctx_t* ctx,
+                             const uint8_t* payload, size_t payloadLen,
+                             uint8_t* plaintext, size_t* plaintextLen) {
+  if (ctx->err) {
+    return ctx->err;
+  }
+  int err = ece_aes128gcm_decrypt_read_header(ctx, &payload, &payloadLen);
+  if (err) {
+    goto end;
+  }
+  if (payloadLen && !ctx->hasKey) {
+    // We wait for the first ciphertext byte before deriving the key, so that
+    // an empty ciphertext fails with the same error as the one-shot API.
+    err = ece_aes128gcm_decrypt_derive_key(ctx);
+    if (err) {
+      goto end;
+    }
+  }
+  size_t plaintextStart = 0;
+  while (payloadLen) {
+    size_t blockLen = *plaintextLen - plaintextStart;
+    if (ctx->recordLen == ctx->rs) {
+      // We have more input, so the pending record isn't the last one.
+      err =
+        ece_aes128gcm_decrypt_record(ctx, ctx->record, ctx->recordLen, false,
+                                     &plaintext[plaintextStart], &blockLen);
+      if (err) {
+        goto end;
+      }
+      plaintextStart += blockLen;
+      ctx->recordLen = 0;
+      continue;
+    }
+    if (!ctx->recordLen && payloadLen > ctx->rs) {
+      // Decrypt full records straight from the input, instead of copying them
+      // into the record buffer first.
+      err = ece_aes128gcm_decrypt_record(ctx, payload, ctx->rs, false,
+                                         &plaintext[plaintextStart], &blockLen);
+      if (err) {
+        goto end;
+      }
+      plaintextStart += blockLen;
+      payload += ctx->rs;
+      payloadLen -= ctx->rs;
+      continue;
+    }
+    size_t chunkLen = ctx->rs - ctx->recordLen;
+    if (chunkLen > payloadLen) {
+      chunkLen = payloadLen;
+    }
+    memcpy(&ctx->record[ctx->recordLen], payload, chunkLen);
+    ctx->recordLen += chunkLen;
+    payload += chunkLen;
+    payloadLen -= chunkLen;
+  }
+  *plaintextLen = plaintextStart;
+
+end:
+  ctx->err = err;
+  return err;
+}
+
+int
+ece_aes128gcm_decrypt_final(ece_aes128gcm_decrypt_ctx_t* ctx,
+                            uint8_t* plaintext, size_t* plaintextLen) {
+  if (ctx->err) {
+    return ctx->err;
+  }
+  int err = ECE_OK;
+  if (!ctx->hasHeader) {
+    err = ECE_ERROR_SHORT_HEADER;
+    goto end;
+  }
+  if (!ctx->recordLen) {
+    err = ECE_ERROR_ZERO_CIPHERTEXT;
+    goto end;
+  }
+  if (ctx->needsTrailer && ctx->recordLen == ctx->rs) {
+    err = ECE_ERROR_DECRYPT_TRUNCATED;
+    goto end;
+  }
+  err = ece_aes128gcm_decrypt_record(ctx, ctx->record, ctx->recordLen, true,
+                                     plaintext, plaintextLen);
+  if (err) {
+    goto end;
+  }
+  ctx->recordLen = 0;
+
+end:
+  ctx->err = err;
+  return err;
+}
@@ -0,0 +1,161 @@
+#include "ece/encrypt.h"
+
+#include "ece/alloc.h"
+#include "ece/pool.h"
+#include "ece/rand.h"
+#include "ece/stats.h"
+
+// A contiguous range of subscribers, encrypted by one worker with its own
+// context.
+typedef struct ece_fanout_run_s {
+  ece_encrypt_ctx_t* ctx;
+  size_t start;
+  size_t end;
+} ece_fanout_run_t;
+
+typedef struct ece_fanout_job_s {
+  // The shared sender key, or `NULL` to generate one per subscriber. OpenSSL
+  // only reads the key during ECDH, so workers can use it concurrently.
+  EC_KEY* senderPrivKey;
+  uint32_t rs;
+  size_t padLen;
+  const uint8_t* plaintext;
+  size_t plaintextLen;
+  const uint8_t* const* rawRecvPubKeys;
+  const uint8_t* const* authSecrets;
+  uint8_t* const* payloads;
+  size_t* payloadLens;
+  int* errs;
+  ece_fanout_run_t* runs;
+} ece_fanout_job_t;
+
+static int
+ece_fanout_encrypt(const ece_fanout_job_t* job, ece_encrypt_ctx_t* ctx,
+                   size_t index) {
+  int err = ECE_OK;
+  EC_KEY* senderPrivKey = NULL;
+  EC_KEY* recvPubKey = NULL;
+  // Each worker draws its salts from its own thread's randomness buffer.
+  uint8_t salt[ECE_SALT_LENGTH];
+  if (!ece_rand_bytes(salt, ECE_SALT_LENGTH)) {
+    err = ECE_ERROR_INVALID_SALT;
+    goto end;
+  }
+  recvPubKey = ece_stats_import_public_key(job->rawRecvPubKeys[index],
+                                           ECE_WEBPUSH_PUBLIC_KEY_LENGTH);
+  if (!recvPubKey) {
+    err = ECE_ERROR_INVALID_PUBLIC_KEY;
+    goto end;
+  }
+  if (!job->senderPrivKey) {
+    senderPrivKey = ece_encrypt_generate_key();
+    if (!senderPrivKey) {
+      err = ECE_ERROR_INVALID_PRIVATE_KEY;
+      goto end;
+    }
+  }
+  err = ece_webpush_aes128gcm_encrypt_init_keys(
+    ctx, senderPrivKey ? senderPrivKey : job->senderPrivKey, recvPubKey,
+    job->authSecrets[index], ECE_WEBPUSH_AUTH_SECRET_LENGTH, salt,
+    ECE_SALT_LENGTH, job->rs, job->padLen);
+  if (err) {
+    goto end;
+  }
+  err = ece_encrypt_all(ctx, job->plaintext, job->plaintextLen,
+                        job->payloads[index], &job->payloadLens[index]);
+
+end:
+  EC_KEY_free(senderPrivKey);
+  EC_KEY_free(recvPubKey);
+  return err;
+}
+
+static void
+ece_fanout_task(void* arg, size_t index) {
+  ece_fanout_job_t* job = arg;
+  const ece_fanout_run_t* run = &job->runs[index];
+  for (size_t i = run->start; i < run->end; i++) {
+    job->errs[i] = ece_fanout_encrypt(job, run->ctx, i);
+  }
+}
+
+int
+ece_webpush_aes128gcm_encrypt_fanout(
+  ece_pool_t* pool, ece_sender_key_policy_t senderKeyPolicy, uint32_t rs,
+  size_t padLen, const uint8_t* plaintext, size_t plaintextLen, size_t count,
+  const uint8_t* const* rawRecvPubKeys, const uint8_t* const* authSecrets,
+  uint8_t* const* payloads, size_t* payloadLens, int* errs) {
+  if (!count) {
+    return ECE_OK;
+  }
+  int err = ECE_OK;
+  ece_fanout_run_t* runs = NULL;
+  EC_KEY* senderPrivKey = NULL;
+  bool ran = false;
+
+  size_t numRuns = ece_pool_size(pool);
+  if (numRuns > count) {
+    numRuns = count;
+  }
+  runs = ece_calloc(numRuns, sizeof(ece_fanout_run_t));
+  if (!runs) {
+    err = ECE_ERROR_OUT_OF_MEMORY;
+    goto end;
+  }
+  // The contexts are allocated here, rather than by the workers, so that they
+  // come from the caller's allocator.
+  for (size_t i = 0; i < numRuns; i++) {
+    runs[i].ctx = ece_encrypt_ctx_new();
+    if (!runs[i].ctx) {
+      err = ECE_ERROR_OUT_OF_MEMORY;
+      goto end;
+    }
+    runs[i].start = count * i / numRuns;
+    runs[i].end = count * (i + 1) / numRuns;
+  }
+  if (senderKeyPolicy == ECE_SENDER_KEY_PER_CALL) {
+    senderPrivKey = ece_encrypt_generate_key();
+    if (!senderPrivKey) {
+      err = ECE_ERROR_INVALID_PRIVATE_KEY;
+      goto end;
+    }
+  }
+
+  ece_fanout_job_t job = {
+    .senderPrivKey = senderPrivKey,
+    .rs = rs,
+    .padLen = padLen,
+    .plaintext = plaintext,
+    .plaintextLen = plaintextLen,
+    .rawRecvPubKeys = rawRecvPubKeys,
+    .authSecrets = authSecrets,
+    .payloads = payloads,
+    .payloadLens = payloadLens,
+    .errs = errs,
+    .runs = runs,
+  };
+  ece_pool_run(pool, numRuns, &ece_fanout_task, &job);
+  ran = true;
+  for (size_t i = 0; i < count; i++) {
+    if (errs[i]) {
+      err = errs[i];
+      break;
+    }
+  }
+
+end:
+  if (runs) {
+    for (size_t i = 0; i < numRuns; i++) {
+      ece_encrypt_ctx_free(runs[i].ctx);
+    }
+    ece_free(runs);
+  }
+  EC_KEY_free(senderPrivKey);
+  if (err && !ran) {
+    // Nothing was encrypted, so every subscriber fails with the same error.
+    for (size_t i = 0; i < count; i++) {
+      errs[i] = err;
+    }
+  }
+  return err;
+}
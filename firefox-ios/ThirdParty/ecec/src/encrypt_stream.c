@@ -0,0 +1,1217 @@
+#include "ece/encrypt.h"
+
+#include "ece/alloc.h"
+#include "ece/base64url.h"
+#include "ece/iov.h"
+#include "ece/pool.h"
+#include "ece/rand.h"
+#include "ece/record.h"
+#include "ece/stats.h"
+#include "ece/trace.h"
+#include "ece/trailer.h"
+
+#include <string.h>
+
+#include <openssl/obj_mac.h>
+
+// The length of the "aes128gcm" header for Web Push payloads, where the key ID
+// is the sender public key.
+#define ECE_WEBPUSH_AES128GCM_HEADER_LENGTH                                    \
+  (ECE_AES128GCM_HEADER_LENGTH + ECE_WEBPUSH_PUBLIC_KEY_LENGTH)
+
+struct ece_encrypt_ctx_s {
+  EVP_CIPHER_CTX* cipherCtx;
+  uint8_t nonce[ECE_NONCE_LENGTH];
+
+  // The encrypted record size, including the padding and authentication tag.
+  // For "aesgcm", this is `rs + ECE_TAG_LENGTH`.
+  uint32_t rs;
+  size_t padSize;
+  pad_t pad;
+  needs_trailer_t needsTrailer;
+
+  // The "aes128gcm" header, written before the first record. `headerLen` is
+  // the number of header bytes that haven't been written yet, and is always 0
+  // for "aesgcm".
+  uint8_t header[ECE_WEBPUSH_AES128GCM_HEADER_LENGTH];
+  size_t headerLen;
+
+  // The padded block for the pending record. Padding is spread over the
+  // records in the same way as the one-shot functions, so each record's
+  // padding length is known before we see its plaintext.
+  uint8_t* block;
+  size_t blockCapacity;
+  size_t blockPadLen;
+  size_t dataLen;
+  // The remaining padding that hasn't been assigned to a record yet.
+  size_t padLen;
+
+  uint64_t counter;
+  size_t plaintextLen;
+  size_t ciphertextLen;
+
+  int err;
+};
+
+ECE_STATIC_ASSERT(sizeof(ece_encrypt_ctx_t) <= ECE_MAX_CONTEXT_LENGTH,
+                  ece_encrypt_ctx_fits);
+
+ece_encrypt_ctx_t*
+ece_encrypt_ctx_new(void) {
+  ece_encrypt_ctx_t* ctx = ece_calloc(1, sizeof(ece_encrypt_ctx_t));
+  if (!ctx) {
+    return NULL;
+  }
+  ctx->cipherCtx = EVP_CIPHER_CTX_new();
+  if (!ctx->cipherCtx) {
+    ece_free(ctx);
+    return NULL;
+  }
+  return ctx;
+}
+
+void
+ece_encrypt_ctx_free(ece_encrypt_ctx_t* ctx) {
+  if (!ctx) {
+    return;
+  }
+  EVP_CIPHER_CTX_free(ctx->cipherCtx);
+  ece_free(ctx->block);
+  ece_free(ctx);
+}
+
+// Returns the maximum length of a record's contents and padding, excluding the
+// padding delimiter.
+static inline size_t
+ece_encrypt_max_block_len(const ece_encrypt_ctx_t* ctx) {
+  return ctx->rs - ctx->padSize - ECE_TAG_LENGTH;
+}
+
+// Returns the plaintext offset in the pending block.
+static inline size_t
+ece_encrypt_data_offset(const ece_encrypt_ctx_t* ctx) {
+  return ctx->pad == &ece_aesgcm_pad ? ctx->padSize + ctx->blockPadLen : 0;
+}
+
+// Returns the maximum plaintext length for the pending record.
+static inline size_t
+ece_encrypt_max_data_len(const ece_encrypt_ctx_t* ctx) {
+  return ece_encrypt_max_block_len(ctx) - ctx->blockPadLen;
+}
+
+// Assigns padding to the next record. As with the one-shot functions, we
+// include as much padding as possible in the first records, and leave room for
+// at least one byte of plaintext in each.
+static void
+ece_encrypt_next_record(ece_encrypt_ctx_t* ctx) {
+  size_t blockPadLen = ece_encrypt_max_block_len(ctx) - 1;
+  if (ctx->padLen && !blockPadLen) {
+    blockPadLen++;
+  }
+  if (blockPadLen > ctx->padLen) {
+    blockPadLen = ctx->padLen;
+  }
+  ctx->padLen -= blockPadLen;
+  ctx->blockPadLen = blockPadLen;
+  ctx->dataLen = 0;
+}
+
+// Returns the encrypted length of the pending record.
+static inline size_t
+ece_encrypt_record_len(const ece_encrypt_ctx_t* ctx) {
+  return ctx->padSize + ctx->blockPadLen + ctx->dataLen + ECE_TAG_LENGTH;
+}
+
+// Indicates if the pending record must be followed by another record, even if
+// there's no more plaintext.
+static bool
+ece_encrypt_needs_more_records(const ece_encrypt_ctx_t* ctx) {
+  return ctx->padLen ||
+         ctx->needsTrailer(ctx->rs - ECE_TAG_LENGTH,
+                           ctx->ciphertextLen + ece_encrypt_record_len(ctx));
+}
+
+static int
+ece_encrypt_init(ece_encrypt_ctx_t* ctx, EC_KEY* senderPrivKey,
+                 EC_KEY* recvPubKey, const uint8_t* authSecret,
+                 size_t authSecretLen, const uint8_t* salt, size_t saltLen,
+                 uint32_t rs, size_t padSize, size_t padLen,
+                 derive_key_and_nonce_t deriveKeyAndNonce,
+                 needs_trailer_t needsTrailer, pad_t pad) {
+  if (authSecretLen != ECE_WEBPUSH_AUTH_SECRET_LENGTH) {
+    return ECE_ERROR_INVALID_AUTH_SECRET;
+  }
+  if (saltLen != ECE_SALT_LENGTH) {
+    return ECE_ERROR_INVALID_SALT;
+  }
+  if (rs <= padSize + ECE_TAG_LENGTH) {
+    return ECE_ERROR_INVALID_RS;
+  }
+  uint8_t key[ECE_AES_KEY_LENGTH];
+  ECE_TRACE1(derive_key_start, saltLen);
+  uint64_t start = ece_stats_begin();
+  int err =
+    deriveKeyAndNonce(ECE_MODE_ENCRYPT, senderPrivKey, recvPubKey, authSecret,
+                      authSecretLen, salt, saltLen, key, ctx->nonce);
+  ece_stats_end(ECE_STATS_STAGE_DERIVE_KEY, start, 0, err);
+  ECE_TRACE2(derive_key_done, saltLen, err);
+  if (err) {
+    return err;
+  }
+  err = ece_record_encrypt_init(ctx->cipherCtx, key);
+  if (err) {
+    return err;
+  }
+  if (ctx->blockCapacity < rs) {
+    uint8_t* block = ece_realloc(ctx->block, rs);
+    if (!block) {
+      return ECE_ERROR_OUT_OF_MEMORY;
+    }
+    ctx->block = block;
+    ctx->blockCapacity = rs;
+  }
+  ctx->rs = rs;
+  ctx->padSize = padSize;
+  ctx->pad = pad;
+  ctx->needsTrailer = needsTrailer;
+  ctx->padLen = padLen;
+  ctx->counter = 0;
+  ctx->plaintextLen = 0;
+  ctx->ciphertextLen = 0;
+  // Clears the error from the last message, if the context is being reused.
+  ctx->err = ECE_OK;
+  ece_encrypt_next_record(ctx);
+  return ECE_OK;
+}
+
+int
+ece_webpush_aes128gcm_encrypt_init_keys(ece_encrypt_ctx_t* ctx,
+                                        EC_KEY* senderPrivKey,
+                                        EC_KEY* recvPubKey,
+                                        const uint8_t* authSecret,
+                                        size_t authSecretLen,
+                                        const uint8_t* salt, size_t saltLen,
+                                        uint32_t rs, size_t padLen) {
+  if (rs < ECE_AES128GCM_MIN_RS) {
+    return ECE_ERROR_INVALID_RS;
+  }
+  int err = ece_encrypt_init(ctx, senderPrivKey, recvPubKey, authSecret,
+                             authSecretLen, salt, saltLen, rs,
+                             ECE_AES128GCM_PAD_SIZE, padLen,
+                             &ece_webpush_aes128gcm_derive_key_and_nonce,
+                             &ece_aes128gcm_needs_trailer, &ece_aes128gcm_pad);
+  if (err) {
+    return err;
+  }
+  // The header is salt || rs || idLen || keyId, where the key ID is the
+  // sender public key.
+  memcpy(ctx->header, salt, ECE_SALT_LENGTH);
+  ctx->header[ECE_SALT_LENGTH] = (rs >> 24) & 0xff;
+  ctx->header[ECE_SALT_LENGTH + 1] = (rs >> 16) & 0xff;
+  ctx->header[ECE_SALT_LENGTH + 2] = (rs >> 8) & 0xff;
+  ctx->header[ECE_SALT_LENGTH + 3] = rs & 0xff;
+  ctx->header[ECE_AES128GCM_HEADER_LENGTH - 1] = ECE_WEBPUSH_PUBLIC_KEY_LENGTH;
+  if (EC_POINT_point2oct(EC_KEY_get0_group(senderPrivKey),
+                         EC_KEY_get0_public_key(senderPrivKey),
+                         POINT_CONVERSION_UNCOMPRESSED,
+                         &ctx->header[ECE_AES128GCM_HEADER_LENGTH],
+                         ECE_WEBPUSH_PUBLIC_KEY_LENGTH,
+                         NULL) != ECE_WEBPUSH_PUBLIC_KEY_LENGTH) {
+    return ECE_ERROR_ENCODE_PUBLIC_KEY;
+  }
+  ctx->headerLen = ECE_WEBPUSH_AES128GCM_HEADER_LENGTH;
+  return ECE_OK;
+}
+
+EC_KEY*
+ece_encrypt_generate_key(void) {
+  // We generate the key ourselves, instead of with `EC_KEY_generate_key`, so
+  // that the private key comes from the thread's randomness buffer.
+  EC_KEY* key = EC_KEY_new_by_curve_name(NID_X9_62_prime256v1);
+  BIGNUM* scalar = BN_secure_new();
+  EC_POINT* pubKey = NULL;
+  bool ok = false;
+  if (!key || !scalar) {
+    goto end;
+  }
+  const EC_GROUP* group = EC_KEY_get0_group(key);
+  pubKey = EC_POINT_new(group);
+  BN_set_flags(scalar, BN_FLG_CONSTTIME);
+  ok = pubKey && ece_rand_scalar(EC_GROUP_get0_order(group), scalar) &&
+       EC_POINT_mul(group, pubKey, scalar, NULL, NULL, NULL) == 1 &&
+       EC_KEY_set_private_key(key, scalar) == 1 &&
+       EC_KEY_set_public_key(key, pubKey) == 1;
+
+end:
+  EC_POINT_free(pubKey);
+  BN_clear_free(scalar);
+  if (!ok) {
+    EC_KEY_free(key);
+    return NULL;
+  }
+  return key;
+}
+
+int
+ece_webpush_aes128gcm_encrypt_init(ece_encrypt_ctx_t* ctx,
+                                   const uint8_t* rawRecvPubKey,
+                                   size_t rawRecvPubKeyLen,
+                                   const uint8_t* authSecret,
+                                   size_t authSecretLen, uint32_t rs,
+                                   size_t padLen) {
+  int err = ECE_OK;
+  EC_KEY* senderPrivKey = NULL;
+  EC_KEY* recvPubKey = NULL;
+  uint8_t salt[ECE_SALT_LENGTH];
+  if (!ece_rand_bytes(salt, ECE_SALT_LENGTH)) {
+    err = ECE_ERROR_INVALID_SALT;
+    goto end;
+  }
+  senderPrivKey = ece_encrypt_generate_key();
+  if (!senderPrivKey) {
+    err = ECE_ERROR_INVALID_PRIVATE_KEY;
+    goto end;
+  }
+  recvPubKey = ece_stats_import_public_key(rawRecvPubKey, rawRecvPubKeyLen);
+  if (!recvPubKey) {
+    err = ECE_ERROR_INVALID_PUBLIC_KEY;
+    goto end;
+  }
+  err = ece_webpush_aes128gcm_encrypt_init_keys(
+    ctx, senderPrivKey, recvPubKey, authSecret, authSecretLen, salt,
+    ECE_SALT_LENGTH, rs, padLen);
+
+end:
+  EC_KEY_free(senderPrivKey);
+  EC_KEY_free(recvPubKey);
+  ctx->err = err;
+  return err;
+}
+
+int
+ece_webpush_aes128gcm_encrypt_init_with_keys(
+  ece_encrypt_ctx_t* ctx, const uint8_t* rawSenderPrivKey,
+  size_t rawSenderPrivKeyLen, const uint8_t* authSecret, size_t authSecretLen,
+  const uint8_t* salt, size_t saltLen, const uint8_t* rawRecvPubKey,
+  size_t rawRecvPubKeyLen, uint32_t rs, size_t padLen) {
+  int err = ECE_OK;
+  EC_KEY* senderPrivKey = NULL;
+  EC_KEY* recvPubKey = NULL;
+  senderPrivKey =
+    ece_stats_import_private_key(rawSenderPrivKey, rawSenderPrivKeyLen);
+  if (!senderPrivKey) {
+    err = ECE_ERROR_INVALID_PRIVATE_KEY;
+    goto end;
+  }
+  recvPubKey = ece_stats_import_public_key(rawRecvPubKey, rawRecvPubKeyLen);
+  if (!recvPubKey) {
+    err = ECE_ERROR_INVALID_PUBLIC_KEY;
+    goto end;
+  }
+  err = ece_webpush_aes128gcm_encrypt_init_keys(ctx, senderPrivKey, recvPubKey,
+                                                authSecret, authSecretLen, salt,
+                                                saltLen, rs, padLen);
+
+end:
+  EC_KEY_free(senderPrivKey);
+  EC_KEY_free(recvPubKey);
+  ctx->err = err;
+  return err;
+}
+
+int
+ece_webpush_aesgcm_encrypt_init_keys(ece_encrypt_ctx_t* ctx,
+                                     EC_KEY* senderPrivKey, EC_KEY* recvPubKey,
+                                     const uint8_t* authSecret,
+                                     size_t authSecretLen, const uint8_t* salt,
+                                     size_t saltLen, uint32_t rs,
+                                     size_t padLen) {
+  if (rs < ECE_AESGCM_MIN_RS) {
+    return ECE_ERROR_INVALID_RS;
+  }
+  uint32_t ciphertextRs = ece_aesgcm_rs(rs);
+  if (!ciphertextRs) {
+    return ECE_ERROR_INVALID_RS;
+  }
+  int err = ece_encrypt_init(ctx, senderPrivKey, recvPubKey, authSecret,
+                             authSecretLen, salt, saltLen, ciphertextRs,
+                             ECE_AESGCM_PAD_SIZE, padLen,
+                             &ece_webpush_aesgcm_derive_key_and_nonce,
+                             &ece_aesgcm_needs_trailer, &ece_aesgcm_pad);
+  if (err) {
+    return err;
+  }
+  // "aesgcm" sends the salt and sender public key in the `Encryption` and
+  // `Crypto-Key` headers, so the ciphertext starts with the first record.
+  ctx->headerLen = 0;
+  return ECE_OK;
+}
+
+int
+ece_webpush_aesgcm_encrypt_init(ece_encrypt_ctx_t* ctx,
+                                const uint8_t* rawRecvPubKey,
+                                size_t rawRecvPubKeyLen,
+                                const uint8_t* authSecret, size_t authSecretLen,
+                                uint32_t rs, size_t padLen, uint8_t* salt,
+                                size_t saltLen, uint8_t* rawSenderPubKey,
+                                size_t rawSenderPubKeyLen) {
+  int err = ECE_OK;
+  EC_KEY* senderPrivKey = NULL;
+  EC_KEY* recvPubKey = NULL;
+  if (saltLen != ECE_SALT_LENGTH || !ece_rand_bytes(salt, saltLen)) {
+    err = ECE_ERROR_INVALID_SALT;
+    goto end;
+  }
+  if (rawSenderPubKeyLen != ECE_WEBPUSH_PUBLIC_KEY_LENGTH) {
+    err = ECE_ERROR_INVALID_PUBLIC_KEY;
+    goto end;
+  }
+  senderPrivKey = ece_encrypt_generate_key();
+  if (!senderPrivKey) {
+    err = ECE_ERROR_INVALID_PRIVATE_KEY;
+    goto end;
+  }
+  if (EC_POINT_point2oct(EC_KEY_get0_group(senderPrivKey),
+                         EC_KEY_get0_public_key(senderPrivKey),
+                         POINT_CONVERSION_UNCOMPRESSED, rawSenderPubKey,
+                         rawSenderPubKeyLen, NULL) != rawSenderPubKeyLen) {
+    err = ECE_ERROR_ENCODE_PUBLIC_KEY;
+    goto end;
+  }
+  recvPubKey = ece_stats_import_public_key(rawRecvPubKey, rawRecvPubKeyLen);
+  if (!recvPubKey) {
+    err = ECE_ERROR_INVALID_PUBLIC_KEY;
+    goto end;
+  }
+  err = ece_webpush_aesgcm_encrypt_init_keys(ctx, senderPrivKey, recvPubKey,
+                                             authSecret, authSecretLen, salt,
+                                             saltLen, rs, padLen);
+
+end:
+  EC_KEY_free(senderPrivKey);
+  EC_KEY_free(recvPubKey);
+  ctx->err = err;
+  return err;
+}
+
+int
+ece_webpush_aesgcm_encrypt_init_with_keys(
+  ece_encrypt_ctx_t* ctx, const uint8_t* rawSenderPrivKey,
+  size_t rawSenderPrivKeyLen, const uint8_t* authSecret, size_t authSecretLen,
+  const uint8_t* salt, size_t saltLen, const uint8_t* rawRecvPubKey,
+  size_t rawRecvPubKeyLen, uint32_t rs, size_t padLen) {
+  int err = ECE_OK;
+  EC_KEY* senderPrivKey = NULL;
+  EC_KEY* recvPubKey = NULL;
+  senderPrivKey =
+    ece_stats_import_private_key(rawSenderPrivKey, rawSenderPrivKeyLen);
+  if (!senderPrivKey) {
+    err = ECE_ERROR_INVALID_PRIVATE_KEY;
+    goto end;
+  }
+  recvPubKey = ece_stats_import_public_key(rawRecvPubKey, rawRecvPubKeyLen);
+  if (!recvPubKey) {
+    err = ECE_ERROR_INVALID_PUBLIC_KEY;
+    goto end;
+  }
+  err = ece_webpush_aesgcm_encrypt_init_keys(ctx, senderPrivKey, recvPubKey,
+                                             authSecret, authSecretLen, salt,
+                                             saltLen, rs, padLen);
+
+end:
+  EC_KEY_free(senderPrivKey);
+  EC_KEY_free(recvPubKey);
+  ctx->err = err;
+  return err;
+}
+
+size_t
+ece_encrypt_update_max_length(const ece_encrypt_ctx_t* ctx,
+                              size_t plaintextLen) {
+  if (ctx->err) {
+    return 0;
+  }
+  // Every record except the last holds `maxBlockLen` bytes of plaintext and
+  // padding, so we can bound the number of records we'll write.
+  size_t dataLen =
+    ctx->dataLen + ctx->blockPadLen + ctx->padLen + plaintextLen;
+  size_t numRecords = dataLen / ece_encrypt_max_block_len(ctx) + 1;
+  return ctx->headerLen + numRecords * ctx->rs;
+}
+
+// Writes any pending header bytes to `ciphertext`.
+static int
+ece_encrypt_write_header(ece_encrypt_ctx_t* ctx, uint8_t* ciphertext,
+                         size_t ciphertextLen, size_t* ciphertextStart) {
+  if (!ctx->headerLen) {
+    return ECE_OK;
+  }
+  if (ctx->headerLen > ciphertextLen) {
+    return ECE_ERROR_OUT_OF_MEMORY;
+  }
+  memcpy(ciphertext, ctx->header, ctx->headerLen);
+  *ciphertextStart += ctx->headerLen;
+  ctx->headerLen = 0;
+  return ECE_OK;
+}
+
+// Pads and encrypts the pending record into `ciphertext`, and starts the next
+// record.
+static int
+ece_encrypt_seal(ece_encrypt_ctx_t* ctx, bool isLastRecord,
+                 uint8_t* ciphertext, size_t ciphertextLen,
+                 size_t* ciphertextStart) {
+  size_t recordLen = ece_encrypt_record_len(ctx);
+  if (recordLen > ciphertextLen - *ciphertextStart) {
+    return ECE_ERROR_OUT_OF_MEMORY;
+  }
+  ctx->pad(ctx->block, ctx->blockPadLen, ctx->dataLen, isLastRecord);
+  uint8_t iv[ECE_NONCE_LENGTH];
+  ece_generate_iv(ctx->nonce, ctx->counter, iv);
+  ECE_TRACE3(record_seal_start, ctx->counter, recordLen - ECE_TAG_LENGTH,
+             ctx->rs);
+  int err = ece_record_encrypt(ctx->cipherCtx, iv, ctx->block,
+                               recordLen - ECE_TAG_LENGTH,
+                               &ciphertext[*ciphertextStart]);
+  ECE_TRACE3(record_seal_done, ctx->counter, recordLen - ECE_TAG_LENGTH, err);
+  if (err) {
+    return err;
+  }
+  ctx->counter++;
+  ctx->ciphertextLen += recordLen;
+  *ciphertextStart += recordLen;
+  ece_encrypt_next_record(ctx);
+  return ECE_OK;
+}
+
+int
+ece_encrypt_update(ece_encrypt_ctx_t* ctx, const uint8_t* plaintext,
+                   size_t plaintextLen, uint8_t* ciphertext,
+                   size_t* ciphertextLen) {
+  if (ctx->err) {
+    return ctx->err;
+  }
+  size_t ciphertextStart = 0;
+  int err = ece_encrypt_write_header(ctx, ciphertext, *ciphertextLen,
+                                     &ciphertextStart);
+  if (err) {
+    goto end;
+  }
+  ctx->plaintextLen += plaintextLen;
+  while (true) {
+    if (ctx->dataLen == ece_encrypt_max_data_len(ctx)) {
+      // The pending record is full. We can only seal it once we know it's not
+      // the last record, since "aes128gcm" uses a different delimiter for the
+      // last record.
+      if (!plaintextLen && !ece_encrypt_needs_more_records(ctx)) {
+        break;
+      }
+      err = ece_encrypt_seal(ctx, false, ciphertext, *ciphertextLen,
+                             &ciphertextStart);
+      if (err) {
+        goto end;
+      }
+      continue;
+    }
+    if (!plaintextLen) {
+      break;
+    }
+    size_t chunkLen = ece_encrypt_max_data_len(ctx) - ctx->dataLen;
+    if (chunkLen > plaintextLen) {
+      chunkLen = plaintextLen;
+    }
+    memcpy(&ctx->block[ece_encrypt_data_offset(ctx) + ctx->dataLen], plaintext,
+           chunkLen);
+    ctx->dataLen += chunkLen;
+    plaintext += chunkLen;
+    plaintextLen -= chunkLen;
+  }
+  *ciphertextLen = ciphertextStart;
+
+end:
+  ctx->err = err;
+  return err;
+}
+
+int
+ece_encrypt_final(ece_encrypt_ctx_t* ctx, uint8_t* ciphertext,
+                  size_t* ciphertextLen) {
+  if (ctx->err) {
+    return ctx->err;
+  }
+  int err = ECE_OK;
+  if (!ctx->plaintextLen) {
+    err = ECE_ERROR_ZERO_PLAINTEXT;
+    goto end;
+  }
+  size_t ciphertextStart = 0;
+  err = ece_encrypt_write_header(ctx, ciphertext, *ciphertextLen,
+                                 &ciphertextStart);
+  if (err) {
+    goto end;
+  }
+  // Write the remaining plaintext and padding, followed by a padding-only
+  // trailer record if the ciphertext would otherwise end on a record
+  // boundary.
+  bool isLastRecord = false;
+  while (!isLastRecord) {
+    isLastRecord = !ece_encrypt_needs_more_records(ctx);
+    if (!isLastRecord &&
+        ctx->blockPadLen + ctx->dataLen < ece_encrypt_max_block_len(ctx)) {
+      // We ran out of plaintext before we could spread the remaining padding
+      // over full records.
+      err = ECE_ERROR_ENCRYPT_PADDING;
+      goto end;
+    }
+    err = ece_encrypt_seal(ctx, isLastRecord, ciphertext, *ciphertextLen,
+                           &ciphertextStart);
+    if (err) {
+      goto end;
+    }
+  }
+  *ciphertextLen = ciphertextStart;
+
+end:
+  ctx->err = err;
+  return err;
+}
+
+int
+ece_encrypt_all(ece_encrypt_ctx_t* ctx, const uint8_t* plaintext,
+                size_t plaintextLen, uint8_t* ciphertext,
+                size_t* ciphertextLen) {
+  size_t updateLen = *ciphertextLen;
+  int err =
+    ece_encrypt_update(ctx, plaintext, plaintextLen, ciphertext, &updateLen);
+  if (err) {
+    return err;
+  }
+  size_t finalLen = *ciphertextLen - updateLen;
+  err = ece_encrypt_final(ctx, &ciphertext[updateLen], &finalLen);
+  if (err) {
+    return err;
+  }
+  *ciphertextLen = updateLen + finalLen;
+  return ECE_OK;
+}
+
+// The position of a record in a message encrypted with `ece_encrypt_parallel`,
+// `ece_encrypt_in_place`, `ece_encrypt_iov`, or `ece_encrypt_base64url`.
+// Since the whole plaintext is known up front, each record's padding and
+// contents can be computed without encrypting the records before it.
+typedef struct ece_encrypt_layout_s {
+  // The state before the next record.
+  uint64_t counter;
+  size_t padLen;
+  size_t plaintextStart;
+  size_t ciphertextStart;
+
+  // The next record.
+  size_t blockPadLen;
+  size_t dataLen;
+  bool isLastRecord;
+} ece_encrypt_layout_t;
+
+// Computes the next record in `layout`, using the same rules as
+// `ece_encrypt_update` and `ece_encrypt_final`.
+static int
+ece_encrypt_layout_next(const ece_encrypt_ctx_t* ctx, size_t plaintextLen,
+                        ece_encrypt_layout_t* layout) {
+  size_t maxBlockLen = ece_encrypt_max_block_len(ctx);
+  size_t blockPadLen = maxBlockLen - 1;
+  if (layout->padLen && !blockPadLen) {
+    blockPadLen++;
+  }
+  if (blockPadLen > layout->padLen) {
+    blockPadLen = layout->padLen;
+  }
+  size_t dataLen = plaintextLen - layout->plaintextStart;
+  if (dataLen > maxBlockLen - blockPadLen) {
+    dataLen = maxBlockLen - blockPadLen;
+  }
+  size_t recordLen = ctx->padSize + blockPadLen + dataLen + ECE_TAG_LENGTH;
+  bool needsMoreRecords =
+    layout->padLen > blockPadLen ||
+    ctx->needsTrailer(ctx->rs - ECE_TAG_LENGTH,
+                      layout->ciphertextStart + recordLen);
+  bool isLastRecord =
+    layout->plaintextStart + dataLen == plaintextLen && !needsMoreRecords;
+  if (!isLastRecord && blockPadLen + dataLen < maxBlockLen) {
+    return ECE_ERROR_ENCRYPT_PADDING;
+  }
+  layout->blockPadLen = blockPadLen;
+  layout->dataLen = dataLen;
+  layout->isLastRecord = isLastRecord;
+  return ECE_OK;
+}
+
+// Moves `layout` past the record computed by `ece_encrypt_layout_next`.
+static void
+ece_encrypt_layout_advance(const ece_encrypt_ctx_t* ctx,
+                           ece_encrypt_layout_t* layout) {
+  layout->counter++;
+  layout->padLen -= layout->blockPadLen;
+  layout->plaintextStart += layout->dataLen;
+  layout->ciphertextStart += ctx->padSize + layout->blockPadLen +
+                             layout->dataLen + ECE_TAG_LENGTH;
+}
+
+// Returns the plaintext offset in the block for the record at `layout`.
+static inline size_t
+ece_encrypt_layout_data_offset(const ece_encrypt_ctx_t* ctx,
+                               const ece_encrypt_layout_t* layout) {
+  return ctx->pad == &ece_aesgcm_pad ? ctx->padSize + layout->blockPadLen : 0;
+}
+
+// Pads and encrypts the record at `layout` in place. `block` must have room
+// for the whole record, including the tag. `data` holds the record's
+// contents, which are moved to their offset in `block` first; they may
+// overlap `block`, or already be in place.
+static int
+ece_encrypt_seal_record(const ece_encrypt_ctx_t* ctx,
+                        EVP_CIPHER_CTX* cipherCtx,
+                        const ece_encrypt_layout_t* layout,
+                        const uint8_t* data, uint8_t* block) {
+  uint8_t* dataStart = &block[ece_encrypt_layout_data_offset(ctx, layout)];
+  if (data != dataStart) {
+    memmove(dataStart, data, layout->dataLen);
+  }
+  ctx->pad(block, layout->blockPadLen, layout->dataLen, layout->isLastRecord);
+  uint8_t iv[ECE_NONCE_LENGTH];
+  ece_generate_iv(ctx->nonce, layout->counter, iv);
+  size_t blockLen = ctx->padSize + layout->blockPadLen + layout->dataLen;
+  ECE_TRACE3(record_seal_start, layout->counter, blockLen, ctx->rs);
+  int err = ece_record_encrypt(cipherCtx, iv, block, blockLen, block);
+  ECE_TRACE3(record_seal_done, layout->counter, blockLen, err);
+  return err;
+}
+
+// Lays out all records for a message with `plaintextLen` bytes of plaintext,
+// to find the number of records and their encrypted length. `start` is set to
+// the layout before the first record.
+static int
+ece_encrypt_layout_all(const ece_encrypt_ctx_t* ctx, size_t plaintextLen,
+                       ece_encrypt_layout_t* start, uint64_t* numRecords,
+                       size_t* recordsLen) {
+  // `ece_encrypt_init` already assigned padding to the first record, so we
+  // start from the total padding length.
+  ece_encrypt_layout_t layout = {
+    .padLen = ctx->padLen + ctx->blockPadLen,
+  };
+  *start = layout;
+  while (true) {
+    int err = ece_encrypt_layout_next(ctx, plaintextLen, &layout);
+    if (err) {
+      return err;
+    }
+    bool isLastRecord = layout.isLastRecord;
+    ece_encrypt_layout_advance(ctx, &layout);
+    if (isLastRecord) {
+      break;
+    }
+  }
+  *numRecords = layout.counter;
+  *recordsLen = layout.ciphertextStart;
+  return ECE_OK;
+}
+
+// Leaves the context in the same state as `ece_encrypt_final`, after writing
+// the header and all records of a message at once.
+static void
+ece_encrypt_finish(ece_encrypt_ctx_t* ctx, uint64_t numRecords,
+                   size_t plaintextLen, size_t recordsLen) {
+  ctx->headerLen = 0;
+  ctx->counter = numRecords;
+  ctx->plaintextLen = plaintextLen;
+  ctx->ciphertextLen = recordsLen;
+  ctx->padLen = 0;
+  ece_encrypt_next_record(ctx);
+}
+
+// Returns the exact length of all records for a message, or 0 if the record
+// size is too small or the padding can't be spread over the records. The
+// layout only reads the record size, padding, and trailer rule, so we can lay
+// out a message without deriving keys.
+static size_t
+ece_encrypt_records_length(uint32_t rs, size_t padSize, size_t padLen,
+                           needs_trailer_t needsTrailer, size_t plaintextLen) {
+  if (rs <= padSize + ECE_TAG_LENGTH || !plaintextLen) {
+    return 0;
+  }
+  ece_encrypt_ctx_t ctx;
+  memset(&ctx, 0, sizeof(ece_encrypt_ctx_t));
+  ctx.rs = rs;
+  ctx.padSize = padSize;
+  ctx.needsTrailer = needsTrailer;
+  ctx.padLen = padLen;
+  ece_encrypt_next_record(&ctx);
+  ece_encrypt_layout_t start;
+  uint64_t numRecords;
+  size_t recordsLen;
+  if (ece_encrypt_layout_all(&ctx, plaintextLen, &start, &numRecords,
+                             &recordsLen)) {
+    return 0;
+  }
+  return recordsLen;
+}
+
+size_t
+ece_webpush_aes128gcm_payload_length(uint32_t rs, size_t padLen,
+                                     size_t plaintextLen) {
+  if (rs < ECE_AES128GCM_MIN_RS) {
+    return 0;
+  }
+  size_t recordsLen =
+    ece_encrypt_records_length(rs, ECE_AES128GCM_PAD_SIZE, padLen,
+                               &ece_aes128gcm_needs_trailer, plaintextLen);
+  if (!recordsLen) {
+    return 0;
+  }
+  return ECE_WEBPUSH_AES128GCM_HEADER_LENGTH + recordsLen;
+}
+
+size_t
+ece_webpush_aesgcm_ciphertext_length(uint32_t rs, size_t padLen,
+                                     size_t plaintextLen) {
+  if (rs < ECE_AESGCM_MIN_RS) {
+    return 0;
+  }
+  uint32_t ciphertextRs = ece_aesgcm_rs(rs);
+  if (!ciphertextRs) {
+    return 0;
+  }
+  return ece_encrypt_records_length(ciphertextRs, ECE_AESGCM_PAD_SIZE, padLen,
+                                    &ece_aesgcm_needs_trailer, plaintextLen);
+}
+
+// A run of records encrypted by one worker.
+typedef struct ece_encrypt_run_s {
+  EVP_CIPHER_CTX* cipherCtx;
+  ece_encrypt_layout_t layout;
+  uint64_t endRecord;
+  int err;
+} ece_encrypt_run_t;
+
+typedef struct ece_encrypt_job_s {
+  const ece_encrypt_ctx_t* ctx;
+  const uint8_t* plaintext;
+  size_t plaintextLen;
+  uint8_t* ciphertext;
+  ece_encrypt_run_t* runs;
+} ece_encrypt_job_t;
+
+static void
+ece_encrypt_task(void* arg, size_t index) {
+  ece_encrypt_job_t* job = arg;
+  const ece_encrypt_ctx_t* ctx = job->ctx;
+  ece_encrypt_run_t* run = &job->runs[index];
+  ece_encrypt_layout_t* layout = &run->layout;
+  while (layout->counter < run->endRecord) {
+    run->err = ece_encrypt_layout_next(ctx, job->plaintextLen, layout);
+    if (run->err) {
+      return;
+    }
+    // Each block is padded and encrypted in place, in the record's slot in the
+    // ciphertext.
+    run->err = ece_encrypt_seal_record(
+      ctx, run->cipherCtx, layout, &job->plaintext[layout->plaintextStart],
+      &job->ciphertext[layout->ciphertextStart]);
+    if (run->err) {
+      return;
+    }
+    ece_encrypt_layout_advance(ctx, layout);
+  }
+}
+
+int
+ece_encrypt_parallel(ece_encrypt_ctx_t* ctx, ece_pool_t* pool,
+                     const uint8_t* plaintext, size_t plaintextLen,
+                     uint8_t* ciphertext, size_t* ciphertextLen) {
+  if (ctx->err) {
+    return ctx->err;
+  }
+  if (ece_pool_size(pool) < 2 || ctx->plaintextLen || ctx->counter) {
+    // There's nothing to split, or the context already has pending records.
+    return ece_encrypt_all(ctx, plaintext, plaintextLen, ciphertext,
+                           ciphertextLen);
+  }
+  int err = ECE_OK;
+  ece_encrypt_run_t* runs = NULL;
+  size_t numRuns = 0;
+  if (!plaintextLen) {
+    err = ECE_ERROR_ZERO_PLAINTEXT;
+    goto end;
+  }
+
+  // Lay out all records first, to find the number of records and the
+  // ciphertext length.
+  ece_encrypt_layout_t start;
+  uint64_t numRecords;
+  size_t recordsLen;
+  err = ece_encrypt_layout_all(ctx, plaintextLen, &start, &numRecords,
+                               &recordsLen);
+  if (err) {
+    goto end;
+  }
+  if (ctx->headerLen > *ciphertextLen ||
+      recordsLen > *ciphertextLen - ctx->headerLen) {
+    err = ECE_ERROR_OUT_OF_MEMORY;
+    goto end;
+  }
+
+  numRuns = ece_pool_size(pool);
+  if (numRuns > numRecords) {
+    numRuns = (size_t) numRecords;
+  }
+  runs = ece_calloc(numRuns, sizeof(ece_encrypt_run_t));
+  if (!runs) {
+    err = ECE_ERROR_OUT_OF_MEMORY;
+    goto end;
+  }
+  // Walk the layout again to find where each run starts. Each run gets its own
+  // copy of the cipher context, which already has the key schedule.
+  ece_encrypt_layout_t layout = start;
+  for (size_t i = 0; i < numRuns; i++) {
+    ece_encrypt_run_t* run = &runs[i];
+    uint64_t firstRecord = numRecords * i / numRuns;
+    while (layout.counter < firstRecord) {
+      ece_encrypt_layout_next(ctx, plaintextLen, &layout);
+      ece_encrypt_layout_advance(ctx, &layout);
+    }
+    run->layout = layout;
+    run->endRecord = numRecords * (i + 1) / numRuns;
+    if (!i) {
+      run->cipherCtx = ctx->cipherCtx;
+      continue;
+    }
+    run->cipherCtx = EVP_CIPHER_CTX_new();
+    if (!run->cipherCtx) {
+      err = ECE_ERROR_OUT_OF_MEMORY;
+      goto end;
+    }
+    if (EVP_CIPHER_CTX_copy(run->cipherCtx, ctx->cipherCtx) != 1) {
+      err = ECE_ERROR_ENCRYPT;
+      goto end;
+    }
+  }
+
+  memcpy(ciphertext, ctx->header, ctx->headerLen);
+  ece_encrypt_job_t job = {
+    .ctx = ctx,
+    .plaintext = plaintext,
+    .plaintextLen = plaintextLen,
+    .ciphertext = &ciphertext[ctx->headerLen],
+    .runs = runs,
+  };
+  ece_pool_run(pool, numRuns, &ece_encrypt_task, &job);
+  for (size_t i = 0; i < numRuns; i++) {
+    if (runs[i].err) {
+      err = runs[i].err;
+      goto end;
+    }
+  }
+  *ciphertextLen = ctx->headerLen + recordsLen;
+  ece_encrypt_finish(ctx, numRecords, plaintextLen, recordsLen);
+
+end:
+  if (runs) {
+    for (size_t i = 1; i < numRuns; i++) {
+      EVP_CIPHER_CTX_free(runs[i].cipherCtx);
+    }
+    ece_free(runs);
+  }
+  ctx->err = err;
+  return err;
+}
+
+int
+ece_encrypt_in_place(ece_encrypt_ctx_t* ctx, uint8_t* buffer, size_t bufferLen,
+                     size_t plaintextLen, size_t* ciphertextLen) {
+  if (ctx->err) {
+    return ctx->err;
+  }
+  int err = ECE_OK;
+  if (ctx->plaintextLen || ctx->counter) {
+    // The context already has a pending record outside the buffer.
+    err = ECE_ERROR_ENCRYPT;
+    goto end;
+  }
+  if (!plaintextLen) {
+    err = ECE_ERROR_ZERO_PLAINTEXT;
+    goto end;
+  }
+  ece_encrypt_layout_t layout;
+  uint64_t numRecords;
+  size_t recordsLen;
+  err = ece_encrypt_layout_all(ctx, plaintextLen, &layout, &numRecords,
+                               &recordsLen);
+  if (err) {
+    goto end;
+  }
+  if (ctx->headerLen > bufferLen ||
+      recordsLen > bufferLen - ctx->headerLen) {
+    err = ECE_ERROR_OUT_OF_MEMORY;
+    goto end;
+  }
+
+  // The plaintext is at the end of the buffer, and the records are written
+  // from the start. Each record is at least as long as its contents, so the
+  // records written so far always end before the plaintext we haven't read
+  // yet. This also holds for the header, since the records are at least as
+  // long as the plaintext.
+  uint8_t* plaintext = &buffer[bufferLen - plaintextLen];
+  memcpy(buffer, ctx->header, ctx->headerLen);
+  uint8_t* records = &buffer[ctx->headerLen];
+  while (true) {
+    err = ece_encrypt_layout_next(ctx, plaintextLen, &layout);
+    if (err) {
+      goto end;
+    }
+    // A record's contents may overlap their slot; the seal moves them before
+    // writing the padding.
+    err = ece_encrypt_seal_record(ctx, ctx->cipherCtx, &layout,
+                                  &plaintext[layout.plaintextStart],
+                                  &records[layout.ciphertextStart]);
+    if (err) {
+      goto end;
+    }
+    bool isLastRecord = layout.isLastRecord;
+    ece_encrypt_layout_advance(ctx, &layout);
+    if (isLastRecord) {
+      break;
+    }
+  }
+  *ciphertextLen = ctx->headerLen + recordsLen;
+  ece_encrypt_finish(ctx, numRecords, plaintextLen, recordsLen);
+
+end:
+  ctx->err = err;
+  return err;
+}
+
+int
+ece_encrypt_iov(ece_encrypt_ctx_t* ctx, const ece_iovec_t* plaintext,
+                size_t plaintextCount, const ece_iovec_t* ciphertext,
+                size_t ciphertextCount, size_t* ciphertextLen) {
+  if (ctx->err) {
+    return ctx->err;
+  }
+  int err = ECE_OK;
+  if (ctx->plaintextLen || ctx->counter) {
+    // The context already has a pending record.
+    err = ECE_ERROR_ENCRYPT;
+    goto end;
+  }
+  size_t plaintextLen = ece_iov_length(plaintext, plaintextCount);
+  if (!plaintextLen) {
+    err = ECE_ERROR_ZERO_PLAINTEXT;
+    goto end;
+  }
+  ece_encrypt_layout_t layout;
+  uint64_t numRecords;
+  size_t recordsLen;
+  err = ece_encrypt_layout_all(ctx, plaintextLen, &layout, &numRecords,
+                               &recordsLen);
+  if (err) {
+    goto end;
+  }
+  size_t maxCiphertextLen = ece_iov_length(ciphertext, ciphertextCount);
+  if (ctx->headerLen > maxCiphertextLen ||
+      recordsLen > maxCiphertextLen - ctx->headerLen) {
+    err = ECE_ERROR_OUT_OF_MEMORY;
+    goto end;
+  }
+
+  ece_iov_cursor_t input;
+  ece_iov_cursor_init(&input, plaintext, plaintextCount);
+  ece_iov_cursor_t output;
+  ece_iov_cursor_init(&output, ciphertext, ciphertextCount);
+  ece_iov_write(&output, ctx->header, ctx->headerLen);
+  while (true) {
+    err = ece_encrypt_layout_next(ctx, plaintextLen, &layout);
+    if (err) {
+      goto end;
+    }
+    // Records that fit in the current output segment are padded and encrypted
+    // in place. Records that straddle segments are built in the pending block,
+    // then copied out.
+    size_t recordLen = ctx->padSize + layout.blockPadLen + layout.dataLen +
+                       ECE_TAG_LENGTH;
+    size_t segmentLen;
+    uint8_t* block = ece_iov_peek(&output, &segmentLen);
+    bool isScattered = segmentLen < recordLen;
+    if (isScattered) {
+      block = ctx->block;
+    }
+    uint8_t* data = &block[ece_encrypt_layout_data_offset(ctx, &layout)];
+    ece_iov_read(&input, data, layout.dataLen);
+    err = ece_encrypt_seal_record(ctx, ctx->cipherCtx, &layout, data, block);
+    if (err) {
+      goto end;
+    }
+    if (isScattered) {
+      ece_iov_write(&output, block, recordLen);
+    } else {
+      ece_iov_skip(&output, recordLen);
+    }
+    bool isLastRecord = layout.isLastRecord;
+    ece_encrypt_layout_advance(ctx, &layout);
+    if (isLastRecord) {
+      break;
+    }
+  }
+  *ciphertextLen = ctx->headerLen + recordsLen;
+  ece_encrypt_finish(ctx, numRecords, plaintextLen, recordsLen);
+
+end:
+  ctx->err = err;
+  return err;
+}
+
+size_t
+ece_encrypt_base64url_length(const ece_encrypt_ctx_t* ctx, size_t plaintextLen,
+                             ece_base64url_encode_policy_t paddingPolicy) {
+  if (ctx->err || ctx->plaintextLen || ctx->counter || !plaintextLen) {
+    return 0;
+  }
+  ece_encrypt_layout_t layout;
+  uint64_t numRecords;
+  size_t recordsLen;
+  if (ece_encrypt_layout_all(ctx, plaintextLen, &layout, &numRecords,
+                             &recordsLen)) {
+    return 0;
+  }
+  return ece_base64url_encode(NULL, ctx->headerLen + recordsLen, paddingPolicy,
+                              NULL, 0);
+}
+
+int
+ece_encrypt_base64url(ece_encrypt_ctx_t* ctx, const uint8_t* plaintext,
+                      size_t plaintextLen,
+                      ece_base64url_encode_policy_t paddingPolicy,
+                      char* base64, size_t* base64Len) {
+  if (ctx->err) {
+    return ctx->err;
+  }
+  int err = ECE_OK;
+  if (ctx->plaintextLen || ctx->counter) {
+    // The context already has a pending record.
+    err = ECE_ERROR_ENCRYPT;
+    goto end;
+  }
+  if (!plaintextLen) {
+    err = ECE_ERROR_ZERO_PLAINTEXT;
+    goto end;
+  }
+  ece_encrypt_layout_t layout;
+  uint64_t numRecords;
+  size_t recordsLen;
+  err = ece_encrypt_layout_all(ctx, plaintextLen, &layout, &numRecords,
+                               &recordsLen);
+  if (err) {
+    goto end;
+  }
+  if (ece_base64url_encode(NULL, ctx->headerLen + recordsLen, paddingPolicy,
+                           NULL, 0) > *base64Len) {
+    err = ECE_ERROR_OUT_OF_MEMORY;
+    goto end;
+  }
+
+  // We checked the full length up front, so the encoder always has room for
+  // each chunk.
+  ece_base64url_encoder_t encoder;
+  ece_base64url_encoder_init(&encoder, paddingPolicy);
+  size_t outLen = *base64Len;
+  err = ece_base64url_encode_update(&encoder, ctx->header, ctx->headerLen,
+                                    base64, &outLen);
+  if (err) {
+    goto end;
+  }
+  size_t encodedLen = outLen;
+  while (true) {
+    err = ece_encrypt_layout_next(ctx, plaintextLen, &layout);
+    if (err) {
+      goto end;
+    }
+    // Each record is sealed in the pending block, which holds a full record,
+    // and encoded before the next one overwrites it.
+    uint8_t* block = ctx->block;
+    size_t recordLen = ctx->padSize + layout.blockPadLen + layout.dataLen +
+                       ECE_TAG_LENGTH;
+    err = ece_encrypt_seal_record(ctx, ctx->cipherCtx, &layout,
+                                  &plaintext[layout.plaintextStart], block);
+    if (err) {
+      goto end;
+    }
+    outLen = *base64Len - encodedLen;
+    err = ece_base64url_encode_update(&encoder, block, recordLen,
+                                      &base64[encodedLen], &outLen);
+    if (err) {
+      goto end;
+    }
+    encodedLen += outLen;
+    bool isLastRecord = layout.isLastRecord;
+    ece_encrypt_layout_advance(ctx, &layout);
+    if (isLastRecord) {
+      break;
+    }
+  }
+  outLen = *base64Len - encodedLen;
+  err = ece_base64url_encode_final(&encoder, &base64[encodedLen], &outLen);
+  if (err) {
+    goto end;
+  }
+  *base64Len = encodedLen + outLen;
+  ece_encrypt_finish(ctx, numRecords, plaintextLen, recordsLen);
+
+end:
+  ctx->err = err;
+  return err;
+}
+
+size_t
+ece_aes128gcm_payload_length_base64url(
+  uint32_t rs, size_t padLen, size_t plaintextLen,
+  ece_base64url_encode_policy_t paddingPolicy) {
+  if (rs < ECE_AES128GCM_MIN_RS) {
+    return 0;
+  }
+  // The layout only depends on the record size, padding, and scheme, so we
+  // can compute it without deriving any keys.
+  ece_encrypt_ctx_t ctx = {
+    .rs = rs,
+    .padSize = ECE_AES128GCM_PAD_SIZE,
+    .pad = &ece_aes128gcm_pad,
+    .needsTrailer = &ece_aes128gcm_needs_trailer,
+    .headerLen = ECE_WEBPUSH_AES128GCM_HEADER_LENGTH,
+    .padLen = padLen,
+  };
+  return ece_encrypt_base64url_length(&ctx, plaintextLen, paddingPolicy);
+}
+
+int
+ece_webpush_aes128gcm_encrypt_base64url(
+  const uint8_t* rawRecvPubKey, size_t rawRecvPubKeyLen,
+  const uint8_t* authSecret, size_t authSecretLen, uint32_t rs, size_t padLen,
+  const uint8_t* plaintext, size_t plaintextLen,
+  ece_base64url_encode_policy_t paddingPolicy, char* payload,
+  size_t* payloadLen) {
+  int err = ECE_OK;
+  ece_encrypt_ctx_t* ctx = ece_encrypt_ctx_new();
+  if (!ctx) {
+    err = ECE_ERROR_OUT_OF_MEMORY;
+    goto end;
+  }
+  err = ece_webpush_aes128gcm_encrypt_init(ctx, rawRecvPubKey,
+                                           rawRecvPubKeyLen, authSecret,
+                                           authSecretLen, rs, padLen);
+  if (err) {
+    goto end;
+  }
+  err = ece_encrypt_base64url(ctx, plaintext, plaintextLen, paddingPolicy,
+                              payload, payloadLen);
+
+end:
+  ece_encrypt_ctx_free(ctx);
+  return err;
+}
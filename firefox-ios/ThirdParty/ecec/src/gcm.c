@@ -0,0 +1,391 @@
+#include "ece/gcm.h"
+
+#include "ece/cipher.h"
+#include "ece/record.h"
+
+#include <limits.h>
+#include <string.h>
+
+#include <openssl/crypto.h>
+#include <openssl/evp.h>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define ECE_GCM_HAVE_CLMUL
+#endif
+
+#ifdef ECE_GCM_HAVE_CLMUL
+#ifdef _MSC_VER
+#include <intrin.h>
+#define ECE_GCM_TARGET
+#else
+#include <cpuid.h>
+#include <emmintrin.h>
+#include <tmmintrin.h>
+#include <wmmintrin.h>
+// The kernel is compiled for AES-NI and PCLMULQDQ even if the rest of the
+// library isn't, and only called if the CPU supports them.
+#define ECE_GCM_TARGET __attribute__((target("aes,pclmul,ssse3")))
+#endif
+#endif /* ECE_GCM_HAVE_CLMUL */
+
+// Clears the output of a record that failed authentication, so that callers
+// can't use unauthenticated plaintext.
+static void
+ece_gcm_clear_output(ece_gcm_job_t* job) {
+  if (job->inLen > ECE_TAG_LENGTH) {
+    OPENSSL_cleanse(job->out, job->inLen - ECE_TAG_LENGTH);
+  }
+}
+
+// Runs jobs one at a time with OpenSSL. Consecutive jobs with the same key
+// share a pooled context, so they also share a key schedule.
+static void
+ece_gcm_portable(ece_gcm_job_t* jobs, size_t count, bool encrypt) {
+  EVP_CIPHER_CTX* ctx = NULL;
+  const uint8_t* key = NULL;
+  for (size_t i = 0; i < count; i++) {
+    ece_gcm_job_t* job = &jobs[i];
+    if (job->key != key) {
+      ece_cipher_ctx_release(ctx);
+      key = NULL;
+      job->err = ece_cipher_ctx_acquire(
+        encrypt ? ECE_MODE_ENCRYPT : ECE_MODE_DECRYPT, job->key, &ctx);
+      if (job->err) {
+        continue;
+      }
+      key = job->key;
+    }
+    if (encrypt) {
+      job->err =
+        ece_record_encrypt(ctx, job->iv, job->in, job->inLen, job->out);
+      continue;
+    }
+    job->err = ece_record_decrypt(ctx, job->iv, job->in, job->inLen, job->out);
+    if (job->err == ECE_ERROR_DECRYPT) {
+      ece_gcm_clear_output(job);
+    }
+  }
+  ece_cipher_ctx_release(ctx);
+}
+
+#ifdef ECE_GCM_HAVE_CLMUL
+
+static bool
+ece_gcm_cpu_has_clmul(void) {
+  unsigned int ecx;
+#ifdef _MSC_VER
+  int info[4];
+  __cpuid(info, 1);
+  ecx = (unsigned int) info[2];
+#else
+  unsigned int eax, ebx, edx;
+  if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx)) {
+    return false;
+  }
+#endif
+  // PCLMULQDQ is bit 1, SSSE3 is bit 9, and AES-NI is bit 25.
+  return (ecx & (1u << 1)) && (ecx & (1u << 9)) && (ecx & (1u << 25));
+}
+
+// The state for one lane of the kernel. GHASH values are kept byte-reversed,
+// so that the carry-less multiply can treat them as little-endian.
+typedef struct ece_gcm_lane_s {
+  __m128i rk[11];
+  __m128i h;
+  __m128i y;
+  __m128i ctr;
+  __m128i tagMask;
+  size_t len;
+  bool active;
+} ece_gcm_lane_t;
+
+static inline ECE_GCM_TARGET __m128i
+ece_gcm_bswap(__m128i x) {
+  const __m128i mask =
+    _mm_set_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+  return _mm_shuffle_epi8(x, mask);
+}
+
+static inline ECE_GCM_TARGET __m128i
+ece_gcm_expand_step(__m128i key, __m128i gen) {
+  gen = _mm_shuffle_epi32(gen, 0xff);
+  key = _mm_xor_si128(key, _mm_slli_si128(key, 4));
+  key = _mm_xor_si128(key, _mm_slli_si128(key, 4));
+  key = _mm_xor_si128(key, _mm_slli_si128(key, 4));
+  return _mm_xor_si128(key, gen);
+}
+
+// `_mm_aeskeygenassist_si128` needs a constant round constant, so the key
+// expansion is unrolled.
+#define ECE_GCM_EXPAND(rk, i, rcon)                                            \
+  (rk)[i] = ece_gcm_expand_step((rk)[(i) - 1],                                \
+                                _mm_aeskeygenassist_si128((rk)[(i) - 1], rcon))
+
+static ECE_GCM_TARGET void
+ece_gcm_expand_key(const uint8_t* key, __m128i* rk) {
+  rk[0] = _mm_loadu_si128((const __m128i*) key);
+  ECE_GCM_EXPAND(rk, 1, 0x01);
+  ECE_GCM_EXPAND(rk, 2, 0x02);
+  ECE_GCM_EXPAND(rk, 3, 0x04);
+  ECE_GCM_EXPAND(rk, 4, 0x08);
+  ECE_GCM_EXPAND(rk, 5, 0x10);
+  ECE_GCM_EXPAND(rk, 6, 0x20);
+  ECE_GCM_EXPAND(rk, 7, 0x40);
+  ECE_GCM_EXPAND(rk, 8, 0x80);
+  ECE_GCM_EXPAND(rk, 9, 0x1b);
+  ECE_GCM_EXPAND(rk, 10, 0x36);
+}
+
+static inline ECE_GCM_TARGET __m128i
+ece_gcm_encrypt_block(const __m128i* rk, __m128i block) {
+  block = _mm_xor_si128(block, rk[0]);
+  for (int r = 1; r < 10; r++) {
+    block = _mm_aesenc_si128(block, rk[r]);
+  }
+  return _mm_aesenclast_si128(block, rk[10]);
+}
+
+// Multiplies two byte-reversed elements of GF(2^128), using the reflected
+// method from Intel's "Carry-Less Multiplication and Its Usage for Computing
+// the GCM Mode" white paper.
+static inline ECE_GCM_TARGET __m128i
+ece_gcm_mul(__m128i a, __m128i b) {
+  __m128i lo = _mm_clmulepi64_si128(a, b, 0x00);
+  __m128i mid = _mm_xor_si128(_mm_clmulepi64_si128(a, b, 0x10),
+                              _mm_clmulepi64_si128(a, b, 0x01));
+  __m128i hi = _mm_clmulepi64_si128(a, b, 0x11);
+  lo = _mm_xor_si128(lo, _mm_slli_si128(mid, 8));
+  hi = _mm_xor_si128(hi, _mm_srli_si128(mid, 8));
+
+  // Shift the 256-bit product left by one bit, since the operands are
+  // bit-reflected.
+  __m128i loCarry = _mm_srli_epi32(lo, 31);
+  __m128i hiCarry = _mm_srli_epi32(hi, 31);
+  lo = _mm_slli_epi32(lo, 1);
+  hi = _mm_slli_epi32(hi, 1);
+  __m128i crossCarry = _mm_srli_si128(loCarry, 12);
+  hiCarry = _mm_slli_si128(hiCarry, 4);
+  loCarry = _mm_slli_si128(loCarry, 4);
+  lo = _mm_or_si128(lo, loCarry);
+  hi = _mm_or_si128(hi, hiCarry);
+  hi = _mm_or_si128(hi, crossCarry);
+
+  // Reduce modulo x^128 + x^7 + x^2 + x + 1.
+  __m128i t1 = _mm_xor_si128(
+    _mm_xor_si128(_mm_slli_epi32(lo, 31), _mm_slli_epi32(lo, 30)),
+    _mm_slli_epi32(lo, 25));
+  __m128i t2 = _mm_srli_si128(t1, 4);
+  lo = _mm_xor_si128(lo, _mm_slli_si128(t1, 12));
+  __m128i t3 = _mm_xor_si128(
+    _mm_xor_si128(_mm_srli_epi32(lo, 1), _mm_srli_epi32(lo, 2)),
+    _mm_srli_epi32(lo, 7));
+  t3 = _mm_xor_si128(t3, t2);
+  lo = _mm_xor_si128(lo, t3);
+  return _mm_xor_si128(hi, lo);
+}
+
+// Sets up a lane for a job: expands the key, and derives the hash key and the
+// mask for the authentication tag.
+static ECE_GCM_TARGET void
+ece_gcm_lane_init(ece_gcm_lane_t* lane, ece_gcm_job_t* job, bool encrypt) {
+  size_t len = job->inLen;
+  if (!encrypt) {
+    if (len < ECE_TAG_LENGTH) {
+      job->err = ECE_ERROR_DECRYPT;
+      return;
+    }
+    if (len == ECE_TAG_LENGTH) {
+      job->err = ECE_ERROR_SHORT_BLOCK;
+      return;
+    }
+    len -= ECE_TAG_LENGTH;
+  }
+  if (len > INT_MAX) {
+    job->err = encrypt ? ECE_ERROR_ENCRYPT : ECE_ERROR_DECRYPT;
+    return;
+  }
+  job->err = ECE_OK;
+  ece_gcm_expand_key(job->key, lane->rk);
+  lane->h = ece_gcm_bswap(
+    ece_gcm_encrypt_block(lane->rk, _mm_setzero_si128()));
+  lane->y = _mm_setzero_si128();
+
+  // The pre-counter block is the IV followed by a 32-bit big-endian 1. The
+  // tag is masked with its encryption, and the data with the following
+  // counters.
+  uint8_t j0[16];
+  memcpy(j0, job->iv, ECE_NONCE_LENGTH);
+  j0[12] = 0;
+  j0[13] = 0;
+  j0[14] = 0;
+  j0[15] = 1;
+  __m128i block = _mm_loadu_si128((const __m128i*) j0);
+  lane->tagMask = ece_gcm_encrypt_block(lane->rk, block);
+  lane->ctr = ece_gcm_bswap(block);
+  lane->len = len;
+  lane->active = true;
+}
+
+// Encrypts or decrypts up to `ECE_GCM_LANES` jobs in lockstep. The AES rounds
+// and GHASH multiplies for different lanes are independent, so the CPU can
+// overlap them.
+static ECE_GCM_TARGET void
+ece_gcm_clmul_lanes(ece_gcm_job_t* jobs, size_t count, bool encrypt) {
+  ece_gcm_lane_t lanes[ECE_GCM_LANES];
+  memset(lanes, 0, sizeof(lanes));
+  size_t maxLen = 0;
+  for (size_t l = 0; l < count; l++) {
+    ece_gcm_lane_init(&lanes[l], &jobs[l], encrypt);
+    if (lanes[l].active && lanes[l].len > maxLen) {
+      maxLen = lanes[l].len;
+    }
+  }
+
+  const __m128i one = _mm_set_epi32(0, 0, 0, 1);
+  for (size_t offset = 0; offset < maxLen; offset += 16) {
+    __m128i keystream[ECE_GCM_LANES];
+    for (size_t l = 0; l < ECE_GCM_LANES; l++) {
+      lanes[l].ctr = _mm_add_epi32(lanes[l].ctr, one);
+      keystream[l] =
+        _mm_xor_si128(ece_gcm_bswap(lanes[l].ctr), lanes[l].rk[0]);
+    }
+    for (int r = 1; r < 10; r++) {
+      for (size_t l = 0; l < ECE_GCM_LANES; l++) {
+        keystream[l] = _mm_aesenc_si128(keystream[l], lanes[l].rk[r]);
+      }
+    }
+    for (size_t l = 0; l < ECE_GCM_LANES; l++) {
+      keystream[l] = _mm_aesenclast_si128(keystream[l], lanes[l].rk[10]);
+    }
+
+    for (size_t l = 0; l < count; l++) {
+      ece_gcm_lane_t* lane = &lanes[l];
+      if (!lane->active || offset >= lane->len) {
+        continue;
+      }
+      const uint8_t* in = &jobs[l].in[offset];
+      uint8_t* out = &jobs[l].out[offset];
+      __m128i input;
+      __m128i output;
+      size_t blockLen = lane->len - offset;
+      if (blockLen >= 16) {
+        input = _mm_loadu_si128((const __m128i*) in);
+        output = _mm_xor_si128(input, keystream[l]);
+        _mm_storeu_si128((__m128i*) out, output);
+      } else {
+        // Pad the last partial block with zeros. GHASH covers the
+        // zero-padded ciphertext, so we also clear the unused keystream.
+        uint8_t buf[16] = {0};
+        memcpy(buf, in, blockLen);
+        input = _mm_loadu_si128((const __m128i*) buf);
+        output = _mm_xor_si128(input, keystream[l]);
+        _mm_storeu_si128((__m128i*) buf, output);
+        memcpy(out, buf, blockLen);
+        memset(&buf[blockLen], 0, 16 - blockLen);
+        output = _mm_loadu_si128((const __m128i*) buf);
+      }
+      __m128i ciphertext = encrypt ? output : input;
+      lane->y =
+        ece_gcm_mul(_mm_xor_si128(lane->y, ece_gcm_bswap(ciphertext)), lane->h);
+    }
+  }
+
+  for (size_t l = 0; l < count; l++) {
+    ece_gcm_lane_t* lane = &lanes[l];
+    if (!lane->active) {
+      continue;
+    }
+    // The length block holds the bit lengths of the additional data, which is
+    // always empty, and the ciphertext.
+    __m128i lens = _mm_set_epi64x(0, (long long) lane->len * 8);
+    lane->y = ece_gcm_mul(_mm_xor_si128(lane->y, lens), lane->h);
+    __m128i tag = _mm_xor_si128(ece_gcm_bswap(lane->y), lane->tagMask);
+    if (encrypt) {
+      _mm_storeu_si128((__m128i*) &jobs[l].out[lane->len], tag);
+      continue;
+    }
+    uint8_t expected[ECE_TAG_LENGTH];
+    _mm_storeu_si128((__m128i*) expected, tag);
+    if (CRYPTO_memcmp(expected, &jobs[l].in[lane->len], ECE_TAG_LENGTH)) {
+      jobs[l].err = ECE_ERROR_DECRYPT;
+      ece_gcm_clear_output(&jobs[l]);
+    }
+  }
+  // The lanes hold expanded keys.
+  OPENSSL_cleanse(lanes, sizeof(lanes));
+}
+
+static void
+ece_gcm_clmul(ece_gcm_job_t* jobs, size_t count, bool encrypt) {
+  for (size_t i = 0; i < count; i += ECE_GCM_LANES) {
+    size_t lanes = count - i;
+    if (lanes > ECE_GCM_LANES) {
+      lanes = ECE_GCM_LANES;
+    }
+    ece_gcm_clmul_lanes(&jobs[i], lanes, encrypt);
+  }
+}
+
+#endif /* ECE_GCM_HAVE_CLMUL */
+
+bool
+ece_gcm_impl_supported(ece_gcm_impl_t impl) {
+  switch (impl) {
+  case ECE_GCM_IMPL_PORTABLE:
+    return true;
+  case ECE_GCM_IMPL_CLMUL:
+#ifdef ECE_GCM_HAVE_CLMUL
+    return ece_gcm_cpu_has_clmul();
+#else
+    return false;
+#endif
+  }
+  return false;
+}
+
+ece_gcm_impl_t
+ece_gcm_best_impl(void) {
+  // 0 means we haven't probed the CPU yet. Concurrent first calls may both
+  // probe, but they'll store the same value.
+  static volatile int best = 0;
+  if (!best) {
+    best = ece_gcm_impl_supported(ECE_GCM_IMPL_CLMUL)
+             ? ECE_GCM_IMPL_CLMUL + 1
+             : ECE_GCM_IMPL_PORTABLE + 1;
+  }
+  return (ece_gcm_impl_t)(best - 1);
+}
+
+static void
+ece_gcm_run(ece_gcm_impl_t impl, ece_gcm_job_t* jobs, size_t count,
+            bool encrypt) {
+#ifdef ECE_GCM_HAVE_CLMUL
+  if (impl == ECE_GCM_IMPL_CLMUL) {
+    ece_gcm_clmul(jobs, count, encrypt);
+    return;
+  }
+#else
+  ECE_UNUSED(impl);
+#endif
+  ece_gcm_portable(jobs, count, encrypt);
+}
+
+void
+ece_gcm_open_impl(ece_gcm_impl_t impl, ece_gcm_job_t* jobs, size_t count) {
+  ece_gcm_run(impl, jobs, count, false);
+}
+
+void
+ece_gcm_seal_impl(ece_gcm_impl_t impl, ece_gcm_job_t* jobs, size_t count) {
+  ece_gcm_run(impl, jobs, count, true);
+}
+
+void
+ece_gcm_open(ece_gcm_job_t* jobs, size_t count) {
+  ece_gcm_open_impl(ece_gcm_best_impl(), jobs, count);
+}
+
+void
+ece_gcm_seal(ece_gcm_job_t* jobs, size_t count) {
+  ece_gcm_seal_impl(ece_gcm_best_impl(), jobs, count);
+}
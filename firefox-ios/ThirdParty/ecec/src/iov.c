@@ -0,0 +1,90 @@
+#include "ece/iov.h"
+
+#include <string.h>
+
+size_t
+ece_iov_length(const ece_iovec_t* iov, size_t count) {
+  size_t len = 0;
+  for (size_t i = 0; i < count; i++) {
+    len += iov[i].len;
+  }
+  return len;
+}
+
+void
+ece_iov_cursor_init(ece_iov_cursor_t* cursor, const ece_iovec_t* iov,
+                    size_t count) {
+  cursor->iov = iov;
+  cursor->count = count;
+  cursor->index = 0;
+  cursor->offset = 0;
+}
+
+uint8_t*
+ece_iov_peek(ece_iov_cursor_t* cursor, size_t* len) {
+  while (cursor->index < cursor->count &&
+         cursor->offset == cursor->iov[cursor->index].len) {
+    cursor->index++;
+    cursor->offset = 0;
+  }
+  if (cursor->index == cursor->count) {
+    *len = 0;
+    return NULL;
+  }
+  const ece_iovec_t* segment = &cursor->iov[cursor->index];
+  *len = segment->len - cursor->offset;
+  return &((uint8_t*) segment->base)[cursor->offset];
+}
+
+uint8_t*
+ece_iov_next(ece_iov_cursor_t* cursor, size_t maxLen, size_t* len) {
+  uint8_t* bytes = ece_iov_peek(cursor, len);
+  if (*len > maxLen) {
+    *len = maxLen;
+  }
+  cursor->offset += *len;
+  return bytes;
+}
+
+size_t
+ece_iov_skip(ece_iov_cursor_t* cursor, size_t len) {
+  size_t skipped = 0;
+  while (skipped < len) {
+    size_t chunkLen;
+    if (!ece_iov_next(cursor, len - skipped, &chunkLen) || !chunkLen) {
+      break;
+    }
+    skipped += chunkLen;
+  }
+  return skipped;
+}
+
+size_t
+ece_iov_read(ece_iov_cursor_t* cursor, uint8_t* bytes, size_t len) {
+  size_t bytesRead = 0;
+  while (bytesRead < len) {
+    size_t chunkLen;
+    const uint8_t* chunk = ece_iov_next(cursor, len - bytesRead, &chunkLen);
+    if (!chunk || !chunkLen) {
+      break;
+    }
+    memcpy(&bytes[bytesRead], chunk, chunkLen);
+    bytesRead += chunkLen;
+  }
+  return bytesRead;
+}
+
+size_t
+ece_iov_write(ece_iov_cursor_t* cursor, const uint8_t* bytes, size_t len) {
+  size_t written = 0;
+  while (written < len) {
+    size_t chunkLen;
+    uint8_t* chunk = ece_iov_next(cursor, len - written, &chunkLen);
+    if (!chunk || !chunkLen) {
+      break;
+    }
+    memcpy(chunk, &bytes[written], chunkLen);
+    written += chunkLen;
+  }
+  return written;
+}
@@ -0,0 +1,143 @@
+#include "ece.h"
+#include "ece/rand.h"
+
+#include <openssl/bn.h>
+#include <openssl/crypto.h>
+#include <openssl/ec.h>
+#include <openssl/obj_mac.h>
+
+// The number of public keys that share one field inversion when we convert
+// them to affine coordinates. Larger batches amortize the inversion better,
+// but hold more points in memory at once.
+#define ECE_KEYGEN_BATCH_SIZE 256
+
+// Generates `count` key pairs, up to `ECE_KEYGEN_BATCH_SIZE`. Each private key
+// is a uniformly random scalar in [1, n), and its public key is the generator
+// multiple. `points` holds the multiples until they're converted to affine
+// coordinates together.
+static int
+ece_keygen_batch(const EC_GROUP* group, const BIGNUM* order, BIGNUM* scalar,
+                 EC_POINT** points, size_t count, uint8_t* rawRecvPrivKeys,
+                 uint8_t* rawRecvPubKeys, BN_CTX* bnCtx) {
+  for (size_t i = 0; i < count; i++) {
+    if (!ece_rand_scalar(order, scalar)) {
+      return ECE_ERROR_GENERATE_KEYS;
+    }
+    uint8_t* rawRecvPrivKey =
+      &rawRecvPrivKeys[i * ECE_WEBPUSH_PRIVATE_KEY_LENGTH];
+    if (BN_bn2binpad(scalar, rawRecvPrivKey, ECE_WEBPUSH_PRIVATE_KEY_LENGTH) !=
+        ECE_WEBPUSH_PRIVATE_KEY_LENGTH) {
+      return ECE_ERROR_GENERATE_KEYS;
+    }
+    // Passing the scalar as the generator multiplier lets OpenSSL use its
+    // fixed-base table, instead of a variable-base ladder.
+    if (EC_POINT_mul(group, points[i], scalar, NULL, NULL, bnCtx) != 1) {
+      return ECE_ERROR_GENERATE_KEYS;
+    }
+  }
+  // Encoding a projective point inverts its Z coordinate. Converting the
+  // whole batch first replaces `count` inversions with one, using
+  // Montgomery's trick.
+  if (EC_POINTs_make_affine(group, count, points, bnCtx) != 1) {
+    return ECE_ERROR_GENERATE_KEYS;
+  }
+  for (size_t i = 0; i < count; i++) {
+    uint8_t* rawRecvPubKey = &rawRecvPubKeys[i * ECE_WEBPUSH_PUBLIC_KEY_LENGTH];
+    if (EC_POINT_point2oct(group, points[i], POINT_CONVERSION_UNCOMPRESSED,
+                           rawRecvPubKey, ECE_WEBPUSH_PUBLIC_KEY_LENGTH,
+                           bnCtx) != ECE_WEBPUSH_PUBLIC_KEY_LENGTH) {
+      return ECE_ERROR_ENCODE_PUBLIC_KEY;
+    }
+  }
+  return ECE_OK;
+}
+
+int
+ece_webpush_generate_keys_bulk(size_t count, uint8_t* rawRecvPrivKeys,
+                               size_t rawRecvPrivKeysLen,
+                               uint8_t* rawRecvPubKeys,
+                               size_t rawRecvPubKeysLen, uint8_t* authSecrets,
+                               size_t authSecretsLen) {
+  if (rawRecvPrivKeysLen % ECE_WEBPUSH_PRIVATE_KEY_LENGTH ||
+      rawRecvPrivKeysLen / ECE_WEBPUSH_PRIVATE_KEY_LENGTH != count) {
+    return ECE_ERROR_INVALID_PRIVATE_KEY;
+  }
+  if (rawRecvPubKeysLen % ECE_WEBPUSH_PUBLIC_KEY_LENGTH ||
+      rawRecvPubKeysLen / ECE_WEBPUSH_PUBLIC_KEY_LENGTH != count) {
+    return ECE_ERROR_INVALID_PUBLIC_KEY;
+  }
+  if (authSecretsLen % ECE_WEBPUSH_AUTH_SECRET_LENGTH ||
+      authSecretsLen / ECE_WEBPUSH_AUTH_SECRET_LENGTH != count) {
+    return ECE_ERROR_INVALID_AUTH_SECRET;
+  }
+  if (!count) {
+    return ECE_OK;
+  }
+
+  int err = ECE_OK;
+  EC_POINT* points[ECE_KEYGEN_BATCH_SIZE] = {NULL};
+  size_t numPoints = 0;
+  BIGNUM* scalar = NULL;
+
+  BN_CTX* bnCtx = BN_CTX_new();
+  EC_GROUP* group = EC_GROUP_new_by_curve_name(NID_X9_62_prime256v1);
+  if (!bnCtx || !group) {
+    err = ECE_ERROR_OUT_OF_MEMORY;
+    goto end;
+  }
+  // Most P-256 builds ship a static generator table. If this one doesn't,
+  // build it once for all the keys.
+  if (!EC_GROUP_have_precompute_mult(group) &&
+      EC_GROUP_precompute_mult(group, bnCtx) != 1) {
+    err = ECE_ERROR_GENERATE_KEYS;
+    goto end;
+  }
+  const BIGNUM* order = EC_GROUP_get0_order(group);
+  scalar = BN_secure_new();
+  if (!order || !scalar) {
+    err = ECE_ERROR_OUT_OF_MEMORY;
+    goto end;
+  }
+  BN_set_flags(scalar, BN_FLG_CONSTTIME);
+  numPoints = count < ECE_KEYGEN_BATCH_SIZE ? count : ECE_KEYGEN_BATCH_SIZE;
+  for (size_t i = 0; i < numPoints; i++) {
+    points[i] = EC_POINT_new(group);
+    if (!points[i]) {
+      err = ECE_ERROR_OUT_OF_MEMORY;
+      goto end;
+    }
+  }
+
+  for (size_t i = 0; i < count; i += ECE_KEYGEN_BATCH_SIZE) {
+    size_t batchLen = count - i;
+    if (batchLen > ECE_KEYGEN_BATCH_SIZE) {
+      batchLen = ECE_KEYGEN_BATCH_SIZE;
+    }
+    err = ece_keygen_batch(
+      group, order, scalar, points, batchLen,
+      &rawRecvPrivKeys[i * ECE_WEBPUSH_PRIVATE_KEY_LENGTH],
+      &rawRecvPubKeys[i * ECE_WEBPUSH_PUBLIC_KEY_LENGTH], bnCtx);
+    if (err) {
+      goto end;
+    }
+    if (!ece_rand_bytes(&authSecrets[i * ECE_WEBPUSH_AUTH_SECRET_LENGTH],
+                        batchLen * ECE_WEBPUSH_AUTH_SECRET_LENGTH)) {
+      err = ECE_ERROR_GENERATE_KEYS;
+      goto end;
+    }
+  }
+
+end:
+  for (size_t i = 0; i < numPoints; i++) {
+    EC_POINT_free(points[i]);
+  }
+  BN_clear_free(scalar);
+  EC_GROUP_free(group);
+  BN_CTX_free(bnCtx);
+  if (err) {
+    OPENSSL_cleanse(rawRecvPrivKeys, rawRecvPrivKeysLen);
+    OPENSSL_cleanse(rawRecvPubKeys, rawRecvPubKeysLen);
+    OPENSSL_cleanse(authSecrets, authSecretsLen);
+  }
+  return err;
+}
@@ -0,0 +1,338 @@
+#include "ece/pad.h"
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define ECE_PAD_HAVE_X86
+#endif
+
+#if defined(__aarch64__) || defined(_M_ARM64)
+#define ECE_PAD_HAVE_NEON
+#endif
+
+#ifdef ECE_PAD_HAVE_X86
+#ifdef _MSC_VER
+#include <intrin.h>
+#include <immintrin.h>
+#define ECE_PAD_TARGET_AVX2
+#else
+#include <cpuid.h>
+#include <immintrin.h>
+// SSE2 is part of the base x86-64 instruction set, but the AVX2 kernels are
+// compiled for AVX2 even if the rest of the library isn't, and only called if
+// the CPU supports it.
+#define ECE_PAD_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif /* ECE_PAD_HAVE_X86 */
+
+#ifdef ECE_PAD_HAVE_NEON
+#include <arm_neon.h>
+#endif
+
+static size_t
+ece_pad_trim_zeros_scalar(const uint8_t* block, size_t len) {
+  while (len && !block[len - 1]) {
+    len--;
+  }
+  return len;
+}
+
+static bool
+ece_pad_is_zero_scalar(const uint8_t* block, size_t len) {
+  uint8_t bits = 0;
+  for (size_t i = 0; i < len; i++) {
+    bits |= block[i];
+  }
+  return !bits;
+}
+
+// The kernels below skip whole vectors of zeros, and leave the rest to the
+// scalar code. When trimming, they return the end of the last vector with a
+// non-zero byte, or the length of the head that's shorter than a vector. When
+// checking, they return the length of the all-zero prefix that they checked,
+// stopping before the first vector with a non-zero byte.
+
+#ifdef ECE_PAD_HAVE_X86
+
+// Probes for AVX2, with OS support for the YMM registers.
+static bool
+ece_pad_cpu_has_avx2(void) {
+  unsigned int ecx, ebx7;
+#ifdef _MSC_VER
+  int info[4];
+  __cpuid(info, 0);
+  int maxLeaf = info[0];
+  __cpuid(info, 1);
+  ecx = (unsigned int) info[2];
+  ebx7 = 0;
+  if (maxLeaf >= 7) {
+    __cpuidex(info, 7, 0);
+    ebx7 = (unsigned int) info[1];
+  }
+#else
+  unsigned int eax, ebx, edx;
+  if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx)) {
+    return false;
+  }
+  ebx7 = 0;
+  if (__get_cpuid_max(0, NULL) >= 7) {
+    unsigned int eax7, ecx7, edx7;
+    __cpuid_count(7, 0, eax7, ebx7, ecx7, edx7);
+    ECE_UNUSED(eax7);
+    ECE_UNUSED(ecx7);
+    ECE_UNUSED(edx7);
+  }
+#endif
+  // AVX2 is bit 5 of leaf 7. The OS must also save the YMM registers: OSXSAVE
+  // is bit 27 of leaf 1, AVX is bit 28, and XCR0 must enable SSE and AVX state.
+  if (!(ebx7 & (1u << 5)) || !(ecx & (1u << 27)) || !(ecx & (1u << 28))) {
+    return false;
+  }
+#ifdef _MSC_VER
+  unsigned long long xcr0 = _xgetbv(0);
+#else
+  unsigned int xcr0Lo, xcr0Hi;
+  __asm__("xgetbv" : "=a"(xcr0Lo), "=d"(xcr0Hi) : "c"(0));
+  ECE_UNUSED(xcr0Hi);
+  unsigned long long xcr0 = xcr0Lo;
+#endif
+  return (xcr0 & 6) == 6;
+}
+
+// Indicates if any byte of `v` is non-zero.
+static inline bool
+ece_pad_any_sse2(__m128i v) {
+  return _mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_setzero_si128())) != 0xffff;
+}
+
+static size_t
+ece_pad_trim_zeros_sse2(const uint8_t* block, size_t len) {
+  // Padding is usually long, so we check 4 vectors per branch until we reach
+  // the data.
+  while (len >= 64) {
+    const uint8_t* p = &block[len - 64];
+    __m128i v = _mm_or_si128(
+      _mm_or_si128(_mm_loadu_si128((const __m128i*) p),
+                   _mm_loadu_si128((const __m128i*) &p[16])),
+      _mm_or_si128(_mm_loadu_si128((const __m128i*) &p[32]),
+                   _mm_loadu_si128((const __m128i*) &p[48])));
+    if (ece_pad_any_sse2(v)) {
+      break;
+    }
+    len -= 64;
+  }
+  while (len >= 16) {
+    __m128i v = _mm_loadu_si128((const __m128i*) &block[len - 16]);
+    if (ece_pad_any_sse2(v)) {
+      break;
+    }
+    len -= 16;
+  }
+  return len;
+}
+
+static size_t
+ece_pad_is_zero_sse2(const uint8_t* block, size_t len) {
+  size_t i = 0;
+  for (; len - i >= 64; i += 64) {
+    const uint8_t* p = &block[i];
+    __m128i v = _mm_or_si128(
+      _mm_or_si128(_mm_loadu_si128((const __m128i*) p),
+                   _mm_loadu_si128((const __m128i*) &p[16])),
+      _mm_or_si128(_mm_loadu_si128((const __m128i*) &p[32]),
+                   _mm_loadu_si128((const __m128i*) &p[48])));
+    if (ece_pad_any_sse2(v)) {
+      break;
+    }
+  }
+  return i;
+}
+
+ECE_PAD_TARGET_AVX2 static inline bool
+ece_pad_any_avx2(__m256i v) {
+  return !_mm256_testz_si256(v, v);
+}
+
+ECE_PAD_TARGET_AVX2 static size_t
+ece_pad_trim_zeros_avx2(const uint8_t* block, size_t len) {
+  while (len >= 128) {
+    const uint8_t* p = &block[len - 128];
+    __m256i v = _mm256_or_si256(
+      _mm256_or_si256(_mm256_loadu_si256((const __m256i*) p),
+                      _mm256_loadu_si256((const __m256i*) &p[32])),
+      _mm256_or_si256(_mm256_loadu_si256((const __m256i*) &p[64]),
+                      _mm256_loadu_si256((const __m256i*) &p[96])));
+    if (ece_pad_any_avx2(v)) {
+      break;
+    }
+    len -= 128;
+  }
+  while (len >= 32) {
+    __m256i v = _mm256_loadu_si256((const __m256i*) &block[len - 32]);
+    if (ece_pad_any_avx2(v)) {
+      break;
+    }
+    len -= 32;
+  }
+  return len;
+}
+
+ECE_PAD_TARGET_AVX2 static size_t
+ece_pad_is_zero_avx2(const uint8_t* block, size_t len) {
+  size_t i = 0;
+  for (; len - i >= 128; i += 128) {
+    const uint8_t* p = &block[i];
+    __m256i v = _mm256_or_si256(
+      _mm256_or_si256(_mm256_loadu_si256((const __m256i*) p),
+                      _mm256_loadu_si256((const __m256i*) &p[32])),
+      _mm256_or_si256(_mm256_loadu_si256((const __m256i*) &p[64]),
+                      _mm256_loadu_si256((const __m256i*) &p[96])));
+    if (ece_pad_any_avx2(v)) {
+      break;
+    }
+  }
+  return i;
+}
+
+#endif /* ECE_PAD_HAVE_X86 */
+
+#ifdef ECE_PAD_HAVE_NEON
+
+static size_t
+ece_pad_trim_zeros_neon(const uint8_t* block, size_t len) {
+  while (len >= 64) {
+    const uint8_t* p = &block[len - 64];
+    uint8x16_t v = vorrq_u8(vorrq_u8(vld1q_u8(p), vld1q_u8(&p[16])),
+                            vorrq_u8(vld1q_u8(&p[32]), vld1q_u8(&p[48])));
+    if (vmaxvq_u8(v)) {
+      break;
+    }
+    len -= 64;
+  }
+  while (len >= 16) {
+    if (vmaxvq_u8(vld1q_u8(&block[len - 16]))) {
+      break;
+    }
+    len -= 16;
+  }
+  return len;
+}
+
+static size_t
+ece_pad_is_zero_neon(const uint8_t* block, size_t len) {
+  size_t i = 0;
+  for (; len - i >= 64; i += 64) {
+    const uint8_t* p = &block[i];
+    uint8x16_t v = vorrq_u8(vorrq_u8(vld1q_u8(p), vld1q_u8(&p[16])),
+                            vorrq_u8(vld1q_u8(&p[32]), vld1q_u8(&p[48])));
+    if (vmaxvq_u8(v)) {
+      break;
+    }
+  }
+  return i;
+}
+
+#endif /* ECE_PAD_HAVE_NEON */
+
+bool
+ece_pad_impl_supported(ece_pad_impl_t impl) {
+  switch (impl) {
+  case ECE_PAD_IMPL_SCALAR:
+    return true;
+  case ECE_PAD_IMPL_SSE2:
+#ifdef ECE_PAD_HAVE_X86
+    return true;
+#else
+    return false;
+#endif
+  case ECE_PAD_IMPL_AVX2:
+#ifdef ECE_PAD_HAVE_X86
+    return ece_pad_cpu_has_avx2();
+#else
+    return false;
+#endif
+  case ECE_PAD_IMPL_NEON:
+#ifdef ECE_PAD_HAVE_NEON
+    // NEON is part of the base AArch64 instruction set.
+    return true;
+#else
+    return false;
+#endif
+  }
+  return false;
+}
+
+ece_pad_impl_t
+ece_pad_best_impl(void) {
+  // 0 means we haven't probed the CPU yet. Concurrent first calls may both
+  // probe, but they'll store the same value.
+  static volatile int best = 0;
+  if (!best) {
+    ece_pad_impl_t impl = ECE_PAD_IMPL_SCALAR;
+    if (ece_pad_impl_supported(ECE_PAD_IMPL_NEON)) {
+      impl = ECE_PAD_IMPL_NEON;
+    } else if (ece_pad_impl_supported(ECE_PAD_IMPL_AVX2)) {
+      impl = ECE_PAD_IMPL_AVX2;
+    } else if (ece_pad_impl_supported(ECE_PAD_IMPL_SSE2)) {
+      impl = ECE_PAD_IMPL_SSE2;
+    }
+    best = (int) impl + 1;
+  }
+  return (ece_pad_impl_t)(best - 1);
+}
+
+size_t
+ece_pad_trim_zeros_impl(ece_pad_impl_t impl, const uint8_t* block,
+                        size_t len) {
+  switch (impl) {
+#ifdef ECE_PAD_HAVE_X86
+  case ECE_PAD_IMPL_SSE2:
+    len = ece_pad_trim_zeros_sse2(block, len);
+    break;
+  case ECE_PAD_IMPL_AVX2:
+    len = ece_pad_trim_zeros_avx2(block, len);
+    break;
+#endif
+#ifdef ECE_PAD_HAVE_NEON
+  case ECE_PAD_IMPL_NEON:
+    len = ece_pad_trim_zeros_neon(block, len);
+    break;
+#endif
+  default:
+    break;
+  }
+  // The scalar code finds the last non-zero byte in the vector where the
+  // kernel stopped.
+  return ece_pad_trim_zeros_scalar(block, len);
+}
+
+bool
+ece_pad_is_zero_impl(ece_pad_impl_t impl, const uint8_t* block, size_t len) {
+  size_t i = 0;
+  switch (impl) {
+#ifdef ECE_PAD_HAVE_X86
+  case ECE_PAD_IMPL_SSE2:
+    i = ece_pad_is_zero_sse2(block, len);
+    break;
+  case ECE_PAD_IMPL_AVX2:
+    i = ece_pad_is_zero_avx2(block, len);
+    break;
+#endif
+#ifdef ECE_PAD_HAVE_NEON
+  case ECE_PAD_IMPL_NEON:
+    i = ece_pad_is_zero_neon(block, len);
+    break;
+#endif
+  default:
+    break;
+  }
+  return ece_pad_is_zero_scalar(&block[i], len - i);
+}
+
+size_t
+ece_pad_trim_zeros(const uint8_t* block, size_t len) {
+  return ece_pad_trim_zeros_impl(ece_pad_best_impl(), block, len);
+}
+
+bool
+ece_pad_is_zero(const uint8_t* block, size_t len) {
+  return ece_pad_is_zero_impl(ece_pad_best_impl(), block, len);
+}
@@ -0,0 +1,261 @@
+#include "ece/params.h"
+
+#include "ece/base64url.h"
+#include "ece/trailer.h"
+
+#include <string.h>
+
+void
+ece_header_tokenizer_init(ece_header_tokenizer_t* tokenizer,
+                          const char* header, size_t headerLen) {
+  tokenizer->p = header;
+  // Avoids adding 0 to a `NULL` pointer for an empty header.
+  tokenizer->end = headerLen ? &header[headerLen] : header;
+}
+
+static inline bool
+ece_header_is_token(char c) {
+  return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+         (c >= '0' && c <= '9') || c == '-' || c == '_';
+}
+
+static inline bool
+ece_header_is_space(char c) {
+  return c == ' ' || c == '\t';
+}
+
+static inline void
+ece_header_skip_spaces(ece_header_tokenizer_t* tokenizer) {
+  while (tokenizer->p < tokenizer->end && ece_header_is_space(*tokenizer->p)) {
+    tokenizer->p++;
+  }
+}
+
+// Consumes a run of token characters, and returns it in `token`. Returns
+// false if the run is empty.
+static inline bool
+ece_header_read_token(ece_header_tokenizer_t* tokenizer,
+                      ece_header_slice_t* token) {
+  const char* start = tokenizer->p;
+  while (tokenizer->p < tokenizer->end && ece_header_is_token(*tokenizer->p)) {
+    tokenizer->p++;
+  }
+  token->value = start;
+  token->len = (size_t)(tokenizer->p - start);
+  return token->len > 0;
+}
+
+bool
+ece_header_next_pair(ece_header_tokenizer_t* tokenizer,
+                     ece_header_pair_t* pair) {
+  ece_header_skip_spaces(tokenizer);
+  if (!ece_header_read_token(tokenizer, &pair->name)) {
+    return false;
+  }
+  ece_header_skip_spaces(tokenizer);
+  if (tokenizer->p == tokenizer->end || *tokenizer->p != '=') {
+    return false;
+  }
+  tokenizer->p++;
+  ece_header_skip_spaces(tokenizer);
+  if (tokenizer->p < tokenizer->end && *tokenizer->p == '"') {
+    tokenizer->p++;
+    if (!ece_header_read_token(tokenizer, &pair->value) ||
+        tokenizer->p == tokenizer->end || *tokenizer->p != '"') {
+      return false;
+    }
+    tokenizer->p++;
+  } else if (!ece_header_read_token(tokenizer, &pair->value)) {
+    return false;
+  }
+  ece_header_skip_spaces(tokenizer);
+  if (tokenizer->p == tokenizer->end) {
+    pair->sep = ECE_HEADER_SEP_END;
+    return true;
+  }
+  switch (*tokenizer->p++) {
+  case ';':
+    pair->sep = ECE_HEADER_SEP_PAIR;
+    return true;
+  case ',':
+    pair->sep = ECE_HEADER_SEP_PARAM;
+    return true;
+  }
+  return false;
+}
+
+static inline bool
+ece_header_slice_is(ece_header_slice_t slice, const char* name,
+                    size_t nameLen) {
+  return slice.len == nameLen && !memcmp(slice.value, name, nameLen);
+}
+
+static inline bool
+ece_header_slice_eq(ece_header_slice_t a, ece_header_slice_t b) {
+  return a.len == b.len && !memcmp(a.value, b.value, a.len);
+}
+
+// The tokenizer has already checked that the value isn't empty. Record sizes
+// that overflow when the tag length is added are rejected here, so that the
+// decryption functions never see them.
+bool
+ece_header_parse_rs(ece_header_slice_t value, uint32_t* rs) {
+  uint64_t result = 0;
+  for (size_t i = 0; i < value.len; i++) {
+    char c = value.value[i];
+    if (c < '0' || c > '9') {
+      return false;
+    }
+    result = result * 10 + (uint64_t)(c - '0');
+    if (result > UINT32_MAX) {
+      return false;
+    }
+  }
+  if (result < ECE_AESGCM_MIN_RS || !ece_aesgcm_rs((uint32_t) result)) {
+    return false;
+  }
+  *rs = (uint32_t) result;
+  return true;
+}
+
+// Whole quanta go through the block decoder, which uses SIMD when the CPU has
+// it; the scalar decoder only sees the last partial quantum. We check the
+// length first, because the block decoder doesn't bound its output.
+bool
+ece_header_decode(ece_header_slice_t value, uint8_t* binary,
+                  size_t binaryLen) {
+  size_t tailLen = value.len % 4;
+  if (tailLen == 1) {
+    return false;
+  }
+  size_t decodedLen = value.len / 4 * 3 + (tailLen ? tailLen - 1 : 0);
+  if (decodedLen != binaryLen) {
+    return false;
+  }
+  size_t blocksLen = ece_base64url_decode_blocks(value.value,
+                                                 value.len - tailLen, binary);
+  if (blocksLen == value.len) {
+    return true;
+  }
+  // The rest is either the partial quantum, or starts with an invalid
+  // quantum that the scalar decoder rejects.
+  size_t restLen = binaryLen - blocksLen / 4 * 3;
+  return ece_base64url_decode(&value.value[blocksLen], value.len - blocksLen,
+                              ECE_BASE64URL_REJECT_PADDING,
+                              &binary[blocksLen / 4 * 3], restLen) == restLen;
+}
+
+// The pairs that we extract from the first `Encryption` param.
+typedef struct ece_header_encryption_params_s {
+  ece_header_slice_t keyId;
+  ece_header_slice_t salt;
+  ece_header_slice_t rs;
+} ece_header_encryption_params_t;
+
+// Validates every param in the `Encryption` header, and returns the pairs
+// from the first one. A param can't repeat a known pair.
+static int
+ece_header_parse_encryption(ece_header_tokenizer_t* tokenizer,
+                            ece_header_encryption_params_t* params) {
+  ece_header_encryption_params_t current;
+  memset(&current, 0, sizeof(ece_header_encryption_params_t));
+  bool isFirst = true;
+  ece_header_pair_t pair;
+  do {
+    if (!ece_header_next_pair(tokenizer, &pair)) {
+      return ECE_ERROR_INVALID_ENCRYPTION_HEADER;
+    }
+    ece_header_slice_t* slot = NULL;
+    if (ece_header_slice_is(pair.name, "keyid", 5)) {
+      slot = &current.keyId;
+    } else if (ece_header_slice_is(pair.name, "salt", 4)) {
+      slot = &current.salt;
+    } else if (ece_header_slice_is(pair.name, "rs", 2)) {
+      slot = &current.rs;
+    }
+    if (slot) {
+      if (slot->value) {
+        return ECE_ERROR_INVALID_ENCRYPTION_HEADER;
+      }
+      *slot = pair.value;
+    }
+    if (pair.sep != ECE_HEADER_SEP_PAIR) {
+      if (isFirst) {
+        *params = current;
+        isFirst = false;
+      }
+      memset(&current, 0, sizeof(ece_header_encryption_params_t));
+    }
+  } while (pair.sep != ECE_HEADER_SEP_END);
+  return ECE_OK;
+}
+
+// Validates every param in the `Crypto-Key` header, and returns the `dh`
+// value from the first param that matches `keyId`. If `keyId` is empty, the
+// first param with a `dh` pair matches. Once we find a match, we only check
+// the syntax of the remaining params.
+static int
+ece_header_parse_crypto_key(ece_header_tokenizer_t* tokenizer,
+                            ece_header_slice_t keyId, ece_header_slice_t* dh) {
+  ece_header_slice_t currentDh = {NULL, 0};
+  bool isMatch = !keyId.value;
+  ece_header_pair_t pair;
+  do {
+    if (!ece_header_next_pair(tokenizer, &pair)) {
+      return ECE_ERROR_INVALID_CRYPTO_KEY_HEADER;
+    }
+    if (!dh->value) {
+      if (ece_header_slice_is(pair.name, "dh", 2)) {
+        currentDh = pair.value;
+      } else if (keyId.value && ece_header_slice_is(pair.name, "keyid", 5) &&
+                 ece_header_slice_eq(pair.value, keyId)) {
+        isMatch = true;
+      }
+    }
+    if (pair.sep != ECE_HEADER_SEP_PAIR) {
+      if (!dh->value && isMatch && currentDh.value) {
+        *dh = currentDh;
+      }
+      currentDh.value = NULL;
+      isMatch = !keyId.value;
+    }
+  } while (pair.sep != ECE_HEADER_SEP_END);
+  return ECE_OK;
+}
+
+int
+ece_webpush_aesgcm_headers_extract_params_slices(
+  const char* cryptoKeyHeader, size_t cryptoKeyHeaderLen,
+  const char* encryptionHeader, size_t encryptionHeaderLen, uint8_t* salt,
+  size_t saltLen, uint8_t* rawSenderPubKey, size_t rawSenderPubKeyLen,
+  uint32_t* rs) {
+  ece_header_tokenizer_t tokenizer;
+  ece_header_tokenizer_init(&tokenizer, encryptionHeader, encryptionHeaderLen);
+  ece_header_encryption_params_t params;
+  memset(&params, 0, sizeof(ece_header_encryption_params_t));
+  int err = ece_header_parse_encryption(&tokenizer, &params);
+  if (err) {
+    return err;
+  }
+  // The salt and key are decoded straight from the header into the caller's
+  // arrays.
+  if (!params.salt.value || !ece_header_decode(params.salt, salt, saltLen)) {
+    return ECE_ERROR_INVALID_SALT;
+  }
+  *rs = ECE_HEADER_DEFAULT_RS;
+  if (params.rs.value && !ece_header_parse_rs(params.rs, rs)) {
+    return ECE_ERROR_INVALID_RS;
+  }
+
+  ece_header_tokenizer_init(&tokenizer, cryptoKeyHeader, cryptoKeyHeaderLen);
+  ece_header_slice_t dh = {NULL, 0};
+  err = ece_header_parse_crypto_key(&tokenizer, params.keyId, &dh);
+  if (err) {
+    return err;
+  }
+  if (!dh.value ||
+      !ece_header_decode(dh, rawSenderPubKey, rawSenderPubKeyLen)) {
+    return ECE_ERROR_INVALID_DH;
+  }
+  return ECE_OK;
+}
@@ -0,0 +1,195 @@
+#ifdef ECE_HAVE_PTHREADS
+// `pthread.h` needs POSIX declarations, which aren't part of strict C99.
+#define _POSIX_C_SOURCE 200112L
+#endif
+
+#include "ece/pool.h"
+
+#include "ece/alloc.h"
+
+#include <stdbool.h>
+
+#ifdef ECE_HAVE_PTHREADS
+#include <pthread.h>
+#endif
+
+struct ece_pool_s {
+  size_t numWorkers;
+#ifdef ECE_HAVE_PTHREADS
+  pthread_t* threads;
+  size_t numThreads;
+
+  // Held for the duration of `ece_pool_run`, so that only one job uses the
+  // workers at a time.
+  pthread_mutex_t runLock;
+
+  // Protects the job state below. Workers wait on `wake` for a new job, and
+  // the caller waits on `idle` for the running tasks to finish.
+  pthread_mutex_t lock;
+  pthread_cond_t wake;
+  pthread_cond_t idle;
+  uint64_t generation;
+  bool shutdown;
+  ece_pool_task_t task;
+  void* arg;
+  size_t count;
+  size_t next;
+  size_t remaining;
+#endif
+};
+
+#ifdef ECE_HAVE_PTHREADS
+
+// Claims and runs tasks from the current job until none are left. The pool
+// lock must be held, and is held again on return.
+static void
+ece_pool_run_tasks(ece_pool_t* pool) {
+  while (pool->next < pool->count) {
+    size_t index = pool->next++;
+    ece_pool_task_t task = pool->task;
+    void* arg = pool->arg;
+    pthread_mutex_unlock(&pool->lock);
+    task(arg, index);
+    pthread_mutex_lock(&pool->lock);
+    if (!--pool->remaining) {
+      pthread_cond_signal(&pool->idle);
+    }
+  }
+}
+
+static void*
+ece_pool_worker(void* arg) {
+  ece_pool_t* pool = arg;
+  uint64_t generation = 0;
+  pthread_mutex_lock(&pool->lock);
+  while (true) {
+    while (!pool->shutdown && pool->generation == generation) {
+      pthread_cond_wait(&pool->wake, &pool->lock);
+    }
+    if (pool->shutdown) {
+      break;
+    }
+    generation = pool->generation;
+    ece_pool_run_tasks(pool);
+  }
+  pthread_mutex_unlock(&pool->lock);
+  return NULL;
+}
+
+#endif /* ECE_HAVE_PTHREADS */
+
+ece_pool_t*
+ece_pool_new(size_t numWorkers) {
+  if (!numWorkers) {
+    return NULL;
+  }
+  ece_pool_t* pool = ece_calloc(1, sizeof(ece_pool_t));
+  if (!pool) {
+    return NULL;
+  }
+  pool->numWorkers = 1;
+#ifdef ECE_HAVE_PTHREADS
+  if (numWorkers == 1) {
+    return pool;
+  }
+  pool->threads = ece_calloc(numWorkers - 1, sizeof(pthread_t));
+  if (!pool->threads) {
+    ece_free(pool);
+    return NULL;
+  }
+  if (pthread_mutex_init(&pool->runLock, NULL)) {
+    goto error;
+  }
+  if (pthread_mutex_init(&pool->lock, NULL)) {
+    pthread_mutex_destroy(&pool->runLock);
+    goto error;
+  }
+  if (pthread_cond_init(&pool->wake, NULL)) {
+    pthread_mutex_destroy(&pool->lock);
+    pthread_mutex_destroy(&pool->runLock);
+    goto error;
+  }
+  if (pthread_cond_init(&pool->idle, NULL)) {
+    pthread_cond_destroy(&pool->wake);
+    pthread_mutex_destroy(&pool->lock);
+    pthread_mutex_destroy(&pool->runLock);
+    goto error;
+  }
+  for (size_t i = 0; i < numWorkers - 1; i++) {
+    if (pthread_create(&pool->threads[i], NULL, &ece_pool_worker, pool)) {
+      ece_pool_free(pool);
+      return NULL;
+    }
+    pool->numThreads++;
+    pool->numWorkers++;
+  }
+  return pool;
+
+error:
+  ece_free(pool->threads);
+  ece_free(pool);
+  return NULL;
+#else
+  // Without thread support, all tasks run on the calling thread.
+  return pool;
+#endif
+}
+
+void
+ece_pool_free(ece_pool_t* pool) {
+  if (!pool) {
+    return;
+  }
+#ifdef ECE_HAVE_PTHREADS
+  if (pool->threads) {
+    pthread_mutex_lock(&pool->lock);
+    pool->shutdown = true;
+    pthread_cond_broadcast(&pool->wake);
+    pthread_mutex_unlock(&pool->lock);
+    for (size_t i = 0; i < pool->numThreads; i++) {
+      pthread_join(pool->threads[i], NULL);
+    }
+    pthread_cond_destroy(&pool->idle);
+    pthread_cond_destroy(&pool->wake);
+    pthread_mutex_destroy(&pool->lock);
+    pthread_mutex_destroy(&pool->runLock);
+    ece_free(pool->threads);
+  }
+#endif
+  ece_free(pool);
+}
+
+size_t
+ece_pool_size(const ece_pool_t* pool) {
+  return pool ? pool->numWorkers : 1;
+}
+
+void
+ece_pool_run(ece_pool_t* pool, size_t count, ece_pool_task_t task, void* arg) {
+  if (!count) {
+    return;
+  }
+  if (ece_pool_size(pool) == 1 || count == 1) {
+    for (size_t i = 0; i < count; i++) {
+      task(arg, i);
+    }
+    return;
+  }
+#ifdef ECE_HAVE_PTHREADS
+  pthread_mutex_lock(&pool->runLock);
+  pthread_mutex_lock(&pool->lock);
+  pool->task = task;
+  pool->arg = arg;
+  pool->count = count;
+  pool->next = 0;
+  pool->remaining = count;
+  pool->generation++;
+  pthread_cond_broadcast(&pool->wake);
+  ece_pool_run_tasks(pool);
+  while (pool->remaining) {
+    pthread_cond_wait(&pool->idle, &pool->lock);
+  }
+  pthread_mutex_unlock(&pool->lock);
+  pthread_mutex_unlock(&pool->runLock);
+#endif
+}
@@ -0,0 +1,189 @@
+#ifdef ECE_HAVE_PTHREADS
+// `pthread.h` needs POSIX declarations, which aren't part of strict C99.
+#define _POSIX_C_SOURCE 200112L
+#elif !defined(_WIN32)
+// Without pthreads, we detect forks by checking the process ID.
+#define _POSIX_C_SOURCE 200112L
+#define ECE_RAND_CHECK_PID
+#endif
+
+#include "ece/rand.h"
+
+#include "ece/alloc.h"
+
+#include <limits.h>
+#include <string.h>
+
+#include <openssl/crypto.h>
+#include <openssl/rand.h>
+
+#ifdef ECE_HAVE_PTHREADS
+#include <pthread.h>
+#endif
+
+#ifdef ECE_RAND_CHECK_PID
+#include <sys/types.h>
+#include <unistd.h>
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+#define ECE_RAND_LOAD(value) __atomic_load_n(&(value), __ATOMIC_ACQUIRE)
+#define ECE_RAND_INCREMENT(value)                                              \
+  __atomic_add_fetch(&(value), 1, __ATOMIC_RELEASE)
+#else
+#define ECE_RAND_LOAD(value) (*(volatile uint64_t*) &(value))
+#define ECE_RAND_INCREMENT(value) (++*(volatile uint64_t*) &(value))
+#endif
+
+// The number of times `ece_rand_scalar` draws before giving up. Each draw is
+// out of range with probability less than 2^-32 for P-256, so this only fails
+// if the source is broken, like a custom source that returns all ones.
+#define ECE_RAND_MAX_SCALAR_DRAWS 64
+
+// Private keys should be drawn from OpenSSL's private DRBG when it has one.
+// Salts come from the same buffer; they're public, but DRBG output doesn't
+// reveal anything about the bytes next to it.
+#if OPENSSL_VERSION_NUMBER >= 0x10101000L
+#define ECE_RAND_OPENSSL_BYTES RAND_priv_bytes
+#else
+#define ECE_RAND_OPENSSL_BYTES RAND_bytes
+#endif
+
+typedef struct ece_rand_buffer_s {
+  uint8_t bytes[ECE_RAND_BUFFER_LENGTH];
+  // The number of unused bytes at the end of `bytes`. Used bytes are cleared,
+  // so that keys handed out earlier don't linger in the buffer.
+  size_t avail;
+  // The generation of the source that filled the buffer.
+  uint64_t generation;
+#ifdef ECE_RAND_CHECK_PID
+  pid_t pid;
+#endif
+} ece_rand_buffer_t;
+
+static bool
+ece_rand_default_fill(void* opaque, uint8_t* bytes, size_t len) {
+  ECE_UNUSED(opaque);
+  while (len) {
+    int chunkLen = len > INT_MAX ? INT_MAX : (int) len;
+    if (ECE_RAND_OPENSSL_BYTES(bytes, chunkLen) != 1) {
+      return false;
+    }
+    bytes += chunkLen;
+    len -= (size_t) chunkLen;
+  }
+  return true;
+}
+
+static const ece_rand_source_t ece_rand_default_source = {
+  .fill = &ece_rand_default_fill,
+  .opaque = NULL,
+};
+
+static ece_rand_source_t ece_rand_source = {
+  .fill = &ece_rand_default_fill,
+  .opaque = NULL,
+};
+
+// Incremented when the source changes, and in a child process after `fork`.
+// Each thread discards its buffer when it sees a new generation. This starts
+// at 1, so that a thread's zeroed buffer is always from an old generation.
+static uint64_t ece_rand_generation = 1;
+
+static ECE_THREAD_LOCAL ece_rand_buffer_t ece_rand_buffer;
+
+#ifdef ECE_HAVE_PTHREADS
+
+static pthread_once_t ece_rand_once = PTHREAD_ONCE_INIT;
+
+// The child only has the thread that called `fork`, so it's safe to update
+// the generation without synchronization. Other threads' buffers don't exist
+// in the child.
+static void
+ece_rand_atfork_child(void) {
+  ECE_RAND_INCREMENT(ece_rand_generation);
+}
+
+static void
+ece_rand_register_atfork(void) {
+  pthread_atfork(NULL, NULL, &ece_rand_atfork_child);
+}
+
+#endif /* ECE_HAVE_PTHREADS */
+
+static inline uint64_t
+ece_rand_current_generation(void) {
+#ifdef ECE_HAVE_PTHREADS
+  pthread_once(&ece_rand_once, &ece_rand_register_atfork);
+#endif
+  return ECE_RAND_LOAD(ece_rand_generation);
+}
+
+// Clears the rest of the buffer, so that the next draw refills it.
+static void
+ece_rand_discard(ece_rand_buffer_t* buffer) {
+  OPENSSL_cleanse(&buffer->bytes[ECE_RAND_BUFFER_LENGTH - buffer->avail],
+                  buffer->avail);
+  buffer->avail = 0;
+}
+
+void
+ece_set_rand_source(const ece_rand_source_t* source) {
+  ece_rand_source = source ? *source : ece_rand_default_source;
+  ECE_RAND_INCREMENT(ece_rand_generation);
+}
+
+bool
+ece_rand_bytes(uint8_t* bytes, size_t len) {
+  ece_rand_buffer_t* buffer = &ece_rand_buffer;
+  uint64_t generation = ece_rand_current_generation();
+  bool isStale = buffer->generation != generation;
+#ifdef ECE_RAND_CHECK_PID
+  pid_t pid = getpid();
+  isStale = isStale || buffer->pid != pid;
+#endif
+  if (isStale) {
+    ece_rand_discard(buffer);
+    buffer->generation = generation;
+#ifdef ECE_RAND_CHECK_PID
+    buffer->pid = pid;
+#endif
+  }
+  if (len > ECE_RAND_BUFFER_LENGTH / 4) {
+    return ece_rand_source.fill(ece_rand_source.opaque, bytes, len);
+  }
+  if (buffer->avail < len) {
+    // Any leftover bytes are too few for this request, so we drop them
+    // instead of splitting the request across two fills.
+    ece_rand_discard(buffer);
+    if (!ece_rand_source.fill(ece_rand_source.opaque, buffer->bytes,
+                              ECE_RAND_BUFFER_LENGTH)) {
+      OPENSSL_cleanse(buffer->bytes, ECE_RAND_BUFFER_LENGTH);
+      return false;
+    }
+    buffer->avail = ECE_RAND_BUFFER_LENGTH;
+  }
+  uint8_t* next = &buffer->bytes[ECE_RAND_BUFFER_LENGTH - buffer->avail];
+  memcpy(bytes, next, len);
+  OPENSSL_cleanse(next, len);
+  buffer->avail -= len;
+  return true;
+}
+
+bool
+ece_rand_scalar(const BIGNUM* order, BIGNUM* scalar) {
+  uint8_t raw[ECE_WEBPUSH_PRIVATE_KEY_LENGTH];
+  bool ok = false;
+  for (size_t i = 0; i < ECE_RAND_MAX_SCALAR_DRAWS; i++) {
+    if (!ece_rand_bytes(raw, ECE_WEBPUSH_PRIVATE_KEY_LENGTH) ||
+        !BN_bin2bn(raw, ECE_WEBPUSH_PRIVATE_KEY_LENGTH, scalar)) {
+      break;
+    }
+    if (!BN_is_zero(scalar) && BN_cmp(scalar, order) < 0) {
+      ok = true;
+      break;
+    }
+  }
+  OPENSSL_cleanse(raw, ECE_WEBPUSH_PRIVATE_KEY_LENGTH);
+  return ok;
+}
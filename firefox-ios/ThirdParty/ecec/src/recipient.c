@@ -0,0 +1,354 @@
+#include "ece/recipient.h"
+
+#include "ece/alloc.h"
+#include "ece/encrypt.h"
+#include "ece/rand.h"
+#include "ece/stats.h"
+
+#include <string.h>
+
+#include <openssl/crypto.h>
+
+#ifdef _MSC_VER
+#include <windows.h>
+#endif
+
+// Adds and releases references to a recipient. `ECE_RECIPIENT_RELEASE`
+// returns the new count. Releasing orders the caller's earlier accesses
+// before the free on whichever thread drops the last reference.
+#ifdef _MSC_VER
+#define ECE_RECIPIENT_RETAIN(refs) InterlockedIncrement(&(refs))
+#define ECE_RECIPIENT_RELEASE(refs) InterlockedDecrement(&(refs))
+#else
+#define ECE_RECIPIENT_RETAIN(refs)                                             \
+  __atomic_add_fetch(&(refs), 1, __ATOMIC_RELAXED)
+#define ECE_RECIPIENT_RELEASE(refs)                                            \
+  __atomic_sub_fetch(&(refs), 1, __ATOMIC_ACQ_REL)
+#endif
+
+typedef struct ece_recipient_cache_entry_s ece_recipient_cache_entry_t;
+
+struct ece_recipient_cache_entry_s {
+  ece_recipient_t* recipient;
+  uint64_t hash;
+  // The next entry in the same hash bucket.
+  ece_recipient_cache_entry_t* bucketNext;
+  // The neighboring entries in recency order. `lruPrev` is more recently used.
+  ece_recipient_cache_entry_t* lruPrev;
+  ece_recipient_cache_entry_t* lruNext;
+};
+
+struct ece_recipient_cache_s {
+  size_t capacity;
+  size_t len;
+  ece_recipient_cache_entry_t** buckets;
+  size_t bucketMask;
+  // The most and least recently used entries. We evict from the tail.
+  ece_recipient_cache_entry_t* lruHead;
+  ece_recipient_cache_entry_t* lruTail;
+  uint64_t hits;
+  uint64_t misses;
+};
+
+ECE_STATIC_ASSERT(sizeof(ece_recipient_t) <= ECE_MAX_CONTEXT_LENGTH,
+                  ece_recipient_fits);
+ECE_STATIC_ASSERT(sizeof(ece_recipient_cache_t) <= ECE_MAX_CONTEXT_LENGTH,
+                  ece_recipient_cache_fits);
+
+int
+ece_recipient_create(const uint8_t* rawRecvPubKey, size_t rawRecvPubKeyLen,
+                     const uint8_t* authSecret, size_t authSecretLen,
+                     ece_recipient_t** recipient) {
+  *recipient = NULL;
+  if (authSecretLen != ECE_WEBPUSH_AUTH_SECRET_LENGTH) {
+    return ECE_ERROR_INVALID_AUTH_SECRET;
+  }
+  if (rawRecvPubKeyLen > ECE_WEBPUSH_PUBLIC_KEY_LENGTH) {
+    return ECE_ERROR_INVALID_PUBLIC_KEY;
+  }
+  ece_recipient_t* newRecipient = ece_calloc(1, sizeof(ece_recipient_t));
+  if (!newRecipient) {
+    return ECE_ERROR_OUT_OF_MEMORY;
+  }
+  newRecipient->recvPubKey =
+    ece_stats_import_public_key(rawRecvPubKey, rawRecvPubKeyLen);
+  if (!newRecipient->recvPubKey) {
+    ece_free(newRecipient);
+    return ECE_ERROR_INVALID_PUBLIC_KEY;
+  }
+  memcpy(newRecipient->rawRecvPubKey, rawRecvPubKey, rawRecvPubKeyLen);
+  newRecipient->rawRecvPubKeyLen = rawRecvPubKeyLen;
+  memcpy(newRecipient->authSecret, authSecret, ECE_WEBPUSH_AUTH_SECRET_LENGTH);
+  newRecipient->refs = 1;
+  *recipient = newRecipient;
+  return ECE_OK;
+}
+
+void
+ece_recipient_destroy(ece_recipient_t* recipient) {
+  if (!recipient || ECE_RECIPIENT_RELEASE(recipient->refs)) {
+    return;
+  }
+  EC_KEY_free(recipient->recvPubKey);
+  OPENSSL_cleanse(recipient->authSecret, ECE_WEBPUSH_AUTH_SECRET_LENGTH);
+  ece_free(recipient);
+}
+
+int
+ece_recipient_aes128gcm_encrypt(const ece_recipient_t* recipient, uint32_t rs,
+                                size_t padLen, const uint8_t* plaintext,
+                                size_t plaintextLen, uint8_t* payload,
+                                size_t* payloadLen) {
+  int err = ECE_OK;
+  EC_KEY* senderPrivKey = NULL;
+  ece_encrypt_ctx_t* ctx = NULL;
+  uint8_t salt[ECE_SALT_LENGTH];
+  if (!ece_rand_bytes(salt, ECE_SALT_LENGTH)) {
+    err = ECE_ERROR_INVALID_SALT;
+    goto end;
+  }
+  senderPrivKey = ece_encrypt_generate_key();
+  if (!senderPrivKey) {
+    err = ECE_ERROR_INVALID_PRIVATE_KEY;
+    goto end;
+  }
+  ctx = ece_encrypt_ctx_new();
+  if (!ctx) {
+    err = ECE_ERROR_OUT_OF_MEMORY;
+    goto end;
+  }
+  err = ece_webpush_aes128gcm_encrypt_init_keys(
+    ctx, senderPrivKey, recipient->recvPubKey, recipient->authSecret,
+    ECE_WEBPUSH_AUTH_SECRET_LENGTH, salt, ECE_SALT_LENGTH, rs, padLen);
+  if (err) {
+    goto end;
+  }
+  err = ece_encrypt_all(ctx, plaintext, plaintextLen, payload, payloadLen);
+
+end:
+  ece_encrypt_ctx_free(ctx);
+  EC_KEY_free(senderPrivKey);
+  return err;
+}
+
+int
+ece_recipient_aesgcm_encrypt(const ece_recipient_t* recipient, uint32_t rs,
+                             size_t padLen, const uint8_t* plaintext,
+                             size_t plaintextLen, uint8_t* salt,
+                             size_t saltLen, uint8_t* rawSenderPubKey,
+                             size_t rawSenderPubKeyLen, uint8_t* ciphertext,
+                             size_t* ciphertextLen) {
+  int err = ECE_OK;
+  EC_KEY* senderPrivKey = NULL;
+  ece_encrypt_ctx_t* ctx = NULL;
+  if (saltLen != ECE_SALT_LENGTH || !ece_rand_bytes(salt, saltLen)) {
+    err = ECE_ERROR_INVALID_SALT;
+    goto end;
+  }
+  if (rawSenderPubKeyLen != ECE_WEBPUSH_PUBLIC_KEY_LENGTH) {
+    err = ECE_ERROR_INVALID_PUBLIC_KEY;
+    goto end;
+  }
+  senderPrivKey = ece_encrypt_generate_key();
+  if (!senderPrivKey) {
+    err = ECE_ERROR_INVALID_PRIVATE_KEY;
+    goto end;
+  }
+  if (EC_POINT_point2oct(EC_KEY_get0_group(senderPrivKey),
+                         EC_KEY_get0_public_key(senderPrivKey),
+                         POINT_CONVERSION_UNCOMPRESSED, rawSenderPubKey,
+                         rawSenderPubKeyLen, NULL) != rawSenderPubKeyLen) {
+    err = ECE_ERROR_ENCODE_PUBLIC_KEY;
+    goto end;
+  }
+  ctx = ece_encrypt_ctx_new();
+  if (!ctx) {
+    err = ECE_ERROR_OUT_OF_MEMORY;
+    goto end;
+  }
+  err = ece_webpush_aesgcm_encrypt_init_keys(
+    ctx, senderPrivKey, recipient->recvPubKey, recipient->authSecret,
+    ECE_WEBPUSH_AUTH_SECRET_LENGTH, salt, saltLen, rs, padLen);
+  if (err) {
+    goto end;
+  }
+  err = ece_encrypt_all(ctx, plaintext, plaintextLen, ciphertext,
+                        ciphertextLen);
+
+end:
+  ece_encrypt_ctx_free(ctx);
+  EC_KEY_free(senderPrivKey);
+  return err;
+}
+
+ece_recipient_cache_t*
+ece_recipient_cache_new(size_t capacity) {
+  if (!capacity) {
+    return NULL;
+  }
+  ece_recipient_cache_t* cache = ece_calloc(1, sizeof(ece_recipient_cache_t));
+  if (!cache) {
+    return NULL;
+  }
+  // Use a power-of-two bucket count, with at most one entry per bucket on
+  // average when the cache is full.
+  size_t bucketCount = 1;
+  while (bucketCount < capacity && bucketCount <= SIZE_MAX / 2) {
+    bucketCount *= 2;
+  }
+  cache->buckets =
+    ece_calloc(bucketCount, sizeof(ece_recipient_cache_entry_t*));
+  if (!cache->buckets) {
+    ece_free(cache);
+    return NULL;
+  }
+  cache->bucketMask = bucketCount - 1;
+  cache->capacity = capacity;
+  return cache;
+}
+
+// Unlinks `entry` from its bucket and the recency list, and releases the
+// cache's reference to its recipient.
+static void
+ece_recipient_cache_remove(ece_recipient_cache_t* cache,
+                           ece_recipient_cache_entry_t* entry) {
+  ece_recipient_cache_entry_t** bucket =
+    &cache->buckets[entry->hash & cache->bucketMask];
+  while (*bucket != entry) {
+    bucket = &(*bucket)->bucketNext;
+  }
+  *bucket = entry->bucketNext;
+  if (entry->lruPrev) {
+    entry->lruPrev->lruNext = entry->lruNext;
+  } else {
+    cache->lruHead = entry->lruNext;
+  }
+  if (entry->lruNext) {
+    entry->lruNext->lruPrev = entry->lruPrev;
+  } else {
+    cache->lruTail = entry->lruPrev;
+  }
+  cache->len--;
+  ece_recipient_destroy(entry->recipient);
+  ece_free(entry);
+}
+
+void
+ece_recipient_cache_free(ece_recipient_cache_t* cache) {
+  if (!cache) {
+    return;
+  }
+  while (cache->lruHead) {
+    ece_recipient_cache_remove(cache, cache->lruHead);
+  }
+  ece_free(cache->buckets);
+  ece_free(cache);
+}
+
+// Hashes the raw public key with 64-bit FNV-1a. Public keys aren't secret, so
+// we don't need a keyed hash.
+static uint64_t
+ece_recipient_cache_hash(const uint8_t* rawRecvPubKey,
+                         size_t rawRecvPubKeyLen) {
+  uint64_t hash = 0xcbf29ce484222325;
+  for (size_t i = 0; i < rawRecvPubKeyLen; i++) {
+    hash ^= rawRecvPubKey[i];
+    hash *= 0x100000001b3;
+  }
+  return hash;
+}
+
+// Moves `entry` to the front of the recency list.
+static void
+ece_recipient_cache_touch(ece_recipient_cache_t* cache,
+                          ece_recipient_cache_entry_t* entry) {
+  if (cache->lruHead == entry) {
+    return;
+  }
+  entry->lruPrev->lruNext = entry->lruNext;
+  if (entry->lruNext) {
+    entry->lruNext->lruPrev = entry->lruPrev;
+  } else {
+    cache->lruTail = entry->lruPrev;
+  }
+  entry->lruPrev = NULL;
+  entry->lruNext = cache->lruHead;
+  cache->lruHead->lruPrev = entry;
+  cache->lruHead = entry;
+}
+
+int
+ece_recipient_cache_get(ece_recipient_cache_t* cache,
+                        const uint8_t* rawRecvPubKey, size_t rawRecvPubKeyLen,
+                        const uint8_t* authSecret, size_t authSecretLen,
+                        ece_recipient_t** recipient) {
+  *recipient = NULL;
+  uint64_t hash = ece_recipient_cache_hash(rawRecvPubKey, rawRecvPubKeyLen);
+  ece_recipient_cache_entry_t* entry =
+    cache->buckets[hash & cache->bucketMask];
+  while (entry) {
+    ece_recipient_t* cached = entry->recipient;
+    if (entry->hash == hash && cached->rawRecvPubKeyLen == rawRecvPubKeyLen &&
+        !memcmp(cached->rawRecvPubKey, rawRecvPubKey, rawRecvPubKeyLen)) {
+      break;
+    }
+    entry = entry->bucketNext;
+  }
+  if (entry) {
+    // The public key is public, but the auth secret isn't, so we compare it in
+    // constant time.
+    if (authSecretLen == ECE_WEBPUSH_AUTH_SECRET_LENGTH &&
+        !CRYPTO_memcmp(entry->recipient->authSecret, authSecret,
+                       ECE_WEBPUSH_AUTH_SECRET_LENGTH)) {
+      cache->hits++;
+      ece_recipient_cache_touch(cache, entry);
+      ECE_RECIPIENT_RETAIN(entry->recipient->refs);
+      *recipient = entry->recipient;
+      return ECE_OK;
+    }
+    // The subscription was renewed with a new auth secret, so the cached
+    // recipient is stale.
+    ece_recipient_cache_remove(cache, entry);
+  }
+  cache->misses++;
+
+  ece_recipient_t* newRecipient = NULL;
+  int err = ece_recipient_create(rawRecvPubKey, rawRecvPubKeyLen, authSecret,
+                                 authSecretLen, &newRecipient);
+  if (err) {
+    return err;
+  }
+  entry = ece_calloc(1, sizeof(ece_recipient_cache_entry_t));
+  if (!entry) {
+    ece_recipient_destroy(newRecipient);
+    return ECE_ERROR_OUT_OF_MEMORY;
+  }
+  if (cache->len == cache->capacity) {
+    ece_recipient_cache_remove(cache, cache->lruTail);
+  }
+  // The cache and the caller each hold a reference.
+  ECE_RECIPIENT_RETAIN(newRecipient->refs);
+  entry->recipient = newRecipient;
+  entry->hash = hash;
+  ece_recipient_cache_entry_t** bucket =
+    &cache->buckets[hash & cache->bucketMask];
+  entry->bucketNext = *bucket;
+  *bucket = entry;
+  entry->lruNext = cache->lruHead;
+  if (cache->lruHead) {
+    cache->lruHead->lruPrev = entry;
+  } else {
+    cache->lruTail = entry;
+  }
+  cache->lruHead = entry;
+  cache->len++;
+  *recipient = newRecipient;
+  return ECE_OK;
+}
+
+void
+ece_recipient_cache_stats(const ece_recipient_cache_t* cache, uint64_t* hits,
+                          uint64_t* misses) {
+  *hits = cache->hits;
+  *misses = cache->misses;
+}
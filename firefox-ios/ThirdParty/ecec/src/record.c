@@ -0,0 +1,408 @@
+#include "ece/record.h"
+
+#include "ece.h"
+#include "ece/alloc.h"
+#include "ece/keys.h"
+#include "ece/pad.h"
+#include "ece/pool.h"
+#include "ece/stats.h"
+#include "ece/trace.h"
+
+#include <limits.h>
+#include <string.h>
+
+int
+ece_record_decrypt_init(EVP_CIPHER_CTX* ctx, const uint8_t* key) {
+  if (EVP_DecryptInit_ex(ctx, EVP_aes_128_gcm(), NULL, key, NULL) != 1) {
+    return ECE_ERROR_DECRYPT;
+  }
+  return ECE_OK;
+}
+
+static int
+ece_record_open(EVP_CIPHER_CTX* ctx, const uint8_t* iv, const uint8_t* record,
+                size_t recordLen, uint8_t* block) {
+  if (recordLen < ECE_TAG_LENGTH) {
+    // The record is too short to hold the authentication tag.
+    return ECE_ERROR_DECRYPT;
+  }
+  if (recordLen == ECE_TAG_LENGTH) {
+    // A record that only contains the tag doesn't have room for the padding
+    // delimiter.
+    return ECE_ERROR_SHORT_BLOCK;
+  }
+  size_t blockLen = recordLen - ECE_TAG_LENGTH;
+  if (blockLen > INT_MAX) {
+    return ECE_ERROR_DECRYPT;
+  }
+  int chunkLen = -1;
+  if (EVP_DecryptInit_ex(ctx, NULL, NULL, NULL, iv) != 1) {
+    return ECE_ERROR_DECRYPT;
+  }
+  // The authentication tag is included at the end of the encrypted record. We
+  // set it before decrypting, since `block` may alias `record`.
+  if (EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_GCM_SET_TAG, ECE_TAG_LENGTH,
+                          (void*) &record[blockLen]) != 1) {
+    return ECE_ERROR_DECRYPT;
+  }
+  if (EVP_DecryptUpdate(ctx, block, &chunkLen, record, (int) blockLen) != 1) {
+    return ECE_ERROR_DECRYPT;
+  }
+  if (EVP_DecryptFinal_ex(ctx, NULL, &chunkLen) != 1) {
+    return ECE_ERROR_DECRYPT;
+  }
+  return ECE_OK;
+}
+
+int
+ece_record_decrypt(EVP_CIPHER_CTX* ctx, const uint8_t* iv,
+                   const uint8_t* record, size_t recordLen, uint8_t* block) {
+  uint64_t start = ece_stats_begin();
+  int err = ece_record_open(ctx, iv, record, recordLen, block);
+  ece_stats_end(ECE_STATS_STAGE_DECRYPT_RECORD, start, recordLen, err);
+  return err;
+}
+
+// Decrypts and unpads a run of consecutive records, starting with the record
+// at `counter`. `isLastRun` indicates if the run ends with the last record of
+// the message.
+static int
+ece_record_decrypt_run(EVP_CIPHER_CTX* ctx, const uint8_t* nonce,
+                       uint64_t counter, uint32_t rs, const uint8_t* ciphertext,
+                       size_t ciphertextLen, bool isLastRun, unpad_t unpad,
+                       uint8_t* plaintext, size_t* plaintextLen) {
+  size_t ciphertextStart = 0;
+  size_t plaintextStart = 0;
+  for (; ciphertextStart < ciphertextLen; counter++) {
+    size_t recordLen = ciphertextLen - ciphertextStart;
+    if (recordLen > rs) {
+      recordLen = rs;
+    }
+    bool isLastRecord =
+      isLastRun && ciphertextStart + recordLen >= ciphertextLen;
+    if (recordLen > ECE_TAG_LENGTH &&
+        recordLen - ECE_TAG_LENGTH > *plaintextLen - plaintextStart) {
+      return ECE_ERROR_OUT_OF_MEMORY;
+    }
+    uint8_t iv[ECE_NONCE_LENGTH];
+    ece_generate_iv(nonce, counter, iv);
+    uint8_t* block = &plaintext[plaintextStart];
+    ECE_TRACE3(record_open_start, counter, recordLen, rs);
+    int err = ece_record_decrypt(ctx, iv, &ciphertext[ciphertextStart],
+                                 recordLen, block);
+    ECE_TRACE3(record_open_done, counter, recordLen, err);
+    if (err) {
+      return err;
+    }
+    size_t blockLen = recordLen - ECE_TAG_LENGTH;
+    err = unpad(block, isLastRecord, &blockLen);
+    if (err) {
+      return err;
+    }
+    ciphertextStart += recordLen;
+    plaintextStart += blockLen;
+  }
+  *plaintextLen = plaintextStart;
+  return ECE_OK;
+}
+
+int
+ece_record_decrypt_all(EVP_CIPHER_CTX* ctx, const uint8_t* nonce, uint32_t rs,
+                       const uint8_t* ciphertext, size_t ciphertextLen,
+                       unpad_t unpad, uint8_t* plaintext,
+                       size_t* plaintextLen) {
+  return ece_record_decrypt_run(ctx, nonce, 0, rs, ciphertext, ciphertextLen,
+                                true, unpad, plaintext, plaintextLen);
+}
+
+int
+ece_record_decrypt_all_in_place(EVP_CIPHER_CTX* ctx, const uint8_t* nonce,
+                                uint32_t rs, uint8_t* ciphertext,
+                                size_t ciphertextLen, unpad_t unpad,
+                                size_t* plaintextLen) {
+  size_t ciphertextStart = 0;
+  size_t plaintextStart = 0;
+  for (uint64_t counter = 0; ciphertextStart < ciphertextLen; counter++) {
+    size_t recordLen = ciphertextLen - ciphertextStart;
+    if (recordLen > rs) {
+      recordLen = rs;
+    }
+    bool isLastRecord = ciphertextStart + recordLen >= ciphertextLen;
+    // OpenSSL rejects partially overlapping buffers, so each record is
+    // decrypted at its own offset, then moved down to the end of the
+    // plaintext decrypted so far.
+    uint8_t iv[ECE_NONCE_LENGTH];
+    ece_generate_iv(nonce, counter, iv);
+    uint8_t* block = &ciphertext[ciphertextStart];
+    ECE_TRACE3(record_open_start, counter, recordLen, rs);
+    int err = ece_record_decrypt(ctx, iv, block, recordLen, block);
+    ECE_TRACE3(record_open_done, counter, recordLen, err);
+    if (err) {
+      return err;
+    }
+    size_t blockLen = recordLen - ECE_TAG_LENGTH;
+    err = unpad(block, isLastRecord, &blockLen);
+    if (err) {
+      return err;
+    }
+    memmove(&ciphertext[plaintextStart], block, blockLen);
+    ciphertextStart += recordLen;
+    plaintextStart += blockLen;
+  }
+  *plaintextLen = plaintextStart;
+  return ECE_OK;
+}
+
+// A run of records decrypted by one worker. Each run decrypts into its own
+// region of the plaintext buffer, starting at the offset where the run's
+// records would be if none of them were padded.
+typedef struct ece_record_decrypt_run_s {
+  EVP_CIPHER_CTX* ctx;
+  uint64_t firstRecord;
+  size_t ciphertextStart;
+  size_t ciphertextLen;
+  size_t plaintextStart;
+  size_t plaintextLen;
+  int err;
+} ece_record_decrypt_run_t;
+
+typedef struct ece_record_decrypt_job_s {
+  const uint8_t* nonce;
+  uint32_t rs;
+  const uint8_t* ciphertext;
+  unpad_t unpad;
+  uint8_t* plaintext;
+  ece_record_decrypt_run_t* runs;
+  size_t numRuns;
+} ece_record_decrypt_job_t;
+
+static void
+ece_record_decrypt_task(void* arg, size_t index) {
+  ece_record_decrypt_job_t* job = arg;
+  ece_record_decrypt_run_t* run = &job->runs[index];
+  run->err = ece_record_decrypt_run(
+    run->ctx, job->nonce, run->firstRecord, job->rs,
+    &job->ciphertext[run->ciphertextStart], run->ciphertextLen,
+    index == job->numRuns - 1, job->unpad,
+    &job->plaintext[run->plaintextStart], &run->plaintextLen);
+}
+
+int
+ece_record_decrypt_all_parallel(ece_pool_t* pool, EVP_CIPHER_CTX* ctx,
+                                const uint8_t* nonce, uint32_t rs,
+                                const uint8_t* ciphertext,
+                                size_t ciphertextLen, unpad_t unpad,
+                                uint8_t* plaintext, size_t* plaintextLen) {
+  size_t numRecords = ciphertextLen / rs;
+  size_t lastRecordLen = ciphertextLen % rs;
+  if (lastRecordLen) {
+    numRecords++;
+  } else {
+    lastRecordLen = rs;
+  }
+  size_t numRuns = ece_pool_size(pool);
+  if (numRuns > numRecords) {
+    numRuns = numRecords;
+  }
+  // Each run decrypts into the space its records would take without padding,
+  // so the buffer must be large enough to hold every block. Smaller buffers,
+  // which only leave room for the unpadded plaintext, are decrypted serially.
+  size_t blocksLen = (numRecords - 1) * (rs - ECE_TAG_LENGTH);
+  if (lastRecordLen > ECE_TAG_LENGTH) {
+    blocksLen += lastRecordLen - ECE_TAG_LENGTH;
+  }
+  if (numRuns < 2 || *plaintextLen < blocksLen) {
+    return ece_record_decrypt_all(ctx, nonce, rs, ciphertext, ciphertextLen,
+                                  unpad, plaintext, plaintextLen);
+  }
+
+  int err = ECE_OK;
+  ece_record_decrypt_run_t* runs =
+    ece_calloc(numRuns, sizeof(ece_record_decrypt_run_t));
+  if (!runs) {
+    return ECE_ERROR_OUT_OF_MEMORY;
+  }
+  // Split the records evenly between the runs. Each worker needs its own copy
+  // of the cipher context; we make the copies up front, since the first run
+  // uses `ctx` itself.
+  for (size_t i = 0; i < numRuns; i++) {
+    ece_record_decrypt_run_t* run = &runs[i];
+    run->firstRecord = numRecords * i / numRuns;
+    size_t endRecord = numRecords * (i + 1) / numRuns;
+    run->ciphertextStart = run->firstRecord * rs;
+    run->ciphertextLen = i == numRuns - 1
+                           ? ciphertextLen - run->ciphertextStart
+                           : (endRecord - run->firstRecord) * rs;
+    run->plaintextStart = run->firstRecord * (rs - ECE_TAG_LENGTH);
+    run->plaintextLen = i == numRuns - 1
+                          ? *plaintextLen - run->plaintextStart
+                          : (endRecord - run->firstRecord) *
+                              (rs - ECE_TAG_LENGTH);
+    if (!i) {
+      run->ctx = ctx;
+      continue;
+    }
+    run->ctx = EVP_CIPHER_CTX_new();
+    if (!run->ctx) {
+      err = ECE_ERROR_OUT_OF_MEMORY;
+      goto end;
+    }
+    if (EVP_CIPHER_CTX_copy(run->ctx, ctx) != 1) {
+      err = ECE_ERROR_DECRYPT;
+      goto end;
+    }
+  }
+
+  ece_record_decrypt_job_t job = {
+    .nonce = nonce,
+    .rs = rs,
+    .ciphertext = ciphertext,
+    .unpad = unpad,
+    .plaintext = plaintext,
+    .runs = runs,
+    .numRuns = numRuns,
+  };
+  ece_pool_run(pool, numRuns, &ece_record_decrypt_task, &job);
+
+  // Merge the runs in order. The first run that failed has the lowest failing
+  // record, so we return the same error as decrypting serially.
+  size_t plaintextStart = 0;
+  for (size_t i = 0; i < numRuns; i++) {
+    if (runs[i].err) {
+      err = runs[i].err;
+      goto end;
+    }
+    memmove(&plaintext[plaintextStart], &plaintext[runs[i].plaintextStart],
+            runs[i].plaintextLen);
+    plaintextStart += runs[i].plaintextLen;
+  }
+  *plaintextLen = plaintextStart;
+
+end:
+  for (size_t i = 1; i < numRuns; i++) {
+    EVP_CIPHER_CTX_free(runs[i].ctx);
+  }
+  ece_free(runs);
+  return err;
+}
+
+int
+ece_record_encrypt_init(EVP_CIPHER_CTX* ctx, const uint8_t* key) {
+  if (EVP_EncryptInit_ex(ctx, EVP_aes_128_gcm(), NULL, key, NULL) != 1) {
+    return ECE_ERROR_ENCRYPT;
+  }
+  return ECE_OK;
+}
+
+static int
+ece_record_seal(EVP_CIPHER_CTX* ctx, const uint8_t* iv, const uint8_t* block,
+                size_t blockLen, uint8_t* record) {
+  if (blockLen > INT_MAX) {
+    return ECE_ERROR_ENCRYPT;
+  }
+  int chunkLen = -1;
+  if (EVP_EncryptInit_ex(ctx, NULL, NULL, NULL, iv) != 1) {
+    return ECE_ERROR_ENCRYPT;
+  }
+  if (EVP_EncryptUpdate(ctx, record, &chunkLen, block, (int) blockLen) != 1) {
+    return ECE_ERROR_ENCRYPT;
+  }
+  if (EVP_EncryptFinal_ex(ctx, NULL, &chunkLen) != 1) {
+    return ECE_ERROR_ENCRYPT;
+  }
+  // Append the authentication tag to the encrypted record.
+  if (EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_GCM_GET_TAG, ECE_TAG_LENGTH,
+                          &record[blockLen]) != 1) {
+    return ECE_ERROR_ENCRYPT;
+  }
+  return ECE_OK;
+}
+
+int
+ece_record_encrypt(EVP_CIPHER_CTX* ctx, const uint8_t* iv,
+                   const uint8_t* block, size_t blockLen, uint8_t* record) {
+  uint64_t start = ece_stats_begin();
+  int err = ece_record_seal(ctx, iv, block, blockLen, record);
+  ece_stats_end(ECE_STATS_STAGE_ENCRYPT_RECORD, start, blockLen, err);
+  return err;
+}
+
+void
+ece_aes128gcm_pad(uint8_t* block, size_t blockPadLen, size_t dataLen,
+                  bool isLastRecord) {
+  block[dataLen] =
+    isLastRecord ? ECE_AES128GCM_LAST_DELIMITER : ECE_AES128GCM_DELIMITER;
+  memset(&block[dataLen + ECE_AES128GCM_PAD_SIZE], 0, blockPadLen);
+}
+
+void
+ece_aesgcm_pad(uint8_t* block, size_t blockPadLen, size_t dataLen,
+               bool isLastRecord) {
+  ECE_UNUSED(dataLen);
+  ECE_UNUSED(isLastRecord);
+  // The padding length is a 16-bit big-endian integer, followed by that many
+  // zero bytes.
+  block[0] = (uint8_t)((blockPadLen >> 8) & 0xff);
+  block[1] = (uint8_t)(blockPadLen & 0xff);
+  memset(&block[ECE_AESGCM_PAD_SIZE], 0, blockPadLen);
+}
+
+static int
+ece_aes128gcm_unpad_block(uint8_t* block, bool isLastRecord,
+                          size_t* blockLen) {
+  // Remove trailing padding. The delimiter is the last non-zero byte.
+  size_t len = ece_pad_trim_zeros(block, *blockLen);
+  if (!len) {
+    return ECE_ERROR_ZERO_PLAINTEXT;
+  }
+  uint8_t padDelim =
+    isLastRecord ? ECE_AES128GCM_LAST_DELIMITER : ECE_AES128GCM_DELIMITER;
+  if (block[len - 1] != padDelim) {
+    return ECE_ERROR_DECRYPT_PADDING;
+  }
+  *blockLen = len - 1;
+  return ECE_OK;
+}
+
+int
+ece_aes128gcm_unpad(uint8_t* block, bool isLastRecord, size_t* blockLen) {
+  size_t paddedLen = *blockLen;
+  ECE_TRACE2(unpad_start, paddedLen, isLastRecord);
+  uint64_t start = ece_stats_begin();
+  int err = ece_aes128gcm_unpad_block(block, isLastRecord, blockLen);
+  ece_stats_end(ECE_STATS_STAGE_UNPAD, start, paddedLen, err);
+  ECE_TRACE2(unpad_done, paddedLen, err);
+  return err;
+}
+
+static int
+ece_aesgcm_unpad_block(uint8_t* block, bool isLastRecord, size_t* blockLen) {
+  ECE_UNUSED(isLastRecord);
+  if (*blockLen < ECE_AESGCM_PAD_SIZE) {
+    return ECE_ERROR_DECRYPT_PADDING;
+  }
+  size_t padLen = ece_read_uint16_be(block);
+  if (padLen > *blockLen - ECE_AESGCM_PAD_SIZE) {
+    return ECE_ERROR_DECRYPT_PADDING;
+  }
+  // In "aesgcm", the content is offset by the pad size and padding, and all
+  // padding bytes must be zero.
+  if (!ece_pad_is_zero(&block[ECE_AESGCM_PAD_SIZE], padLen)) {
+    return ECE_ERROR_DECRYPT_PADDING;
+  }
+  size_t offset = ECE_AESGCM_PAD_SIZE + padLen;
+  *blockLen -= offset;
+  memmove(block, &block[offset], *blockLen);
+  return ECE_OK;
+}
+
+int
+ece_aesgcm_unpad(uint8_t* block, bool isLastRecord, size_t* blockLen) {
+  size_t paddedLen = *blockLen;
+  ECE_TRACE2(unpad_start, paddedLen, isLastRecord);
+  uint64_t start = ece_stats_begin();
+  int err = ece_aesgcm_unpad_block(block, isLastRecord, blockLen);
+  ece_stats_end(ECE_STATS_STAGE_UNPAD, start, paddedLen, err);
+  ECE_TRACE2(unpad_done, paddedLen, err);
+  return err;
+}
@@ -0,0 +1,262 @@
+#include "ece/encrypt.h"
+#include "ece/trailer.h"
+
+#include <string.h>
+
+// The length of the longest decimal `uint64_t`.
+#define ECE_REQUEST_MAX_DECIMAL_LENGTH 20
+
+// The Base64url-encoded lengths of the salt and sender public key, without
+// padding.
+#define ECE_REQUEST_SALT_BASE64_LENGTH 22
+#define ECE_REQUEST_PUBLIC_KEY_BASE64_LENGTH 87
+
+// The header fields that we write, in order. Values are filled in between
+// the name and the line ending.
+static const char ece_request_content_encoding[] = "Content-Encoding: ";
+static const char ece_request_crypto_key[] = "Crypto-Key: dh=";
+static const char ece_request_encryption_rs[] = "Encryption: rs=";
+static const char ece_request_encryption_salt[] = ";salt=";
+static const char ece_request_ttl[] = "TTL: ";
+static const char ece_request_content_length[] = "Content-Length: ";
+static const char ece_request_crlf[] = "\r\n";
+
+// Excludes the trailing null byte.
+#define ECE_REQUEST_LITERAL_LENGTH(literal) (sizeof(literal) - 1)
+
+#define ECE_REQUEST_WRITE_LITERAL(p, literal)                                  \
+  ece_request_write((p), (literal), ECE_REQUEST_LITERAL_LENGTH(literal))
+
+// The "aesgcm" parameters, sent in the `Crypto-Key` and `Encryption` headers.
+// "aes128gcm" includes these in the payload instead.
+typedef struct ece_request_aesgcm_params_s {
+  const uint8_t* salt;
+  const uint8_t* rawSenderPubKey;
+  uint32_t rs;
+} ece_request_aesgcm_params_t;
+
+static size_t
+ece_request_decimal_length(uint64_t value) {
+  size_t len = 1;
+  while (value >= 10) {
+    value /= 10;
+    len++;
+  }
+  return len;
+}
+
+static char*
+ece_request_write_decimal(char* p, uint64_t value) {
+  char digits[ECE_REQUEST_MAX_DECIMAL_LENGTH];
+  size_t len = 0;
+  do {
+    digits[len++] = (char) ('0' + value % 10);
+    value /= 10;
+  } while (value);
+  while (len) {
+    *p++ = digits[--len];
+  }
+  return p;
+}
+
+static inline char*
+ece_request_write(char* p, const char* value, size_t valueLen) {
+  memcpy(p, value, valueLen);
+  return &p[valueLen];
+}
+
+// Returns the length of the header block, including the empty line that ends
+// it. `aesgcm` is `NULL` for "aes128gcm".
+static size_t
+ece_request_headers_length(const char* contentEncoding,
+                           const ece_request_aesgcm_params_t* aesgcm,
+                           uint32_t ttl, size_t bodyLen) {
+  size_t len = ECE_REQUEST_LITERAL_LENGTH(ece_request_content_encoding) +
+               strlen(contentEncoding) +
+               ECE_REQUEST_LITERAL_LENGTH(ece_request_crlf);
+  if (aesgcm) {
+    len += ECE_REQUEST_LITERAL_LENGTH(ece_request_crypto_key) +
+           ECE_REQUEST_PUBLIC_KEY_BASE64_LENGTH +
+           ECE_REQUEST_LITERAL_LENGTH(ece_request_crlf);
+    len += ECE_REQUEST_LITERAL_LENGTH(ece_request_encryption_rs) +
+           ece_request_decimal_length(aesgcm->rs) +
+           ECE_REQUEST_LITERAL_LENGTH(ece_request_encryption_salt) +
+           ECE_REQUEST_SALT_BASE64_LENGTH +
+           ECE_REQUEST_LITERAL_LENGTH(ece_request_crlf);
+  }
+  len += ECE_REQUEST_LITERAL_LENGTH(ece_request_ttl) +
+         ece_request_decimal_length(ttl) +
+         ECE_REQUEST_LITERAL_LENGTH(ece_request_crlf);
+  len += ECE_REQUEST_LITERAL_LENGTH(ece_request_content_length) +
+         ece_request_decimal_length(bodyLen) +
+         ECE_REQUEST_LITERAL_LENGTH(ece_request_crlf);
+  return len + ECE_REQUEST_LITERAL_LENGTH(ece_request_crlf);
+}
+
+// Writes the header block computed by `ece_request_headers_length`.
+static void
+ece_request_write_headers(char* p, const char* contentEncoding,
+                          const ece_request_aesgcm_params_t* aesgcm,
+                          uint32_t ttl, size_t bodyLen) {
+  p = ECE_REQUEST_WRITE_LITERAL(p, ece_request_content_encoding);
+  p = ece_request_write(p, contentEncoding, strlen(contentEncoding));
+  p = ECE_REQUEST_WRITE_LITERAL(p, ece_request_crlf);
+  if (aesgcm) {
+    p = ECE_REQUEST_WRITE_LITERAL(p, ece_request_crypto_key);
+    p += ece_base64url_encode(aesgcm->rawSenderPubKey,
+                              ECE_WEBPUSH_PUBLIC_KEY_LENGTH,
+                              ECE_BASE64URL_OMIT_PADDING, p,
+                              ECE_REQUEST_PUBLIC_KEY_BASE64_LENGTH);
+    p = ECE_REQUEST_WRITE_LITERAL(p, ece_request_crlf);
+    p = ECE_REQUEST_WRITE_LITERAL(p, ece_request_encryption_rs);
+    p = ece_request_write_decimal(p, aesgcm->rs);
+    p = ECE_REQUEST_WRITE_LITERAL(p, ece_request_encryption_salt);
+    p += ece_base64url_encode(aesgcm->salt, ECE_SALT_LENGTH,
+                              ECE_BASE64URL_OMIT_PADDING, p,
+                              ECE_REQUEST_SALT_BASE64_LENGTH);
+    p = ECE_REQUEST_WRITE_LITERAL(p, ece_request_crlf);
+  }
+  p = ECE_REQUEST_WRITE_LITERAL(p, ece_request_ttl);
+  p = ece_request_write_decimal(p, ttl);
+  p = ECE_REQUEST_WRITE_LITERAL(p, ece_request_crlf);
+  p = ECE_REQUEST_WRITE_LITERAL(p, ece_request_content_length);
+  p = ece_request_write_decimal(p, bodyLen);
+  p = ECE_REQUEST_WRITE_LITERAL(p, ece_request_crlf);
+  ECE_REQUEST_WRITE_LITERAL(p, ece_request_crlf);
+}
+
+// Returns the request length for a body of `bodyLen` bytes, or 0 if the body
+// is empty or the request is too long to address.
+static size_t
+ece_request_length(const char* contentEncoding,
+                   const ece_request_aesgcm_params_t* aesgcm, uint32_t ttl,
+                   size_t bodyLen) {
+  if (!bodyLen) {
+    return 0;
+  }
+  size_t headersLen =
+    ece_request_headers_length(contentEncoding, aesgcm, ttl, bodyLen);
+  if (bodyLen > SIZE_MAX - headersLen) {
+    return 0;
+  }
+  return headersLen + bodyLen;
+}
+
+// Writes the header block, and encrypts the plaintext after it. The context
+// must already be initialized, and `*requestLen` must hold the whole request.
+static int
+ece_request_encrypt(ece_encrypt_ctx_t* ctx, const char* contentEncoding,
+                    const ece_request_aesgcm_params_t* aesgcm, uint32_t ttl,
+                    const uint8_t* plaintext, size_t plaintextLen,
+                    size_t bodyLen, uint8_t* request, size_t* requestLen) {
+  size_t headersLen =
+    ece_request_headers_length(contentEncoding, aesgcm, ttl, bodyLen);
+  ece_request_write_headers((char*) request, contentEncoding, aesgcm, ttl,
+                            bodyLen);
+  size_t ciphertextLen = bodyLen;
+  int err = ece_encrypt_all(ctx, plaintext, plaintextLen, &request[headersLen],
+                            &ciphertextLen);
+  if (err) {
+    return err;
+  }
+  if (ciphertextLen != bodyLen) {
+    // The layout disagrees with the encrypted length, so `Content-Length` is
+    // wrong.
+    return ECE_ERROR_ENCRYPT;
+  }
+  *requestLen = headersLen + bodyLen;
+  return ECE_OK;
+}
+
+size_t
+ece_webpush_aes128gcm_request_length(uint32_t rs, size_t padLen,
+                                     size_t plaintextLen, uint32_t ttl) {
+  size_t bodyLen =
+    ece_webpush_aes128gcm_payload_length(rs, padLen, plaintextLen);
+  return ece_request_length("aes128gcm", NULL, ttl, bodyLen);
+}
+
+int
+ece_webpush_aes128gcm_encrypt_request(
+  ece_encrypt_ctx_t* ctx, const uint8_t* rawRecvPubKey, size_t rawRecvPubKeyLen,
+  const uint8_t* authSecret, size_t authSecretLen, uint32_t rs, size_t padLen,
+  uint32_t ttl, const uint8_t* plaintext, size_t plaintextLen,
+  uint8_t* request, size_t* requestLen) {
+  if (!plaintextLen) {
+    return ECE_ERROR_ZERO_PLAINTEXT;
+  }
+  if (rs < ECE_AES128GCM_MIN_RS) {
+    return ECE_ERROR_INVALID_RS;
+  }
+  // Check the lengths before generating keys, so that a short buffer fails
+  // quickly.
+  size_t bodyLen =
+    ece_webpush_aes128gcm_payload_length(rs, padLen, plaintextLen);
+  if (!bodyLen) {
+    return ECE_ERROR_ENCRYPT_PADDING;
+  }
+  size_t len = ece_request_length("aes128gcm", NULL, ttl, bodyLen);
+  if (!len || *requestLen < len) {
+    return ECE_ERROR_OUT_OF_MEMORY;
+  }
+  int err = ece_webpush_aes128gcm_encrypt_init(ctx, rawRecvPubKey,
+                                               rawRecvPubKeyLen, authSecret,
+                                               authSecretLen, rs, padLen);
+  if (err) {
+    return err;
+  }
+  return ece_request_encrypt(ctx, "aes128gcm", NULL, ttl, plaintext,
+                             plaintextLen, bodyLen, request, requestLen);
+}
+
+size_t
+ece_webpush_aesgcm_request_length(uint32_t rs, size_t padLen,
+                                  size_t plaintextLen, uint32_t ttl) {
+  size_t bodyLen =
+    ece_webpush_aesgcm_ciphertext_length(rs, padLen, plaintextLen);
+  ece_request_aesgcm_params_t aesgcm = {
+    .salt = NULL,
+    .rawSenderPubKey = NULL,
+    .rs = rs,
+  };
+  return ece_request_length("aesgcm", &aesgcm, ttl, bodyLen);
+}
+
+int
+ece_webpush_aesgcm_encrypt_request(
+  ece_encrypt_ctx_t* ctx, const uint8_t* rawRecvPubKey, size_t rawRecvPubKeyLen,
+  const uint8_t* authSecret, size_t authSecretLen, uint32_t rs, size_t padLen,
+  uint32_t ttl, const uint8_t* plaintext, size_t plaintextLen,
+  uint8_t* request, size_t* requestLen) {
+  if (!plaintextLen) {
+    return ECE_ERROR_ZERO_PLAINTEXT;
+  }
+  if (rs < ECE_AESGCM_MIN_RS || !ece_aesgcm_rs(rs)) {
+    return ECE_ERROR_INVALID_RS;
+  }
+  size_t bodyLen =
+    ece_webpush_aesgcm_ciphertext_length(rs, padLen, plaintextLen);
+  if (!bodyLen) {
+    return ECE_ERROR_ENCRYPT_PADDING;
+  }
+  uint8_t salt[ECE_SALT_LENGTH];
+  uint8_t rawSenderPubKey[ECE_WEBPUSH_PUBLIC_KEY_LENGTH];
+  ece_request_aesgcm_params_t aesgcm = {
+    .salt = salt,
+    .rawSenderPubKey = rawSenderPubKey,
+    .rs = rs,
+  };
+  size_t len = ece_request_length("aesgcm", &aesgcm, ttl, bodyLen);
+  if (!len || *requestLen < len) {
+    return ECE_ERROR_OUT_OF_MEMORY;
+  }
+  int err = ece_webpush_aesgcm_encrypt_init(
+    ctx, rawRecvPubKey, rawRecvPubKeyLen, authSecret, authSecretLen, rs,
+    padLen, salt, ECE_SALT_LENGTH, rawSenderPubKey,
+    ECE_WEBPUSH_PUBLIC_KEY_LENGTH);
+  if (err) {
+    return err;
+  }
+  return ece_request_encrypt(ctx, "aesgcm", &aesgcm, ttl, plaintext,
+                             plaintextLen, bodyLen, request, requestLen);
+}
@@ -0,0 +1,292 @@
+#ifdef ECE_HAVE_PTHREADS
+// `pthread.h` and `clock_gettime` need POSIX declarations, which aren't part
+// of strict C99.
+#define _POSIX_C_SOURCE 200112L
+#elif !defined(_WIN32)
+#define _POSIX_C_SOURCE 199309L
+#endif
+
+#include "ece/stats.h"
+
+#include "ece/alloc.h"
+#include "ece/trace.h"
+
+#include <string.h>
+
+#include <openssl/crypto.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+#ifdef ECE_HAVE_PTHREADS
+#include <pthread.h>
+#endif
+
+// Each counter is only written by the thread that owns it, and read by any
+// thread that takes a snapshot. Relaxed atomic loads and stores keep those
+// reads well-defined, without the cost of a locked increment.
+#if defined(__GNUC__) || defined(__clang__)
+#define ECE_STATS_LOAD(counter) __atomic_load_n(&(counter), __ATOMIC_RELAXED)
+#define ECE_STATS_STORE(counter, value)                                        \
+  __atomic_store_n(&(counter), (value), __ATOMIC_RELAXED)
+#define ECE_STATS_LOAD_FLAG(flag) __atomic_load_n(&(flag), __ATOMIC_RELAXED)
+#define ECE_STATS_STORE_FLAG(flag, value)                                      \
+  __atomic_store_n(&(flag), (value), __ATOMIC_RELAXED)
+#else
+#define ECE_STATS_LOAD(counter) (*(volatile uint64_t*) &(counter))
+#define ECE_STATS_STORE(counter, value)                                        \
+  (*(volatile uint64_t*) &(counter) = (value))
+#define ECE_STATS_LOAD_FLAG(flag) (*(volatile bool*) &(flag))
+#define ECE_STATS_STORE_FLAG(flag, value) (*(volatile bool*) &(flag) = (value))
+#endif
+
+#define ECE_STATS_COUNTERS (sizeof(ece_stats_t) / sizeof(uint64_t))
+
+ECE_STATIC_ASSERT(sizeof(ece_stats_t) % sizeof(uint64_t) == 0,
+                  ece_stats_is_all_counters);
+
+static bool ece_stats_is_enabled = false;
+
+// Treats a stats struct as a flat array of counters, so that snapshots and
+// resets don't need to know its layout.
+static inline uint64_t*
+ece_stats_counters(ece_stats_t* stats) {
+  return (uint64_t*) stats;
+}
+
+static inline void
+ece_stats_add(uint64_t* counter, uint64_t value) {
+  ECE_STATS_STORE(*counter, ECE_STATS_LOAD(*counter) + value);
+}
+
+static uint64_t
+ece_stats_now_ns(void) {
+#ifdef _WIN32
+  LARGE_INTEGER freq, counter;
+  QueryPerformanceFrequency(&freq);
+  QueryPerformanceCounter(&counter);
+  return (uint64_t)((double) counter.QuadPart * 1e9 / (double) freq.QuadPart);
+#else
+  struct timespec ts;
+  if (clock_gettime(CLOCK_MONOTONIC, &ts)) {
+    return 0;
+  }
+  return (uint64_t) ts.tv_sec * 1000000000 + (uint64_t) ts.tv_nsec;
+#endif
+}
+
+// Returns the histogram bucket for a call that took `ns` nanoseconds.
+static inline size_t
+ece_stats_bucket(uint64_t ns) {
+  size_t bucket = 0;
+  while (ns > 1 && bucket < ECE_STATS_HISTOGRAM_BUCKETS - 1) {
+    ns >>= 1;
+    bucket++;
+  }
+  return bucket;
+}
+
+#ifdef ECE_HAVE_PTHREADS
+
+// Each thread's counters are linked into a list, so that a snapshot can sum
+// them. When a thread exits, its counters are folded into `retired`, and it's
+// removed from the list. Like the cipher context pool, the counters come from
+// OpenSSL's allocator, since they outlive any single call.
+typedef struct ece_stats_thread_s {
+  ece_stats_t stats;
+  struct ece_stats_thread_s* prev;
+  struct ece_stats_thread_s* next;
+} ece_stats_thread_t;
+
+static pthread_mutex_t ece_stats_lock = PTHREAD_MUTEX_INITIALIZER;
+static ece_stats_thread_t* ece_stats_threads = NULL;
+static ece_stats_t ece_stats_retired;
+// The sum of all counters at the last reset. Other threads may be updating
+// their counters during a reset, so we subtract this from later snapshots
+// instead of clearing them.
+static ece_stats_t ece_stats_baseline;
+
+static pthread_once_t ece_stats_once = PTHREAD_ONCE_INIT;
+static pthread_key_t ece_stats_key;
+static bool ece_stats_has_key = false;
+
+// Adds `stats` to `sum`. The caller must hold the lock.
+static void
+ece_stats_sum(ece_stats_t* sum, ece_stats_t* stats) {
+  uint64_t* sumCounters = ece_stats_counters(sum);
+  uint64_t* counters = ece_stats_counters(stats);
+  for (size_t i = 0; i < ECE_STATS_COUNTERS; i++) {
+    sumCounters[i] += ECE_STATS_LOAD(counters[i]);
+  }
+}
+
+static void
+ece_stats_thread_destroy(void* arg) {
+  ece_stats_thread_t* thread = arg;
+  pthread_mutex_lock(&ece_stats_lock);
+  ece_stats_sum(&ece_stats_retired, &thread->stats);
+  if (thread->prev) {
+    thread->prev->next = thread->next;
+  } else {
+    ece_stats_threads = thread->next;
+  }
+  if (thread->next) {
+    thread->next->prev = thread->prev;
+  }
+  pthread_mutex_unlock(&ece_stats_lock);
+  OPENSSL_free(thread);
+}
+
+static void
+ece_stats_create_key(void) {
+  ece_stats_has_key =
+    !pthread_key_create(&ece_stats_key, &ece_stats_thread_destroy);
+}
+
+// Returns the calling thread's counters, creating them if needed. Returns
+// `NULL` if they can't be created.
+static ece_stats_t*
+ece_stats_get(void) {
+  pthread_once(&ece_stats_once, &ece_stats_create_key);
+  if (!ece_stats_has_key) {
+    return NULL;
+  }
+  ece_stats_thread_t* thread = pthread_getspecific(ece_stats_key);
+  if (thread) {
+    return &thread->stats;
+  }
+  thread = OPENSSL_zalloc(sizeof(ece_stats_thread_t));
+  if (!thread) {
+    return NULL;
+  }
+  if (pthread_setspecific(ece_stats_key, thread)) {
+    OPENSSL_free(thread);
+    return NULL;
+  }
+  pthread_mutex_lock(&ece_stats_lock);
+  thread->next = ece_stats_threads;
+  if (ece_stats_threads) {
+    ece_stats_threads->prev = thread;
+  }
+  ece_stats_threads = thread;
+  pthread_mutex_unlock(&ece_stats_lock);
+  return &thread->stats;
+}
+
+// Sums the counters of all threads. The caller must hold the lock.
+static void
+ece_stats_sum_all(ece_stats_t* sum) {
+  *sum = ece_stats_retired;
+  for (ece_stats_thread_t* thread = ece_stats_threads; thread;
+       thread = thread->next) {
+    ece_stats_sum(sum, &thread->stats);
+  }
+}
+
+void
+ece_stats_snapshot(ece_stats_t* stats) {
+  pthread_mutex_lock(&ece_stats_lock);
+  ece_stats_sum_all(stats);
+  uint64_t* counters = ece_stats_counters(stats);
+  uint64_t* baseline = ece_stats_counters(&ece_stats_baseline);
+  for (size_t i = 0; i < ECE_STATS_COUNTERS; i++) {
+    counters[i] -= baseline[i];
+  }
+  pthread_mutex_unlock(&ece_stats_lock);
+}
+
+void
+ece_stats_reset(void) {
+  pthread_mutex_lock(&ece_stats_lock);
+  ece_stats_sum_all(&ece_stats_baseline);
+  pthread_mutex_unlock(&ece_stats_lock);
+}
+
+#else
+
+// Without pthreads, there's no way to find the other threads' counters, so
+// each thread only sees its own.
+static ECE_THREAD_LOCAL ece_stats_t ece_thread_stats;
+
+static ece_stats_t*
+ece_stats_get(void) {
+  return &ece_thread_stats;
+}
+
+void
+ece_stats_snapshot(ece_stats_t* stats) {
+  *stats = ece_thread_stats;
+}
+
+void
+ece_stats_reset(void) {
+  memset(&ece_thread_stats, 0, sizeof(ece_stats_t));
+}
+
+#endif /* ECE_HAVE_PTHREADS */
+
+void
+ece_stats_enable(bool enabled) {
+  ECE_STATS_STORE_FLAG(ece_stats_is_enabled, enabled);
+}
+
+bool
+ece_stats_enabled(void) {
+  return ECE_STATS_LOAD_FLAG(ece_stats_is_enabled);
+}
+
+uint64_t
+ece_stats_begin(void) {
+  if (!ECE_STATS_LOAD_FLAG(ece_stats_is_enabled)) {
+    return 0;
+  }
+  return ece_stats_now_ns();
+}
+
+void
+ece_stats_end(ece_stats_stage_t stage, uint64_t start, size_t bytes, int err) {
+  if (!start) {
+    return;
+  }
+  uint64_t end = ece_stats_now_ns();
+  ece_stats_t* stats = ece_stats_get();
+  if (!stats) {
+    return;
+  }
+  uint64_t ns = end > start ? end - start : 0;
+  ece_stats_stage_counters_t* counters = &stats->stages[stage];
+  ece_stats_add(&counters->calls, 1);
+  ece_stats_add(&counters->bytes, bytes);
+  ece_stats_add(&counters->ns, ns);
+  ece_stats_add(&counters->histogram[ece_stats_bucket(ns)], 1);
+  if (err) {
+    ece_stats_add(&counters->errors, 1);
+    size_t code = (size_t) -err;
+    ece_stats_add(&stats->errors[code < ECE_STATS_ERROR_CODES ? code : 0], 1);
+  }
+}
+
+EC_KEY*
+ece_stats_import_private_key(const uint8_t* rawKey, size_t rawKeyLen) {
+  ECE_TRACE1(import_key_start, rawKeyLen);
+  uint64_t start = ece_stats_begin();
+  EC_KEY* key = ece_import_private_key(rawKey, rawKeyLen);
+  int err = key ? ECE_OK : ECE_ERROR_INVALID_PRIVATE_KEY;
+  ece_stats_end(ECE_STATS_STAGE_IMPORT_KEY, start, rawKeyLen, err);
+  ECE_TRACE2(import_key_done, rawKeyLen, err);
+  return key;
+}
+
+EC_KEY*
+ece_stats_import_public_key(const uint8_t* rawKey, size_t rawKeyLen) {
+  ECE_TRACE1(import_key_start, rawKeyLen);
+  uint64_t start = ece_stats_begin();
+  EC_KEY* key = ece_import_public_key(rawKey, rawKeyLen);
+  int err = key ? ECE_OK : ECE_ERROR_INVALID_PUBLIC_KEY;
+  ece_stats_end(ECE_STATS_STAGE_IMPORT_KEY, start, rawKeyLen, err);
+  ECE_TRACE2(import_key_done, rawKeyLen, err);
+  return key;
+}
@@ -0,0 +1,270 @@
+#include "ece/subscription.h"
+
+#include "ece/alloc.h"
+#include "ece/cipher.h"
+#include "ece/stats.h"
+#include "ece/trace.h"
+#include "ece/trailer.h"
+
+#include <string.h>
+
+#include <openssl/crypto.h>
+
+ECE_STATIC_ASSERT(sizeof(ece_subscription_t) <= ECE_MAX_CONTEXT_LENGTH,
+                  ece_subscription_fits);
+
+int
+ece_subscription_create(const uint8_t* rawRecvPrivKey, size_t rawRecvPrivKeyLen,
+                        const uint8_t* authSecret, size_t authSecretLen,
+                        ece_subscription_t** sub) {
+  *sub = NULL;
+  if (authSecretLen != ECE_WEBPUSH_AUTH_SECRET_LENGTH) {
+    return ECE_ERROR_INVALID_AUTH_SECRET;
+  }
+  ece_subscription_t* newSub = ece_calloc(1, sizeof(ece_subscription_t));
+  if (!newSub) {
+    return ECE_ERROR_OUT_OF_MEMORY;
+  }
+  newSub->recvPrivKey =
+    ece_stats_import_private_key(rawRecvPrivKey, rawRecvPrivKeyLen);
+  if (!newSub->recvPrivKey) {
+    ece_free(newSub);
+    return ECE_ERROR_INVALID_PRIVATE_KEY;
+  }
+  memcpy(newSub->authSecret, authSecret, ECE_WEBPUSH_AUTH_SECRET_LENGTH);
+  *sub = newSub;
+  return ECE_OK;
+}
+
+void
+ece_subscription_destroy(ece_subscription_t* sub) {
+  if (!sub) {
+    return;
+  }
+  EC_KEY_free(sub->recvPrivKey);
+  // The auth secret is as sensitive as the private key, so we clear it before
+  // releasing the memory.
+  OPENSSL_cleanse(sub->authSecret, ECE_WEBPUSH_AUTH_SECRET_LENGTH);
+  ece_free(sub);
+}
+
+int
+ece_subscription_derive_key_and_nonce(const ece_subscription_t* sub,
+                                      const uint8_t* salt, size_t saltLen,
+                                      const uint8_t* rawSenderPubKey,
+                                      size_t rawSenderPubKeyLen,
+                                      derive_key_and_nonce_t deriveKeyAndNonce,
+                                      uint8_t* key, uint8_t* nonce) {
+  EC_KEY* senderPubKey =
+    ece_stats_import_public_key(rawSenderPubKey, rawSenderPubKeyLen);
+  if (!senderPubKey) {
+    return ECE_ERROR_INVALID_PUBLIC_KEY;
+  }
+  ECE_TRACE1(derive_key_start, saltLen);
+  uint64_t start = ece_stats_begin();
+  int err = deriveKeyAndNonce(ECE_MODE_DECRYPT, sub->recvPrivKey, senderPubKey,
+                              sub->authSecret, ECE_WEBPUSH_AUTH_SECRET_LENGTH,
+                              salt, saltLen, key, nonce);
+  ece_stats_end(ECE_STATS_STAGE_DERIVE_KEY, start, 0, err);
+  ECE_TRACE2(derive_key_done, saltLen, err);
+  EC_KEY_free(senderPubKey);
+  return err;
+}
+
+int
+ece_subscription_decrypt_records(ece_pool_t* pool,
+                                 const ece_subscription_t* sub,
+                                 const uint8_t* salt, size_t saltLen,
+                                 const uint8_t* rawSenderPubKey,
+                                 size_t rawSenderPubKeyLen, uint32_t rs,
+                                 const uint8_t* ciphertext,
+                                 size_t ciphertextLen,
+                                 derive_key_and_nonce_t deriveKeyAndNonce,
+                                 unpad_t unpad, uint8_t* plaintext,
+                                 size_t* plaintextLen) {
+  uint8_t key[ECE_AES_KEY_LENGTH];
+  uint8_t nonce[ECE_NONCE_LENGTH];
+  int err = ece_subscription_derive_key_and_nonce(
+    sub, salt, saltLen, rawSenderPubKey, rawSenderPubKeyLen,
+    deriveKeyAndNonce, key, nonce);
+  if (err) {
+    return err;
+  }
+  EVP_CIPHER_CTX* ctx;
+  err = ece_cipher_ctx_acquire(ECE_MODE_DECRYPT, key, &ctx);
+  if (err) {
+    return err;
+  }
+  err = ece_record_decrypt_all_parallel(pool, ctx, nonce, rs, ciphertext,
+                                        ciphertextLen, unpad, plaintext,
+                                        plaintextLen);
+  ece_cipher_ctx_release(ctx);
+  return err;
+}
+
+int
+ece_subscription_aes128gcm_decrypt(const ece_subscription_t* sub,
+                                   const uint8_t* payload, size_t payloadLen,
+                                   uint8_t* plaintext, size_t* plaintextLen) {
+  return ece_subscription_aes128gcm_decrypt_parallel(
+    sub, NULL, payload, payloadLen, plaintext, plaintextLen);
+}
+
+int
+ece_subscription_aes128gcm_decrypt_parallel(const ece_subscription_t* sub,
+                                            ece_pool_t* pool,
+                                            const uint8_t* payload,
+                                            size_t payloadLen,
+                                            uint8_t* plaintext,
+                                            size_t* plaintextLen) {
+  const uint8_t* salt;
+  size_t saltLen;
+  const uint8_t* rawSenderPubKey;
+  size_t rawSenderPubKeyLen;
+  uint32_t rs = 0;
+  const uint8_t* ciphertext;
+  size_t ciphertextLen;
+  ECE_TRACE1(header_parse_start, payloadLen);
+  int err = ece_aes128gcm_payload_extract_params(
+    payload, payloadLen, &salt, &saltLen, &rawSenderPubKey,
+    &rawSenderPubKeyLen, &rs, &ciphertext, &ciphertextLen);
+  ECE_TRACE3(header_parse_done, payloadLen, rs, err);
+  if (err) {
+    return err;
+  }
+  if (!ciphertextLen) {
+    return ECE_ERROR_ZERO_CIPHERTEXT;
+  }
+  return ece_subscription_decrypt_records(
+    pool, sub, salt, saltLen, rawSenderPubKey, rawSenderPubKeyLen, rs,
+    ciphertext, ciphertextLen, &ece_webpush_aes128gcm_derive_key_and_nonce,
+    &ece_aes128gcm_unpad, plaintext, plaintextLen);
+}
+
+int
+ece_subscription_aesgcm_decrypt(const ece_subscription_t* sub,
+                                const uint8_t* salt, size_t saltLen,
+                                const uint8_t* rawSenderPubKey,
+                                size_t rawSenderPubKeyLen, uint32_t rs,
+                                const uint8_t* ciphertext, size_t ciphertextLen,
+                                uint8_t* plaintext, size_t* plaintextLen) {
+  return ece_subscription_aesgcm_decrypt_parallel(
+    sub, NULL, salt, saltLen, rawSenderPubKey, rawSenderPubKeyLen, rs,
+    ciphertext, ciphertextLen, plaintext, plaintextLen);
+}
+
+int
+ece_subscription_aesgcm_decrypt_parallel(
+  const ece_subscription_t* sub, ece_pool_t* pool, const uint8_t* salt,
+  size_t saltLen, const uint8_t* rawSenderPubKey, size_t rawSenderPubKeyLen,
+  uint32_t rs, const uint8_t* ciphertext, size_t ciphertextLen,
+  uint8_t* plaintext, size_t* plaintextLen) {
+  if (rs < ECE_AESGCM_MIN_RS || !ece_aesgcm_rs(rs)) {
+    return ECE_ERROR_INVALID_RS;
+  }
+  if (saltLen != ECE_SALT_LENGTH) {
+    return ECE_ERROR_INVALID_SALT;
+  }
+  if (!ciphertextLen) {
+    return ECE_ERROR_ZERO_CIPHERTEXT;
+  }
+  if (ece_aesgcm_needs_trailer(rs, ciphertextLen)) {
+    return ECE_ERROR_DECRYPT_TRUNCATED;
+  }
+  return ece_subscription_decrypt_records(
+    pool, sub, salt, saltLen, rawSenderPubKey, rawSenderPubKeyLen,
+    ece_aesgcm_rs(rs), ciphertext, ciphertextLen,
+    &ece_webpush_aesgcm_derive_key_and_nonce, &ece_aesgcm_unpad, plaintext,
+    plaintextLen);
+}
+
+// Derives the content encryption key and nonce for a message to `sub`, and
+// decrypts all records in place.
+static int
+ece_subscription_decrypt_records_in_place(
+  const ece_subscription_t* sub, const uint8_t* salt, size_t saltLen,
+  const uint8_t* rawSenderPubKey, size_t rawSenderPubKeyLen, uint32_t rs,
+  uint8_t* ciphertext, size_t ciphertextLen,
+  derive_key_and_nonce_t deriveKeyAndNonce, unpad_t unpad,
+  size_t* plaintextLen) {
+  uint8_t key[ECE_AES_KEY_LENGTH];
+  uint8_t nonce[ECE_NONCE_LENGTH];
+  int err = ece_subscription_derive_key_and_nonce(
+    sub, salt, saltLen, rawSenderPubKey, rawSenderPubKeyLen,
+    deriveKeyAndNonce, key, nonce);
+  if (err) {
+    return err;
+  }
+  EVP_CIPHER_CTX* ctx;
+  err = ece_cipher_ctx_acquire(ECE_MODE_DECRYPT, key, &ctx);
+  if (err) {
+    return err;
+  }
+  err = ece_record_decrypt_all_in_place(ctx, nonce, rs, ciphertext,
+                                        ciphertextLen, unpad, plaintextLen);
+  ece_cipher_ctx_release(ctx);
+  return err;
+}
+
+int
+ece_subscription_aes128gcm_decrypt_in_place(const ece_subscription_t* sub,
+                                            uint8_t* payload,
+                                            size_t payloadLen,
+                                            size_t* plaintextOffset,
+                                            size_t* plaintextLen) {
+  const uint8_t* salt;
+  size_t saltLen;
+  const uint8_t* rawSenderPubKey;
+  size_t rawSenderPubKeyLen;
+  uint32_t rs = 0;
+  const uint8_t* ciphertext;
+  size_t ciphertextLen;
+  ECE_TRACE1(header_parse_start, payloadLen);
+  int err = ece_aes128gcm_payload_extract_params(
+    payload, payloadLen, &salt, &saltLen, &rawSenderPubKey,
+    &rawSenderPubKeyLen, &rs, &ciphertext, &ciphertextLen);
+  ECE_TRACE3(header_parse_done, payloadLen, rs, err);
+  if (err) {
+    return err;
+  }
+  if (!ciphertextLen) {
+    return ECE_ERROR_ZERO_CIPHERTEXT;
+  }
+  // The salt and key ID point into the header, which the records don't
+  // overwrite, so the plaintext starts where the first record did.
+  size_t ciphertextStart = (size_t)(ciphertext - payload);
+  err = ece_subscription_decrypt_records_in_place(
+    sub, salt, saltLen, rawSenderPubKey, rawSenderPubKeyLen, rs,
+    &payload[ciphertextStart], ciphertextLen,
+    &ece_webpush_aes128gcm_derive_key_and_nonce, &ece_aes128gcm_unpad,
+    plaintextLen);
+  if (err) {
+    return err;
+  }
+  *plaintextOffset = ciphertextStart;
+  return ECE_OK;
+}
+
+int
+ece_subscription_aesgcm_decrypt_in_place(
+  const ece_subscription_t* sub, const uint8_t* salt, size_t saltLen,
+  const uint8_t* rawSenderPubKey, size_t rawSenderPubKeyLen, uint32_t rs,
+  uint8_t* ciphertext, size_t ciphertextLen, size_t* plaintextLen) {
+  if (rs < ECE_AESGCM_MIN_RS || !ece_aesgcm_rs(rs)) {
+    return ECE_ERROR_INVALID_RS;
+  }
+  if (saltLen != ECE_SALT_LENGTH) {
+    return ECE_ERROR_INVALID_SALT;
+  }
+  if (!ciphertextLen) {
+    return ECE_ERROR_ZERO_CIPHERTEXT;
+  }
+  if (ece_aesgcm_needs_trailer(rs, ciphertextLen)) {
+    return ECE_ERROR_DECRYPT_TRUNCATED;
+  }
+  return ece_subscription_decrypt_records_in_place(
+    sub, salt, saltLen, rawSenderPubKey, rawSenderPubKeyLen,
+    ece_aesgcm_rs(rs), ciphertext, ciphertextLen,
+    &ece_webpush_aesgcm_derive_key_and_nonce, &ece_aesgcm_unpad,
+    plaintextLen);
+}
@@ -0,0 +1,243 @@
+#include "test.h"
+
+#include <inttypes.h>
+#include <string.h>
+
+// Counts allocations, and forwards them to the C heap.
+typedef struct alloc_counter_s {
+  size_t allocs;
+  size_t frees;
+  size_t live;
+} alloc_counter_t;
+
+static void*
+counting_alloc(void* opaque, size_t size) {
+  alloc_counter_t* counter = opaque;
+  void* ptr = malloc(size);
+  if (ptr) {
+    counter->allocs++;
+    counter->live++;
+  }
+  return ptr;
+}
+
+static void*
+counting_realloc(void* opaque, void* ptr, size_t size) {
+  alloc_counter_t* counter = opaque;
+  void* newPtr = realloc(ptr, size);
+  if (newPtr && !ptr) {
+    counter->allocs++;
+    counter->live++;
+  }
+  return newPtr;
+}
+
+static void
+counting_free(void* opaque, void* ptr) {
+  alloc_counter_t* counter = opaque;
+  counter->frees++;
+  counter->live--;
+  free(ptr);
+}
+
+static void*
+failing_alloc(void* opaque, size_t size) {
+  ECE_UNUSED(opaque);
+  ECE_UNUSED(size);
+  return NULL;
+}
+
+static void*
+failing_realloc(void* opaque, void* ptr, size_t size) {
+  ECE_UNUSED(opaque);
+  ECE_UNUSED(ptr);
+  ECE_UNUSED(size);
+  return NULL;
+}
+
+static void
+failing_free(void* opaque, void* ptr) {
+  ECE_UNUSED(opaque);
+  ECE_UNUSED(ptr);
+}
+
+typedef struct alloc_keys_s {
+  uint8_t rawRecvPrivKey[ECE_WEBPUSH_PRIVATE_KEY_LENGTH];
+  uint8_t rawRecvPubKey[ECE_WEBPUSH_PUBLIC_KEY_LENGTH];
+  uint8_t authSecret[ECE_WEBPUSH_AUTH_SECRET_LENGTH];
+} alloc_keys_t;
+
+static void
+alloc_generate_keys(alloc_keys_t* keys) {
+  int err = ece_webpush_generate_keys(
+    keys->rawRecvPrivKey, ECE_WEBPUSH_PRIVATE_KEY_LENGTH, keys->rawRecvPubKey,
+    ECE_WEBPUSH_PUBLIC_KEY_LENGTH, keys->authSecret,
+    ECE_WEBPUSH_AUTH_SECRET_LENGTH);
+  ece_assert(!err, "Got %d generating keys", err);
+}
+
+// Encrypts `plaintext` with a streaming context, then decrypts the payload
+// with a streaming context and the scatter-gather function. All library
+// allocations use the current allocator.
+static void
+alloc_round_trip(const alloc_keys_t* keys, uint32_t rs,
+                 const uint8_t* plaintext, size_t plaintextLen) {
+  ece_encrypt_ctx_t* encryptCtx = ece_encrypt_ctx_new();
+  ece_assert(encryptCtx, "Want encryption context for rs = %" PRIu32, rs);
+  int err = ece_webpush_aes128gcm_encrypt_init(
+    encryptCtx, keys->rawRecvPubKey, ECE_WEBPUSH_PUBLIC_KEY_LENGTH,
+    keys->authSecret, ECE_WEBPUSH_AUTH_SECRET_LENGTH, rs, 0);
+  ece_assert(!err, "Got %d initializing encryption for rs = %" PRIu32, err,
+             rs);
+  uint8_t* payload = NULL;
+  size_t payloadLen = 0;
+  err = ece_test_encrypt_stream(encryptCtx, plaintext, plaintextLen, 7,
+                                &payload, &payloadLen);
+  ece_assert(!err, "Got %d encrypting for rs = %" PRIu32, err, rs);
+  ece_encrypt_ctx_free(encryptCtx);
+
+  ece_aes128gcm_decrypt_ctx_t* decryptCtx = ece_aes128gcm_decrypt_ctx_new();
+  ece_assert(decryptCtx, "Want decryption context for rs = %" PRIu32, rs);
+  err = ece_webpush_aes128gcm_decrypt_init(
+    decryptCtx, keys->rawRecvPrivKey, ECE_WEBPUSH_PRIVATE_KEY_LENGTH,
+    keys->authSecret, ECE_WEBPUSH_AUTH_SECRET_LENGTH);
+  ece_assert(!err, "Got %d initializing decryption for rs = %" PRIu32, err,
+             rs);
+  uint8_t* decrypted = calloc(plaintextLen + rs, sizeof(uint8_t));
+  size_t decryptedLen = plaintextLen + rs;
+  err = ece_aes128gcm_decrypt_update(decryptCtx, payload, payloadLen,
+                                     decrypted, &decryptedLen);
+  ece_assert(!err, "Got %d decrypting for rs = %" PRIu32, err, rs);
+  size_t finalLen = plaintextLen + rs - decryptedLen;
+  err = ece_aes128gcm_decrypt_final(decryptCtx, &decrypted[decryptedLen],
+                                    &finalLen);
+  ece_assert(!err, "Got %d finishing decryption for rs = %" PRIu32, err, rs);
+  decryptedLen += finalLen;
+  ece_aes128gcm_decrypt_ctx_free(decryptCtx);
+  ece_assert(decryptedLen == plaintextLen &&
+               !memcmp(decrypted, plaintext, plaintextLen),
+             "Wrong streaming plaintext for rs = %" PRIu32, rs);
+
+  size_t payloadCount;
+  ece_iovec_t* payloadIov =
+    ece_test_iov_new(payload, payloadLen, rs / 3 + 1, &payloadCount);
+  size_t plaintextCount;
+  ece_iovec_t* plaintextIov =
+    ece_test_iov_new(NULL, plaintextLen, rs / 2 + 1, &plaintextCount);
+  decryptedLen = plaintextLen;
+  err = ece_webpush_aes128gcm_decrypt_iov(
+    keys->rawRecvPrivKey, ECE_WEBPUSH_PRIVATE_KEY_LENGTH, keys->authSecret,
+    ECE_WEBPUSH_AUTH_SECRET_LENGTH, payloadIov, payloadCount, plaintextIov,
+    plaintextCount, &decryptedLen);
+  ece_assert(!err, "Got %d decrypting segments for rs = %" PRIu32, err, rs);
+  ece_test_iov_flatten(plaintextIov, plaintextCount, decrypted, decryptedLen);
+  ece_assert(decryptedLen == plaintextLen &&
+               !memcmp(decrypted, plaintext, plaintextLen),
+             "Wrong scatter-gather plaintext for rs = %" PRIu32, rs);
+
+  ece_test_iov_free(payloadIov, payloadCount);
+  ece_test_iov_free(plaintextIov, plaintextCount);
+  free(decrypted);
+  free(payload);
+}
+
+void
+test_alloc_hooks(void) {
+  alloc_keys_t keys;
+  alloc_generate_keys(&keys);
+  uint8_t plaintext[100];
+  memset(plaintext, 'a', sizeof(plaintext));
+
+  alloc_counter_t counter = {0, 0, 0};
+  ece_allocator_t counting = {
+    .alloc = &counting_alloc,
+    .realloc = &counting_realloc,
+    .free = &counting_free,
+    .opaque = &counter,
+  };
+  ece_set_allocator(&counting);
+  alloc_round_trip(&keys, 32, plaintext, sizeof(plaintext));
+  ece_assert(counter.allocs >= 5, "Got %zu allocations; want at least 5",
+             counter.allocs);
+  ece_assert(!counter.live, "Got %zu live allocations after freeing",
+             counter.live);
+  ece_assert(counter.allocs == counter.frees,
+             "Got %zu allocations and %zu frees", counter.allocs,
+             counter.frees);
+
+  // The thread allocator takes precedence over the global allocator.
+  ece_allocator_t failing = {
+    .alloc = &failing_alloc,
+    .realloc = &failing_realloc,
+    .free = &failing_free,
+    .opaque = NULL,
+  };
+  ece_set_allocator(&failing);
+  ece_assert(!ece_encrypt_ctx_new(), "Want failing global allocator%s", "");
+  counter.allocs = 0;
+  ece_set_thread_allocator(&counting);
+  ece_encrypt_ctx_t* ctx = ece_encrypt_ctx_new();
+  ece_assert(ctx, "Want encryption context from thread allocator%s", "");
+  ece_assert(counter.allocs == 1, "Got %zu thread allocations; want 1",
+             counter.allocs);
+  ece_encrypt_ctx_free(ctx);
+  ece_set_thread_allocator(NULL);
+  ece_assert(!ece_encrypt_ctx_new(), "Want failing global allocator%s", "");
+
+  // OpenSSL has already allocated, so it's too late to replace its allocator.
+  int err = ece_set_openssl_allocator(&counting);
+  ece_assert(err == ECE_ERROR_ALLOCATOR,
+             "Got %d setting OpenSSL allocator; want %d", err,
+             ECE_ERROR_ALLOCATOR);
+  err = ece_set_openssl_allocator(NULL);
+  ece_assert(err == ECE_ERROR_ALLOCATOR,
+             "Got %d setting null OpenSSL allocator; want %d", err,
+             ECE_ERROR_ALLOCATOR);
+
+  ece_test_set_heap_allocator();
+}
+
+void
+test_alloc_arena(void) {
+  static const uint32_t recordSizes[] = {18, 32, 1024, 4096};
+
+  alloc_keys_t keys;
+  alloc_generate_keys(&keys);
+  uint8_t plaintext[5000];
+  for (size_t i = 0; i < sizeof(plaintext); i++) {
+    plaintext[i] = (uint8_t) i;
+  }
+
+  for (size_t i = 0; i < sizeof(recordSizes) / sizeof(uint32_t); i++) {
+    uint32_t rs = recordSizes[i];
+    size_t scratchLen = ece_scratch_size(rs, 0);
+    uint8_t* scratch = malloc(scratchLen);
+    ece_arena_t arena;
+    ece_arena_init(&arena, scratch, scratchLen);
+    ece_allocator_t allocator;
+    ece_arena_allocator(&arena, &allocator);
+
+    ece_set_allocator(&allocator);
+    alloc_round_trip(&keys, rs, plaintext, sizeof(plaintext));
+    ece_test_set_heap_allocator();
+
+    ece_assert(arena.peak > 0 && arena.peak <= scratchLen,
+               "Got peak %zu for rs = %" PRIu32 "; want at most %zu",
+               arena.peak, rs, scratchLen);
+    // Contexts free their memory in reverse order, so the arena is empty.
+    ece_assert(!arena.used, "Got %zu used bytes for rs = %" PRIu32,
+               arena.used, rs);
+    free(scratch);
+  }
+
+  // Allocations fail once the arena is exhausted.
+  uint8_t scratch[64];
+  ece_arena_t arena;
+  ece_arena_init(&arena, scratch, sizeof(scratch));
+  ece_allocator_t allocator;
+  ece_arena_allocator(&arena, &allocator);
+  ece_set_thread_allocator(&allocator);
+  ece_assert(!ece_encrypt_ctx_new(), "Want failing arena allocation%s", "");
+  ece_set_thread_allocator(NULL);
+  ece_assert(!arena.used, "Got %zu used bytes after failing", arena.used);
+}
@@ -2,6 +2,8 @@
 
 #include <string.h>
 
+#include <ece/base64url.h>
+
 typedef struct base64url_encode_test_s {
   const char* binary;
   size_t binaryLen;
@@ -176,3 +178,368 @@ test_base64url_decode(void) {
     free(binary);
   }
 }
+
+static const char*
+base64url_impl_name(ece_base64url_impl_t impl) {
+  switch (impl) {
+  case ECE_BASE64URL_IMPL_SCALAR:
+    return "scalar";
+  case ECE_BASE64URL_IMPL_SSE41:
+    return "sse4.1";
+  case ECE_BASE64URL_IMPL_AVX2:
+    return "avx2";
+  case ECE_BASE64URL_IMPL_NEON:
+    return "neon";
+  }
+  return "unknown";
+}
+
+// A small deterministic generator, so that failures are reproducible.
+static uint32_t
+base64url_random(uint32_t* state) {
+  uint32_t x = *state;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  *state = x;
+  return x;
+}
+
+// Characters outside the alphabet, including the standard Base64 characters,
+// padding, and bytes with the high bit set.
+static const char base64url_invalid_chars[] = "+/=. \n\0\x80\xbf\xff";
+
+void
+test_base64url_simd(void) {
+  static const ece_base64url_impl_t impls[] = {
+    ECE_BASE64URL_IMPL_SSE41,
+    ECE_BASE64URL_IMPL_AVX2,
+    ECE_BASE64URL_IMPL_NEON,
+  };
+  static const size_t maxBinaryLen = 600;
+  static const size_t maxBase64Len = 800;
+
+  uint8_t* binary = malloc(maxBinaryLen);
+  char* base64 = malloc(maxBase64Len);
+  char* wantBase64 = malloc(maxBase64Len);
+  char* text = malloc(maxBase64Len);
+  uint8_t* decoded = malloc(maxBinaryLen);
+  uint8_t* wantDecoded = malloc(maxBinaryLen);
+
+  uint32_t state = 0x6ba5e64;
+  for (size_t round = 0; round < 2000; round++) {
+    size_t binaryLen = base64url_random(&state) % maxBinaryLen;
+    for (size_t i = 0; i < binaryLen; i++) {
+      binary[i] = (uint8_t) base64url_random(&state);
+    }
+
+    // The scalar path is the reference for the kernels. It must also agree
+    // with the public encoder for the complete groups.
+    size_t wantEncoded = ece_base64url_encode_blocks_impl(
+      ECE_BASE64URL_IMPL_SCALAR, binary, binaryLen, wantBase64);
+    ece_assert(wantEncoded == binaryLen / 3 * 3,
+               "Got %zu scalar encoded bytes for length %zu", wantEncoded,
+               binaryLen);
+    size_t textLen = ece_base64url_encode(
+      binary, binaryLen, ECE_BASE64URL_OMIT_PADDING, text, maxBase64Len);
+    ece_assert(!memcmp(text, wantBase64, wantEncoded / 3 * 4),
+               "Wrong scalar encoding for length %zu", binaryLen);
+
+    // Decode the encoded text, with an invalid character in some rounds. The
+    // scalar path stops before the quantum with the invalid character.
+    if (textLen && base64url_random(&state) % 2) {
+      size_t index = base64url_random(&state) % textLen;
+      text[index] =
+        base64url_invalid_chars[base64url_random(&state) %
+                                (sizeof(base64url_invalid_chars) - 1)];
+    }
+    size_t wantDecodedLen = ece_base64url_decode_blocks_impl(
+      ECE_BASE64URL_IMPL_SCALAR, text, textLen, wantDecoded);
+    ece_assert(wantDecodedLen % 4 == 0 && wantDecodedLen <= textLen,
+               "Got %zu scalar decoded characters for length %zu",
+               wantDecodedLen, textLen);
+    ece_assert(!memcmp(wantDecoded, binary, wantDecodedLen / 4 * 3),
+               "Wrong scalar decoding for length %zu", textLen);
+
+    for (size_t i = 0; i < sizeof(impls) / sizeof(ece_base64url_impl_t); i++) {
+      ece_base64url_impl_t impl = impls[i];
+      if (!ece_base64url_impl_supported(impl)) {
+        continue;
+      }
+      const char* name = base64url_impl_name(impl);
+
+      size_t encoded =
+        ece_base64url_encode_blocks_impl(impl, binary, binaryLen, base64);
+      ece_assert(encoded == wantEncoded,
+                 "Got %zu %s encoded bytes for length %zu; want %zu", encoded,
+                 name, binaryLen, wantEncoded);
+      ece_assert(!memcmp(base64, wantBase64, encoded / 3 * 4),
+                 "Wrong %s encoding for length %zu", name, binaryLen);
+
+      size_t decodedLen =
+        ece_base64url_decode_blocks_impl(impl, text, textLen, decoded);
+      ece_assert(decodedLen == wantDecodedLen,
+                 "Got %zu %s decoded characters for length %zu; want %zu",
+                 decodedLen, name, textLen, wantDecodedLen);
+      ece_assert(!memcmp(decoded, wantDecoded, decodedLen / 4 * 3),
+                 "Wrong %s decoding for length %zu", name, textLen);
+    }
+  }
+
+  free(binary);
+  free(base64);
+  free(wantBase64);
+  free(text);
+  free(decoded);
+  free(wantDecoded);
+}
+
+// Decodes `base64` with an incremental decoder, in a first fragment of
+// `firstLen` characters followed by fragments of `stepLen` characters. The
+// first fragment may be empty.
+static int
+base64url_stream_decode(ece_base64url_decode_policy_t paddingPolicy,
+                        const char* base64, size_t base64Len, size_t firstLen,
+                        size_t stepLen, uint8_t* binary, size_t* binaryLen) {
+  ece_base64url_decoder_t decoder;
+  ece_base64url_decoder_init(&decoder, paddingPolicy);
+  size_t inLen = 0;
+  size_t outLen = 0;
+  size_t fragmentLen = firstLen;
+  while (inLen < base64Len) {
+    if (fragmentLen > base64Len - inLen) {
+      fragmentLen = base64Len - inLen;
+    }
+    size_t decodedLen = *binaryLen - outLen;
+    int err = ece_base64url_decode_update(&decoder, &base64[inLen], fragmentLen,
+                                          &binary[outLen], &decodedLen);
+    if (err) {
+      return err;
+    }
+    inLen += fragmentLen;
+    outLen += decodedLen;
+    fragmentLen = stepLen;
+  }
+  size_t decodedLen = *binaryLen - outLen;
+  int err = ece_base64url_decode_final(&decoder, &binary[outLen], &decodedLen);
+  if (err) {
+    return err;
+  }
+  *binaryLen = outLen + decodedLen;
+  return ECE_OK;
+}
+
+// Encodes `binary` with an incremental encoder, in fragments like
+// `base64url_stream_decode`.
+static int
+base64url_stream_encode(ece_base64url_encode_policy_t paddingPolicy,
+                        const uint8_t* binary, size_t binaryLen,
+                        size_t firstLen, size_t stepLen, char* base64,
+                        size_t* base64Len) {
+  ece_base64url_encoder_t encoder;
+  ece_base64url_encoder_init(&encoder, paddingPolicy);
+  size_t inLen = 0;
+  size_t outLen = 0;
+  size_t fragmentLen = firstLen;
+  while (inLen < binaryLen) {
+    if (fragmentLen > binaryLen - inLen) {
+      fragmentLen = binaryLen - inLen;
+    }
+    size_t encodedLen = *base64Len - outLen;
+    int err = ece_base64url_encode_update(&encoder, &binary[inLen], fragmentLen,
+                                          &base64[outLen], &encodedLen);
+    if (err) {
+      return err;
+    }
+    inLen += fragmentLen;
+    outLen += encodedLen;
+    fragmentLen = stepLen;
+  }
+  size_t encodedLen = *base64Len - outLen;
+  int err = ece_base64url_encode_final(&encoder, &base64[outLen], &encodedLen);
+  if (err) {
+    return err;
+  }
+  *base64Len = outLen + encodedLen;
+  return ECE_OK;
+}
+
+void
+test_base64url_stream(void) {
+  size_t tests =
+    sizeof(base64url_encode_tests) / sizeof(base64url_encode_test_t);
+  for (size_t i = 0; i < tests; i++) {
+    base64url_encode_test_t t = base64url_encode_tests[i];
+    for (size_t firstLen = 0; firstLen <= t.binaryLen; firstLen++) {
+      for (size_t stepLen = 1; stepLen <= t.binaryLen; stepLen++) {
+        char base64[16];
+        size_t base64Len = sizeof(base64);
+        int err = base64url_stream_encode(
+          t.paddingPolicy, (const uint8_t*) t.binary, t.binaryLen, firstLen,
+          stepLen, base64, &base64Len);
+        ece_assert(!err, "Got %d encoding `%s` in fragments %zu, %zu", err,
+                   t.base64, firstLen, stepLen);
+        ece_assert(base64Len == t.base64Len &&
+                     !memcmp(base64, t.base64, base64Len),
+                   "Wrong output encoding `%s` in fragments %zu, %zu",
+                   t.base64, firstLen, stepLen);
+      }
+    }
+  }
+
+  tests = sizeof(base64url_decode_tests) / sizeof(base64url_decode_test_t);
+  for (size_t i = 0; i < tests; i++) {
+    base64url_decode_test_t t = base64url_decode_tests[i];
+    // The one-shot decoder returns 0 for invalid input.
+    bool wantErr = t.base64Len && !t.binaryLen;
+    for (size_t firstLen = 0; firstLen <= t.base64Len; firstLen++) {
+      for (size_t stepLen = 1; stepLen <= t.base64Len; stepLen++) {
+        uint8_t binary[16];
+        size_t binaryLen = sizeof(binary);
+        int err =
+          base64url_stream_decode(t.paddingPolicy, t.base64, t.base64Len,
+                                  firstLen, stepLen, binary, &binaryLen);
+        if (wantErr) {
+          ece_assert(err == ECE_ERROR_INVALID_BASE64URL,
+                     "Got %d decoding `%s` with padding %d in fragments %zu, "
+                     "%zu; want %d",
+                     err, t.base64, t.paddingPolicy, firstLen, stepLen,
+                     ECE_ERROR_INVALID_BASE64URL);
+          continue;
+        }
+        ece_assert(!err,
+                   "Got %d decoding `%s` with padding %d in fragments %zu, %zu",
+                   err, t.base64, t.paddingPolicy, firstLen, stepLen);
+        ece_assert(binaryLen == t.binaryLen &&
+                     !memcmp(binary, t.binary, binaryLen),
+                   "Wrong output decoding `%s` with padding %d in fragments "
+                   "%zu, %zu",
+                   t.base64, t.paddingPolicy, firstLen, stepLen);
+      }
+    }
+  }
+
+  // Short output buffers leave the codec unchanged, so the caller can retry.
+  ece_base64url_decoder_t decoder;
+  ece_base64url_decoder_init(&decoder, ECE_BASE64URL_REQUIRE_PADDING);
+  uint8_t binary[6];
+  size_t binaryLen = 2;
+  int err = ece_base64url_decode_update(&decoder, "Zm9vYg==", 8, binary,
+                                        &binaryLen);
+  ece_assert(err == ECE_ERROR_OUT_OF_MEMORY,
+             "Got %d decoding into short buffer; want %d", err,
+             ECE_ERROR_OUT_OF_MEMORY);
+  binaryLen = sizeof(binary);
+  err = ece_base64url_decode_update(&decoder, "Zm9vYg==", 8, binary,
+                                    &binaryLen);
+  ece_assert(!err && binaryLen == 3, "Got %d, %zu retrying decode", err,
+             binaryLen);
+  size_t finalLen = 0;
+  err = ece_base64url_decode_final(&decoder, &binary[binaryLen], &finalLen);
+  ece_assert(err == ECE_ERROR_OUT_OF_MEMORY,
+             "Got %d finishing into short buffer; want %d", err,
+             ECE_ERROR_OUT_OF_MEMORY);
+  finalLen = sizeof(binary) - binaryLen;
+  err = ece_base64url_decode_final(&decoder, &binary[binaryLen], &finalLen);
+  ece_assert(!err && finalLen == 1 && !memcmp(binary, "foob", 4),
+             "Got %d, %zu retrying final decode", err, finalLen);
+}
+
+void
+test_base64url_stream_random(void) {
+  static const ece_base64url_decode_policy_t decodePolicies[] = {
+    ECE_BASE64URL_REQUIRE_PADDING,
+    ECE_BASE64URL_IGNORE_PADDING,
+    ECE_BASE64URL_REJECT_PADDING,
+  };
+  static const size_t maxBinaryLen = 600;
+  static const size_t maxBase64Len = 808;
+
+  uint8_t* binary = malloc(maxBinaryLen);
+  char* base64 = malloc(maxBase64Len);
+  char* wantBase64 = malloc(maxBase64Len);
+  uint8_t* decoded = malloc(maxBinaryLen);
+  uint8_t* wantDecoded = malloc(maxBinaryLen);
+
+  uint32_t state = 0x5a3e7b1;
+  for (size_t round = 0; round < 2000; round++) {
+    size_t binaryLen = base64url_random(&state) % maxBinaryLen;
+    for (size_t i = 0; i < binaryLen; i++) {
+      binary[i] = (uint8_t) base64url_random(&state);
+    }
+    ece_base64url_encode_policy_t encodePolicy =
+      base64url_random(&state) % 2 ? ECE_BASE64URL_INCLUDE_PADDING
+                                   : ECE_BASE64URL_OMIT_PADDING;
+    size_t firstLen = base64url_random(&state) % 70;
+    size_t stepLen = base64url_random(&state) % 70 + 1;
+
+    size_t wantBase64Len = ece_base64url_encode(binary, binaryLen, encodePolicy,
+                                                wantBase64, maxBase64Len);
+    size_t base64Len = maxBase64Len;
+    int err = base64url_stream_encode(encodePolicy, binary, binaryLen, firstLen,
+                                      stepLen, base64, &base64Len);
+    ece_assert(!err, "Got %d encoding length %zu", err, binaryLen);
+    ece_assert(base64Len == wantBase64Len &&
+                 !memcmp(base64, wantBase64, base64Len),
+               "Wrong output encoding length %zu in fragments %zu, %zu",
+               binaryLen, firstLen, stepLen);
+
+    // Corrupt the encoded text in some rounds, by truncating it, appending
+    // padding, or replacing a character.
+    switch (base64url_random(&state) % 4) {
+    case 1: {
+      size_t truncateLen = base64url_random(&state) % 3 + 1;
+      base64Len = base64Len > truncateLen ? base64Len - truncateLen : 0;
+      break;
+    }
+    case 2:
+      for (size_t i = base64url_random(&state) % 4; i > 0; i--) {
+        base64[base64Len++] = '=';
+      }
+      break;
+    case 3:
+      if (base64Len) {
+        base64[base64url_random(&state) % base64Len] =
+          base64url_invalid_chars[base64url_random(&state) %
+                                  (sizeof(base64url_invalid_chars) - 1)];
+      }
+      break;
+    }
+
+    for (size_t i = 0;
+         i < sizeof(decodePolicies) / sizeof(ece_base64url_decode_policy_t);
+         i++) {
+      ece_base64url_decode_policy_t decodePolicy = decodePolicies[i];
+      size_t wantDecodedLen =
+        ece_base64url_decode(base64, base64Len, decodePolicy, NULL, 0);
+      if (wantDecodedLen) {
+        wantDecodedLen = ece_base64url_decode(
+          base64, base64Len, decodePolicy, wantDecoded, maxBinaryLen);
+      }
+      bool wantErr = base64Len && !wantDecodedLen;
+
+      size_t decodedLen = maxBinaryLen;
+      err = base64url_stream_decode(decodePolicy, base64, base64Len, firstLen,
+                                    stepLen, decoded, &decodedLen);
+      if (wantErr) {
+        ece_assert(err == ECE_ERROR_INVALID_BASE64URL,
+                   "Got %d decoding length %zu with padding %d; want %d", err,
+                   base64Len, decodePolicy, ECE_ERROR_INVALID_BASE64URL);
+        continue;
+      }
+      ece_assert(!err, "Got %d decoding length %zu with padding %d", err,
+                 base64Len, decodePolicy);
+      ece_assert(decodedLen == wantDecodedLen &&
+                   !memcmp(decoded, wantDecoded, decodedLen),
+                 "Wrong output decoding length %zu with padding %d in "
+                 "fragments %zu, %zu",
+                 base64Len, decodePolicy, firstLen, stepLen);
+    }
+  }
+
+  free(binary);
+  free(base64);
+  free(wantBase64);
+  free(decoded);
+  free(wantDecoded);
+}
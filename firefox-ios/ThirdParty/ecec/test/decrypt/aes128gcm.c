@@ -1,7 +1,11 @@
 #include "test.h"
 
+#include <inttypes.h>
 #include <string.h>
 
+#include <ece/pad.h>
+#include <ece/record.h>
+
 typedef struct webpush_aes128gcm_decrypt_ok_test_s {
   const char* desc;
   const char* plaintext;
@@ -495,3 +499,863 @@ test_aes128gcm_decrypt_err(void) {
     free(plaintext);
   }
 }
+
+// Feeds `payload` to a streaming decryption context in chunks of `chunkLen`
+// bytes, and collects the decrypted records into `plaintext`.
+static int
+aes128gcm_decrypt_stream(ece_aes128gcm_decrypt_ctx_t* ctx,
+                         const uint8_t* payload, size_t payloadLen,
+                         size_t chunkLen, uint8_t* plaintext,
+                         size_t* plaintextLen) {
+  size_t plaintextStart = 0;
+  size_t payloadStart = 0;
+  int err = ECE_OK;
+  while (payloadStart < payloadLen) {
+    size_t payloadEnd = payloadStart + chunkLen;
+    if (payloadEnd > payloadLen) {
+      payloadEnd = payloadLen;
+    }
+    size_t blockLen = ece_aes128gcm_decrypt_update_max_length(
+      ctx, payloadEnd - payloadStart);
+    uint8_t* block = calloc(blockLen + 1, sizeof(uint8_t));
+    err = ece_aes128gcm_decrypt_update(ctx, &payload[payloadStart],
+                                       payloadEnd - payloadStart, block,
+                                       &blockLen);
+    if (!err) {
+      ece_assert(plaintextStart + blockLen <= *plaintextLen,
+                 "Got %zu bytes of plaintext; want at most %zu",
+                 plaintextStart + blockLen, *plaintextLen);
+      memcpy(&plaintext[plaintextStart], block, blockLen);
+      plaintextStart += blockLen;
+    }
+    free(block);
+    if (err) {
+      return err;
+    }
+    payloadStart = payloadEnd;
+  }
+  size_t blockLen = ece_aes128gcm_decrypt_update_max_length(ctx, 0);
+  uint8_t* block = calloc(blockLen + 1, sizeof(uint8_t));
+  err = ece_aes128gcm_decrypt_final(ctx, block, &blockLen);
+  if (!err) {
+    ece_assert(plaintextStart + blockLen <= *plaintextLen,
+               "Got %zu bytes of plaintext; want at most %zu",
+               plaintextStart + blockLen, *plaintextLen);
+    memcpy(&plaintext[plaintextStart], block, blockLen);
+    plaintextStart += blockLen;
+    *plaintextLen = plaintextStart;
+  }
+  free(block);
+  return err;
+}
+
+// Chunk sizes for the streaming tests. We split the header and records at
+// different offsets, and also pass the entire payload at once.
+static size_t aes128gcm_decrypt_stream_chunk_lens[] = {1, 2, 7, 21, 64,
+                                                       SIZE_MAX};
+
+#define AES128GCM_DECRYPT_STREAM_CHUNK_LENS                                    \
+  (sizeof(aes128gcm_decrypt_stream_chunk_lens) / sizeof(size_t))
+
+void
+test_webpush_aes128gcm_decrypt_stream(void) {
+  ece_aes128gcm_decrypt_ctx_t* ctx = ece_aes128gcm_decrypt_ctx_new();
+  ece_assert(ctx, "Want decryption context for `%s`", "stream");
+
+  size_t tests = sizeof(webpush_aes128gcm_decrypt_ok_tests) /
+                 sizeof(webpush_aes128gcm_decrypt_ok_test_t);
+  for (size_t i = 0; i < tests; i++) {
+    webpush_aes128gcm_decrypt_ok_test_t t =
+      webpush_aes128gcm_decrypt_ok_tests[i];
+
+    for (size_t j = 0; j < AES128GCM_DECRYPT_STREAM_CHUNK_LENS; j++) {
+      size_t chunkLen = aes128gcm_decrypt_stream_chunk_lens[j];
+
+      int err = ece_webpush_aes128gcm_decrypt_init(
+        ctx, (const uint8_t*) t.recvPrivKey, ECE_WEBPUSH_PRIVATE_KEY_LENGTH,
+        (const uint8_t*) t.authSecret, ECE_WEBPUSH_AUTH_SECRET_LENGTH);
+      ece_assert(!err, "Got %d initializing context for `%s`", err, t.desc);
+
+      size_t plaintextLen = t.maxPlaintextLen;
+      uint8_t* plaintext = calloc(plaintextLen + 1, sizeof(uint8_t));
+      err = aes128gcm_decrypt_stream(ctx, (const uint8_t*) t.payload,
+                                     t.payloadLen, chunkLen, plaintext,
+                                     &plaintextLen);
+      ece_assert(!err, "Got %d decrypting `%s` in %zu-byte chunks", err,
+                 t.desc, chunkLen);
+
+      ece_assert(plaintextLen == t.plaintextLen,
+                 "Got plaintext length %zu for `%s`; want %zu", plaintextLen,
+                 t.desc, t.plaintextLen);
+      ece_assert(!memcmp(plaintext, t.plaintext, plaintextLen),
+                 "Wrong plaintext for `%s` in %zu-byte chunks", t.desc,
+                 chunkLen);
+
+      free(plaintext);
+    }
+  }
+
+  size_t errTests = sizeof(webpush_aes128gcm_err_decrypt_tests) /
+                    sizeof(webpush_aes128gcm_err_decrypt_test_t);
+  for (size_t i = 0; i < errTests; i++) {
+    webpush_aes128gcm_err_decrypt_test_t t =
+      webpush_aes128gcm_err_decrypt_tests[i];
+
+    for (size_t j = 0; j < AES128GCM_DECRYPT_STREAM_CHUNK_LENS; j++) {
+      size_t chunkLen = aes128gcm_decrypt_stream_chunk_lens[j];
+
+      int err = ece_webpush_aes128gcm_decrypt_init(
+        ctx, (const uint8_t*) t.recvPrivKey, ECE_WEBPUSH_PRIVATE_KEY_LENGTH,
+        (const uint8_t*) t.authSecret, ECE_WEBPUSH_AUTH_SECRET_LENGTH);
+      size_t plaintextLen = t.maxPlaintextLen;
+      uint8_t* plaintext = calloc(plaintextLen + 1, sizeof(uint8_t));
+      if (!err) {
+        err = aes128gcm_decrypt_stream(ctx, (const uint8_t*) t.payload,
+                                       t.payloadLen, chunkLen, plaintext,
+                                       &plaintextLen);
+      }
+      ece_assert(err == t.err,
+                 "Got %d decrypting `%s` in %zu-byte chunks; want %d", err,
+                 t.desc, chunkLen, t.err);
+
+      free(plaintext);
+    }
+  }
+
+  ece_aes128gcm_decrypt_ctx_free(ctx);
+}
+
+void
+test_aes128gcm_decrypt_stream(void) {
+  ece_aes128gcm_decrypt_ctx_t* ctx = ece_aes128gcm_decrypt_ctx_new();
+  ece_assert(ctx, "Want decryption context for `%s`", "stream");
+
+  size_t tests =
+    sizeof(aes128gcm_ok_decrypt_tests) / sizeof(aes128gcm_ok_decrypt_test_t);
+  for (size_t i = 0; i < tests; i++) {
+    aes128gcm_ok_decrypt_test_t t = aes128gcm_ok_decrypt_tests[i];
+
+    for (size_t j = 0; j < AES128GCM_DECRYPT_STREAM_CHUNK_LENS; j++) {
+      size_t chunkLen = aes128gcm_decrypt_stream_chunk_lens[j];
+
+      int err = ece_aes128gcm_decrypt_init(ctx, (const uint8_t*) t.ikm, 16);
+      ece_assert(!err, "Got %d initializing context for `%s`", err, t.desc);
+
+      size_t plaintextLen = t.maxPlaintextLen;
+      uint8_t* plaintext = calloc(plaintextLen + 1, sizeof(uint8_t));
+      err = aes128gcm_decrypt_stream(ctx, (const uint8_t*) t.payload,
+                                     t.payloadLen, chunkLen, plaintext,
+                                     &plaintextLen);
+      ece_assert(!err, "Got %d decrypting `%s` in %zu-byte chunks", err,
+                 t.desc, chunkLen);
+
+      ece_assert(plaintextLen == t.plaintextLen,
+                 "Got plaintext length %zu for `%s`; want %zu", plaintextLen,
+                 t.desc, t.plaintextLen);
+      ece_assert(!memcmp(plaintext, t.plaintext, plaintextLen),
+                 "Wrong plaintext for `%s` in %zu-byte chunks", t.desc,
+                 chunkLen);
+
+      free(plaintext);
+    }
+  }
+
+  size_t errTests =
+    sizeof(aes128gcm_err_decrypt_tests) / sizeof(aes128gcm_err_decrypt_test_t);
+  for (size_t i = 0; i < errTests; i++) {
+    aes128gcm_err_decrypt_test_t t = aes128gcm_err_decrypt_tests[i];
+
+    for (size_t j = 0; j < AES128GCM_DECRYPT_STREAM_CHUNK_LENS; j++) {
+      size_t chunkLen = aes128gcm_decrypt_stream_chunk_lens[j];
+
+      int err = ece_aes128gcm_decrypt_init(ctx, (const uint8_t*) t.ikm, 16);
+      ece_assert(!err, "Got %d initializing context for `%s`", err, t.desc);
+
+      size_t plaintextLen = t.maxPlaintextLen;
+      uint8_t* plaintext = calloc(plaintextLen + 1, sizeof(uint8_t));
+      err = aes128gcm_decrypt_stream(ctx, (const uint8_t*) t.payload,
+                                     t.payloadLen, chunkLen, plaintext,
+                                     &plaintextLen);
+      ece_assert(err == t.err,
+                 "Got %d decrypting `%s` in %zu-byte chunks; want %d", err,
+                 t.desc, chunkLen, t.err);
+
+      free(plaintext);
+    }
+  }
+
+  ece_aes128gcm_decrypt_ctx_free(ctx);
+}
+
+void
+test_webpush_aes128gcm_decrypt_batch(void) {
+  size_t okTests = sizeof(webpush_aes128gcm_decrypt_ok_tests) /
+                   sizeof(webpush_aes128gcm_decrypt_ok_test_t);
+  size_t errTests = sizeof(webpush_aes128gcm_err_decrypt_tests) /
+                    sizeof(webpush_aes128gcm_err_decrypt_test_t);
+
+  // Each batch holds every test payload, so that messages for other
+  // subscriptions and malformed payloads are mixed in with valid ones.
+  size_t count = okTests + errTests;
+  const uint8_t** payloads = calloc(count, sizeof(const uint8_t*));
+  size_t* payloadLens = calloc(count, sizeof(size_t));
+  for (size_t i = 0; i < okTests; i++) {
+    webpush_aes128gcm_decrypt_ok_test_t t =
+      webpush_aes128gcm_decrypt_ok_tests[i];
+    payloads[i] = (const uint8_t*) t.payload;
+    payloadLens[i] = t.payloadLen;
+  }
+  for (size_t i = 0; i < errTests; i++) {
+    webpush_aes128gcm_err_decrypt_test_t t =
+      webpush_aes128gcm_err_decrypt_tests[i];
+    payloads[okTests + i] = (const uint8_t*) t.payload;
+    payloadLens[okTests + i] = t.payloadLen;
+  }
+
+  uint8_t** plaintexts = calloc(count, sizeof(uint8_t*));
+  size_t* plaintextLens = calloc(count, sizeof(size_t));
+  int* errs = calloc(count, sizeof(int));
+
+  for (size_t i = 0; i < okTests; i++) {
+    webpush_aes128gcm_decrypt_ok_test_t t =
+      webpush_aes128gcm_decrypt_ok_tests[i];
+
+    for (size_t j = 0; j < count; j++) {
+      plaintextLens[j] =
+        ece_aes128gcm_plaintext_max_length(payloads[j], payloadLens[j]);
+      plaintexts[j] = calloc(plaintextLens[j] + 1, sizeof(uint8_t));
+    }
+
+    int err = ece_webpush_aes128gcm_decrypt_batch(
+      (const uint8_t*) t.recvPrivKey, ECE_WEBPUSH_PRIVATE_KEY_LENGTH,
+      (const uint8_t*) t.authSecret, ECE_WEBPUSH_AUTH_SECRET_LENGTH, count,
+      payloads, payloadLens, plaintexts, plaintextLens, errs);
+
+    // Check every message against the one-at-a-time path.
+    int wantErr = ECE_OK;
+    for (size_t j = 0; j < count; j++) {
+      size_t wantLen =
+        ece_aes128gcm_plaintext_max_length(payloads[j], payloadLens[j]);
+      uint8_t* want = calloc(wantLen + 1, sizeof(uint8_t));
+      int wantMessageErr = ece_webpush_aes128gcm_decrypt(
+        (const uint8_t*) t.recvPrivKey, ECE_WEBPUSH_PRIVATE_KEY_LENGTH,
+        (const uint8_t*) t.authSecret, ECE_WEBPUSH_AUTH_SECRET_LENGTH,
+        payloads[j], payloadLens[j], want, &wantLen);
+      ece_assert(errs[j] == wantMessageErr,
+                 "Got %d decrypting message %zu with key for `%s`; want %d",
+                 errs[j], j, t.desc, wantMessageErr);
+      if (!wantMessageErr) {
+        ece_assert(plaintextLens[j] == wantLen &&
+                     !memcmp(plaintexts[j], want, wantLen),
+                   "Wrong plaintext for message %zu with key for `%s`", j,
+                   t.desc);
+      }
+      if (wantMessageErr && !wantErr) {
+        wantErr = wantMessageErr;
+      }
+      free(want);
+    }
+    ece_assert(err == wantErr, "Got %d decrypting batch for `%s`; want %d", err,
+               t.desc, wantErr);
+    ece_assert(!errs[i], "Got %d decrypting `%s` in batch", errs[i], t.desc);
+
+    for (size_t j = 0; j < count; j++) {
+      free(plaintexts[j]);
+    }
+  }
+
+  // An invalid auth secret should fail every message, after the payload checks.
+  int err = ece_webpush_aes128gcm_decrypt_batch(
+    (const uint8_t*) webpush_aes128gcm_decrypt_ok_tests[0].recvPrivKey,
+    ECE_WEBPUSH_PRIVATE_KEY_LENGTH,
+    (const uint8_t*) webpush_aes128gcm_decrypt_ok_tests[0].authSecret,
+    ECE_WEBPUSH_AUTH_SECRET_LENGTH - 1, 1, payloads, payloadLens, plaintexts,
+    plaintextLens, errs);
+  ece_assert(err == ECE_ERROR_INVALID_AUTH_SECRET && errs[0] == err,
+             "Got %d decrypting batch with short auth secret", err);
+
+  free(errs);
+  free(plaintextLens);
+  free(plaintexts);
+  free(payloadLens);
+  free(payloads);
+}
+
+void
+test_webpush_aes128gcm_decrypt_subscription(void) {
+  size_t okTests = sizeof(webpush_aes128gcm_decrypt_ok_tests) /
+                   sizeof(webpush_aes128gcm_decrypt_ok_test_t);
+  for (size_t i = 0; i < okTests; i++) {
+    webpush_aes128gcm_decrypt_ok_test_t t =
+      webpush_aes128gcm_decrypt_ok_tests[i];
+
+    ece_subscription_t* sub = NULL;
+    int err = ece_subscription_create(
+      (const uint8_t*) t.recvPrivKey, ECE_WEBPUSH_PRIVATE_KEY_LENGTH,
+      (const uint8_t*) t.authSecret, ECE_WEBPUSH_AUTH_SECRET_LENGTH, &sub);
+    ece_assert(!err, "Got %d creating subscription for `%s`", err, t.desc);
+
+    // Decrypt twice, to make sure the subscription can be reused.
+    for (size_t j = 0; j < 2; j++) {
+      size_t plaintextLen = ece_aes128gcm_plaintext_max_length(
+        (const uint8_t*) t.payload, t.payloadLen);
+      uint8_t* plaintext = calloc(plaintextLen, sizeof(uint8_t));
+
+      err = ece_subscription_aes128gcm_decrypt(sub, (const uint8_t*) t.payload,
+                                               t.payloadLen, plaintext,
+                                               &plaintextLen);
+      ece_assert(!err, "Got %d decrypting payload for `%s`", err, t.desc);
+
+      ece_assert(plaintextLen == t.plaintextLen,
+                 "Got plaintext length %zu for `%s`; want %zu", plaintextLen,
+                 t.desc, t.plaintextLen);
+      ece_assert(!memcmp(plaintext, t.plaintext, plaintextLen),
+                 "Wrong plaintext for `%s`", t.desc);
+
+      free(plaintext);
+    }
+
+    ece_subscription_destroy(sub);
+  }
+
+  size_t errTests = sizeof(webpush_aes128gcm_err_decrypt_tests) /
+                    sizeof(webpush_aes128gcm_err_decrypt_test_t);
+  for (size_t i = 0; i < errTests; i++) {
+    webpush_aes128gcm_err_decrypt_test_t t =
+      webpush_aes128gcm_err_decrypt_tests[i];
+
+    size_t plaintextLen = ece_aes128gcm_plaintext_max_length(
+      (const uint8_t*) t.payload, t.payloadLen);
+    uint8_t* plaintext = calloc(plaintextLen + 1, sizeof(uint8_t));
+
+    // The one-shot function checks the payload header before the keys, so
+    // we compare against it instead of the expected error.
+    size_t wantLen = plaintextLen;
+    uint8_t* want = calloc(wantLen + 1, sizeof(uint8_t));
+    int wantErr = ece_webpush_aes128gcm_decrypt(
+      (const uint8_t*) t.recvPrivKey, ECE_WEBPUSH_PRIVATE_KEY_LENGTH,
+      (const uint8_t*) t.authSecret, ECE_WEBPUSH_AUTH_SECRET_LENGTH,
+      (const uint8_t*) t.payload, t.payloadLen, want, &wantLen);
+
+    ece_subscription_t* sub = NULL;
+    int err = ece_subscription_create(
+      (const uint8_t*) t.recvPrivKey, ECE_WEBPUSH_PRIVATE_KEY_LENGTH,
+      (const uint8_t*) t.authSecret, ECE_WEBPUSH_AUTH_SECRET_LENGTH, &sub);
+    if (!err) {
+      err = ece_subscription_aes128gcm_decrypt(sub, (const uint8_t*) t.payload,
+                                               t.payloadLen, plaintext,
+                                               &plaintextLen);
+      ece_assert(err == wantErr, "Got %d decrypting payload for `%s`; want %d",
+                 err, t.desc, wantErr);
+    }
+    ece_assert(err == t.err, "Got %d decrypting payload for `%s`; want %d", err,
+               t.desc, t.err);
+
+    ece_subscription_destroy(sub);
+    free(want);
+    free(plaintext);
+  }
+}
+
+// Decrypts the `index`th Web Push test payload with `sub`.
+static void
+webpush_aes128gcm_decrypt_pooled(const ece_subscription_t* sub, size_t index) {
+  webpush_aes128gcm_decrypt_ok_test_t t =
+    webpush_aes128gcm_decrypt_ok_tests[index];
+  size_t plaintextLen = ece_aes128gcm_plaintext_max_length(
+    (const uint8_t*) t.payload, t.payloadLen);
+  uint8_t* plaintext = calloc(plaintextLen, sizeof(uint8_t));
+  int err = ece_subscription_aes128gcm_decrypt(
+    sub, (const uint8_t*) t.payload, t.payloadLen, plaintext, &plaintextLen);
+  ece_assert(!err, "Got %d decrypting payload for `%s`", err, t.desc);
+  ece_assert(plaintextLen == t.plaintextLen &&
+               !memcmp(plaintext, t.plaintext, plaintextLen),
+             "Wrong plaintext for `%s`", t.desc);
+  free(plaintext);
+}
+
+// Checks the calling thread's cipher pool counters.
+static void
+webpush_aes128gcm_check_pool_stats(const char* desc, uint64_t acquires,
+                                   uint64_t hits, uint64_t allocs) {
+  ece_cipher_pool_stats_t stats;
+  ece_cipher_pool_get_stats(&stats);
+  ece_assert(stats.acquires == acquires,
+             "Got %" PRIu64 " acquires after %s; want %" PRIu64,
+             stats.acquires, desc, acquires);
+  ece_assert(stats.hits == hits, "Got %" PRIu64 " hits after %s; want %" PRIu64,
+             stats.hits, desc, hits);
+  ece_assert(stats.rekeys == acquires - hits,
+             "Got %" PRIu64 " rekeys after %s; want %" PRIu64, stats.rekeys,
+             desc, acquires - hits);
+  ece_assert(stats.allocs == allocs,
+             "Got %" PRIu64 " allocs after %s; want %" PRIu64, stats.allocs,
+             desc, allocs);
+  ece_assert(!stats.overflows, "Got %" PRIu64 " overflows after %s",
+             stats.overflows, desc);
+}
+
+void
+test_webpush_aes128gcm_decrypt_cipher_pool(void) {
+  ece_cipher_pool_flush();
+  ece_cipher_pool_reset_stats();
+
+  ece_subscription_t* subs[2];
+  for (size_t i = 0; i < 2; i++) {
+    webpush_aes128gcm_decrypt_ok_test_t t =
+      webpush_aes128gcm_decrypt_ok_tests[i];
+    int err = ece_subscription_create(
+      (const uint8_t*) t.recvPrivKey, ECE_WEBPUSH_PRIVATE_KEY_LENGTH,
+      (const uint8_t*) t.authSecret, ECE_WEBPUSH_AUTH_SECRET_LENGTH, &subs[i]);
+    ece_assert(!err, "Got %d creating subscription for `%s`", err, t.desc);
+  }
+
+  // Decrypting the same message again reuses the keyed context.
+  webpush_aes128gcm_decrypt_pooled(subs[0], 0);
+  webpush_aes128gcm_check_pool_stats("first message", 1, 0, 1);
+  webpush_aes128gcm_decrypt_pooled(subs[0], 0);
+  webpush_aes128gcm_decrypt_pooled(subs[0], 0);
+  webpush_aes128gcm_check_pool_stats("repeated message", 3, 2, 1);
+
+  // A message with a different key gets its own context, so alternating
+  // between the two messages doesn't re-key.
+  webpush_aes128gcm_decrypt_pooled(subs[1], 1);
+  webpush_aes128gcm_check_pool_stats("second message", 4, 2, 2);
+  webpush_aes128gcm_decrypt_pooled(subs[0], 0);
+  webpush_aes128gcm_decrypt_pooled(subs[1], 1);
+  webpush_aes128gcm_check_pool_stats("alternating messages", 6, 4, 2);
+
+  // Flushing frees the contexts, so the next message allocates again.
+  ece_cipher_pool_flush();
+  webpush_aes128gcm_decrypt_pooled(subs[0], 0);
+  webpush_aes128gcm_check_pool_stats("flush", 7, 4, 3);
+
+  ece_cipher_pool_reset_stats();
+  webpush_aes128gcm_check_pool_stats("reset", 0, 0, 0);
+
+  ece_subscription_destroy(subs[0]);
+  ece_subscription_destroy(subs[1]);
+  ece_cipher_pool_flush();
+}
+
+void
+test_webpush_aes128gcm_decrypt_in_place(void) {
+  size_t okTests = sizeof(webpush_aes128gcm_decrypt_ok_tests) /
+                   sizeof(webpush_aes128gcm_decrypt_ok_test_t);
+  for (size_t i = 0; i < okTests; i++) {
+    webpush_aes128gcm_decrypt_ok_test_t t =
+      webpush_aes128gcm_decrypt_ok_tests[i];
+
+    uint8_t* payload = malloc(t.payloadLen);
+    memcpy(payload, t.payload, t.payloadLen);
+
+    size_t plaintextOffset = 0;
+    size_t plaintextLen = 0;
+    int err = ece_webpush_aes128gcm_decrypt_in_place(
+      (const uint8_t*) t.recvPrivKey, ECE_WEBPUSH_PRIVATE_KEY_LENGTH,
+      (const uint8_t*) t.authSecret, ECE_WEBPUSH_AUTH_SECRET_LENGTH, payload,
+      t.payloadLen, &plaintextOffset, &plaintextLen);
+    ece_assert(!err, "Got %d decrypting payload for `%s` in place", err,
+               t.desc);
+
+    // The plaintext starts after the header and key ID.
+    size_t headerLen = ECE_AES128GCM_HEADER_LENGTH +
+                       (uint8_t) t.payload[ECE_AES128GCM_HEADER_LENGTH - 1];
+    ece_assert(plaintextOffset == headerLen,
+               "Got plaintext offset %zu for `%s`; want %zu", plaintextOffset,
+               t.desc, headerLen);
+    ece_assert(plaintextLen == t.plaintextLen,
+               "Got plaintext length %zu for `%s`; want %zu", plaintextLen,
+               t.desc, t.plaintextLen);
+    ece_assert(
+      !memcmp(&payload[plaintextOffset], t.plaintext, plaintextLen),
+      "Wrong plaintext for `%s`", t.desc);
+
+    // Decrypting with a subscription should give the same result.
+    ece_subscription_t* sub = NULL;
+    err = ece_subscription_create(
+      (const uint8_t*) t.recvPrivKey, ECE_WEBPUSH_PRIVATE_KEY_LENGTH,
+      (const uint8_t*) t.authSecret, ECE_WEBPUSH_AUTH_SECRET_LENGTH, &sub);
+    ece_assert(!err, "Got %d creating subscription for `%s`", err, t.desc);
+    memcpy(payload, t.payload, t.payloadLen);
+    err = ece_subscription_aes128gcm_decrypt_in_place(
+      sub, payload, t.payloadLen, &plaintextOffset, &plaintextLen);
+    ece_assert(!err, "Got %d decrypting payload for `%s` in place", err,
+               t.desc);
+    ece_assert(plaintextOffset == headerLen && plaintextLen == t.plaintextLen &&
+                 !memcmp(&payload[plaintextOffset], t.plaintext,
+                         plaintextLen),
+               "Wrong plaintext for `%s` with subscription", t.desc);
+    ece_subscription_destroy(sub);
+
+    free(payload);
+  }
+
+  size_t errTests = sizeof(webpush_aes128gcm_err_decrypt_tests) /
+                    sizeof(webpush_aes128gcm_err_decrypt_test_t);
+  for (size_t i = 0; i < errTests; i++) {
+    webpush_aes128gcm_err_decrypt_test_t t =
+      webpush_aes128gcm_err_decrypt_tests[i];
+
+    uint8_t* payload = malloc(t.payloadLen + 1);
+    memcpy(payload, t.payload, t.payloadLen);
+
+    size_t plaintextOffset = 0;
+    size_t plaintextLen = 0;
+    int err = ece_webpush_aes128gcm_decrypt_in_place(
+      (const uint8_t*) t.recvPrivKey, ECE_WEBPUSH_PRIVATE_KEY_LENGTH,
+      (const uint8_t*) t.authSecret, ECE_WEBPUSH_AUTH_SECRET_LENGTH, payload,
+      t.payloadLen, &plaintextOffset, &plaintextLen);
+    ece_assert(err == t.err,
+               "Got %d decrypting payload for `%s` in place; want %d", err,
+               t.desc, t.err);
+
+    free(payload);
+  }
+}
+
+void
+test_webpush_aes128gcm_decrypt_iov(void) {
+  static const size_t segmentLens[] = {1, 7, 16, 33, SIZE_MAX};
+  static const size_t numSegmentLens = sizeof(segmentLens) / sizeof(size_t);
+
+  size_t okTests = sizeof(webpush_aes128gcm_decrypt_ok_tests) /
+                   sizeof(webpush_aes128gcm_decrypt_ok_test_t);
+  for (size_t i = 0; i < okTests; i++) {
+    webpush_aes128gcm_decrypt_ok_test_t t =
+      webpush_aes128gcm_decrypt_ok_tests[i];
+
+    for (size_t j = 0; j < numSegmentLens; j++) {
+      for (size_t k = 0; k < numSegmentLens; k++) {
+        size_t payloadCount;
+        ece_iovec_t* payload =
+          ece_test_iov_new((const uint8_t*) t.payload, t.payloadLen,
+                           segmentLens[j], &payloadCount);
+        size_t plaintextCount;
+        ece_iovec_t* plaintext = ece_test_iov_new(NULL, t.maxPlaintextLen,
+                                                  segmentLens[k],
+                                                  &plaintextCount);
+
+        size_t plaintextLen = 0;
+        int err = ece_webpush_aes128gcm_decrypt_iov(
+          (const uint8_t*) t.recvPrivKey, ECE_WEBPUSH_PRIVATE_KEY_LENGTH,
+          (const uint8_t*) t.authSecret, ECE_WEBPUSH_AUTH_SECRET_LENGTH,
+          payload, payloadCount, plaintext, plaintextCount, &plaintextLen);
+        ece_assert(!err, "Got %d decrypting `%s` with segments %zu, %zu", err,
+                   t.desc, segmentLens[j], segmentLens[k]);
+
+        ece_assert(plaintextLen == t.plaintextLen,
+                   "Got plaintext length %zu for `%s`; want %zu",
+                   plaintextLen, t.desc, t.plaintextLen);
+        uint8_t* result = malloc(plaintextLen + 1);
+        ece_test_iov_flatten(plaintext, plaintextCount, result, plaintextLen);
+        ece_assert(!memcmp(result, t.plaintext, plaintextLen),
+                   "Wrong plaintext for `%s` with segments %zu, %zu", t.desc,
+                   segmentLens[j], segmentLens[k]);
+
+        free(result);
+        ece_test_iov_free(plaintext, plaintextCount);
+        ece_test_iov_free(payload, payloadCount);
+      }
+    }
+  }
+
+  size_t ikmTests =
+    sizeof(aes128gcm_ok_decrypt_tests) / sizeof(aes128gcm_ok_decrypt_test_t);
+  for (size_t i = 0; i < ikmTests; i++) {
+    aes128gcm_ok_decrypt_test_t t = aes128gcm_ok_decrypt_tests[i];
+
+    for (size_t j = 0; j < numSegmentLens; j++) {
+      size_t payloadCount;
+      ece_iovec_t* payload =
+        ece_test_iov_new((const uint8_t*) t.payload, t.payloadLen,
+                         segmentLens[j], &payloadCount);
+      size_t plaintextCount;
+      ece_iovec_t* plaintext = ece_test_iov_new(
+        NULL, t.maxPlaintextLen, segmentLens[numSegmentLens - 1 - j],
+        &plaintextCount);
+
+      size_t plaintextLen = 0;
+      int err = ece_aes128gcm_decrypt_iov(
+        (const uint8_t*) t.ikm, 16, payload, payloadCount, plaintext,
+        plaintextCount, &plaintextLen);
+      ece_assert(!err, "Got %d decrypting `%s` with %zu-byte segments", err,
+                 t.desc, segmentLens[j]);
+
+      uint8_t* result = malloc(plaintextLen + 1);
+      ece_test_iov_flatten(plaintext, plaintextCount, result, plaintextLen);
+      ece_assert(plaintextLen == t.plaintextLen &&
+                   !memcmp(result, t.plaintext, plaintextLen),
+                 "Wrong plaintext for `%s` with %zu-byte segments", t.desc,
+                 segmentLens[j]);
+
+      free(result);
+      ece_test_iov_free(plaintext, plaintextCount);
+      ece_test_iov_free(payload, payloadCount);
+    }
+  }
+
+  size_t errTests = sizeof(webpush_aes128gcm_err_decrypt_tests) /
+                    sizeof(webpush_aes128gcm_err_decrypt_test_t);
+  for (size_t i = 0; i < errTests; i++) {
+    webpush_aes128gcm_err_decrypt_test_t t =
+      webpush_aes128gcm_err_decrypt_tests[i];
+
+    size_t payloadCount;
+    ece_iovec_t* payload = ece_test_iov_new((const uint8_t*) t.payload,
+                                            t.payloadLen, 5, &payloadCount);
+    size_t plaintextCount;
+    ece_iovec_t* plaintext =
+      ece_test_iov_new(NULL, t.maxPlaintextLen, 3, &plaintextCount);
+
+    size_t plaintextLen = 0;
+    int err = ece_webpush_aes128gcm_decrypt_iov(
+      (const uint8_t*) t.recvPrivKey, ECE_WEBPUSH_PRIVATE_KEY_LENGTH,
+      (const uint8_t*) t.authSecret, ECE_WEBPUSH_AUTH_SECRET_LENGTH, payload,
+      payloadCount, plaintext, plaintextCount, &plaintextLen);
+    ece_assert(err == t.err,
+               "Got %d decrypting payload for `%s` with segments; want %d",
+               err, t.desc, t.err);
+
+    ece_test_iov_free(plaintext, plaintextCount);
+    ece_test_iov_free(payload, payloadCount);
+  }
+
+  size_t ikmErrTests =
+    sizeof(aes128gcm_err_decrypt_tests) / sizeof(aes128gcm_err_decrypt_test_t);
+  for (size_t i = 0; i < ikmErrTests; i++) {
+    aes128gcm_err_decrypt_test_t t = aes128gcm_err_decrypt_tests[i];
+
+    size_t payloadCount;
+    ece_iovec_t* payload = ece_test_iov_new((const uint8_t*) t.payload,
+                                            t.payloadLen, 11, &payloadCount);
+    size_t plaintextCount;
+    ece_iovec_t* plaintext =
+      ece_test_iov_new(NULL, t.maxPlaintextLen, 4, &plaintextCount);
+
+    size_t plaintextLen = 0;
+    int err =
+      ece_aes128gcm_decrypt_iov((const uint8_t*) t.ikm, 16, payload,
+                                payloadCount, plaintext, plaintextCount,
+                                &plaintextLen);
+    ece_assert(err == t.err,
+               "Got %d decrypting payload for `%s` with segments; want %d",
+               err, t.desc, t.err);
+
+    ece_test_iov_free(plaintext, plaintextCount);
+    ece_test_iov_free(payload, payloadCount);
+  }
+}
+
+// Base64url-encodes a test payload, with padding if `paddingPolicy` includes
+// it. The caller frees the result.
+static char*
+aes128gcm_base64url_payload(const char* payload, size_t payloadLen,
+                            ece_base64url_encode_policy_t paddingPolicy,
+                            size_t* base64Len) {
+  *base64Len =
+    ece_base64url_encode(payload, payloadLen, paddingPolicy, NULL, 0);
+  char* base64 = malloc(*base64Len + 1);
+  ece_base64url_encode(payload, payloadLen, paddingPolicy, base64,
+                       *base64Len);
+  return base64;
+}
+
+void
+test_webpush_aes128gcm_decrypt_base64url(void) {
+  size_t okTests = sizeof(webpush_aes128gcm_decrypt_ok_tests) /
+                   sizeof(webpush_aes128gcm_decrypt_ok_test_t);
+  for (size_t i = 0; i < okTests; i++) {
+    webpush_aes128gcm_decrypt_ok_test_t t =
+      webpush_aes128gcm_decrypt_ok_tests[i];
+
+    size_t base64Len;
+    char* base64 = aes128gcm_base64url_payload(
+      t.payload, t.payloadLen, ECE_BASE64URL_OMIT_PADDING, &base64Len);
+
+    // Unpadded input decodes to an exact length, so the maximum should match
+    // the binary payload.
+    size_t plaintextLen =
+      ece_aes128gcm_plaintext_max_length_base64url(base64, base64Len);
+    ece_assert(plaintextLen == t.maxPlaintextLen,
+               "Got plaintext max length %zu for encoded `%s`; want %zu",
+               plaintextLen, t.desc, t.maxPlaintextLen);
+
+    uint8_t* plaintext = calloc(plaintextLen, sizeof(uint8_t));
+    int err = ece_webpush_aes128gcm_decrypt_base64url(
+      (const uint8_t*) t.recvPrivKey, ECE_WEBPUSH_PRIVATE_KEY_LENGTH,
+      (const uint8_t*) t.authSecret, ECE_WEBPUSH_AUTH_SECRET_LENGTH, base64,
+      base64Len, ECE_BASE64URL_REJECT_PADDING, plaintext, &plaintextLen);
+    ece_assert(!err, "Got %d decrypting encoded payload for `%s`", err,
+               t.desc);
+    ece_assert(plaintextLen == t.plaintextLen &&
+                 !memcmp(plaintext, t.plaintext, plaintextLen),
+               "Wrong plaintext for encoded `%s`", t.desc);
+    free(plaintext);
+
+    // An invalid character in the last record fails decoding, even though
+    // the records before it decrypt.
+    base64[base64Len - 1] = '+';
+    plaintextLen = t.maxPlaintextLen;
+    plaintext = calloc(plaintextLen, sizeof(uint8_t));
+    err = ece_webpush_aes128gcm_decrypt_base64url(
+      (const uint8_t*) t.recvPrivKey, ECE_WEBPUSH_PRIVATE_KEY_LENGTH,
+      (const uint8_t*) t.authSecret, ECE_WEBPUSH_AUTH_SECRET_LENGTH, base64,
+      base64Len, ECE_BASE64URL_REJECT_PADDING, plaintext, &plaintextLen);
+    ece_assert(err == ECE_ERROR_INVALID_BASE64URL,
+               "Got %d decrypting corrupted payload for `%s`; want %d", err,
+               t.desc, ECE_ERROR_INVALID_BASE64URL);
+    free(plaintext);
+    free(base64);
+
+    // Padded input is only accepted if the policy allows it.
+    base64 = aes128gcm_base64url_payload(
+      t.payload, t.payloadLen, ECE_BASE64URL_INCLUDE_PADDING, &base64Len);
+    plaintextLen =
+      ece_aes128gcm_plaintext_max_length_base64url(base64, base64Len);
+    ece_assert(plaintextLen >= t.plaintextLen,
+               "Got plaintext max length %zu for padded `%s`; want at least "
+               "%zu",
+               plaintextLen, t.desc, t.plaintextLen);
+    plaintext = calloc(plaintextLen, sizeof(uint8_t));
+    size_t maxPlaintextLen = plaintextLen;
+    err = ece_webpush_aes128gcm_decrypt_base64url(
+      (const uint8_t*) t.recvPrivKey, ECE_WEBPUSH_PRIVATE_KEY_LENGTH,
+      (const uint8_t*) t.authSecret, ECE_WEBPUSH_AUTH_SECRET_LENGTH, base64,
+      base64Len, ECE_BASE64URL_REQUIRE_PADDING, plaintext, &plaintextLen);
+    ece_assert(!err && plaintextLen == t.plaintextLen &&
+                 !memcmp(plaintext, t.plaintext, plaintextLen),
+               "Got %d decrypting padded payload for `%s`", err, t.desc);
+    if (t.payloadLen % 3) {
+      plaintextLen = maxPlaintextLen;
+      err = ece_webpush_aes128gcm_decrypt_base64url(
+        (const uint8_t*) t.recvPrivKey, ECE_WEBPUSH_PRIVATE_KEY_LENGTH,
+        (const uint8_t*) t.authSecret, ECE_WEBPUSH_AUTH_SECRET_LENGTH, base64,
+        base64Len, ECE_BASE64URL_REJECT_PADDING, plaintext, &plaintextLen);
+      ece_assert(err == ECE_ERROR_INVALID_BASE64URL,
+                 "Got %d decrypting padded payload for `%s`; want %d", err,
+                 t.desc, ECE_ERROR_INVALID_BASE64URL);
+    }
+    free(plaintext);
+    free(base64);
+  }
+
+  size_t errTests = sizeof(webpush_aes128gcm_err_decrypt_tests) /
+                    sizeof(webpush_aes128gcm_err_decrypt_test_t);
+  for (size_t i = 0; i < errTests; i++) {
+    webpush_aes128gcm_err_decrypt_test_t t =
+      webpush_aes128gcm_err_decrypt_tests[i];
+
+    size_t base64Len;
+    char* base64 = aes128gcm_base64url_payload(
+      t.payload, t.payloadLen, ECE_BASE64URL_OMIT_PADDING, &base64Len);
+    size_t plaintextLen =
+      ece_aes128gcm_plaintext_max_length_base64url(base64, base64Len);
+    ece_assert(plaintextLen == t.maxPlaintextLen,
+               "Got plaintext max length %zu for encoded `%s`; want %zu",
+               plaintextLen, t.desc, t.maxPlaintextLen);
+
+    uint8_t* plaintext = calloc(plaintextLen + 1, sizeof(uint8_t));
+    int err = ece_webpush_aes128gcm_decrypt_base64url(
+      (const uint8_t*) t.recvPrivKey, ECE_WEBPUSH_PRIVATE_KEY_LENGTH,
+      (const uint8_t*) t.authSecret, ECE_WEBPUSH_AUTH_SECRET_LENGTH, base64,
+      base64Len, ECE_BASE64URL_REJECT_PADDING, plaintext, &plaintextLen);
+    ece_assert(err == t.err,
+               "Got %d decrypting encoded payload for `%s`; want %d", err,
+               t.desc, t.err);
+
+    free(plaintext);
+    free(base64);
+  }
+}
+
+static const ece_pad_impl_t pad_impls[] = {
+  ECE_PAD_IMPL_SCALAR,
+  ECE_PAD_IMPL_SSE2,
+  ECE_PAD_IMPL_AVX2,
+  ECE_PAD_IMPL_NEON,
+};
+
+void
+test_aes128gcm_unpad_large(void) {
+  // Every block length up to a few unrolled vectors, with the last non-zero
+  // byte at every position, so that each kernel stops in every lane of its
+  // vectors and leaves every tail length for the scalar code.
+  static const size_t maxLen = 300;
+  uint8_t* block = calloc(maxLen, sizeof(uint8_t));
+  ece_assert(block, "Want block for %zu bytes", maxLen);
+  for (size_t i = 0; i < sizeof(pad_impls) / sizeof(ece_pad_impl_t); i++) {
+    ece_pad_impl_t impl = pad_impls[i];
+    if (!ece_pad_impl_supported(impl)) {
+      continue;
+    }
+    for (size_t len = 0; len <= maxLen; len++) {
+      size_t trimmedLen = ece_pad_trim_zeros_impl(impl, block, len);
+      ece_assert(!trimmedLen, "Got %zu trimming %zu zeros with impl %d",
+                 trimmedLen, len, (int) impl);
+      ece_assert(ece_pad_is_zero_impl(impl, block, len),
+                 "Want %zu zeros with impl %d", len, (int) impl);
+      for (size_t j = 0; j < len; j++) {
+        block[j] = (uint8_t)(j % 255 + 1);
+        trimmedLen = ece_pad_trim_zeros_impl(impl, block, len);
+        ece_assert(trimmedLen == j + 1,
+                   "Got %zu trimming %zu bytes with impl %d; want %zu",
+                   trimmedLen, len, (int) impl, j + 1);
+        ece_assert(!ece_pad_is_zero_impl(impl, block, len),
+                   "Want non-zero byte %zu of %zu with impl %d", j, len,
+                   (int) impl);
+        block[j] = 0;
+      }
+    }
+  }
+  free(block);
+
+  // Records that are almost all padding, as senders use to hide the length of
+  // short messages.
+  static const size_t blockLen = 65536 - ECE_TAG_LENGTH;
+  block = calloc(blockLen, sizeof(uint8_t));
+  ece_assert(block, "Want block for %zu bytes", blockLen);
+  memcpy(block, "hi", 2);
+  block[2] = ECE_AES128GCM_DELIMITER;
+  size_t len = blockLen;
+  int err = ece_aes128gcm_unpad(block, false, &len);
+  ece_assert(!err, "Got %d unpadding record", err);
+  ece_assert(len == 2, "Got %zu unpadding record; want 2", len);
+
+  len = blockLen;
+  err = ece_aes128gcm_unpad(block, true, &len);
+  ece_assert(err == ECE_ERROR_DECRYPT_PADDING,
+             "Got %d unpadding last record with wrong delimiter", err);
+
+  memset(block, 0, 3);
+  len = blockLen;
+  err = ece_aes128gcm_unpad(block, true, &len);
+  ece_assert(err == ECE_ERROR_ZERO_PLAINTEXT,
+             "Got %d unpadding record without delimiter", err);
+
+  // An "aesgcm" block with 65533 bytes of padding, then the data. A non-zero
+  // byte anywhere in the padding is an error.
+  size_t padLen = blockLen - ECE_AESGCM_PAD_SIZE - 1;
+  block[0] = (uint8_t)(padLen >> 8);
+  block[1] = (uint8_t)(padLen & 0xff);
+  block[blockLen - 1] = 'x';
+  len = blockLen;
+  err = ece_aesgcm_unpad(block, true, &len);
+  ece_assert(!err, "Got %d unpadding \"aesgcm\" record", err);
+  ece_assert(len == 1 && block[0] == 'x',
+             "Got %zu unpadding \"aesgcm\" record; want 1", len);
+
+  static const size_t strayOffsets[] = {0, 1, 31, 32, 4095, 65000};
+  for (size_t i = 0; i < sizeof(strayOffsets) / sizeof(size_t); i++) {
+    memset(block, 0, blockLen);
+    block[0] = (uint8_t)(padLen >> 8);
+    block[1] = (uint8_t)(padLen & 0xff);
+    block[ECE_AESGCM_PAD_SIZE + strayOffsets[i]] = 1;
+    len = blockLen;
+    err = ece_aesgcm_unpad(block, true, &len);
+    ece_assert(err == ECE_ERROR_DECRYPT_PADDING,
+               "Got %d unpadding \"aesgcm\" record with byte %zu set", err,
+               strayOffsets[i]);
+  }
+  free(block);
+}
@@ -27,6 +27,10 @@ typedef struct webpush_aesgcm_decrypt_err_test_s {
   int err;
 } webpush_aesgcm_decrypt_err_test_t;
 
+// A record size that overflows when the tag length is added. The decryption
+// functions must reject it before using it to split the ciphertext.
+static const uint32_t oversized_rs = 0xFFFFFFF8u;
+
 static webpush_aesgcm_decrypt_ok_test_t webpush_aesgcm_decrypt_ok_tests[] = {
   {
     .desc = "rs = 24, pad = 0",
@@ -304,3 +308,460 @@ test_webpush_aesgcm_decrypt_err(void) {
     free(plaintext);
   }
 }
+
+void
+test_webpush_aesgcm_decrypt_subscription(void) {
+  size_t okTests = sizeof(webpush_aesgcm_decrypt_ok_tests) /
+                   sizeof(webpush_aesgcm_decrypt_ok_test_t);
+  for (size_t i = 0; i < okTests; i++) {
+    webpush_aesgcm_decrypt_ok_test_t t = webpush_aesgcm_decrypt_ok_tests[i];
+
+    ece_subscription_t* sub = NULL;
+    int err = ece_subscription_create(
+      (const uint8_t*) t.recvPrivKey, ECE_WEBPUSH_PRIVATE_KEY_LENGTH,
+      (const uint8_t*) t.authSecret, ECE_WEBPUSH_AUTH_SECRET_LENGTH, &sub);
+    ece_assert(!err, "Got %d creating subscription for `%s`", err, t.desc);
+
+    uint8_t salt[ECE_SALT_LENGTH];
+    uint8_t rawSenderPubKey[ECE_WEBPUSH_PUBLIC_KEY_LENGTH];
+    uint32_t rs;
+    err = ece_webpush_aesgcm_headers_extract_params(
+      t.cryptoKey, t.encryption, salt, ECE_SALT_LENGTH, rawSenderPubKey,
+      ECE_WEBPUSH_PUBLIC_KEY_LENGTH, &rs);
+    ece_assert(!err, "Got %d parsing crypto headers", err);
+
+    // Decrypt twice, to make sure the subscription can be reused.
+    for (size_t j = 0; j < 2; j++) {
+      size_t plaintextLen =
+        ece_aesgcm_plaintext_max_length(rs, t.ciphertextLen);
+      uint8_t* plaintext = calloc(plaintextLen, sizeof(uint8_t));
+
+      err = ece_subscription_aesgcm_decrypt(
+        sub, salt, ECE_SALT_LENGTH, rawSenderPubKey,
+        ECE_WEBPUSH_PUBLIC_KEY_LENGTH, rs, (const uint8_t*) t.ciphertext,
+        t.ciphertextLen, plaintext, &plaintextLen);
+      ece_assert(!err, "Got %d decrypting ciphertext for `%s`", err, t.desc);
+
+      ece_assert(plaintextLen == t.plaintextLen,
+                 "Got plaintext length %zu for `%s`; want %zu", plaintextLen,
+                 t.desc, t.plaintextLen);
+      ece_assert(!memcmp(plaintext, t.plaintext, plaintextLen),
+                 "Wrong plaintext for `%s`", t.desc);
+
+      free(plaintext);
+    }
+
+    ece_subscription_destroy(sub);
+  }
+
+  size_t errTests = sizeof(webpush_aesgcm_decrypt_err_tests) /
+                    sizeof(webpush_aesgcm_decrypt_err_test_t);
+  for (size_t i = 0; i < errTests; i++) {
+    webpush_aesgcm_decrypt_err_test_t t = webpush_aesgcm_decrypt_err_tests[i];
+
+    uint8_t salt[ECE_SALT_LENGTH];
+    uint8_t rawSenderPubKey[ECE_WEBPUSH_PUBLIC_KEY_LENGTH];
+    uint32_t rs;
+    int err = ece_webpush_aesgcm_headers_extract_params(
+      t.cryptoKey, t.encryption, salt, ECE_SALT_LENGTH, rawSenderPubKey,
+      ECE_WEBPUSH_PUBLIC_KEY_LENGTH, &rs);
+    ece_assert(!err, "Got %d parsing crypto headers", err);
+
+    ece_subscription_t* sub = NULL;
+    err = ece_subscription_create(
+      (const uint8_t*) t.recvPrivKey, ECE_WEBPUSH_PRIVATE_KEY_LENGTH,
+      (const uint8_t*) t.authSecret, ECE_WEBPUSH_AUTH_SECRET_LENGTH, &sub);
+    if (!err) {
+      size_t plaintextLen =
+        ece_aesgcm_plaintext_max_length(rs, t.ciphertextLen);
+      uint8_t* plaintext = calloc(plaintextLen + 1, sizeof(uint8_t));
+      err = ece_subscription_aesgcm_decrypt(
+        sub, salt, ECE_SALT_LENGTH, rawSenderPubKey,
+        ECE_WEBPUSH_PUBLIC_KEY_LENGTH, rs, (const uint8_t*) t.ciphertext,
+        t.ciphertextLen, plaintext, &plaintextLen);
+      free(plaintext);
+    }
+    ece_assert(err == t.err, "Got %d decrypting ciphertext for `%s`; want %d",
+               err, t.desc, t.err);
+
+    ece_subscription_destroy(sub);
+  }
+
+  webpush_aesgcm_decrypt_err_test_t t = webpush_aesgcm_decrypt_err_tests[0];
+  uint8_t salt[ECE_SALT_LENGTH];
+  uint8_t rawSenderPubKey[ECE_WEBPUSH_PUBLIC_KEY_LENGTH];
+  uint32_t rs;
+  int err = ece_webpush_aesgcm_headers_extract_params(
+    t.cryptoKey, t.encryption, salt, ECE_SALT_LENGTH, rawSenderPubKey,
+    ECE_WEBPUSH_PUBLIC_KEY_LENGTH, &rs);
+  ece_assert(!err, "Got %d parsing crypto headers", err);
+  ece_subscription_t* sub = NULL;
+  err = ece_subscription_create(
+    (const uint8_t*) t.recvPrivKey, ECE_WEBPUSH_PRIVATE_KEY_LENGTH,
+    (const uint8_t*) t.authSecret, ECE_WEBPUSH_AUTH_SECRET_LENGTH, &sub);
+  ece_assert(!err, "Got %d creating subscription for `%s`", err, t.desc);
+  uint8_t ciphertext[64] = {0};
+  uint8_t plaintext[64];
+  size_t plaintextLen = sizeof(plaintext);
+  err = ece_subscription_aesgcm_decrypt(
+    sub, salt, ECE_SALT_LENGTH, rawSenderPubKey, ECE_WEBPUSH_PUBLIC_KEY_LENGTH,
+    oversized_rs, ciphertext, sizeof(ciphertext), plaintext, &plaintextLen);
+  ece_assert(err == ECE_ERROR_INVALID_RS,
+             "Got %d decrypting with oversized rs; want %d", err,
+             ECE_ERROR_INVALID_RS);
+  err = ece_subscription_aesgcm_decrypt_in_place(
+    sub, salt, ECE_SALT_LENGTH, rawSenderPubKey, ECE_WEBPUSH_PUBLIC_KEY_LENGTH,
+    oversized_rs, ciphertext, sizeof(ciphertext), &plaintextLen);
+  ece_assert(err == ECE_ERROR_INVALID_RS,
+             "Got %d decrypting in place with oversized rs; want %d", err,
+             ECE_ERROR_INVALID_RS);
+  ece_subscription_destroy(sub);
+}
+
+void
+test_webpush_aesgcm_decrypt_in_place(void) {
+  size_t okTests = sizeof(webpush_aesgcm_decrypt_ok_tests) /
+                   sizeof(webpush_aesgcm_decrypt_ok_test_t);
+  for (size_t i = 0; i < okTests; i++) {
+    webpush_aesgcm_decrypt_ok_test_t t = webpush_aesgcm_decrypt_ok_tests[i];
+
+    uint8_t salt[ECE_SALT_LENGTH];
+    uint8_t rawSenderPubKey[ECE_WEBPUSH_PUBLIC_KEY_LENGTH];
+    uint32_t rs;
+    int err = ece_webpush_aesgcm_headers_extract_params(
+      t.cryptoKey, t.encryption, salt, ECE_SALT_LENGTH, rawSenderPubKey,
+      ECE_WEBPUSH_PUBLIC_KEY_LENGTH, &rs);
+    ece_assert(!err, "Got %d parsing crypto headers", err);
+
+    uint8_t* ciphertext = malloc(t.ciphertextLen);
+    memcpy(ciphertext, t.ciphertext, t.ciphertextLen);
+
+    size_t plaintextLen = 0;
+    err = ece_webpush_aesgcm_decrypt_in_place(
+      (const uint8_t*) t.recvPrivKey, ECE_WEBPUSH_PRIVATE_KEY_LENGTH,
+      (const uint8_t*) t.authSecret, ECE_WEBPUSH_AUTH_SECRET_LENGTH, salt,
+      ECE_SALT_LENGTH, rawSenderPubKey, ECE_WEBPUSH_PUBLIC_KEY_LENGTH, rs,
+      ciphertext, t.ciphertextLen, &plaintextLen);
+    ece_assert(!err, "Got %d decrypting ciphertext for `%s` in place", err,
+               t.desc);
+
+    ece_assert(plaintextLen == t.plaintextLen,
+               "Got plaintext length %zu for `%s`; want %zu", plaintextLen,
+               t.desc, t.plaintextLen);
+    ece_assert(!memcmp(ciphertext, t.plaintext, plaintextLen),
+               "Wrong plaintext for `%s`", t.desc);
+
+    // Decrypting with a subscription should give the same result.
+    ece_subscription_t* sub = NULL;
+    err = ece_subscription_create(
+      (const uint8_t*) t.recvPrivKey, ECE_WEBPUSH_PRIVATE_KEY_LENGTH,
+      (const uint8_t*) t.authSecret, ECE_WEBPUSH_AUTH_SECRET_LENGTH, &sub);
+    ece_assert(!err, "Got %d creating subscription for `%s`", err, t.desc);
+    memcpy(ciphertext, t.ciphertext, t.ciphertextLen);
+    err = ece_subscription_aesgcm_decrypt_in_place(
+      sub, salt, ECE_SALT_LENGTH, rawSenderPubKey,
+      ECE_WEBPUSH_PUBLIC_KEY_LENGTH, rs, ciphertext, t.ciphertextLen,
+      &plaintextLen);
+    ece_assert(!err, "Got %d decrypting ciphertext for `%s` in place", err,
+               t.desc);
+    ece_assert(plaintextLen == t.plaintextLen &&
+                 !memcmp(ciphertext, t.plaintext, plaintextLen),
+               "Wrong plaintext for `%s` with subscription", t.desc);
+    ece_subscription_destroy(sub);
+
+    free(ciphertext);
+  }
+
+  size_t errTests = sizeof(webpush_aesgcm_decrypt_err_tests) /
+                    sizeof(webpush_aesgcm_decrypt_err_test_t);
+  for (size_t i = 0; i < errTests; i++) {
+    webpush_aesgcm_decrypt_err_test_t t = webpush_aesgcm_decrypt_err_tests[i];
+
+    uint8_t salt[ECE_SALT_LENGTH];
+    uint8_t rawSenderPubKey[ECE_WEBPUSH_PUBLIC_KEY_LENGTH];
+    uint32_t rs;
+    int err = ece_webpush_aesgcm_headers_extract_params(
+      t.cryptoKey, t.encryption, salt, ECE_SALT_LENGTH, rawSenderPubKey,
+      ECE_WEBPUSH_PUBLIC_KEY_LENGTH, &rs);
+    ece_assert(!err, "Got %d parsing crypto headers", err);
+
+    uint8_t* ciphertext = malloc(t.ciphertextLen + 1);
+    memcpy(ciphertext, t.ciphertext, t.ciphertextLen);
+
+    size_t plaintextLen = 0;
+    err = ece_webpush_aesgcm_decrypt_in_place(
+      (const uint8_t*) t.recvPrivKey, ECE_WEBPUSH_PRIVATE_KEY_LENGTH,
+      (const uint8_t*) t.authSecret, ECE_WEBPUSH_AUTH_SECRET_LENGTH, salt,
+      ECE_SALT_LENGTH, rawSenderPubKey, ECE_WEBPUSH_PUBLIC_KEY_LENGTH, rs,
+      ciphertext, t.ciphertextLen, &plaintextLen);
+    ece_assert(err == t.err,
+               "Got %d decrypting ciphertext for `%s` in place; want %d", err,
+               t.desc, t.err);
+
+    free(ciphertext);
+  }
+
+  webpush_aesgcm_decrypt_err_test_t t = webpush_aesgcm_decrypt_err_tests[0];
+  uint8_t salt[ECE_SALT_LENGTH] = {0};
+  uint8_t ciphertext[64] = {0};
+  size_t plaintextLen = 0;
+  int err = ece_webpush_aesgcm_decrypt_in_place(
+    (const uint8_t*) t.recvPrivKey, ECE_WEBPUSH_PRIVATE_KEY_LENGTH,
+    (const uint8_t*) t.authSecret, ECE_WEBPUSH_AUTH_SECRET_LENGTH, salt,
+    ECE_SALT_LENGTH, NULL, 0, oversized_rs, ciphertext, sizeof(ciphertext),
+    &plaintextLen);
+  ece_assert(err == ECE_ERROR_INVALID_RS,
+             "Got %d decrypting in place with oversized rs; want %d", err,
+             ECE_ERROR_INVALID_RS);
+}
+
+void
+test_webpush_aesgcm_decrypt_iov(void) {
+  static const size_t segmentLens[] = {1, 7, 16, 33, SIZE_MAX};
+  static const size_t numSegmentLens = sizeof(segmentLens) / sizeof(size_t);
+
+  size_t okTests = sizeof(webpush_aesgcm_decrypt_ok_tests) /
+                   sizeof(webpush_aesgcm_decrypt_ok_test_t);
+  for (size_t i = 0; i < okTests; i++) {
+    webpush_aesgcm_decrypt_ok_test_t t = webpush_aesgcm_decrypt_ok_tests[i];
+
+    uint8_t salt[ECE_SALT_LENGTH];
+    uint8_t rawSenderPubKey[ECE_WEBPUSH_PUBLIC_KEY_LENGTH];
+    uint32_t rs;
+    int err = ece_webpush_aesgcm_headers_extract_params(
+      t.cryptoKey, t.encryption, salt, ECE_SALT_LENGTH, rawSenderPubKey,
+      ECE_WEBPUSH_PUBLIC_KEY_LENGTH, &rs);
+    ece_assert(!err, "Got %d parsing crypto headers", err);
+
+    for (size_t j = 0; j < numSegmentLens; j++) {
+      for (size_t k = 0; k < numSegmentLens; k++) {
+        size_t ciphertextCount;
+        ece_iovec_t* ciphertext =
+          ece_test_iov_new((const uint8_t*) t.ciphertext, t.ciphertextLen,
+                           segmentLens[j], &ciphertextCount);
+        size_t plaintextCount;
+        ece_iovec_t* plaintext = ece_test_iov_new(NULL, t.maxPlaintextLen,
+                                                  segmentLens[k],
+                                                  &plaintextCount);
+
+        size_t plaintextLen = 0;
+        err = ece_webpush_aesgcm_decrypt_iov(
+          (const uint8_t*) t.recvPrivKey, ECE_WEBPUSH_PRIVATE_KEY_LENGTH,
+          (const uint8_t*) t.authSecret, ECE_WEBPUSH_AUTH_SECRET_LENGTH, salt,
+          ECE_SALT_LENGTH, rawSenderPubKey, ECE_WEBPUSH_PUBLIC_KEY_LENGTH, rs,
+          ciphertext, ciphertextCount, plaintext, plaintextCount,
+          &plaintextLen);
+        ece_assert(!err, "Got %d decrypting `%s` with segments %zu, %zu", err,
+                   t.desc, segmentLens[j], segmentLens[k]);
+
+        ece_assert(plaintextLen == t.plaintextLen,
+                   "Got plaintext length %zu for `%s`; want %zu",
+                   plaintextLen, t.desc, t.plaintextLen);
+        uint8_t* result = malloc(plaintextLen + 1);
+        ece_test_iov_flatten(plaintext, plaintextCount, result, plaintextLen);
+        ece_assert(!memcmp(result, t.plaintext, plaintextLen),
+                   "Wrong plaintext for `%s` with segments %zu, %zu", t.desc,
+                   segmentLens[j], segmentLens[k]);
+
+        free(result);
+        ece_test_iov_free(plaintext, plaintextCount);
+        ece_test_iov_free(ciphertext, ciphertextCount);
+      }
+    }
+  }
+
+  size_t errTests = sizeof(webpush_aesgcm_decrypt_err_tests) /
+                    sizeof(webpush_aesgcm_decrypt_err_test_t);
+  for (size_t i = 0; i < errTests; i++) {
+    webpush_aesgcm_decrypt_err_test_t t = webpush_aesgcm_decrypt_err_tests[i];
+
+    uint8_t salt[ECE_SALT_LENGTH];
+    uint8_t rawSenderPubKey[ECE_WEBPUSH_PUBLIC_KEY_LENGTH];
+    uint32_t rs;
+    int err = ece_webpush_aesgcm_headers_extract_params(
+      t.cryptoKey, t.encryption, salt, ECE_SALT_LENGTH, rawSenderPubKey,
+      ECE_WEBPUSH_PUBLIC_KEY_LENGTH, &rs);
+    ece_assert(!err, "Got %d parsing crypto headers", err);
+
+    size_t ciphertextCount;
+    ece_iovec_t* ciphertext =
+      ece_test_iov_new((const uint8_t*) t.ciphertext, t.ciphertextLen, 5,
+                       &ciphertextCount);
+    size_t plaintextCount;
+    ece_iovec_t* plaintext =
+      ece_test_iov_new(NULL, t.maxPlaintextLen, 3, &plaintextCount);
+
+    size_t plaintextLen = 0;
+    err = ece_webpush_aesgcm_decrypt_iov(
+      (const uint8_t*) t.recvPrivKey, ECE_WEBPUSH_PRIVATE_KEY_LENGTH,
+      (const uint8_t*) t.authSecret, ECE_WEBPUSH_AUTH_SECRET_LENGTH, salt,
+      ECE_SALT_LENGTH, rawSenderPubKey, ECE_WEBPUSH_PUBLIC_KEY_LENGTH, rs,
+      ciphertext, ciphertextCount, plaintext, plaintextCount, &plaintextLen);
+    ece_assert(err == t.err,
+               "Got %d decrypting ciphertext for `%s` with segments; want %d",
+               err, t.desc, t.err);
+
+    ece_test_iov_free(plaintext, plaintextCount);
+    ece_test_iov_free(ciphertext, ciphertextCount);
+  }
+
+  webpush_aesgcm_decrypt_err_test_t t = webpush_aesgcm_decrypt_err_tests[0];
+  uint8_t salt[ECE_SALT_LENGTH] = {0};
+  uint8_t buffer[64] = {0};
+  ece_iovec_t ciphertext = {buffer, sizeof(buffer)};
+  uint8_t result[64];
+  ece_iovec_t plaintext = {result, sizeof(result)};
+  size_t plaintextLen = 0;
+  int err = ece_webpush_aesgcm_decrypt_iov(
+    (const uint8_t*) t.recvPrivKey, ECE_WEBPUSH_PRIVATE_KEY_LENGTH,
+    (const uint8_t*) t.authSecret, ECE_WEBPUSH_AUTH_SECRET_LENGTH, salt,
+    ECE_SALT_LENGTH, NULL, 0, oversized_rs, &ciphertext, 1, &plaintext, 1,
+    &plaintextLen);
+  ece_assert(err == ECE_ERROR_INVALID_RS,
+             "Got %d decrypting segments with oversized rs; want %d", err,
+             ECE_ERROR_INVALID_RS);
+}
+
+// Feeds `ciphertext` to a streaming decryption context in chunks of
+// `chunkLen` bytes, and collects the decrypted records into `plaintext`.
+static int
+aesgcm_decrypt_stream(ece_aes128gcm_decrypt_ctx_t* ctx,
+                      const uint8_t* ciphertext, size_t ciphertextLen,
+                      size_t chunkLen, uint8_t* plaintext,
+                      size_t* plaintextLen) {
+  size_t plaintextStart = 0;
+  size_t ciphertextStart = 0;
+  int err = ECE_OK;
+  while (ciphertextStart < ciphertextLen) {
+    size_t ciphertextEnd = ciphertextStart + chunkLen;
+    if (ciphertextEnd > ciphertextLen) {
+      ciphertextEnd = ciphertextLen;
+    }
+    size_t blockLen = ece_aes128gcm_decrypt_update_max_length(
+      ctx, ciphertextEnd - ciphertextStart);
+    uint8_t* block = calloc(blockLen + 1, sizeof(uint8_t));
+    err = ece_aes128gcm_decrypt_update(ctx, &ciphertext[ciphertextStart],
+                                       ciphertextEnd - ciphertextStart, block,
+                                       &blockLen);
+    if (!err) {
+      ece_assert(plaintextStart + blockLen <= *plaintextLen,
+                 "Got %zu bytes of plaintext; want at most %zu",
+                 plaintextStart + blockLen, *plaintextLen);
+      memcpy(&plaintext[plaintextStart], block, blockLen);
+      plaintextStart += blockLen;
+    }
+    free(block);
+    if (err) {
+      return err;
+    }
+    ciphertextStart = ciphertextEnd;
+  }
+  size_t blockLen = ece_aes128gcm_decrypt_update_max_length(ctx, 0);
+  uint8_t* block = calloc(blockLen + 1, sizeof(uint8_t));
+  err = ece_aes128gcm_decrypt_final(ctx, block, &blockLen);
+  if (!err) {
+    ece_assert(plaintextStart + blockLen <= *plaintextLen,
+               "Got %zu bytes of plaintext; want at most %zu",
+               plaintextStart + blockLen, *plaintextLen);
+    memcpy(&plaintext[plaintextStart], block, blockLen);
+    plaintextStart += blockLen;
+    *plaintextLen = plaintextStart;
+  }
+  free(block);
+  return err;
+}
+
+void
+test_webpush_aesgcm_decrypt_stream(void) {
+  static const size_t chunkLens[] = {1, 7, 16, 33, SIZE_MAX};
+  static const size_t numChunkLens = sizeof(chunkLens) / sizeof(size_t);
+
+  ece_aes128gcm_decrypt_ctx_t* ctx = ece_aes128gcm_decrypt_ctx_new();
+  ece_assert(ctx, "Want decryption context for `%s`", "stream");
+
+  size_t okTests = sizeof(webpush_aesgcm_decrypt_ok_tests) /
+                   sizeof(webpush_aesgcm_decrypt_ok_test_t);
+  for (size_t i = 0; i < okTests; i++) {
+    webpush_aesgcm_decrypt_ok_test_t t = webpush_aesgcm_decrypt_ok_tests[i];
+
+    uint8_t salt[ECE_SALT_LENGTH];
+    uint8_t rawSenderPubKey[ECE_WEBPUSH_PUBLIC_KEY_LENGTH];
+    uint32_t rs;
+    int err = ece_webpush_aesgcm_headers_extract_params(
+      t.cryptoKey, t.encryption, salt, ECE_SALT_LENGTH, rawSenderPubKey,
+      ECE_WEBPUSH_PUBLIC_KEY_LENGTH, &rs);
+    ece_assert(!err, "Got %d parsing crypto headers", err);
+
+    for (size_t j = 0; j < numChunkLens; j++) {
+      err = ece_webpush_aesgcm_decrypt_init(
+        ctx, (const uint8_t*) t.recvPrivKey, ECE_WEBPUSH_PRIVATE_KEY_LENGTH,
+        (const uint8_t*) t.authSecret, ECE_WEBPUSH_AUTH_SECRET_LENGTH, salt,
+        ECE_SALT_LENGTH, rawSenderPubKey, ECE_WEBPUSH_PUBLIC_KEY_LENGTH, rs);
+      ece_assert(!err, "Got %d initializing context for `%s`", err, t.desc);
+
+      size_t plaintextLen = t.maxPlaintextLen;
+      uint8_t* plaintext = calloc(plaintextLen + 1, sizeof(uint8_t));
+      err = aesgcm_decrypt_stream(ctx, (const uint8_t*) t.ciphertext,
+                                  t.ciphertextLen, chunkLens[j], plaintext,
+                                  &plaintextLen);
+      ece_assert(!err, "Got %d decrypting `%s` in %zu-byte chunks", err,
+                 t.desc, chunkLens[j]);
+
+      ece_assert(plaintextLen == t.plaintextLen,
+                 "Got plaintext length %zu for `%s`; want %zu", plaintextLen,
+                 t.desc, t.plaintextLen);
+      ece_assert(!memcmp(plaintext, t.plaintext, plaintextLen),
+                 "Wrong plaintext for `%s` in %zu-byte chunks", t.desc,
+                 chunkLens[j]);
+
+      free(plaintext);
+    }
+  }
+
+  size_t errTests = sizeof(webpush_aesgcm_decrypt_err_tests) /
+                    sizeof(webpush_aesgcm_decrypt_err_test_t);
+  for (size_t i = 0; i < errTests; i++) {
+    webpush_aesgcm_decrypt_err_test_t t = webpush_aesgcm_decrypt_err_tests[i];
+
+    uint8_t salt[ECE_SALT_LENGTH];
+    uint8_t rawSenderPubKey[ECE_WEBPUSH_PUBLIC_KEY_LENGTH];
+    uint32_t rs;
+    int err = ece_webpush_aesgcm_headers_extract_params(
+      t.cryptoKey, t.encryption, salt, ECE_SALT_LENGTH, rawSenderPubKey,
+      ECE_WEBPUSH_PUBLIC_KEY_LENGTH, &rs);
+    ece_assert(!err, "Got %d parsing crypto headers", err);
+
+    for (size_t j = 0; j < numChunkLens; j++) {
+      err = ece_webpush_aesgcm_decrypt_init(
+        ctx, (const uint8_t*) t.recvPrivKey, ECE_WEBPUSH_PRIVATE_KEY_LENGTH,
+        (const uint8_t*) t.authSecret, ECE_WEBPUSH_AUTH_SECRET_LENGTH, salt,
+        ECE_SALT_LENGTH, rawSenderPubKey, ECE_WEBPUSH_PUBLIC_KEY_LENGTH, rs);
+      ece_assert(!err, "Got %d initializing context for `%s`", err, t.desc);
+
+      size_t plaintextLen = t.maxPlaintextLen;
+      uint8_t* plaintext = calloc(plaintextLen + 1, sizeof(uint8_t));
+      err = aesgcm_decrypt_stream(ctx, (const uint8_t*) t.ciphertext,
+                                  t.ciphertextLen, chunkLens[j], plaintext,
+                                  &plaintextLen);
+      ece_assert(err == t.err,
+                 "Got %d decrypting `%s` in %zu-byte chunks; want %d", err,
+                 t.desc, chunkLens[j], t.err);
+
+      free(plaintext);
+    }
+  }
+
+  // The record size is checked before importing the keys.
+  int err = ece_webpush_aesgcm_decrypt_init(
+    ctx, NULL, 0, NULL, 0, NULL, 0, NULL, 0, ECE_AESGCM_MIN_RS - 1);
+  ece_assert(err == ECE_ERROR_INVALID_RS,
+             "Got %d initializing context with short rs; want %d", err,
+             ECE_ERROR_INVALID_RS);
+  size_t plaintextLen = 0;
+  err = ece_aes128gcm_decrypt_final(ctx, NULL, &plaintextLen);
+  ece_assert(err == ECE_ERROR_INVALID_RS,
+             "Got %d finishing failed context; want %d", err,
+             ECE_ERROR_INVALID_RS);
+
+  ece_aes128gcm_decrypt_ctx_free(ctx);
+}
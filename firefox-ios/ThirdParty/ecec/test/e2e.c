@@ -3,6 +3,10 @@
 #include <inttypes.h>
 #include <string.h>
 
+#ifdef ECE_HAVE_PTHREADS
+#include <pthread.h>
+#endif
+
 void
 test_webpush_aes128gcm_e2e(void) {
   uint8_t rawRecvPrivKey[ECE_WEBPUSH_PRIVATE_KEY_LENGTH];
@@ -132,3 +136,498 @@ test_webpush_aesgcm_e2e(void) {
   free(encryptionHeader);
   free(plaintext);
 }
+
+void
+test_webpush_recipient_e2e(void) {
+  static const size_t subscriptions = 4;
+
+  uint8_t rawRecvPrivKeys[4][ECE_WEBPUSH_PRIVATE_KEY_LENGTH];
+  uint8_t rawRecvPubKeys[4][ECE_WEBPUSH_PUBLIC_KEY_LENGTH];
+  uint8_t authSecrets[4][ECE_WEBPUSH_AUTH_SECRET_LENGTH];
+  for (size_t i = 0; i < subscriptions; i++) {
+    int err = ece_webpush_generate_keys(
+      rawRecvPrivKeys[i], ECE_WEBPUSH_PRIVATE_KEY_LENGTH, rawRecvPubKeys[i],
+      ECE_WEBPUSH_PUBLIC_KEY_LENGTH, authSecrets[i],
+      ECE_WEBPUSH_AUTH_SECRET_LENGTH);
+    ece_assert(!err, "Got %d generating keys", err);
+  }
+
+  const void* input = "When I grow up, I want to be a watermelon";
+  size_t inputLen = strlen(input);
+
+  // The cache only holds two recipients, so sending to the subscriptions in
+  // order evicts each one before it's used again.
+  ece_recipient_cache_t* cache = ece_recipient_cache_new(2);
+  ece_assert(cache, "Want recipient cache for %zu subscriptions",
+             subscriptions);
+  for (size_t round = 0; round < 2; round++) {
+    for (size_t i = 0; i < subscriptions; i++) {
+      // Send two messages to each subscription, so that the second lookup
+      // hits the cache.
+      for (size_t j = 0; j < 2; j++) {
+        ece_recipient_t* recipient = NULL;
+        int err = ece_recipient_cache_get(
+          cache, rawRecvPubKeys[i], ECE_WEBPUSH_PUBLIC_KEY_LENGTH,
+          authSecrets[i], ECE_WEBPUSH_AUTH_SECRET_LENGTH, &recipient);
+        ece_assert(!err, "Got %d looking up recipient %zu", err, i);
+
+        size_t payloadLen = ece_aes128gcm_payload_max_length(4096, 0, inputLen);
+        uint8_t* payload = calloc(payloadLen, sizeof(uint8_t));
+        err = ece_recipient_aes128gcm_encrypt(recipient, 4096, 0, input,
+                                              inputLen, payload, &payloadLen);
+        ece_assert(!err, "Got %d encrypting to recipient %zu", err, i);
+
+        size_t plaintextLen =
+          ece_aes128gcm_plaintext_max_length(payload, payloadLen);
+        uint8_t* plaintext = calloc(plaintextLen, sizeof(uint8_t));
+        err = ece_webpush_aes128gcm_decrypt(
+          rawRecvPrivKeys[i], ECE_WEBPUSH_PRIVATE_KEY_LENGTH, authSecrets[i],
+          ECE_WEBPUSH_AUTH_SECRET_LENGTH, payload, payloadLen, plaintext,
+          &plaintextLen);
+        ece_assert(!err, "Got %d decrypting payload for recipient %zu", err,
+                   i);
+        ece_assert(plaintextLen == inputLen &&
+                     !memcmp(plaintext, input, inputLen),
+                   "Wrong plaintext for recipient %zu", i);
+
+        free(plaintext);
+        free(payload);
+
+        size_t ciphertextLen =
+          ece_aesgcm_ciphertext_max_length(26, 6, inputLen);
+        uint8_t* ciphertext = calloc(ciphertextLen, sizeof(uint8_t));
+        uint8_t salt[ECE_SALT_LENGTH];
+        uint8_t rawSenderPubKey[ECE_WEBPUSH_PUBLIC_KEY_LENGTH];
+        err = ece_recipient_aesgcm_encrypt(
+          recipient, 26, 6, input, inputLen, salt, ECE_SALT_LENGTH,
+          rawSenderPubKey, ECE_WEBPUSH_PUBLIC_KEY_LENGTH, ciphertext,
+          &ciphertextLen);
+        ece_assert(!err, "Got %d encrypting to recipient %zu", err, i);
+
+        plaintextLen = ece_aesgcm_plaintext_max_length(26, ciphertextLen);
+        plaintext = calloc(plaintextLen, sizeof(uint8_t));
+        err = ece_webpush_aesgcm_decrypt(
+          rawRecvPrivKeys[i], ECE_WEBPUSH_PRIVATE_KEY_LENGTH, authSecrets[i],
+          ECE_WEBPUSH_AUTH_SECRET_LENGTH, salt, ECE_SALT_LENGTH,
+          rawSenderPubKey, ECE_WEBPUSH_PUBLIC_KEY_LENGTH, 26, ciphertext,
+          ciphertextLen, plaintext, &plaintextLen);
+        ece_assert(!err, "Got %d decrypting ciphertext for recipient %zu", err,
+                   i);
+        ece_assert(plaintextLen == inputLen &&
+                     !memcmp(plaintext, input, inputLen),
+                   "Wrong plaintext for recipient %zu", i);
+
+        free(plaintext);
+        free(ciphertext);
+        ece_recipient_destroy(recipient);
+      }
+    }
+  }
+
+  uint64_t hits = 0;
+  uint64_t misses = 0;
+  ece_recipient_cache_stats(cache, &hits, &misses);
+  ece_assert(hits == 8, "Got %" PRIu64 " cache hits; want 8", hits);
+  ece_assert(misses == 8, "Got %" PRIu64 " cache misses; want 8", misses);
+
+  // A new auth secret for a cached public key replaces the stale recipient.
+  ece_recipient_t* recipient = NULL;
+  int err = ece_recipient_cache_get(
+    cache, rawRecvPubKeys[3], ECE_WEBPUSH_PUBLIC_KEY_LENGTH, authSecrets[0],
+    ECE_WEBPUSH_AUTH_SECRET_LENGTH, &recipient);
+  ece_assert(!err, "Got %d replacing recipient", err);
+  ece_recipient_destroy(recipient);
+  ece_recipient_cache_stats(cache, &hits, &misses);
+  ece_assert(hits == 8 && misses == 9,
+             "Got %" PRIu64 " hits and %" PRIu64 " misses; want 8 and 9", hits,
+             misses);
+
+  // Invalid keys aren't cached.
+  err = ece_recipient_cache_get(cache, (const uint8_t*) "\x04", 1,
+                                authSecrets[0], ECE_WEBPUSH_AUTH_SECRET_LENGTH,
+                                &recipient);
+  ece_assert(err == ECE_ERROR_INVALID_PUBLIC_KEY && !recipient,
+             "Got %d looking up invalid public key", err);
+
+  ece_recipient_cache_free(cache);
+}
+
+void
+test_webpush_generate_keys_bulk(void) {
+  // More than one batch of points, with a partial last batch.
+  static const size_t count = 300;
+
+  uint8_t* rawRecvPrivKeys = calloc(count, ECE_WEBPUSH_PRIVATE_KEY_LENGTH);
+  uint8_t* rawRecvPubKeys = calloc(count, ECE_WEBPUSH_PUBLIC_KEY_LENGTH);
+  uint8_t* authSecrets = calloc(count, ECE_WEBPUSH_AUTH_SECRET_LENGTH);
+  ece_assert(rawRecvPrivKeys && rawRecvPubKeys && authSecrets,
+             "Want buffers for %zu keys", count);
+
+  int err = ece_webpush_generate_keys_bulk(
+    count, rawRecvPrivKeys, count * ECE_WEBPUSH_PRIVATE_KEY_LENGTH,
+    rawRecvPubKeys, count * ECE_WEBPUSH_PUBLIC_KEY_LENGTH - 1, authSecrets,
+    count * ECE_WEBPUSH_AUTH_SECRET_LENGTH);
+  ece_assert(err == ECE_ERROR_INVALID_PUBLIC_KEY,
+             "Got %d generating keys with short public key array", err);
+  err = ece_webpush_generate_keys_bulk(
+    count + 1, rawRecvPrivKeys, count * ECE_WEBPUSH_PRIVATE_KEY_LENGTH,
+    rawRecvPubKeys, count * ECE_WEBPUSH_PUBLIC_KEY_LENGTH, authSecrets,
+    count * ECE_WEBPUSH_AUTH_SECRET_LENGTH);
+  ece_assert(err == ECE_ERROR_INVALID_PRIVATE_KEY,
+             "Got %d generating keys with mismatched count", err);
+  err = ece_webpush_generate_keys_bulk(0, NULL, 0, NULL, 0, NULL, 0);
+  ece_assert(!err, "Got %d generating no keys", err);
+
+  err = ece_webpush_generate_keys_bulk(
+    count, rawRecvPrivKeys, count * ECE_WEBPUSH_PRIVATE_KEY_LENGTH,
+    rawRecvPubKeys, count * ECE_WEBPUSH_PUBLIC_KEY_LENGTH, authSecrets,
+    count * ECE_WEBPUSH_AUTH_SECRET_LENGTH);
+  ece_assert(!err, "Got %d generating %zu keys", err, count);
+
+  const void* input = "When I grow up, I want to be a watermelon";
+  size_t inputLen = strlen(input);
+  size_t maxPayloadLen = ece_aes128gcm_payload_max_length(4096, 0, inputLen);
+  uint8_t* payload = calloc(maxPayloadLen, sizeof(uint8_t));
+  uint8_t plaintext[64];
+
+  for (size_t i = 0; i < count; i++) {
+    const uint8_t* rawRecvPrivKey =
+      &rawRecvPrivKeys[i * ECE_WEBPUSH_PRIVATE_KEY_LENGTH];
+    const uint8_t* rawRecvPubKey =
+      &rawRecvPubKeys[i * ECE_WEBPUSH_PUBLIC_KEY_LENGTH];
+    const uint8_t* authSecret =
+      &authSecrets[i * ECE_WEBPUSH_AUTH_SECRET_LENGTH];
+    if (i) {
+      ece_assert(memcmp(rawRecvPrivKey, rawRecvPrivKeys,
+                        ECE_WEBPUSH_PRIVATE_KEY_LENGTH),
+                 "Want distinct private key for subscription %zu", i);
+      ece_assert(
+        memcmp(authSecret, authSecrets, ECE_WEBPUSH_AUTH_SECRET_LENGTH),
+        "Want distinct auth secret for subscription %zu", i);
+    }
+
+    // Each subscription can decrypt a message encrypted to its public key,
+    // so the public key matches the private key.
+    size_t payloadLen = maxPayloadLen;
+    err = ece_webpush_aes128gcm_encrypt(
+      rawRecvPubKey, ECE_WEBPUSH_PUBLIC_KEY_LENGTH, authSecret,
+      ECE_WEBPUSH_AUTH_SECRET_LENGTH, 4096, 0, input, inputLen, payload,
+      &payloadLen);
+    ece_assert(!err, "Got %d encrypting to subscription %zu", err, i);
+    size_t plaintextLen = sizeof(plaintext);
+    err = ece_webpush_aes128gcm_decrypt(
+      rawRecvPrivKey, ECE_WEBPUSH_PRIVATE_KEY_LENGTH, authSecret,
+      ECE_WEBPUSH_AUTH_SECRET_LENGTH, payload, payloadLen, plaintext,
+      &plaintextLen);
+    ece_assert(!err, "Got %d decrypting for subscription %zu", err, i);
+    ece_assert(plaintextLen == inputLen && !memcmp(plaintext, input, inputLen),
+               "Wrong plaintext for subscription %zu", i);
+  }
+
+  free(payload);
+  free(rawRecvPrivKeys);
+  free(rawRecvPubKeys);
+  free(authSecrets);
+}
+
+// Finds the value of a header field in a request header block. Returns `NULL`
+// if the field is missing.
+static const char*
+e2e_request_header(const char* headers, size_t headersLen, const char* name,
+                   size_t* valueLen) {
+  size_t nameLen = strlen(name);
+  const char* line = headers;
+  const char* end = &headers[headersLen];
+  while (line < end) {
+    const char* lineEnd = line;
+    while (lineEnd + 1 < end && (lineEnd[0] != '\r' || lineEnd[1] != '\n')) {
+      lineEnd++;
+    }
+    size_t lineLen = (size_t)(lineEnd - line);
+    if (lineLen > nameLen + 2 && !memcmp(line, name, nameLen) &&
+        !memcmp(&line[nameLen], ": ", 2)) {
+      *valueLen = lineLen - nameLen - 2;
+      return &line[nameLen + 2];
+    }
+    line = lineEnd + 2;
+  }
+  return NULL;
+}
+
+// Builds a push request for each record size, padding length, and plaintext
+// length, then parses the header block and decrypts the body.
+static void
+e2e_encrypt_request(bool isAes128gcm) {
+  uint8_t rawRecvPrivKey[ECE_WEBPUSH_PRIVATE_KEY_LENGTH];
+  uint8_t rawRecvPubKey[ECE_WEBPUSH_PUBLIC_KEY_LENGTH];
+  uint8_t authSecret[ECE_WEBPUSH_AUTH_SECRET_LENGTH];
+  int err = ece_webpush_generate_keys(
+    rawRecvPrivKey, ECE_WEBPUSH_PRIVATE_KEY_LENGTH, rawRecvPubKey,
+    ECE_WEBPUSH_PUBLIC_KEY_LENGTH, authSecret, ECE_WEBPUSH_AUTH_SECRET_LENGTH);
+  ece_assert(!err, "Got %d generating keys", err);
+
+  static const uint32_t rsValues[] = {25, 4096};
+  static const size_t padLens[] = {0, 40};
+  static const size_t plaintextLens[] = {1, 100, 5000};
+  static const uint32_t ttl = 86400;
+  uint8_t* input = malloc(5000);
+  ece_assert(input, "Want input buffer%s", "");
+  for (size_t i = 0; i < 5000; i++) {
+    input[i] = (uint8_t)(i * 31 + 5);
+  }
+
+  // One context builds every request.
+  ece_encrypt_ctx_t* ctx = ece_encrypt_ctx_new();
+  ece_assert(ctx, "Want encryption context%s", "");
+  for (size_t i = 0; i < sizeof(rsValues) / sizeof(uint32_t); i++) {
+    for (size_t j = 0; j < sizeof(padLens) / sizeof(size_t); j++) {
+      for (size_t k = 0; k < sizeof(plaintextLens) / sizeof(size_t); k++) {
+        uint32_t rs = rsValues[i];
+        size_t padLen = padLens[j];
+        size_t inputLen = plaintextLens[k];
+
+        size_t requestLen =
+          isAes128gcm
+            ? ece_webpush_aes128gcm_request_length(rs, padLen, inputLen, ttl)
+            : ece_webpush_aesgcm_request_length(rs, padLen, inputLen, ttl);
+        size_t bufferLen = requestLen ? requestLen : 1;
+        uint8_t* request = malloc(bufferLen);
+        ece_assert(request, "Want request buffer for %zu bytes", bufferLen);
+        size_t writtenLen = bufferLen;
+        err = isAes128gcm
+                ? ece_webpush_aes128gcm_encrypt_request(
+                    ctx, rawRecvPubKey, ECE_WEBPUSH_PUBLIC_KEY_LENGTH,
+                    authSecret, ECE_WEBPUSH_AUTH_SECRET_LENGTH, rs, padLen,
+                    ttl, input, inputLen, request, &writtenLen)
+                : ece_webpush_aesgcm_encrypt_request(
+                    ctx, rawRecvPubKey, ECE_WEBPUSH_PUBLIC_KEY_LENGTH,
+                    authSecret, ECE_WEBPUSH_AUTH_SECRET_LENGTH, rs, padLen,
+                    ttl, input, inputLen, request, &writtenLen);
+        if (!requestLen) {
+          // The padding doesn't fit in the records.
+          ece_assert(err == ECE_ERROR_ENCRYPT_PADDING,
+                     "Got %d building request with rs = %" PRIu32
+                     ", padLen = %zu, length %zu; want %d",
+                     err, rs, padLen, inputLen, ECE_ERROR_ENCRYPT_PADDING);
+          free(request);
+          continue;
+        }
+        ece_assert(!err,
+                   "Got %d building request with rs = %" PRIu32
+                   ", padLen = %zu, length %zu",
+                   err, rs, padLen, inputLen);
+        ece_assert(writtenLen == requestLen,
+                   "Got request length %zu; want %zu", writtenLen, requestLen);
+
+        const char* headers = (const char*) request;
+        size_t headersLen = 0;
+        while (memcmp(&headers[headersLen], "\r\n\r\n", 4)) {
+          headersLen++;
+          ece_assert(headersLen + 4 <= requestLen,
+                     "Want end of header block%s", "");
+        }
+        headersLen += 4;
+        const uint8_t* body = &request[headersLen];
+        size_t bodyLen = requestLen - headersLen;
+
+        size_t valueLen;
+        const char* value = e2e_request_header(headers, headersLen,
+                                               "Content-Encoding", &valueLen);
+        const char* wantEncoding = isAes128gcm ? "aes128gcm" : "aesgcm";
+        ece_assert(value && valueLen == strlen(wantEncoding) &&
+                     !memcmp(value, wantEncoding, valueLen),
+                   "Wrong Content-Encoding; want %s", wantEncoding);
+        value = e2e_request_header(headers, headersLen, "TTL", &valueLen);
+        ece_assert(value && valueLen == 5 && !memcmp(value, "86400", 5),
+                   "Wrong TTL%s", "");
+        value =
+          e2e_request_header(headers, headersLen, "Content-Length", &valueLen);
+        ece_assert(value, "Missing Content-Length%s", "");
+        size_t contentLen = 0;
+        for (size_t l = 0; l < valueLen; l++) {
+          contentLen = contentLen * 10 + (size_t)(value[l] - '0');
+        }
+        ece_assert(contentLen == bodyLen, "Got Content-Length %zu; want %zu",
+                   contentLen, bodyLen);
+
+        size_t plaintextLen = inputLen + 1;
+        uint8_t* plaintext = malloc(plaintextLen);
+        ece_assert(plaintext, "Want plaintext buffer%s", "");
+        if (isAes128gcm) {
+          err = ece_webpush_aes128gcm_decrypt(
+            rawRecvPrivKey, ECE_WEBPUSH_PRIVATE_KEY_LENGTH, authSecret,
+            ECE_WEBPUSH_AUTH_SECRET_LENGTH, body, bodyLen, plaintext,
+            &plaintextLen);
+        } else {
+          size_t cryptoKeyLen, encryptionLen;
+          const char* cryptoKey = e2e_request_header(
+            headers, headersLen, "Crypto-Key", &cryptoKeyLen);
+          const char* encryption = e2e_request_header(
+            headers, headersLen, "Encryption", &encryptionLen);
+          ece_assert(cryptoKey && encryption,
+                     "Missing Crypto-Key or Encryption%s", "");
+          uint8_t salt[ECE_SALT_LENGTH];
+          uint8_t rawSenderPubKey[ECE_WEBPUSH_PUBLIC_KEY_LENGTH];
+          uint32_t headerRs;
+          err = ece_webpush_aesgcm_headers_extract_params_slices(
+            cryptoKey, cryptoKeyLen, encryption, encryptionLen, salt,
+            ECE_SALT_LENGTH, rawSenderPubKey, ECE_WEBPUSH_PUBLIC_KEY_LENGTH,
+            &headerRs);
+          ece_assert(!err, "Got %d extracting params from request", err);
+          ece_assert(headerRs == rs, "Got rs = %" PRIu32 "; want %" PRIu32,
+                     headerRs, rs);
+          err = ece_webpush_aesgcm_decrypt(
+            rawRecvPrivKey, ECE_WEBPUSH_PRIVATE_KEY_LENGTH, authSecret,
+            ECE_WEBPUSH_AUTH_SECRET_LENGTH, salt, ECE_SALT_LENGTH,
+            rawSenderPubKey, ECE_WEBPUSH_PUBLIC_KEY_LENGTH, rs, body, bodyLen,
+            plaintext, &plaintextLen);
+        }
+        ece_assert(!err, "Got %d decrypting request body", err);
+        ece_assert(plaintextLen == inputLen &&
+                     !memcmp(plaintext, input, inputLen),
+                   "Wrong plaintext for rs = %" PRIu32
+                   ", padLen = %zu, length %zu",
+                   rs, padLen, inputLen);
+
+        // A buffer that's one byte short fails before generating keys.
+        writtenLen = requestLen - 1;
+        err = isAes128gcm
+                ? ece_webpush_aes128gcm_encrypt_request(
+                    ctx, rawRecvPubKey, ECE_WEBPUSH_PUBLIC_KEY_LENGTH,
+                    authSecret, ECE_WEBPUSH_AUTH_SECRET_LENGTH, rs, padLen,
+                    ttl, input, inputLen, request, &writtenLen)
+                : ece_webpush_aesgcm_encrypt_request(
+                    ctx, rawRecvPubKey, ECE_WEBPUSH_PUBLIC_KEY_LENGTH,
+                    authSecret, ECE_WEBPUSH_AUTH_SECRET_LENGTH, rs, padLen,
+                    ttl, input, inputLen, request, &writtenLen);
+        ece_assert(err == ECE_ERROR_OUT_OF_MEMORY,
+                   "Got %d building request into short buffer; want %d", err,
+                   ECE_ERROR_OUT_OF_MEMORY);
+
+        free(plaintext);
+        free(request);
+      }
+    }
+  }
+
+  size_t requestLen =
+    isAes128gcm ? ece_webpush_aes128gcm_request_length(4096, 0, 0, ttl)
+                : ece_webpush_aesgcm_request_length(4096, 0, 0, ttl);
+  ece_assert(!requestLen, "Got request length %zu for empty plaintext",
+             requestLen);
+  uint8_t request[1];
+  requestLen = sizeof(request);
+  err = isAes128gcm
+          ? ece_webpush_aes128gcm_encrypt_request(
+              ctx, rawRecvPubKey, ECE_WEBPUSH_PUBLIC_KEY_LENGTH, authSecret,
+              ECE_WEBPUSH_AUTH_SECRET_LENGTH, 4096, 0, ttl, input, 0, request,
+              &requestLen)
+          : ece_webpush_aesgcm_encrypt_request(
+              ctx, rawRecvPubKey, ECE_WEBPUSH_PUBLIC_KEY_LENGTH, authSecret,
+              ECE_WEBPUSH_AUTH_SECRET_LENGTH, 4096, 0, ttl, input, 0, request,
+              &requestLen);
+  ece_assert(err == ECE_ERROR_ZERO_PLAINTEXT,
+             "Got %d building request for empty plaintext; want %d", err,
+             ECE_ERROR_ZERO_PLAINTEXT);
+
+  ece_encrypt_ctx_free(ctx);
+  free(input);
+}
+
+void
+test_webpush_encrypt_request(void) {
+  e2e_encrypt_request(true);
+  e2e_encrypt_request(false);
+}
+
+#ifdef ECE_HAVE_PTHREADS
+typedef struct recipient_thread_s {
+  ece_recipient_cache_t* cache;
+  pthread_mutex_t* lock;
+  const uint8_t (*rawRecvPubKeys)[ECE_WEBPUSH_PUBLIC_KEY_LENGTH];
+  const uint8_t (*authSecrets)[ECE_WEBPUSH_AUTH_SECRET_LENGTH];
+  size_t first;
+} recipient_thread_t;
+
+// Looks up recipients under the cache lock, and releases them without it.
+// The cache only holds one recipient, and the threads look up different
+// subscriptions, so each lookup evicts a recipient that other threads may be
+// using or releasing.
+static void*
+recipient_thread_run(void* arg) {
+  const recipient_thread_t* thread = arg;
+  const void* input = "I'm just a poor watermelon";
+  size_t inputLen = strlen(input);
+  for (size_t i = 0; i < 200; i++) {
+    size_t j = (thread->first + i) % 2;
+    ece_recipient_t* recipient = NULL;
+    pthread_mutex_lock(thread->lock);
+    int err = ece_recipient_cache_get(
+      thread->cache, thread->rawRecvPubKeys[j], ECE_WEBPUSH_PUBLIC_KEY_LENGTH,
+      thread->authSecrets[j], ECE_WEBPUSH_AUTH_SECRET_LENGTH, &recipient);
+    pthread_mutex_unlock(thread->lock);
+    ece_assert(!err, "Got %d looking up recipient %zu", err, j);
+    if (!(i % 8)) {
+      uint8_t payload[256];
+      size_t payloadLen = sizeof(payload);
+      err = ece_recipient_aes128gcm_encrypt(recipient, 4096, 0, input,
+                                            inputLen, payload, &payloadLen);
+      ece_assert(!err, "Got %d encrypting to recipient %zu", err, j);
+    }
+    ece_recipient_destroy(recipient);
+  }
+  return NULL;
+}
+#endif
+
+void
+test_webpush_recipient_threads(void) {
+#ifdef ECE_HAVE_PTHREADS
+  uint8_t rawRecvPrivKey[ECE_WEBPUSH_PRIVATE_KEY_LENGTH];
+  uint8_t rawRecvPubKeys[2][ECE_WEBPUSH_PUBLIC_KEY_LENGTH];
+  uint8_t authSecrets[2][ECE_WEBPUSH_AUTH_SECRET_LENGTH];
+  for (size_t i = 0; i < 2; i++) {
+    int err = ece_webpush_generate_keys(
+      rawRecvPrivKey, ECE_WEBPUSH_PRIVATE_KEY_LENGTH, rawRecvPubKeys[i],
+      ECE_WEBPUSH_PUBLIC_KEY_LENGTH, authSecrets[i],
+      ECE_WEBPUSH_AUTH_SECRET_LENGTH);
+    ece_assert(!err, "Got %d generating keys", err);
+  }
+
+  ece_recipient_cache_t* cache = ece_recipient_cache_new(1);
+  ece_assert(cache, "Want recipient cache%s", "");
+  pthread_mutex_t lock;
+  int threadErr = pthread_mutex_init(&lock, NULL);
+  ece_assert(!threadErr, "Got %d creating cache lock", threadErr);
+
+  pthread_t threads[4];
+  recipient_thread_t args[4];
+  for (size_t i = 0; i < 4; i++) {
+    args[i] = (recipient_thread_t){
+      .cache = cache,
+      .lock = &lock,
+      .rawRecvPubKeys = (const uint8_t(*)[ECE_WEBPUSH_PUBLIC_KEY_LENGTH])
+        rawRecvPubKeys,
+      .authSecrets =
+        (const uint8_t(*)[ECE_WEBPUSH_AUTH_SECRET_LENGTH]) authSecrets,
+      .first = i,
+    };
+    threadErr =
+      pthread_create(&threads[i], NULL, &recipient_thread_run, &args[i]);
+    ece_assert(!threadErr, "Got %d creating thread %zu", threadErr, i);
+  }
+  for (size_t i = 0; i < 4; i++) {
+    pthread_join(threads[i], NULL);
+  }
+
+  uint64_t hits = 0;
+  uint64_t misses = 0;
+  ece_recipient_cache_stats(cache, &hits, &misses);
+  ece_assert(hits + misses == 800,
+             "Got %" PRIu64 " hits and %" PRIu64 " misses; want 800 lookups",
+             hits, misses);
+
+  pthread_mutex_destroy(&lock);
+  ece_recipient_cache_free(cache);
+#endif
+}
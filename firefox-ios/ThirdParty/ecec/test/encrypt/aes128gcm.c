@@ -370,3 +370,470 @@ test_webpush_aes128gcm_encrypt_pad(void) {
     free(payload);
   }
 }
+
+void
+test_webpush_aes128gcm_encrypt_stream(void) {
+  static const size_t chunkLens[] = {1, 3, 16, 100, SIZE_MAX};
+
+  ece_encrypt_ctx_t* ctx = ece_encrypt_ctx_new();
+  ece_assert(ctx, "Want encryption context for `%s`", "stream");
+
+  size_t tests = sizeof(webpush_aes128gcm_encrypt_ok_tests) /
+                 sizeof(webpush_aes128gcm_encrypt_ok_test_t);
+  for (size_t i = 0; i < tests; i++) {
+    webpush_aes128gcm_encrypt_ok_test_t t =
+      webpush_aes128gcm_encrypt_ok_tests[i];
+
+    for (size_t j = 0; j < sizeof(chunkLens) / sizeof(size_t); j++) {
+      int err = ece_webpush_aes128gcm_encrypt_init_with_keys(
+        ctx, (const uint8_t*) t.senderPrivKey, ECE_WEBPUSH_PRIVATE_KEY_LENGTH,
+        (const uint8_t*) t.authSecret, ECE_WEBPUSH_AUTH_SECRET_LENGTH,
+        (const uint8_t*) t.salt, ECE_SALT_LENGTH,
+        (const uint8_t*) t.recvPubKey, ECE_WEBPUSH_PUBLIC_KEY_LENGTH, t.rs,
+        t.padLen);
+      ece_assert(!err, "Got %d initializing context for `%s`", err, t.desc);
+
+      uint8_t* payload = NULL;
+      size_t payloadLen = 0;
+      err = ece_test_encrypt_stream(ctx, (const uint8_t*) t.plaintext,
+                                    t.plaintextLen, chunkLens[j], &payload,
+                                    &payloadLen);
+      ece_assert(!err, "Got %d encrypting `%s` in %zu-byte chunks", err,
+                 t.desc, chunkLens[j]);
+
+      ece_assert(payloadLen == t.payloadLen,
+                 "Got payload length %zu for `%s` in %zu-byte chunks; want %zu",
+                 payloadLen, t.desc, chunkLens[j], t.payloadLen);
+      ece_assert(!memcmp(payload, t.payload, payloadLen),
+                 "Wrong payload for `%s` in %zu-byte chunks", t.desc,
+                 chunkLens[j]);
+
+      free(payload);
+    }
+  }
+
+  // Padding that can't be spread over full records should fail when the
+  // stream is finalized, as it does for the one-shot function.
+  const void* senderPrivKey = "\xac\xae\xc1\xc3\x7c\x30\x7c\xb9\x02\x8f\xbb\xd9"
+                              "\xc7\xf3\xc6\x89\x26\x60\x08\x95\x9a\x5e\xd4\x03"
+                              "\x42\x21\xb2\xda\x72\x01\x82\x8f";
+  const void* authSecret =
+    "\x44\x29\x81\x2d\x53\x5f\xbf\xdb\xea\xc8\x6d\xb7\x14\x5c\x6a\xf2";
+  const void* salt =
+    "\x45\x2b\xfb\xea\x8c\xc7\xa7\x57\x14\xd2\x03\xcf\xf1\x02\xe8\x76";
+  const void* recvPubKey =
+    "\x04\x2d\x78\x8d\x3e\x8e\x82\xf2\xd7\xea\xef\xbd\xe3\xa1\xbe\xde\xa2\x1f"
+    "\x3b\xc9\x60\x33\x15\x73\x22\xa0\x9e\x14\x46\x55\xa3\xdf\x78\xfd\xca\xc8"
+    "\x10\xe3\x02\x2a\xb5\x6a\x0e\xa9\xb8\xec\x06\x73\x8a\xce\x41\x1f\x49\x54"
+    "\x7b\xc0\x0d\x1a\x1c\xde\x97\xce\x7b\xdd\x26";
+  const void* plaintext = "When I grow up, I want to be a watermelon";
+  size_t plaintextLen = strlen(plaintext);
+  for (uint32_t rs = ECE_AES128GCM_MIN_RS + 1; rs <= 64; rs++) {
+    size_t maxPadLen = (rs - ECE_AES128GCM_MIN_RS) * (plaintextLen + 1);
+    for (size_t padLen = maxPadLen; padLen <= maxPadLen + 1; padLen++) {
+      size_t maxPayloadLen =
+        ece_aes128gcm_payload_max_length(rs, padLen, plaintextLen);
+      uint8_t* want = calloc(maxPayloadLen, sizeof(uint8_t));
+      size_t wantLen = maxPayloadLen;
+      int wantErr = ece_webpush_aes128gcm_encrypt_with_keys(
+        senderPrivKey, ECE_WEBPUSH_PRIVATE_KEY_LENGTH, authSecret,
+        ECE_WEBPUSH_AUTH_SECRET_LENGTH, salt, ECE_SALT_LENGTH, recvPubKey,
+        ECE_WEBPUSH_PUBLIC_KEY_LENGTH, rs, padLen, plaintext, plaintextLen,
+        want, &wantLen);
+
+      int err = ece_webpush_aes128gcm_encrypt_init_with_keys(
+        ctx, senderPrivKey, ECE_WEBPUSH_PRIVATE_KEY_LENGTH, authSecret,
+        ECE_WEBPUSH_AUTH_SECRET_LENGTH, salt, ECE_SALT_LENGTH, recvPubKey,
+        ECE_WEBPUSH_PUBLIC_KEY_LENGTH, rs, padLen);
+      ece_assert(!err, "Got %d initializing context for rs = %d", err, rs);
+
+      uint8_t* payload = NULL;
+      size_t payloadLen = 0;
+      err = ece_test_encrypt_stream(ctx, plaintext, plaintextLen, 5, &payload,
+                                    &payloadLen);
+      ece_assert(err == wantErr,
+                 "Got %d encrypting with rs = %d, padLen = %zu; want %d", err,
+                 rs, padLen, wantErr);
+      if (!err) {
+        ece_assert(payloadLen == wantLen && !memcmp(payload, want, wantLen),
+                   "Wrong payload for rs = %d, padLen = %zu", rs, padLen);
+        free(payload);
+      }
+
+      free(want);
+    }
+  }
+
+  ece_encrypt_ctx_free(ctx);
+}
+
+void
+test_webpush_aes128gcm_encrypt_in_place(void) {
+  static const size_t slackLens[] = {0, 1, 64};
+
+  ece_encrypt_ctx_t* ctx = ece_encrypt_ctx_new();
+  ece_assert(ctx, "Want encryption context for `%s`", "in place");
+
+  size_t tests = sizeof(webpush_aes128gcm_encrypt_ok_tests) /
+                 sizeof(webpush_aes128gcm_encrypt_ok_test_t);
+  for (size_t i = 0; i < tests; i++) {
+    webpush_aes128gcm_encrypt_ok_test_t t =
+      webpush_aes128gcm_encrypt_ok_tests[i];
+
+    for (size_t j = 0; j < sizeof(slackLens) / sizeof(size_t); j++) {
+      int err = ece_webpush_aes128gcm_encrypt_init_with_keys(
+        ctx, (const uint8_t*) t.senderPrivKey, ECE_WEBPUSH_PRIVATE_KEY_LENGTH,
+        (const uint8_t*) t.authSecret, ECE_WEBPUSH_AUTH_SECRET_LENGTH,
+        (const uint8_t*) t.salt, ECE_SALT_LENGTH,
+        (const uint8_t*) t.recvPubKey, ECE_WEBPUSH_PUBLIC_KEY_LENGTH, t.rs,
+        t.padLen);
+      ece_assert(!err, "Got %d initializing context for `%s`", err, t.desc);
+
+      uint8_t* payload = NULL;
+      size_t payloadLen = 0;
+      err = ece_test_encrypt_in_place(ctx, (const uint8_t*) t.plaintext,
+                                      t.plaintextLen, slackLens[j], &payload,
+                                      &payloadLen);
+      ece_assert(!err, "Got %d encrypting `%s` in place", err, t.desc);
+
+      ece_assert(payloadLen == t.payloadLen,
+                 "Got payload length %zu for `%s` in place; want %zu",
+                 payloadLen, t.desc, t.payloadLen);
+      ece_assert(!memcmp(payload, t.payload, payloadLen),
+                 "Wrong payload for `%s` in place", t.desc);
+
+      free(payload);
+    }
+  }
+
+  // Sweep record sizes and padding lengths, including padding that can't be
+  // spread over full records, and compare with the one-shot function.
+  const void* senderPrivKey = "\xac\xae\xc1\xc3\x7c\x30\x7c\xb9\x02\x8f\xbb\xd9"
+                              "\xc7\xf3\xc6\x89\x26\x60\x08\x95\x9a\x5e\xd4\x03"
+                              "\x42\x21\xb2\xda\x72\x01\x82\x8f";
+  const void* authSecret =
+    "\x44\x29\x81\x2d\x53\x5f\xbf\xdb\xea\xc8\x6d\xb7\x14\x5c\x6a\xf2";
+  const void* salt =
+    "\x45\x2b\xfb\xea\x8c\xc7\xa7\x57\x14\xd2\x03\xcf\xf1\x02\xe8\x76";
+  const void* recvPubKey =
+    "\x04\x2d\x78\x8d\x3e\x8e\x82\xf2\xd7\xea\xef\xbd\xe3\xa1\xbe\xde\xa2\x1f"
+    "\x3b\xc9\x60\x33\x15\x73\x22\xa0\x9e\x14\x46\x55\xa3\xdf\x78\xfd\xca\xc8"
+    "\x10\xe3\x02\x2a\xb5\x6a\x0e\xa9\xb8\xec\x06\x73\x8a\xce\x41\x1f\x49\x54"
+    "\x7b\xc0\x0d\x1a\x1c\xde\x97\xce\x7b\xdd\x26";
+  const void* plaintext = "When I grow up, I want to be a watermelon";
+  size_t plaintextLen = strlen(plaintext);
+  for (uint32_t rs = ECE_AES128GCM_MIN_RS; rs <= 64; rs++) {
+    size_t maxPadLen = (rs - ECE_AES128GCM_MIN_RS) * (plaintextLen + 1);
+    for (size_t padLen = 0; padLen <= maxPadLen + 1; padLen += 7) {
+      size_t maxPayloadLen =
+        ece_aes128gcm_payload_max_length(rs, padLen, plaintextLen);
+      uint8_t* want = calloc(maxPayloadLen, sizeof(uint8_t));
+      size_t wantLen = maxPayloadLen;
+      int wantErr = ece_webpush_aes128gcm_encrypt_with_keys(
+        senderPrivKey, ECE_WEBPUSH_PRIVATE_KEY_LENGTH, authSecret,
+        ECE_WEBPUSH_AUTH_SECRET_LENGTH, salt, ECE_SALT_LENGTH, recvPubKey,
+        ECE_WEBPUSH_PUBLIC_KEY_LENGTH, rs, padLen, plaintext, plaintextLen,
+        want, &wantLen);
+
+      int err = ece_webpush_aes128gcm_encrypt_init_with_keys(
+        ctx, senderPrivKey, ECE_WEBPUSH_PRIVATE_KEY_LENGTH, authSecret,
+        ECE_WEBPUSH_AUTH_SECRET_LENGTH, salt, ECE_SALT_LENGTH, recvPubKey,
+        ECE_WEBPUSH_PUBLIC_KEY_LENGTH, rs, padLen);
+      ece_assert(!err, "Got %d initializing context for rs = %d", err, rs);
+
+      uint8_t* payload = NULL;
+      size_t payloadLen = 0;
+      err = ece_test_encrypt_in_place(ctx, plaintext, plaintextLen, 0,
+                                      &payload, &payloadLen);
+      ece_assert(err == wantErr,
+                 "Got %d encrypting with rs = %d, padLen = %zu; want %d", err,
+                 rs, padLen, wantErr);
+      if (!err) {
+        ece_assert(payloadLen == wantLen && !memcmp(payload, want, wantLen),
+                   "Wrong payload for rs = %d, padLen = %zu", rs, padLen);
+        free(payload);
+
+        // A buffer one byte shorter than the payload isn't large enough.
+        err = ece_webpush_aes128gcm_encrypt_init_with_keys(
+          ctx, senderPrivKey, ECE_WEBPUSH_PRIVATE_KEY_LENGTH, authSecret,
+          ECE_WEBPUSH_AUTH_SECRET_LENGTH, salt, ECE_SALT_LENGTH, recvPubKey,
+          ECE_WEBPUSH_PUBLIC_KEY_LENGTH, rs, padLen);
+        ece_assert(!err, "Got %d initializing context for rs = %d", err, rs);
+        uint8_t* buffer = malloc(wantLen - 1);
+        memcpy(&buffer[wantLen - 1 - plaintextLen], plaintext, plaintextLen);
+        err = ece_encrypt_in_place(ctx, buffer, wantLen - 1, plaintextLen,
+                                   &payloadLen);
+        ece_assert(err == ECE_ERROR_OUT_OF_MEMORY,
+                   "Got %d encrypting into short buffer with rs = %d; want %d",
+                   err, rs, ECE_ERROR_OUT_OF_MEMORY);
+        free(buffer);
+      }
+
+      free(want);
+    }
+  }
+
+  ece_encrypt_ctx_free(ctx);
+}
+
+void
+test_webpush_aes128gcm_encrypt_iov(void) {
+  static const size_t segmentLens[] = {1, 7, 16, 33, SIZE_MAX};
+  static const size_t numSegmentLens = sizeof(segmentLens) / sizeof(size_t);
+
+  ece_encrypt_ctx_t* ctx = ece_encrypt_ctx_new();
+  ece_assert(ctx, "Want encryption context for `%s`", "segments");
+
+  size_t tests = sizeof(webpush_aes128gcm_encrypt_ok_tests) /
+                 sizeof(webpush_aes128gcm_encrypt_ok_test_t);
+  for (size_t i = 0; i < tests; i++) {
+    webpush_aes128gcm_encrypt_ok_test_t t =
+      webpush_aes128gcm_encrypt_ok_tests[i];
+
+    for (size_t j = 0; j < numSegmentLens; j++) {
+      for (size_t k = 0; k < numSegmentLens; k++) {
+        int err = ece_webpush_aes128gcm_encrypt_init_with_keys(
+          ctx, (const uint8_t*) t.senderPrivKey,
+          ECE_WEBPUSH_PRIVATE_KEY_LENGTH, (const uint8_t*) t.authSecret,
+          ECE_WEBPUSH_AUTH_SECRET_LENGTH, (const uint8_t*) t.salt,
+          ECE_SALT_LENGTH, (const uint8_t*) t.recvPubKey,
+          ECE_WEBPUSH_PUBLIC_KEY_LENGTH, t.rs, t.padLen);
+        ece_assert(!err, "Got %d initializing context for `%s`", err, t.desc);
+
+        size_t plaintextCount;
+        ece_iovec_t* plaintext =
+          ece_test_iov_new((const uint8_t*) t.plaintext, t.plaintextLen,
+                           segmentLens[j], &plaintextCount);
+        size_t maxPayloadLen =
+          ece_encrypt_update_max_length(ctx, t.plaintextLen);
+        size_t payloadCount;
+        ece_iovec_t* payload = ece_test_iov_new(NULL, maxPayloadLen,
+                                                segmentLens[k], &payloadCount);
+
+        size_t payloadLen = 0;
+        err = ece_encrypt_iov(ctx, plaintext, plaintextCount, payload,
+                              payloadCount, &payloadLen);
+        ece_assert(!err, "Got %d encrypting `%s` with segments %zu, %zu", err,
+                   t.desc, segmentLens[j], segmentLens[k]);
+
+        ece_assert(payloadLen == t.payloadLen,
+                   "Got payload length %zu for `%s`; want %zu", payloadLen,
+                   t.desc, t.payloadLen);
+        uint8_t* result = malloc(payloadLen);
+        ece_test_iov_flatten(payload, payloadCount, result, payloadLen);
+        ece_assert(!memcmp(result, t.payload, payloadLen),
+                   "Wrong payload for `%s` with segments %zu, %zu", t.desc,
+                   segmentLens[j], segmentLens[k]);
+
+        free(result);
+        ece_test_iov_free(payload, payloadCount);
+        ece_test_iov_free(plaintext, plaintextCount);
+      }
+    }
+  }
+
+  ece_encrypt_ctx_free(ctx);
+}
+
+void
+test_webpush_aes128gcm_encrypt_base64url(void) {
+  static const ece_base64url_encode_policy_t policies[] = {
+    ECE_BASE64URL_OMIT_PADDING, ECE_BASE64URL_INCLUDE_PADDING};
+  static const size_t numPolicies =
+    sizeof(policies) / sizeof(ece_base64url_encode_policy_t);
+
+  ece_encrypt_ctx_t* ctx = ece_encrypt_ctx_new();
+  ece_assert(ctx, "Want encryption context for `%s`", "Base64url");
+
+  size_t tests = sizeof(webpush_aes128gcm_encrypt_ok_tests) /
+                 sizeof(webpush_aes128gcm_encrypt_ok_test_t);
+  for (size_t i = 0; i < tests; i++) {
+    webpush_aes128gcm_encrypt_ok_test_t t =
+      webpush_aes128gcm_encrypt_ok_tests[i];
+
+    for (size_t j = 0; j < numPolicies; j++) {
+      size_t expectedLen =
+        ece_base64url_encode(t.payload, t.payloadLen, policies[j], NULL, 0);
+      char* expected = malloc(expectedLen);
+      ece_base64url_encode(t.payload, t.payloadLen, policies[j], expected,
+                           expectedLen);
+
+      int err = ece_webpush_aes128gcm_encrypt_init_with_keys(
+        ctx, (const uint8_t*) t.senderPrivKey, ECE_WEBPUSH_PRIVATE_KEY_LENGTH,
+        (const uint8_t*) t.authSecret, ECE_WEBPUSH_AUTH_SECRET_LENGTH,
+        (const uint8_t*) t.salt, ECE_SALT_LENGTH,
+        (const uint8_t*) t.recvPubKey, ECE_WEBPUSH_PUBLIC_KEY_LENGTH, t.rs,
+        t.padLen);
+      ece_assert(!err, "Got %d initializing context for `%s`", err, t.desc);
+
+      size_t payloadLen =
+        ece_encrypt_base64url_length(ctx, t.plaintextLen, policies[j]);
+      ece_assert(payloadLen == expectedLen,
+                 "Got Base64url length %zu for `%s`; want %zu", payloadLen,
+                 t.desc, expectedLen);
+      size_t oneShotLen = ece_aes128gcm_payload_length_base64url(
+        t.rs, t.padLen, t.plaintextLen, policies[j]);
+      ece_assert(oneShotLen == expectedLen,
+                 "Got payload Base64url length %zu for `%s`; want %zu",
+                 oneShotLen, t.desc, expectedLen);
+
+      // A buffer one character short fails without writing anything, and
+      // poisons the context.
+      char* payload = malloc(payloadLen);
+      size_t shortLen = payloadLen - 1;
+      err = ece_encrypt_base64url(ctx, (const uint8_t*) t.plaintext,
+                                  t.plaintextLen, policies[j], payload,
+                                  &shortLen);
+      ece_assert(err == ECE_ERROR_OUT_OF_MEMORY,
+                 "Got %d encrypting `%s` into short buffer; want %d", err,
+                 t.desc, ECE_ERROR_OUT_OF_MEMORY);
+
+      err = ece_webpush_aes128gcm_encrypt_init_with_keys(
+        ctx, (const uint8_t*) t.senderPrivKey, ECE_WEBPUSH_PRIVATE_KEY_LENGTH,
+        (const uint8_t*) t.authSecret, ECE_WEBPUSH_AUTH_SECRET_LENGTH,
+        (const uint8_t*) t.salt, ECE_SALT_LENGTH,
+        (const uint8_t*) t.recvPubKey, ECE_WEBPUSH_PUBLIC_KEY_LENGTH, t.rs,
+        t.padLen);
+      ece_assert(!err, "Got %d reinitializing context for `%s`", err, t.desc);
+      err = ece_encrypt_base64url(ctx, (const uint8_t*) t.plaintext,
+                                  t.plaintextLen, policies[j], payload,
+                                  &payloadLen);
+      ece_assert(!err, "Got %d encrypting `%s` as Base64url", err, t.desc);
+      ece_assert(payloadLen == expectedLen,
+                 "Got Base64url payload length %zu for `%s`; want %zu",
+                 payloadLen, t.desc, expectedLen);
+      ece_assert(!memcmp(payload, expected, payloadLen),
+                 "Wrong Base64url payload for `%s` with policy %d", t.desc,
+                 policies[j]);
+
+      free(payload);
+      free(expected);
+    }
+  }
+
+  // Round-trip messages that span several records, with random keys and
+  // salts.
+  uint8_t rawRecvPrivKey[ECE_WEBPUSH_PRIVATE_KEY_LENGTH];
+  uint8_t rawRecvPubKey[ECE_WEBPUSH_PUBLIC_KEY_LENGTH];
+  uint8_t authSecret[ECE_WEBPUSH_AUTH_SECRET_LENGTH];
+  int err = ece_webpush_generate_keys(
+    rawRecvPrivKey, ECE_WEBPUSH_PRIVATE_KEY_LENGTH, rawRecvPubKey,
+    ECE_WEBPUSH_PUBLIC_KEY_LENGTH, authSecret, ECE_WEBPUSH_AUTH_SECRET_LENGTH);
+  ece_assert(!err, "Got %d generating keys", err);
+
+  static const size_t plaintextLens[] = {1, 2, 3, 100, 1000, 5000};
+  static const size_t numPlaintextLens = sizeof(plaintextLens) / sizeof(size_t);
+  for (size_t i = 0; i < numPlaintextLens; i++) {
+    size_t plaintextLen = plaintextLens[i];
+    uint8_t* plaintext = malloc(plaintextLen);
+    ece_assert(RAND_bytes(plaintext, (int) plaintextLen) == 1,
+               "Want %zu random plaintext bytes", plaintextLen);
+
+    for (size_t j = 0; j < numPolicies; j++) {
+      size_t payloadLen = ece_aes128gcm_payload_length_base64url(
+        100, 7, plaintextLen, policies[j]);
+      ece_assert(payloadLen, "Want payload length for plaintext length %zu",
+                 plaintextLen);
+      char* payload = malloc(payloadLen);
+      size_t actualLen = payloadLen;
+      err = ece_webpush_aes128gcm_encrypt_base64url(
+        rawRecvPubKey, ECE_WEBPUSH_PUBLIC_KEY_LENGTH, authSecret,
+        ECE_WEBPUSH_AUTH_SECRET_LENGTH, 100, 7, plaintext, plaintextLen,
+        policies[j], payload, &actualLen);
+      ece_assert(!err, "Got %d encrypting plaintext length %zu", err,
+                 plaintextLen);
+      ece_assert(actualLen == payloadLen,
+                 "Got payload length %zu for plaintext length %zu; want %zu",
+                 actualLen, plaintextLen, payloadLen);
+
+      size_t decryptedLen =
+        ece_aes128gcm_plaintext_max_length_base64url(payload, payloadLen);
+      uint8_t* decrypted = malloc(decryptedLen);
+      err = ece_webpush_aes128gcm_decrypt_base64url(
+        rawRecvPrivKey, ECE_WEBPUSH_PRIVATE_KEY_LENGTH, authSecret,
+        ECE_WEBPUSH_AUTH_SECRET_LENGTH, payload, payloadLen,
+        ECE_BASE64URL_IGNORE_PADDING, decrypted, &decryptedLen);
+      ece_assert(!err, "Got %d decrypting plaintext length %zu", err,
+                 plaintextLen);
+      ece_assert(decryptedLen == plaintextLen,
+                 "Got decrypted length %zu; want %zu", decryptedLen,
+                 plaintextLen);
+      ece_assert(!memcmp(decrypted, plaintext, plaintextLen),
+                 "Wrong decrypted plaintext for length %zu", plaintextLen);
+
+      free(decrypted);
+      free(payload);
+    }
+
+    free(plaintext);
+  }
+
+  ece_encrypt_ctx_free(ctx);
+}
+
+void
+test_webpush_aes128gcm_encrypt_large_pad(void) {
+  // Heavily padded messages, where most of each record is padding, and the
+  // decrypter must scan past it to find the delimiter.
+  static const struct {
+    uint32_t rs;
+    size_t plaintextLen;
+    size_t padLen;
+  } tests[] = {
+    {256, 3, 900},
+    {4096, 1, 8000},
+    {4096, 100, 81920},
+    {65536, 1, 131000},
+    {65536, 5000, 1000000},
+  };
+
+  uint8_t rawRecvPrivKey[ECE_WEBPUSH_PRIVATE_KEY_LENGTH];
+  uint8_t rawRecvPubKey[ECE_WEBPUSH_PUBLIC_KEY_LENGTH];
+  uint8_t authSecret[ECE_WEBPUSH_AUTH_SECRET_LENGTH];
+  int err = ece_webpush_generate_keys(
+    rawRecvPrivKey, ECE_WEBPUSH_PRIVATE_KEY_LENGTH, rawRecvPubKey,
+    ECE_WEBPUSH_PUBLIC_KEY_LENGTH, authSecret, ECE_WEBPUSH_AUTH_SECRET_LENGTH);
+  ece_assert(!err, "Got %d generating keys", err);
+
+  for (size_t i = 0; i < sizeof(tests) / sizeof(tests[0]); i++) {
+    uint32_t rs = tests[i].rs;
+    size_t plaintextLen = tests[i].plaintextLen;
+    size_t padLen = tests[i].padLen;
+
+    uint8_t* plaintext = malloc(plaintextLen);
+    int ok = RAND_bytes(plaintext, (int) plaintextLen);
+    ece_assert(ok == 1, "Got %d generating plaintext for rs = %d", ok, rs);
+
+    size_t payloadLen =
+      ece_aes128gcm_payload_max_length(rs, padLen, plaintextLen);
+    uint8_t* payload = malloc(payloadLen);
+    err = ece_webpush_aes128gcm_encrypt(
+      rawRecvPubKey, ECE_WEBPUSH_PUBLIC_KEY_LENGTH, authSecret,
+      ECE_WEBPUSH_AUTH_SECRET_LENGTH, rs, padLen, plaintext, plaintextLen,
+      payload, &payloadLen);
+    ece_assert(!err, "Got %d encrypting with rs = %d, padLen = %zu", err, rs,
+               padLen);
+    ece_assert(payloadLen > padLen,
+               "Got payload length %zu for padLen = %zu; want more",
+               payloadLen, padLen);
+
+    size_t decryptedLen =
+      ece_aes128gcm_plaintext_max_length(payload, payloadLen);
+    uint8_t* decrypted = malloc(decryptedLen);
+    err = ece_webpush_aes128gcm_decrypt(
+      rawRecvPrivKey, ECE_WEBPUSH_PRIVATE_KEY_LENGTH, authSecret,
+      ECE_WEBPUSH_AUTH_SECRET_LENGTH, payload, payloadLen, decrypted,
+      &decryptedLen);
+    ece_assert(!err, "Got %d decrypting with rs = %d, padLen = %zu", err, rs,
+               padLen);
+    ece_assert(decryptedLen == plaintextLen,
+               "Got plaintext length %zu for padLen = %zu; want %zu",
+               decryptedLen, padLen, plaintextLen);
+    ece_assert(!memcmp(decrypted, plaintext, plaintextLen),
+               "Wrong plaintext for rs = %d, padLen = %zu", rs, padLen);
+
+    free(decrypted);
+    free(payload);
+    free(plaintext);
+  }
+}
@@ -217,3 +217,321 @@ test_webpush_aesgcm_encrypt_pad(void) {
     free(ciphertext);
   }
 }
+
+void
+test_webpush_aesgcm_encrypt_stream(void) {
+  static const size_t chunkLens[] = {1, 3, 16, 100, SIZE_MAX};
+
+  ece_encrypt_ctx_t* ctx = ece_encrypt_ctx_new();
+  ece_assert(ctx, "Want encryption context for `%s`", "stream");
+
+  size_t tests = sizeof(webpush_aesgcm_encrypt_ok_tests) /
+                 sizeof(webpush_aesgcm_encrypt_ok_test_t);
+  for (size_t i = 0; i < tests; i++) {
+    webpush_aesgcm_encrypt_ok_test_t t = webpush_aesgcm_encrypt_ok_tests[i];
+
+    for (size_t j = 0; j < sizeof(chunkLens) / sizeof(size_t); j++) {
+      int err = ece_webpush_aesgcm_encrypt_init_with_keys(
+        ctx, (const uint8_t*) t.senderPrivKey, ECE_WEBPUSH_PRIVATE_KEY_LENGTH,
+        (const uint8_t*) t.authSecret, ECE_WEBPUSH_AUTH_SECRET_LENGTH,
+        (const uint8_t*) t.salt, ECE_SALT_LENGTH,
+        (const uint8_t*) t.recvPubKey, ECE_WEBPUSH_PUBLIC_KEY_LENGTH, t.rs,
+        t.padLen);
+      ece_assert(!err, "Got %d initializing context for `%s`", err, t.desc);
+
+      uint8_t* ciphertext = NULL;
+      size_t ciphertextLen = 0;
+      err = ece_test_encrypt_stream(ctx, (const uint8_t*) t.plaintext,
+                                    t.plaintextLen, chunkLens[j], &ciphertext,
+                                    &ciphertextLen);
+      ece_assert(!err, "Got %d encrypting `%s` in %zu-byte chunks", err,
+                 t.desc, chunkLens[j]);
+
+      ece_assert(
+        ciphertextLen == t.ciphertextLen,
+        "Got ciphertext length %zu for `%s` in %zu-byte chunks; want %zu",
+        ciphertextLen, t.desc, chunkLens[j], t.ciphertextLen);
+      ece_assert(!memcmp(ciphertext, t.ciphertext, ciphertextLen),
+                 "Wrong ciphertext for `%s` in %zu-byte chunks", t.desc,
+                 chunkLens[j]);
+
+      free(ciphertext);
+    }
+  }
+
+  // Exact multiples of the record size need a padding-only trailer record.
+  const void* senderPrivKey = "\xac\xae\xc1\xc3\x7c\x30\x7c\xb9\x02\x8f\xbb\xd9"
+                              "\xc7\xf3\xc6\x89\x26\x60\x08\x95\x9a\x5e\xd4\x03"
+                              "\x42\x21\xb2\xda\x72\x01\x82\x8f";
+  const void* authSecret =
+    "\x44\x29\x81\x2d\x53\x5f\xbf\xdb\xea\xc8\x6d\xb7\x14\x5c\x6a\xf2";
+  const void* salt =
+    "\x45\x2b\xfb\xea\x8c\xc7\xa7\x57\x14\xd2\x03\xcf\xf1\x02\xe8\x76";
+  const void* recvPubKey =
+    "\x04\x2d\x78\x8d\x3e\x8e\x82\xf2\xd7\xea\xef\xbd\xe3\xa1\xbe\xde\xa2\x1f"
+    "\x3b\xc9\x60\x33\x15\x73\x22\xa0\x9e\x14\x46\x55\xa3\xdf\x78\xfd\xca\xc8"
+    "\x10\xe3\x02\x2a\xb5\x6a\x0e\xa9\xb8\xec\x06\x73\x8a\xce\x41\x1f\x49\x54"
+    "\x7b\xc0\x0d\x1a\x1c\xde\x97\xce\x7b\xdd\x26";
+  const void* plaintext = "When I grow up, I want to be a watermelon";
+  size_t plaintextLen = strlen(plaintext);
+  for (uint32_t rs = ECE_AESGCM_MIN_RS + 1; rs <= 64; rs++) {
+    for (size_t padLen = 0; padLen <= 4; padLen++) {
+      size_t maxCiphertextLen =
+        ece_aesgcm_ciphertext_max_length(rs, padLen, plaintextLen);
+      uint8_t* want = calloc(maxCiphertextLen, sizeof(uint8_t));
+      size_t wantLen = maxCiphertextLen;
+      int wantErr = ece_webpush_aesgcm_encrypt_with_keys(
+        senderPrivKey, ECE_WEBPUSH_PRIVATE_KEY_LENGTH, authSecret,
+        ECE_WEBPUSH_AUTH_SECRET_LENGTH, salt, ECE_SALT_LENGTH, recvPubKey,
+        ECE_WEBPUSH_PUBLIC_KEY_LENGTH, rs, padLen, plaintext, plaintextLen,
+        want, &wantLen);
+
+      int err = ece_webpush_aesgcm_encrypt_init_with_keys(
+        ctx, senderPrivKey, ECE_WEBPUSH_PRIVATE_KEY_LENGTH, authSecret,
+        ECE_WEBPUSH_AUTH_SECRET_LENGTH, salt, ECE_SALT_LENGTH, recvPubKey,
+        ECE_WEBPUSH_PUBLIC_KEY_LENGTH, rs, padLen);
+      ece_assert(!err, "Got %d initializing context for rs = %d", err, rs);
+
+      uint8_t* ciphertext = NULL;
+      size_t ciphertextLen = 0;
+      err = ece_test_encrypt_stream(ctx, plaintext, plaintextLen, 5,
+                                    &ciphertext, &ciphertextLen);
+      ece_assert(err == wantErr,
+                 "Got %d encrypting with rs = %d, padLen = %zu; want %d", err,
+                 rs, padLen, wantErr);
+      if (!err) {
+        ece_assert(ciphertextLen == wantLen &&
+                     !memcmp(ciphertext, want, wantLen),
+                   "Wrong ciphertext for rs = %d, padLen = %zu", rs, padLen);
+        free(ciphertext);
+      }
+
+      free(want);
+    }
+  }
+
+  ece_encrypt_ctx_free(ctx);
+}
+
+void
+test_webpush_aesgcm_encrypt_in_place(void) {
+  static const size_t slackLens[] = {0, 1, 64};
+
+  ece_encrypt_ctx_t* ctx = ece_encrypt_ctx_new();
+  ece_assert(ctx, "Want encryption context for `%s`", "in place");
+
+  size_t tests = sizeof(webpush_aesgcm_encrypt_ok_tests) /
+                 sizeof(webpush_aesgcm_encrypt_ok_test_t);
+  for (size_t i = 0; i < tests; i++) {
+    webpush_aesgcm_encrypt_ok_test_t t = webpush_aesgcm_encrypt_ok_tests[i];
+
+    for (size_t j = 0; j < sizeof(slackLens) / sizeof(size_t); j++) {
+      int err = ece_webpush_aesgcm_encrypt_init_with_keys(
+        ctx, (const uint8_t*) t.senderPrivKey, ECE_WEBPUSH_PRIVATE_KEY_LENGTH,
+        (const uint8_t*) t.authSecret, ECE_WEBPUSH_AUTH_SECRET_LENGTH,
+        (const uint8_t*) t.salt, ECE_SALT_LENGTH,
+        (const uint8_t*) t.recvPubKey, ECE_WEBPUSH_PUBLIC_KEY_LENGTH, t.rs,
+        t.padLen);
+      ece_assert(!err, "Got %d initializing context for `%s`", err, t.desc);
+
+      uint8_t* ciphertext = NULL;
+      size_t ciphertextLen = 0;
+      err = ece_test_encrypt_in_place(ctx, (const uint8_t*) t.plaintext,
+                                      t.plaintextLen, slackLens[j],
+                                      &ciphertext, &ciphertextLen);
+      ece_assert(!err, "Got %d encrypting `%s` in place", err, t.desc);
+
+      ece_assert(ciphertextLen == t.ciphertextLen,
+                 "Got ciphertext length %zu for `%s` in place; want %zu",
+                 ciphertextLen, t.desc, t.ciphertextLen);
+      ece_assert(!memcmp(ciphertext, t.ciphertext, ciphertextLen),
+                 "Wrong ciphertext for `%s` in place", t.desc);
+
+      free(ciphertext);
+    }
+  }
+
+  // Exact multiples of the record size need a padding-only trailer record.
+  const void* senderPrivKey = "\xac\xae\xc1\xc3\x7c\x30\x7c\xb9\x02\x8f\xbb\xd9"
+                              "\xc7\xf3\xc6\x89\x26\x60\x08\x95\x9a\x5e\xd4\x03"
+                              "\x42\x21\xb2\xda\x72\x01\x82\x8f";
+  const void* authSecret =
+    "\x44\x29\x81\x2d\x53\x5f\xbf\xdb\xea\xc8\x6d\xb7\x14\x5c\x6a\xf2";
+  const void* salt =
+    "\x45\x2b\xfb\xea\x8c\xc7\xa7\x57\x14\xd2\x03\xcf\xf1\x02\xe8\x76";
+  const void* recvPubKey =
+    "\x04\x2d\x78\x8d\x3e\x8e\x82\xf2\xd7\xea\xef\xbd\xe3\xa1\xbe\xde\xa2\x1f"
+    "\x3b\xc9\x60\x33\x15\x73\x22\xa0\x9e\x14\x46\x55\xa3\xdf\x78\xfd\xca\xc8"
+    "\x10\xe3\x02\x2a\xb5\x6a\x0e\xa9\xb8\xec\x06\x73\x8a\xce\x41\x1f\x49\x54"
+    "\x7b\xc0\x0d\x1a\x1c\xde\x97\xce\x7b\xdd\x26";
+  const void* plaintext = "When I grow up, I want to be a watermelon";
+  size_t plaintextLen = strlen(plaintext);
+  for (uint32_t rs = ECE_AESGCM_MIN_RS; rs <= 64; rs++) {
+    for (size_t padLen = 0; padLen <= 40; padLen += 5) {
+      size_t maxCiphertextLen =
+        ece_aesgcm_ciphertext_max_length(rs, padLen, plaintextLen);
+      uint8_t* want = calloc(maxCiphertextLen, sizeof(uint8_t));
+      size_t wantLen = maxCiphertextLen;
+      int wantErr = ece_webpush_aesgcm_encrypt_with_keys(
+        senderPrivKey, ECE_WEBPUSH_PRIVATE_KEY_LENGTH, authSecret,
+        ECE_WEBPUSH_AUTH_SECRET_LENGTH, salt, ECE_SALT_LENGTH, recvPubKey,
+        ECE_WEBPUSH_PUBLIC_KEY_LENGTH, rs, padLen, plaintext, plaintextLen,
+        want, &wantLen);
+
+      int err = ece_webpush_aesgcm_encrypt_init_with_keys(
+        ctx, senderPrivKey, ECE_WEBPUSH_PRIVATE_KEY_LENGTH, authSecret,
+        ECE_WEBPUSH_AUTH_SECRET_LENGTH, salt, ECE_SALT_LENGTH, recvPubKey,
+        ECE_WEBPUSH_PUBLIC_KEY_LENGTH, rs, padLen);
+      ece_assert(!err, "Got %d initializing context for rs = %d", err, rs);
+
+      uint8_t* ciphertext = NULL;
+      size_t ciphertextLen = 0;
+      err = ece_test_encrypt_in_place(ctx, plaintext, plaintextLen, 0,
+                                      &ciphertext, &ciphertextLen);
+      ece_assert(err == wantErr,
+                 "Got %d encrypting with rs = %d, padLen = %zu; want %d", err,
+                 rs, padLen, wantErr);
+      if (!err) {
+        ece_assert(ciphertextLen == wantLen &&
+                     !memcmp(ciphertext, want, wantLen),
+                   "Wrong ciphertext for rs = %d, padLen = %zu", rs, padLen);
+        free(ciphertext);
+      }
+
+      free(want);
+    }
+  }
+
+  ece_encrypt_ctx_free(ctx);
+}
+
+void
+test_webpush_aesgcm_encrypt_iov(void) {
+  static const size_t segmentLens[] = {1, 7, 16, 33, SIZE_MAX};
+  static const size_t numSegmentLens = sizeof(segmentLens) / sizeof(size_t);
+
+  ece_encrypt_ctx_t* ctx = ece_encrypt_ctx_new();
+  ece_assert(ctx, "Want encryption context for `%s`", "segments");
+
+  size_t tests = sizeof(webpush_aesgcm_encrypt_ok_tests) /
+                 sizeof(webpush_aesgcm_encrypt_ok_test_t);
+  for (size_t i = 0; i < tests; i++) {
+    webpush_aesgcm_encrypt_ok_test_t t = webpush_aesgcm_encrypt_ok_tests[i];
+
+    for (size_t j = 0; j < numSegmentLens; j++) {
+      for (size_t k = 0; k < numSegmentLens; k++) {
+        int err = ece_webpush_aesgcm_encrypt_init_with_keys(
+          ctx, (const uint8_t*) t.senderPrivKey,
+          ECE_WEBPUSH_PRIVATE_KEY_LENGTH, (const uint8_t*) t.authSecret,
+          ECE_WEBPUSH_AUTH_SECRET_LENGTH, (const uint8_t*) t.salt,
+          ECE_SALT_LENGTH, (const uint8_t*) t.recvPubKey,
+          ECE_WEBPUSH_PUBLIC_KEY_LENGTH, t.rs, t.padLen);
+        ece_assert(!err, "Got %d initializing context for `%s`", err, t.desc);
+
+        size_t plaintextCount;
+        ece_iovec_t* plaintext =
+          ece_test_iov_new((const uint8_t*) t.plaintext, t.plaintextLen,
+                           segmentLens[j], &plaintextCount);
+        size_t maxCiphertextLen =
+          ece_encrypt_update_max_length(ctx, t.plaintextLen);
+        size_t ciphertextCount;
+        ece_iovec_t* ciphertext =
+          ece_test_iov_new(NULL, maxCiphertextLen, segmentLens[k],
+                           &ciphertextCount);
+
+        size_t ciphertextLen = 0;
+        err = ece_encrypt_iov(ctx, plaintext, plaintextCount, ciphertext,
+                              ciphertextCount, &ciphertextLen);
+        ece_assert(!err, "Got %d encrypting `%s` with segments %zu, %zu", err,
+                   t.desc, segmentLens[j], segmentLens[k]);
+
+        ece_assert(ciphertextLen == t.ciphertextLen,
+                   "Got ciphertext length %zu for `%s`; want %zu",
+                   ciphertextLen, t.desc, t.ciphertextLen);
+        uint8_t* result = malloc(ciphertextLen);
+        ece_test_iov_flatten(ciphertext, ciphertextCount, result,
+                             ciphertextLen);
+        ece_assert(!memcmp(result, t.ciphertext, ciphertextLen),
+                   "Wrong ciphertext for `%s` with segments %zu, %zu", t.desc,
+                   segmentLens[j], segmentLens[k]);
+
+        free(result);
+        ece_test_iov_free(ciphertext, ciphertextCount);
+        ece_test_iov_free(plaintext, plaintextCount);
+      }
+    }
+  }
+
+  ece_encrypt_ctx_free(ctx);
+}
+
+void
+test_webpush_aesgcm_encrypt_large_pad(void) {
+  // Heavily padded messages, where the decrypter must check that long runs of
+  // padding are all zeros.
+  static const struct {
+    uint32_t rs;
+    size_t plaintextLen;
+    size_t padLen;
+  } tests[] = {
+    {256, 3, 700},
+    {4096, 1, 4000},
+    {4096, 100, 40000},
+    {65536, 1, 65000},
+    {65536, 5000, 300000},
+  };
+
+  uint8_t rawRecvPrivKey[ECE_WEBPUSH_PRIVATE_KEY_LENGTH];
+  uint8_t rawRecvPubKey[ECE_WEBPUSH_PUBLIC_KEY_LENGTH];
+  uint8_t authSecret[ECE_WEBPUSH_AUTH_SECRET_LENGTH];
+  int err = ece_webpush_generate_keys(
+    rawRecvPrivKey, ECE_WEBPUSH_PRIVATE_KEY_LENGTH, rawRecvPubKey,
+    ECE_WEBPUSH_PUBLIC_KEY_LENGTH, authSecret, ECE_WEBPUSH_AUTH_SECRET_LENGTH);
+  ece_assert(!err, "Got %d generating keys", err);
+
+  for (size_t i = 0; i < sizeof(tests) / sizeof(tests[0]); i++) {
+    uint32_t rs = tests[i].rs;
+    size_t plaintextLen = tests[i].plaintextLen;
+    size_t padLen = tests[i].padLen;
+
+    uint8_t* plaintext = malloc(plaintextLen);
+    int ok = RAND_bytes(plaintext, (int) plaintextLen);
+    ece_assert(ok == 1, "Got %d generating plaintext for rs = %d", ok, rs);
+
+    size_t ciphertextLen =
+      ece_aesgcm_ciphertext_max_length(rs, padLen, plaintextLen);
+    uint8_t* ciphertext = malloc(ciphertextLen);
+    uint8_t salt[ECE_SALT_LENGTH];
+    uint8_t rawSenderPubKey[ECE_WEBPUSH_PUBLIC_KEY_LENGTH];
+    err = ece_webpush_aesgcm_encrypt(
+      rawRecvPubKey, ECE_WEBPUSH_PUBLIC_KEY_LENGTH, authSecret,
+      ECE_WEBPUSH_AUTH_SECRET_LENGTH, rs, padLen, plaintext, plaintextLen,
+      salt, ECE_SALT_LENGTH, rawSenderPubKey, ECE_WEBPUSH_PUBLIC_KEY_LENGTH,
+      ciphertext, &ciphertextLen);
+    ece_assert(!err, "Got %d encrypting with rs = %d, padLen = %zu", err, rs,
+               padLen);
+    ece_assert(ciphertextLen > padLen,
+               "Got ciphertext length %zu for padLen = %zu; want more",
+               ciphertextLen, padLen);
+
+    size_t decryptedLen =
+      ece_aesgcm_plaintext_max_length(rs, ciphertextLen);
+    uint8_t* decrypted = malloc(decryptedLen);
+    err = ece_webpush_aesgcm_decrypt(
+      rawRecvPrivKey, ECE_WEBPUSH_PRIVATE_KEY_LENGTH, authSecret,
+      ECE_WEBPUSH_AUTH_SECRET_LENGTH, salt, ECE_SALT_LENGTH, rawSenderPubKey,
+      ECE_WEBPUSH_PUBLIC_KEY_LENGTH, rs, ciphertext, ciphertextLen, decrypted,
+      &decryptedLen);
+    ece_assert(!err, "Got %d decrypting with rs = %d, padLen = %zu", err, rs,
+               padLen);
+    ece_assert(decryptedLen == plaintextLen,
+               "Got plaintext length %zu for padLen = %zu; want %zu",
+               decryptedLen, padLen, plaintextLen);
+    ece_assert(!memcmp(decrypted, plaintext, plaintextLen),
+               "Wrong plaintext for rs = %d, padLen = %zu", rs, padLen);
+
+    free(decrypted);
+    free(ciphertext);
+    free(plaintext);
+  }
+}
@@ -0,0 +1,339 @@
+#include "test.h"
+
+#include <stdbool.h>
+#include <string.h>
+
+#include <ece/gcm.h>
+
+#include <openssl/evp.h>
+
+// The number of records in each randomized batch. This isn't a multiple of
+// `ECE_GCM_LANES`, so the last group of lanes is only partly filled.
+#define ECE_TEST_GCM_JOBS 11
+
+typedef struct gcm_vector_test_s {
+  const char* desc;
+  const char* key;
+  const char* iv;
+  const char* plaintext;
+  size_t plaintextLen;
+  // The ciphertext, followed by the tag.
+  const char* record;
+} gcm_vector_test_t;
+
+// Test vectors from "The Galois/Counter Mode of Operation (GCM)", by McGrew and
+// Viega. The records have no additional data.
+static gcm_vector_test_t gcm_vector_tests[] = {
+  {
+    .desc = "Test case 2",
+    .key = "\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00",
+    .iv = "\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00",
+    .plaintext =
+      "\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00",
+    .plaintextLen = 16,
+    .record =
+      "\x03\x88\xda\xce\x60\xb6\xa3\x92\xf3\x28\xc2\xb9\x71\xb2\xfe\x78"
+      "\xab\x6e\x47\xd4\x2c\xec\x13\xbd\xf5\x3a\x67\xb2\x12\x57\xbd\xdf",
+  },
+  {
+    .desc = "Test case 3",
+    .key = "\xfe\xff\xe9\x92\x86\x65\x73\x1c\x6d\x6a\x8f\x94\x67\x30\x83\x08",
+    .iv = "\xca\xfe\xba\xbe\xfa\xce\xdb\xad\xde\xca\xf8\x88",
+    .plaintext =
+      "\xd9\x31\x32\x25\xf8\x84\x06\xe5\xa5\x59\x09\xc5\xaf\xf5\x26\x9a"
+      "\x86\xa7\xa9\x53\x15\x34\xf7\xda\x2e\x4c\x30\x3d\x8a\x31\x8a\x72"
+      "\x1c\x3c\x0c\x95\x95\x68\x09\x53\x2f\xcf\x0e\x24\x49\xa6\xb5\x25"
+      "\xb1\x6a\xed\xf5\xaa\x0d\xe6\x57\xba\x63\x7b\x39\x1a\xaf\xd2\x55",
+    .plaintextLen = 64,
+    .record =
+      "\x42\x83\x1e\xc2\x21\x77\x74\x24\x4b\x72\x21\xb7\x84\xd0\xd4\x9c"
+      "\xe3\xaa\x21\x2f\x2c\x02\xa4\xe0\x35\xc1\x7e\x23\x29\xac\xa1\x2e"
+      "\x21\xd5\x14\xb2\x54\x66\x93\x1c\x7d\x8f\x6a\x5a\xac\x84\xaa\x05"
+      "\x1b\xa3\x0b\x39\x6a\x0a\xac\x97\x3d\x58\xe0\x91\x47\x3f\x59\x85"
+      "\x4d\x5c\x2a\xf3\x27\xcd\x64\xa6\x2c\xf3\x5a\xbd\x2b\xa6\xfa\xb4",
+  },
+};
+
+static const ece_gcm_impl_t gcm_impls[] = {
+  ECE_GCM_IMPL_PORTABLE,
+  ECE_GCM_IMPL_CLMUL,
+};
+
+static const char*
+gcm_impl_name(ece_gcm_impl_t impl) {
+  return impl == ECE_GCM_IMPL_CLMUL ? "clmul" : "portable";
+}
+
+// A small deterministic generator, so that failures are reproducible.
+static uint32_t
+gcm_random(uint32_t* state) {
+  uint32_t x = *state;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  *state = x;
+  return x;
+}
+
+static void
+gcm_random_bytes(uint32_t* state, uint8_t* bytes, size_t len) {
+  for (size_t i = 0; i < len; i++) {
+    bytes[i] = (uint8_t) gcm_random(state);
+  }
+}
+
+// Encrypts a record with OpenSSL directly, as a reference for the kernels.
+static void
+gcm_reference_seal(const uint8_t* key, const uint8_t* iv,
+                   const uint8_t* block, size_t blockLen, uint8_t* record) {
+  EVP_CIPHER_CTX* ctx = EVP_CIPHER_CTX_new();
+  ece_assert(ctx, "Want cipher context for %zu-byte block", blockLen);
+  int chunkLen = 0;
+  ece_assert(EVP_EncryptInit_ex(ctx, EVP_aes_128_gcm(), NULL, key, iv) == 1 &&
+               EVP_EncryptUpdate(ctx, record, &chunkLen, block,
+                                 (int) blockLen) == 1 &&
+               EVP_EncryptFinal_ex(ctx, NULL, &chunkLen) == 1 &&
+               EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_GCM_GET_TAG, ECE_TAG_LENGTH,
+                                   &record[blockLen]) == 1,
+             "Failed to encrypt %zu-byte reference block", blockLen);
+  EVP_CIPHER_CTX_free(ctx);
+}
+
+void
+test_gcm_vectors(void) {
+  size_t tests = sizeof(gcm_vector_tests) / sizeof(gcm_vector_test_t);
+  for (size_t i = 0; i < sizeof(gcm_impls) / sizeof(ece_gcm_impl_t); i++) {
+    ece_gcm_impl_t impl = gcm_impls[i];
+    if (!ece_gcm_impl_supported(impl)) {
+      continue;
+    }
+    for (size_t j = 0; j < tests; j++) {
+      gcm_vector_test_t t = gcm_vector_tests[j];
+      size_t recordLen = t.plaintextLen + ECE_TAG_LENGTH;
+
+      uint8_t record[128];
+      ece_gcm_job_t job = {
+        .key = (const uint8_t*) t.key,
+        .in = (const uint8_t*) t.plaintext,
+        .inLen = t.plaintextLen,
+        .out = record,
+      };
+      memcpy(job.iv, t.iv, ECE_NONCE_LENGTH);
+      ece_gcm_seal_impl(impl, &job, 1);
+      ece_assert(!job.err, "Got %d encrypting `%s` with %s kernel", job.err,
+                 t.desc, gcm_impl_name(impl));
+      ece_assert(!memcmp(record, t.record, recordLen),
+                 "Wrong record for `%s` with %s kernel", t.desc,
+                 gcm_impl_name(impl));
+
+      uint8_t plaintext[128];
+      job.in = (const uint8_t*) t.record;
+      job.inLen = recordLen;
+      job.out = plaintext;
+      ece_gcm_open_impl(impl, &job, 1);
+      ece_assert(!job.err, "Got %d decrypting `%s` with %s kernel", job.err,
+                 t.desc, gcm_impl_name(impl));
+      ece_assert(!memcmp(plaintext, t.plaintext, t.plaintextLen),
+                 "Wrong plaintext for `%s` with %s kernel", t.desc,
+                 gcm_impl_name(impl));
+    }
+  }
+}
+
+void
+test_gcm_equivalence(void) {
+  uint32_t state = 0x9e3779b9;
+  uint8_t keys[ECE_TEST_GCM_JOBS][ECE_AES_KEY_LENGTH];
+  uint8_t* blocks[ECE_TEST_GCM_JOBS];
+  uint8_t* want[ECE_TEST_GCM_JOBS];
+  uint8_t* records[ECE_TEST_GCM_JOBS];
+  uint8_t* plaintexts[ECE_TEST_GCM_JOBS];
+  size_t blockLens[ECE_TEST_GCM_JOBS];
+  ece_gcm_job_t jobs[ECE_TEST_GCM_JOBS];
+
+  for (int round = 0; round < 200; round++) {
+    // Mix short records, which share a key with the previous record half the
+    // time, with some longer ones.
+    for (size_t i = 0; i < ECE_TEST_GCM_JOBS; i++) {
+      blockLens[i] = gcm_random(&state) % (round < 150 ? 100 : 5000);
+      if (i && gcm_random(&state) % 2) {
+        memcpy(keys[i], keys[i - 1], ECE_AES_KEY_LENGTH);
+      } else {
+        gcm_random_bytes(&state, keys[i], ECE_AES_KEY_LENGTH);
+      }
+      memset(&jobs[i], 0, sizeof(ece_gcm_job_t));
+      gcm_random_bytes(&state, jobs[i].iv, ECE_NONCE_LENGTH);
+      blocks[i] = malloc(blockLens[i] + 1);
+      want[i] = malloc(blockLens[i] + ECE_TAG_LENGTH);
+      records[i] = malloc(blockLens[i] + ECE_TAG_LENGTH);
+      plaintexts[i] = malloc(blockLens[i] + 1);
+      ece_assert(blocks[i] && want[i] && records[i] && plaintexts[i],
+                 "Want buffers for %zu-byte block", blockLens[i]);
+      gcm_random_bytes(&state, blocks[i], blockLens[i]);
+      gcm_reference_seal(keys[i], jobs[i].iv, blocks[i], blockLens[i],
+                         want[i]);
+    }
+
+    for (size_t i = 0; i < sizeof(gcm_impls) / sizeof(ece_gcm_impl_t); i++) {
+      ece_gcm_impl_t impl = gcm_impls[i];
+      if (!ece_gcm_impl_supported(impl)) {
+        continue;
+      }
+      for (size_t j = 0; j < ECE_TEST_GCM_JOBS; j++) {
+        jobs[j].key = keys[j];
+        jobs[j].in = blocks[j];
+        jobs[j].inLen = blockLens[j];
+        jobs[j].out = records[j];
+      }
+      ece_gcm_seal_impl(impl, jobs, ECE_TEST_GCM_JOBS);
+      for (size_t j = 0; j < ECE_TEST_GCM_JOBS; j++) {
+        ece_assert(!jobs[j].err, "Got %d encrypting %zu bytes with %s kernel",
+                   jobs[j].err, blockLens[j], gcm_impl_name(impl));
+        ece_assert(!memcmp(records[j], want[j], blockLens[j] + ECE_TAG_LENGTH),
+                   "Wrong record for %zu bytes with %s kernel", blockLens[j],
+                   gcm_impl_name(impl));
+      }
+
+      // Corrupt one record, and decrypt the rest in place.
+      size_t corrupt = gcm_random(&state) % ECE_TEST_GCM_JOBS;
+      records[corrupt][gcm_random(&state) %
+                       (blockLens[corrupt] + ECE_TAG_LENGTH)] ^= 0x80;
+      for (size_t j = 0; j < ECE_TEST_GCM_JOBS; j++) {
+        jobs[j].in = records[j];
+        jobs[j].inLen = blockLens[j] + ECE_TAG_LENGTH;
+        jobs[j].out = j % 2 ? records[j] : plaintexts[j];
+      }
+      ece_gcm_open_impl(impl, jobs, ECE_TEST_GCM_JOBS);
+      for (size_t j = 0; j < ECE_TEST_GCM_JOBS; j++) {
+        int wantErr = ECE_OK;
+        if (!blockLens[j]) {
+          wantErr = ECE_ERROR_SHORT_BLOCK;
+        } else if (j == corrupt) {
+          wantErr = ECE_ERROR_DECRYPT;
+        }
+        ece_assert(jobs[j].err == wantErr,
+                   "Got %d decrypting %zu bytes with %s kernel; want %d",
+                   jobs[j].err, blockLens[j], gcm_impl_name(impl), wantErr);
+        if (wantErr) {
+          continue;
+        }
+        ece_assert(!memcmp(jobs[j].out, blocks[j], blockLens[j]),
+                   "Wrong plaintext for %zu bytes with %s kernel",
+                   blockLens[j], gcm_impl_name(impl));
+      }
+    }
+
+    for (size_t i = 0; i < ECE_TEST_GCM_JOBS; i++) {
+      free(blocks[i]);
+      free(want[i]);
+      free(records[i]);
+      free(plaintexts[i]);
+    }
+  }
+
+  // Records that are too short to hold a tag fail without being decrypted.
+  uint8_t key[ECE_AES_KEY_LENGTH] = {0};
+  uint8_t record[ECE_TAG_LENGTH] = {0};
+  uint8_t plaintext[1];
+  for (size_t i = 0; i < sizeof(gcm_impls) / sizeof(ece_gcm_impl_t); i++) {
+    ece_gcm_impl_t impl = gcm_impls[i];
+    if (!ece_gcm_impl_supported(impl)) {
+      continue;
+    }
+    for (size_t len = 0; len <= ECE_TAG_LENGTH; len++) {
+      ece_gcm_job_t job = {
+        .key = key,
+        .in = record,
+        .inLen = len,
+        .out = plaintext,
+      };
+      ece_gcm_open_impl(impl, &job, 1);
+      int wantErr =
+        len < ECE_TAG_LENGTH ? ECE_ERROR_DECRYPT : ECE_ERROR_SHORT_BLOCK;
+      ece_assert(job.err == wantErr,
+                 "Got %d decrypting %zu-byte record with %s kernel; want %d",
+                 job.err, len, gcm_impl_name(impl), wantErr);
+    }
+  }
+}
+
+void
+test_webpush_aes128gcm_decrypt_batch_lanes(void) {
+  // Enough messages to fill the kernel's queue several times, with single- and
+  // multi-record messages, and one long message that's decrypted on its own.
+  static const size_t count = 150;
+
+  uint8_t rawRecvPrivKey[ECE_WEBPUSH_PRIVATE_KEY_LENGTH];
+  uint8_t rawRecvPubKey[ECE_WEBPUSH_PUBLIC_KEY_LENGTH];
+  uint8_t authSecret[ECE_WEBPUSH_AUTH_SECRET_LENGTH];
+  int err = ece_webpush_generate_keys(
+    rawRecvPrivKey, ECE_WEBPUSH_PRIVATE_KEY_LENGTH, rawRecvPubKey,
+    ECE_WEBPUSH_PUBLIC_KEY_LENGTH, authSecret, ECE_WEBPUSH_AUTH_SECRET_LENGTH);
+  ece_assert(!err, "Got %d generating keys", err);
+
+  uint32_t state = 0x2545f491;
+  uint8_t** inputs = calloc(count, sizeof(uint8_t*));
+  size_t* inputLens = calloc(count, sizeof(size_t));
+  uint8_t** payloads = calloc(count, sizeof(uint8_t*));
+  size_t* payloadLens = calloc(count, sizeof(size_t));
+  uint8_t** plaintexts = calloc(count, sizeof(uint8_t*));
+  size_t* plaintextLens = calloc(count, sizeof(size_t));
+  int* errs = calloc(count, sizeof(int));
+  ece_assert(inputs && inputLens && payloads && payloadLens && plaintexts &&
+               plaintextLens && errs,
+             "Want buffers for %zu messages", count);
+
+  for (size_t i = 0; i < count; i++) {
+    uint32_t rs = i % 3 ? 4096 : 40;
+    inputLens[i] = i == count / 2 ? 4000 : 1 + gcm_random(&state) % 200;
+    inputs[i] = malloc(inputLens[i]);
+    ece_assert(inputs[i], "Want plaintext for message %zu", i);
+    gcm_random_bytes(&state, inputs[i], inputLens[i]);
+
+    payloadLens[i] = ece_aes128gcm_payload_max_length(rs, 0, inputLens[i]);
+    payloads[i] = malloc(payloadLens[i]);
+    ece_assert(payloads[i], "Want payload for message %zu", i);
+    err = ece_webpush_aes128gcm_encrypt(
+      rawRecvPubKey, ECE_WEBPUSH_PUBLIC_KEY_LENGTH, authSecret,
+      ECE_WEBPUSH_AUTH_SECRET_LENGTH, rs, 0, inputs[i], inputLens[i],
+      payloads[i], &payloadLens[i]);
+    ece_assert(!err, "Got %d encrypting message %zu", err, i);
+    if (i % 7 == 3) {
+      // Corrupt the last byte of the tag.
+      payloads[i][payloadLens[i] - 1] ^= 1;
+    }
+
+    plaintextLens[i] =
+      ece_aes128gcm_plaintext_max_length(payloads[i], payloadLens[i]);
+    plaintexts[i] = malloc(plaintextLens[i]);
+    ece_assert(plaintexts[i], "Want plaintext buffer for message %zu", i);
+  }
+
+  err = ece_webpush_aes128gcm_decrypt_batch(
+    rawRecvPrivKey, ECE_WEBPUSH_PRIVATE_KEY_LENGTH, authSecret,
+    ECE_WEBPUSH_AUTH_SECRET_LENGTH, count, (const uint8_t* const*) payloads,
+    payloadLens, plaintexts, plaintextLens, errs);
+  ece_assert(err == ECE_ERROR_DECRYPT, "Got %d decrypting batch; want %d", err,
+             ECE_ERROR_DECRYPT);
+  for (size_t i = 0; i < count; i++) {
+    int wantErr = i % 7 == 3 ? ECE_ERROR_DECRYPT : ECE_OK;
+    ece_assert(errs[i] == wantErr, "Got %d decrypting message %zu; want %d",
+               errs[i], i, wantErr);
+    if (!wantErr) {
+      ece_assert(plaintextLens[i] == inputLens[i] &&
+                   !memcmp(plaintexts[i], inputs[i], inputLens[i]),
+                 "Wrong plaintext for message %zu", i);
+    }
+    free(inputs[i]);
+    free(payloads[i]);
+    free(plaintexts[i]);
+  }
+
+  free(inputs);
+  free(inputLens);
+  free(payloads);
+  free(payloadLens);
+  free(plaintexts);
+  free(plaintextLens);
+  free(errs);
+}
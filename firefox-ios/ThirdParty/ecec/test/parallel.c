@@ -0,0 +1,352 @@
+#include "test.h"
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <string.h>
+
+// The number of workers used by the parallel tests. This is more than the
+// number of records in some tests, and fewer in others.
+#define ECE_TEST_POOL_SIZE 4
+
+typedef struct parallel_keys_s {
+  uint8_t senderPrivKey[ECE_WEBPUSH_PRIVATE_KEY_LENGTH];
+  uint8_t senderPubKey[ECE_WEBPUSH_PUBLIC_KEY_LENGTH];
+  uint8_t recvPrivKey[ECE_WEBPUSH_PRIVATE_KEY_LENGTH];
+  uint8_t recvPubKey[ECE_WEBPUSH_PUBLIC_KEY_LENGTH];
+  uint8_t authSecret[ECE_WEBPUSH_AUTH_SECRET_LENGTH];
+  uint8_t salt[ECE_SALT_LENGTH];
+} parallel_keys_t;
+
+static void
+parallel_generate_keys(parallel_keys_t* keys) {
+  // The sender's auth secret isn't used, so we use it as the salt.
+  int err = ece_webpush_generate_keys(
+    keys->senderPrivKey, ECE_WEBPUSH_PRIVATE_KEY_LENGTH, keys->senderPubKey,
+    ECE_WEBPUSH_PUBLIC_KEY_LENGTH, keys->salt, ECE_SALT_LENGTH);
+  ece_assert(!err, "Got %d generating sender keys", err);
+  err = ece_webpush_generate_keys(
+    keys->recvPrivKey, ECE_WEBPUSH_PRIVATE_KEY_LENGTH, keys->recvPubKey,
+    ECE_WEBPUSH_PUBLIC_KEY_LENGTH, keys->authSecret,
+    ECE_WEBPUSH_AUTH_SECRET_LENGTH);
+  ece_assert(!err, "Got %d generating receiver keys", err);
+}
+
+static int
+parallel_encrypt_init(ece_encrypt_ctx_t* ctx, const parallel_keys_t* keys,
+                      bool isAes128gcm, uint32_t rs, size_t padLen) {
+  if (isAes128gcm) {
+    return ece_webpush_aes128gcm_encrypt_init_with_keys(
+      ctx, keys->senderPrivKey, ECE_WEBPUSH_PRIVATE_KEY_LENGTH,
+      keys->authSecret, ECE_WEBPUSH_AUTH_SECRET_LENGTH, keys->salt,
+      ECE_SALT_LENGTH, keys->recvPubKey, ECE_WEBPUSH_PUBLIC_KEY_LENGTH, rs,
+      padLen);
+  }
+  return ece_webpush_aesgcm_encrypt_init_with_keys(
+    ctx, keys->senderPrivKey, ECE_WEBPUSH_PRIVATE_KEY_LENGTH, keys->authSecret,
+    ECE_WEBPUSH_AUTH_SECRET_LENGTH, keys->salt, ECE_SALT_LENGTH,
+    keys->recvPubKey, ECE_WEBPUSH_PUBLIC_KEY_LENGTH, rs, padLen);
+}
+
+static uint8_t*
+parallel_plaintext(size_t plaintextLen) {
+  uint8_t* plaintext = malloc(plaintextLen ? plaintextLen : 1);
+  ece_assert(plaintext, "Want plaintext buffer for %zu bytes", plaintextLen);
+  for (size_t i = 0; i < plaintextLen; i++) {
+    plaintext[i] = (uint8_t)(i * 31 + 7);
+  }
+  return plaintext;
+}
+
+void
+test_webpush_encrypt_parallel(void) {
+  static const uint32_t rsValues[] = {26, 27, 40, 100, 4096};
+  static const size_t padLens[] = {0, 1, 9, 300};
+  static const size_t plaintextLens[] = {0, 1, 10, 100, 1000, 20000};
+
+  parallel_keys_t keys;
+  parallel_generate_keys(&keys);
+
+  ece_pool_t* pool = ece_pool_new(ECE_TEST_POOL_SIZE);
+  ece_assert(pool, "Want pool with %d workers", ECE_TEST_POOL_SIZE);
+  ece_encrypt_ctx_t* ctx = ece_encrypt_ctx_new();
+  ece_assert(ctx, "Want encryption context for `%s`", "parallel");
+
+  // The parallel output and errors should match encrypting the same message
+  // serially, for every combination of record size, padding, and length.
+  for (int scheme = 0; scheme < 2; scheme++) {
+    bool isAes128gcm = !scheme;
+    for (size_t i = 0; i < sizeof(rsValues) / sizeof(uint32_t); i++) {
+      for (size_t j = 0; j < sizeof(padLens) / sizeof(size_t); j++) {
+        for (size_t k = 0; k < sizeof(plaintextLens) / sizeof(size_t); k++) {
+          uint32_t rs = rsValues[i];
+          size_t padLen = padLens[j];
+          size_t plaintextLen = plaintextLens[k];
+          uint8_t* plaintext = parallel_plaintext(plaintextLen);
+
+          int err =
+            parallel_encrypt_init(ctx, &keys, isAes128gcm, rs, padLen);
+          ece_assert(!err, "Got %d initializing context for rs = %" PRIu32,
+                     err, rs);
+          uint8_t* want = NULL;
+          size_t wantLen = 0;
+          int wantErr = ece_test_encrypt_stream(ctx, plaintext, plaintextLen,
+                                                SIZE_MAX, &want, &wantLen);
+
+          err = parallel_encrypt_init(ctx, &keys, isAes128gcm, rs, padLen);
+          ece_assert(!err, "Got %d initializing context for rs = %" PRIu32,
+                     err, rs);
+          size_t ciphertextLen =
+            ece_encrypt_update_max_length(ctx, plaintextLen);
+          uint8_t* ciphertext = malloc(ciphertextLen);
+          ece_assert(ciphertext, "Want ciphertext buffer for %zu bytes",
+                     ciphertextLen);
+          err = ece_encrypt_parallel(ctx, pool, plaintext, plaintextLen,
+                                     ciphertext, &ciphertextLen);
+          ece_assert(err == wantErr,
+                     "Got %d encrypting %zu bytes with rs = %" PRIu32
+                     ", padLen = %zu; want %d",
+                     err, plaintextLen, rs, padLen, wantErr);
+          if (!err) {
+            ece_assert(ciphertextLen == wantLen &&
+                         !memcmp(ciphertext, want, wantLen),
+                       "Wrong ciphertext for %zu bytes with rs = %" PRIu32
+                       ", padLen = %zu",
+                       plaintextLen, rs, padLen);
+          }
+
+          free(ciphertext);
+          free(want);
+          free(plaintext);
+        }
+      }
+    }
+  }
+
+  ece_encrypt_ctx_free(ctx);
+  ece_pool_free(pool);
+}
+
+// Encrypts a message with `ece_encrypt_parallel`, and returns the ciphertext.
+// For "aes128gcm", the ciphertext is the full payload.
+static uint8_t*
+parallel_encrypt(ece_pool_t* pool, const parallel_keys_t* keys,
+                 bool isAes128gcm, uint32_t rs, const uint8_t* plaintext,
+                 size_t plaintextLen, size_t* ciphertextLen) {
+  ece_encrypt_ctx_t* ctx = ece_encrypt_ctx_new();
+  ece_assert(ctx, "Want encryption context for `%s`", "parallel");
+  int err = parallel_encrypt_init(ctx, keys, isAes128gcm, rs, 0);
+  ece_assert(!err, "Got %d initializing context for rs = %" PRIu32, err, rs);
+  *ciphertextLen = ece_encrypt_update_max_length(ctx, plaintextLen);
+  uint8_t* ciphertext = malloc(*ciphertextLen);
+  ece_assert(ciphertext, "Want ciphertext buffer for %zu bytes",
+             *ciphertextLen);
+  err = ece_encrypt_parallel(ctx, pool, plaintext, plaintextLen, ciphertext,
+                             ciphertextLen);
+  ece_assert(!err, "Got %d encrypting %zu bytes", err, plaintextLen);
+  ece_encrypt_ctx_free(ctx);
+  return ciphertext;
+}
+
+// Decrypts a message with `pool`, or serially if `pool` is `NULL`.
+static int
+parallel_decrypt(const ece_subscription_t* sub, ece_pool_t* pool,
+                 const parallel_keys_t* keys, bool isAes128gcm, uint32_t rs,
+                 const uint8_t* ciphertext, size_t ciphertextLen,
+                 uint8_t* plaintext, size_t* plaintextLen) {
+  if (isAes128gcm) {
+    return ece_subscription_aes128gcm_decrypt_parallel(
+      sub, pool, ciphertext, ciphertextLen, plaintext, plaintextLen);
+  }
+  return ece_subscription_aesgcm_decrypt_parallel(
+    sub, pool, keys->salt, ECE_SALT_LENGTH, keys->senderPubKey,
+    ECE_WEBPUSH_PUBLIC_KEY_LENGTH, rs, ciphertext, ciphertextLen, plaintext,
+    plaintextLen);
+}
+
+void
+test_webpush_decrypt_parallel(void) {
+  static const uint32_t rsValues[] = {25, 100, 4096};
+  static const size_t plaintextLen = 50000;
+
+  parallel_keys_t keys;
+  parallel_generate_keys(&keys);
+  uint8_t* input = parallel_plaintext(plaintextLen);
+
+  ece_pool_t* pool = ece_pool_new(ECE_TEST_POOL_SIZE);
+  ece_assert(pool, "Want pool with %d workers", ECE_TEST_POOL_SIZE);
+  ece_subscription_t* sub = NULL;
+  int err = ece_subscription_create(
+    keys.recvPrivKey, ECE_WEBPUSH_PRIVATE_KEY_LENGTH, keys.authSecret,
+    ECE_WEBPUSH_AUTH_SECRET_LENGTH, &sub);
+  ece_assert(!err, "Got %d creating subscription", err);
+
+  for (int scheme = 0; scheme < 2; scheme++) {
+    bool isAes128gcm = !scheme;
+    // The header length, and the encrypted record size.
+    size_t headerLen = isAes128gcm ? ECE_AES128GCM_HEADER_LENGTH +
+                                       ECE_WEBPUSH_PUBLIC_KEY_LENGTH
+                                   : 0;
+    for (size_t i = 0; i < sizeof(rsValues) / sizeof(uint32_t); i++) {
+      uint32_t rs = rsValues[i];
+      size_t recordLen = isAes128gcm ? rs : rs + ECE_TAG_LENGTH;
+      size_t ciphertextLen = 0;
+      uint8_t* ciphertext = parallel_encrypt(pool, &keys, isAes128gcm, rs,
+                                             input, plaintextLen,
+                                             &ciphertextLen);
+
+      size_t maxLen = isAes128gcm
+                        ? ece_aes128gcm_plaintext_max_length(ciphertext,
+                                                             ciphertextLen)
+                        : ece_aesgcm_plaintext_max_length(rs, ciphertextLen);
+      uint8_t* plaintext = malloc(maxLen);
+      ece_assert(plaintext, "Want plaintext buffer for %zu bytes", maxLen);
+
+      size_t decryptedLen = maxLen;
+      err = parallel_decrypt(sub, pool, &keys, isAes128gcm, rs, ciphertext,
+                             ciphertextLen, plaintext, &decryptedLen);
+      ece_assert(!err, "Got %d decrypting with rs = %" PRIu32, err, rs);
+      ece_assert(decryptedLen == plaintextLen &&
+                   !memcmp(plaintext, input, plaintextLen),
+                 "Wrong plaintext with rs = %" PRIu32, rs);
+
+      // A buffer that's too small to decrypt in place still works, because
+      // the records are decrypted serially.
+      decryptedLen = plaintextLen + recordLen;
+      if (decryptedLen < maxLen) {
+        err = parallel_decrypt(sub, pool, &keys, isAes128gcm, rs, ciphertext,
+                               ciphertextLen, plaintext, &decryptedLen);
+        ece_assert(!err, "Got %d decrypting small buffer with rs = %" PRIu32,
+                   err, rs);
+        ece_assert(decryptedLen == plaintextLen &&
+                     !memcmp(plaintext, input, plaintextLen),
+                   "Wrong plaintext in small buffer with rs = %" PRIu32, rs);
+      }
+
+      // Truncating the last record to just the tag fails with a short block.
+      // Corrupting an earlier record as well should report the earlier error,
+      // even though the records are decrypted out of order.
+      size_t numRecords = (ciphertextLen - headerLen) / recordLen;
+      size_t truncatedLen = headerLen + numRecords * recordLen + ECE_TAG_LENGTH;
+      if (truncatedLen > ciphertextLen) {
+        truncatedLen -= recordLen;
+      }
+      for (int corrupt = 0; corrupt < 2; corrupt++) {
+        if (corrupt) {
+          ciphertext[headerLen + recordLen] ^= 0xff;
+        }
+        size_t serialLen = maxLen;
+        int serialErr =
+          parallel_decrypt(sub, NULL, &keys, isAes128gcm, rs, ciphertext,
+                           truncatedLen, plaintext, &serialLen);
+        int wantErr = corrupt ? ECE_ERROR_DECRYPT : ECE_ERROR_SHORT_BLOCK;
+        ece_assert(serialErr == wantErr,
+                   "Got %d decrypting truncated message with rs = %" PRIu32
+                   "; want %d",
+                   serialErr, rs, wantErr);
+        decryptedLen = maxLen;
+        err = parallel_decrypt(sub, pool, &keys, isAes128gcm, rs, ciphertext,
+                               truncatedLen, plaintext, &decryptedLen);
+        ece_assert(err == serialErr,
+                   "Got %d decrypting truncated message in parallel with rs = "
+                   "%" PRIu32 "; want %d",
+                   err, rs, serialErr);
+      }
+
+      free(plaintext);
+      free(ciphertext);
+    }
+  }
+
+  ece_subscription_destroy(sub);
+  ece_pool_free(pool);
+  free(input);
+}
+
+void
+test_webpush_aes128gcm_encrypt_fanout(void) {
+  // Not a multiple of the pool size, so the workers get uneven ranges.
+  static const size_t count = 37;
+  // This subscriber's public key isn't on the curve.
+  static const size_t badIndex = 5;
+
+  uint8_t rawRecvPrivKeys[37][ECE_WEBPUSH_PRIVATE_KEY_LENGTH];
+  uint8_t rawRecvPubKeys[37][ECE_WEBPUSH_PUBLIC_KEY_LENGTH];
+  uint8_t authSecrets[37][ECE_WEBPUSH_AUTH_SECRET_LENGTH];
+  int err = ece_webpush_generate_keys_bulk(
+    count, &rawRecvPrivKeys[0][0], sizeof(rawRecvPrivKeys),
+    &rawRecvPubKeys[0][0], sizeof(rawRecvPubKeys), &authSecrets[0][0],
+    sizeof(authSecrets));
+  ece_assert(!err, "Got %d generating %zu subscriptions", err, count);
+  rawRecvPubKeys[badIndex][ECE_WEBPUSH_PUBLIC_KEY_LENGTH - 1] ^= 1;
+
+  const uint8_t* pubKeys[37];
+  const uint8_t* secrets[37];
+  for (size_t i = 0; i < count; i++) {
+    pubKeys[i] = rawRecvPubKeys[i];
+    secrets[i] = authSecrets[i];
+  }
+
+  const void* input = "When I grow up, I want to be a watermelon";
+  size_t inputLen = strlen(input);
+  size_t maxPayloadLen = ece_aes128gcm_payload_max_length(24, 10, inputLen);
+
+  ece_pool_t* pool = ece_pool_new(ECE_TEST_POOL_SIZE);
+  ece_assert(pool, "Want pool with %d workers", ECE_TEST_POOL_SIZE);
+  for (int usePool = 0; usePool < 2; usePool++) {
+    for (int policy = 0; policy < 2; policy++) {
+      ece_sender_key_policy_t senderKeyPolicy =
+        policy ? ECE_SENDER_KEY_PER_CALL : ECE_SENDER_KEY_PER_RECIPIENT;
+      uint8_t* payloads[37];
+      size_t payloadLens[37];
+      int errs[37];
+      for (size_t i = 0; i < count; i++) {
+        payloads[i] = malloc(maxPayloadLen);
+        ece_assert(payloads[i], "Want payload buffer for subscriber %zu", i);
+        payloadLens[i] = maxPayloadLen;
+      }
+      err = ece_webpush_aes128gcm_encrypt_fanout(
+        usePool ? pool : NULL, senderKeyPolicy, 24, 10, input, inputLen,
+        count, pubKeys, secrets, payloads, payloadLens, errs);
+      ece_assert(err == ECE_ERROR_INVALID_PUBLIC_KEY,
+                 "Got %d encrypting to %zu subscribers; want %d", err, count,
+                 ECE_ERROR_INVALID_PUBLIC_KEY);
+
+      for (size_t i = 0; i < count; i++) {
+        if (i == badIndex) {
+          ece_assert(errs[i] == ECE_ERROR_INVALID_PUBLIC_KEY,
+                     "Got %d for subscriber %zu with invalid key", errs[i],
+                     i);
+          continue;
+        }
+        ece_assert(!errs[i], "Got %d encrypting to subscriber %zu", errs[i],
+                   i);
+        // Salts are unique, and sender keys are only shared if requested.
+        const uint8_t* other = payloads[i ? 0 : 1];
+        ece_assert(memcmp(payloads[i], other, ECE_SALT_LENGTH),
+                   "Want unique salt for subscriber %zu", i);
+        bool sameKey =
+          !memcmp(&payloads[i][ECE_AES128GCM_HEADER_LENGTH],
+                  &other[ECE_AES128GCM_HEADER_LENGTH],
+                  ECE_WEBPUSH_PUBLIC_KEY_LENGTH);
+        ece_assert(sameKey == (senderKeyPolicy == ECE_SENDER_KEY_PER_CALL),
+                   "Wrong sender key for subscriber %zu with policy %d", i,
+                   policy);
+
+        uint8_t plaintext[64];
+        size_t plaintextLen = sizeof(plaintext);
+        err = ece_webpush_aes128gcm_decrypt(
+          rawRecvPrivKeys[i], ECE_WEBPUSH_PRIVATE_KEY_LENGTH, authSecrets[i],
+          ECE_WEBPUSH_AUTH_SECRET_LENGTH, payloads[i], payloadLens[i],
+          plaintext, &plaintextLen);
+        ece_assert(!err, "Got %d decrypting for subscriber %zu", err, i);
+        ece_assert(plaintextLen == inputLen &&
+                     !memcmp(plaintext, input, inputLen),
+                   "Wrong plaintext for subscriber %zu", i);
+      }
+      for (size_t i = 0; i < count; i++) {
+        free(payloads[i]);
+      }
+    }
+  }
+  ece_pool_free(pool);
+}
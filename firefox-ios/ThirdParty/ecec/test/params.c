@@ -389,3 +389,238 @@ test_webpush_aesgcm_headers_extract_params_err(void) {
                t.desc, t.err);
   }
 }
+
+// Copies a header into an array without a trailing null byte, so that reading
+// past the end of the slice trips the address sanitizer.
+static char*
+params_header_slice(const char* header, size_t* headerLen) {
+  *headerLen = strlen(header);
+  char* slice = malloc(*headerLen ? *headerLen : 1);
+  ece_assert(slice, "Want slice for `%s`", header);
+  memcpy(slice, header, *headerLen);
+  return slice;
+}
+
+typedef struct webpush_aesgcm_extract_params_slices_test_s {
+  const char* desc;
+  const char* cryptoKey;
+  size_t cryptoKeyLen;
+  const char* encryption;
+  size_t encryptionLen;
+  int err;
+} webpush_aesgcm_extract_params_slices_test_t;
+
+static webpush_aesgcm_extract_params_slices_test_t
+  webpush_aesgcm_extract_params_slices_tests[] = {
+    {
+      .desc = "Record size overflows with the tag",
+      .cryptoKey = "dh=Iy1Je2Kv11A",
+      .cryptoKeyLen = 14,
+      .encryption = "salt=upk1yFkp1xI;rs=4294967295",
+      .encryptionLen = 30,
+      .err = ECE_ERROR_INVALID_RS,
+    },
+    {
+      .desc = "Smallest record size that overflows with the tag",
+      .cryptoKey = "dh=Iy1Je2Kv11A",
+      .cryptoKeyLen = 14,
+      .encryption = "salt=upk1yFkp1xI;rs=4294967280",
+      .encryptionLen = 30,
+      .err = ECE_ERROR_INVALID_RS,
+    },
+    {
+      .desc = "Slices end before trailing garbage",
+      .cryptoKey = "dh=Iy1Je2Kv11A!!",
+      .cryptoKeyLen = 14,
+      .encryption = "salt=upk1yFkp1xI;rs=4096,,",
+      .encryptionLen = 24,
+      .err = ECE_OK,
+    },
+    {
+      .desc = "Slices end inside the next param",
+      .cryptoKey = "dh=Iy1Je2Kv11A,dh=zzzzz",
+      .cryptoKeyLen = 14,
+      .encryption = "salt=upk1yFkp1xI;rs=bad",
+      .encryptionLen = 16,
+      .err = ECE_OK,
+    },
+    {
+      .desc = "Slice ends inside quoted value",
+      .cryptoKey = "dh=\"Iy1Je2Kv11A\"",
+      .cryptoKeyLen = 15,
+      .encryption = "salt=upk1yFkp1xI",
+      .encryptionLen = 16,
+      .err = ECE_ERROR_INVALID_CRYPTO_KEY_HEADER,
+    },
+    {
+      .desc = "Slice ends after pair name",
+      .cryptoKey = "dh=Iy1Je2Kv11A",
+      .cryptoKeyLen = 14,
+      .encryption = "salt=upk1yFkp1xI",
+      .encryptionLen = 4,
+      .err = ECE_ERROR_INVALID_ENCRYPTION_HEADER,
+    },
+    {
+      .desc = "Null byte in Crypto-Key slice",
+      .cryptoKey = "dh=Iy1Je2Kv11A\0;keyid=a",
+      .cryptoKeyLen = 23,
+      .encryption = "salt=upk1yFkp1xI",
+      .encryptionLen = 16,
+      .err = ECE_ERROR_INVALID_CRYPTO_KEY_HEADER,
+    },
+    {
+      .desc = "Null byte in Encryption slice",
+      .cryptoKey = "dh=Iy1Je2Kv11A",
+      .cryptoKeyLen = 14,
+      .encryption = "salt=upk1yFkp1xI\0",
+      .encryptionLen = 17,
+      .err = ECE_ERROR_INVALID_ENCRYPTION_HEADER,
+    },
+    {
+      .desc = "Empty Encryption slice",
+      .cryptoKey = "dh=Iy1Je2Kv11A",
+      .cryptoKeyLen = 14,
+      .encryption = NULL,
+      .encryptionLen = 0,
+      .err = ECE_ERROR_INVALID_ENCRYPTION_HEADER,
+    },
+    {
+      .desc = "Empty Crypto-Key slice",
+      .cryptoKey = NULL,
+      .cryptoKeyLen = 0,
+      .encryption = "salt=upk1yFkp1xI",
+      .encryptionLen = 16,
+      .err = ECE_ERROR_INVALID_CRYPTO_KEY_HEADER,
+    },
+};
+
+void
+test_webpush_aesgcm_headers_extract_params_slices(void) {
+  // The slice parser should agree with the null-terminated one on every
+  // case.
+  size_t length = sizeof(webpush_aesgcm_extract_params_ok_tests) /
+                  sizeof(webpush_aesgcm_extract_params_ok_test_t);
+  for (size_t i = 0; i < length; i++) {
+    webpush_aesgcm_extract_params_ok_test_t t =
+      webpush_aesgcm_extract_params_ok_tests[i];
+
+    size_t cryptoKeyLen, encryptionLen;
+    char* cryptoKey = params_header_slice(t.cryptoKey, &cryptoKeyLen);
+    char* encryption = params_header_slice(t.encryption, &encryptionLen);
+    uint8_t salt[8];
+    uint32_t rs;
+    uint8_t rawSenderPubKey[8];
+    int err = ece_webpush_aesgcm_headers_extract_params_slices(
+      cryptoKey, cryptoKeyLen, encryption, encryptionLen, salt, 8,
+      rawSenderPubKey, 8, &rs);
+
+    ece_assert(!err, "Got %d extracting params from slices for `%s`", err,
+               t.desc);
+    ece_assert(!memcmp(salt, t.salt, 8), "Wrong salt for `%s`", t.desc);
+    ece_assert(rs == t.rs, "Got rs = %" PRIu32 " for `%s`; want %" PRIu32, rs,
+               t.desc, t.rs);
+    ece_assert(!memcmp(rawSenderPubKey, t.rawSenderPubKey, 8),
+               "Wrong public key for `%s`", t.desc);
+
+    free(cryptoKey);
+    free(encryption);
+  }
+
+  length = sizeof(webpush_aesgcm_extract_params_err_tests) /
+           sizeof(webpush_aesgcm_extract_params_err_test_t);
+  for (size_t i = 0; i < length; i++) {
+    webpush_aesgcm_extract_params_err_test_t t =
+      webpush_aesgcm_extract_params_err_tests[i];
+
+    size_t cryptoKeyLen, encryptionLen;
+    char* cryptoKey = params_header_slice(t.cryptoKey, &cryptoKeyLen);
+    char* encryption = params_header_slice(t.encryption, &encryptionLen);
+    uint8_t salt[8];
+    uint32_t rs;
+    uint8_t rawSenderPubKey[8];
+    int err = ece_webpush_aesgcm_headers_extract_params_slices(
+      cryptoKey, cryptoKeyLen, encryption, encryptionLen, salt, 8,
+      rawSenderPubKey, 8, &rs);
+
+    ece_assert(err == t.err,
+               "Got %d extracting params from slices for `%s`; want %d", err,
+               t.desc, t.err);
+
+    free(cryptoKey);
+    free(encryption);
+  }
+
+  length = sizeof(webpush_aesgcm_extract_params_slices_tests) /
+           sizeof(webpush_aesgcm_extract_params_slices_test_t);
+  for (size_t i = 0; i < length; i++) {
+    webpush_aesgcm_extract_params_slices_test_t t =
+      webpush_aesgcm_extract_params_slices_tests[i];
+
+    uint8_t salt[8];
+    uint32_t rs;
+    uint8_t rawSenderPubKey[8];
+    int err = ece_webpush_aesgcm_headers_extract_params_slices(
+      t.cryptoKey, t.cryptoKeyLen, t.encryption, t.encryptionLen, salt, 8,
+      rawSenderPubKey, 8, &rs);
+
+    ece_assert(err == t.err,
+               "Got %d extracting params from slices for `%s`; want %d", err,
+               t.desc, t.err);
+    if (!err) {
+      ece_assert(!memcmp(salt, "\xba\x99\x35\xc8\x59\x29\xd7\x12", 8),
+                 "Wrong salt for `%s`", t.desc);
+      ece_assert(rs == 4096, "Got rs = %" PRIu32 " for `%s`; want 4096", rs,
+                 t.desc);
+      ece_assert(!memcmp(rawSenderPubKey, "\x23\x2d\x49\x7b\x62\xaf\xd7\x50",
+                         8),
+                 "Wrong public key for `%s`", t.desc);
+    }
+  }
+
+  // Full-size salts and keys are long enough for the block decoder, so check
+  // that it decodes them, and that the length check runs before it writes to
+  // the caller's array.
+  uint8_t wantSalt[ECE_SALT_LENGTH];
+  uint8_t wantKey[ECE_WEBPUSH_PUBLIC_KEY_LENGTH];
+  for (size_t i = 0; i < ECE_SALT_LENGTH; i++) {
+    wantSalt[i] = (uint8_t)(i * 17 + 1);
+  }
+  for (size_t i = 0; i < ECE_WEBPUSH_PUBLIC_KEY_LENGTH; i++) {
+    wantKey[i] = (uint8_t)(i * 29 + 3);
+  }
+  char cryptoKey[128];
+  size_t cryptoKeyLen = sizeof(cryptoKey);
+  char encryption[128];
+  size_t encryptionLen = sizeof(encryption);
+  int err = ece_webpush_aesgcm_headers_from_params(
+    wantSalt, ECE_SALT_LENGTH, wantKey, ECE_WEBPUSH_PUBLIC_KEY_LENGTH, 4096,
+    cryptoKey, &cryptoKeyLen, encryption, &encryptionLen);
+  ece_assert(!err, "Got %d writing full-size headers", err);
+
+  uint8_t salt[ECE_SALT_LENGTH];
+  uint8_t rawSenderPubKey[ECE_WEBPUSH_PUBLIC_KEY_LENGTH];
+  uint32_t rs;
+  err = ece_webpush_aesgcm_headers_extract_params_slices(
+    cryptoKey, cryptoKeyLen, encryption, encryptionLen, salt, ECE_SALT_LENGTH,
+    rawSenderPubKey, ECE_WEBPUSH_PUBLIC_KEY_LENGTH, &rs);
+  ece_assert(!err, "Got %d extracting full-size params", err);
+  ece_assert(!memcmp(salt, wantSalt, ECE_SALT_LENGTH),
+             "Wrong full-size salt%s", "");
+  ece_assert(!memcmp(rawSenderPubKey, wantKey, ECE_WEBPUSH_PUBLIC_KEY_LENGTH),
+             "Wrong full-size public key%s", "");
+
+  // A key that's one quantum short, or one quantum long, has the wrong
+  // length.
+  err = ece_webpush_aesgcm_headers_extract_params_slices(
+    cryptoKey, cryptoKeyLen - 4, encryption, encryptionLen, salt,
+    ECE_SALT_LENGTH, rawSenderPubKey, ECE_WEBPUSH_PUBLIC_KEY_LENGTH, &rs);
+  ece_assert(err == ECE_ERROR_INVALID_DH,
+             "Got %d extracting short key; want %d", err,
+             ECE_ERROR_INVALID_DH);
+  memcpy(&cryptoKey[cryptoKeyLen], "AAAA", 4);
+  err = ece_webpush_aesgcm_headers_extract_params_slices(
+    cryptoKey, cryptoKeyLen + 4, encryption, encryptionLen, salt,
+    ECE_SALT_LENGTH, rawSenderPubKey, ECE_WEBPUSH_PUBLIC_KEY_LENGTH, &rs);
+  ece_assert(err == ECE_ERROR_INVALID_DH, "Got %d extracting long key; want %d",
+             err, ECE_ERROR_INVALID_DH);
+}
@@ -0,0 +1,202 @@
+#if !defined(_WIN32)
+// `fork` and `pipe` need POSIX declarations, which aren't part of strict C99.
+#define _POSIX_C_SOURCE 200112L
+#endif
+
+#include "test.h"
+
+#include <string.h>
+
+#include <ece/rand.h>
+
+#if !defined(_WIN32)
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+// A deterministic source that fills each byte with the next value of a
+// counter, mixed so that the bytes aren't all in range for P-256 scalars.
+typedef struct rand_counter_s {
+  uint64_t state;
+  size_t calls;
+} rand_counter_t;
+
+static bool
+rand_counter_fill(void* opaque, uint8_t* bytes, size_t len) {
+  rand_counter_t* counter = opaque;
+  counter->calls++;
+  for (size_t i = 0; i < len; i++) {
+    counter->state = counter->state * 6364136223846793005ULL + 1;
+    bytes[i] = (uint8_t)(counter->state >> 56);
+  }
+  return true;
+}
+
+static bool
+rand_fail_fill(void* opaque, uint8_t* bytes, size_t len) {
+  ECE_UNUSED(opaque);
+  ECE_UNUSED(bytes);
+  ECE_UNUSED(len);
+  return false;
+}
+
+// Every scalar drawn from this source is larger than the P-256 order.
+static bool
+rand_ones_fill(void* opaque, uint8_t* bytes, size_t len) {
+  ECE_UNUSED(opaque);
+  memset(bytes, 0xff, len);
+  return true;
+}
+
+// Encrypts a short message with a salt and sender key from the current
+// source. The one-shot `ece_webpush_aes128gcm_encrypt` doesn't use the
+// buffer yet, so we go through an encryption context.
+static int
+rand_encrypt(const uint8_t* rawRecvPubKey, const uint8_t* authSecret,
+             uint8_t* payload, size_t* payloadLen) {
+  const char* input = "When I grow up, I want to be a watermelon";
+  ece_encrypt_ctx_t* ctx = ece_encrypt_ctx_new();
+  ece_assert(ctx, "Want encryption context%s", "");
+  int err = ece_webpush_aes128gcm_encrypt_init(
+    ctx, rawRecvPubKey, ECE_WEBPUSH_PUBLIC_KEY_LENGTH, authSecret,
+    ECE_WEBPUSH_AUTH_SECRET_LENGTH, 4096, 0);
+  if (!err) {
+    err = ece_encrypt_parallel(ctx, NULL, (const uint8_t*) input,
+                               strlen(input), payload, payloadLen);
+  }
+  ece_encrypt_ctx_free(ctx);
+  return err;
+}
+
+void
+test_rand_source(void) {
+  uint8_t rawRecvPrivKey[ECE_WEBPUSH_PRIVATE_KEY_LENGTH];
+  uint8_t rawRecvPubKey[ECE_WEBPUSH_PUBLIC_KEY_LENGTH];
+  uint8_t authSecret[ECE_WEBPUSH_AUTH_SECRET_LENGTH];
+  int err = ece_webpush_generate_keys(
+    rawRecvPrivKey, ECE_WEBPUSH_PRIVATE_KEY_LENGTH, rawRecvPubKey,
+    ECE_WEBPUSH_PUBLIC_KEY_LENGTH, authSecret, ECE_WEBPUSH_AUTH_SECRET_LENGTH);
+  ece_assert(!err, "Got %d generating keys", err);
+
+  // Resetting a deterministic source discards the buffered bytes, so the
+  // salt and sender key repeat, and so does the payload.
+  rand_counter_t counter = {.state = 0, .calls = 0};
+  ece_rand_source_t source = {.fill = &rand_counter_fill, .opaque = &counter};
+  ece_set_rand_source(&source);
+  uint8_t first[200];
+  size_t firstLen = sizeof(first);
+  err = rand_encrypt(rawRecvPubKey, authSecret, first, &firstLen);
+  ece_assert(!err, "Got %d encrypting with deterministic source", err);
+  uint8_t second[200];
+  size_t secondLen = sizeof(second);
+  err = rand_encrypt(rawRecvPubKey, authSecret, second, &secondLen);
+  ece_assert(!err, "Got %d encrypting with deterministic source", err);
+  ece_assert(memcmp(first, second, ECE_SALT_LENGTH),
+             "Want different salts from the same source%s", "");
+  ece_assert(counter.calls == 1, "Got %zu refills for two messages; want 1",
+             counter.calls);
+
+  counter.state = 0;
+  ece_set_rand_source(&source);
+  uint8_t repeat[200];
+  size_t repeatLen = sizeof(repeat);
+  err = rand_encrypt(rawRecvPubKey, authSecret, repeat, &repeatLen);
+  ece_assert(!err, "Got %d encrypting with deterministic source", err);
+  ece_assert(repeatLen == firstLen && !memcmp(repeat, first, firstLen),
+             "Want same payload after resetting source%s", "");
+
+  // The payloads still decrypt.
+  uint8_t plaintext[64];
+  size_t plaintextLen = sizeof(plaintext);
+  err = ece_webpush_aes128gcm_decrypt(
+    rawRecvPrivKey, ECE_WEBPUSH_PRIVATE_KEY_LENGTH, authSecret,
+    ECE_WEBPUSH_AUTH_SECRET_LENGTH, repeat, repeatLen, plaintext,
+    &plaintextLen);
+  ece_assert(!err, "Got %d decrypting deterministic payload", err);
+
+  // Bulk keys are also reproducible.
+  uint8_t bulkPrivKeys[2][3 * ECE_WEBPUSH_PRIVATE_KEY_LENGTH];
+  uint8_t bulkPubKeys[2][3 * ECE_WEBPUSH_PUBLIC_KEY_LENGTH];
+  uint8_t bulkSecrets[2][3 * ECE_WEBPUSH_AUTH_SECRET_LENGTH];
+  for (size_t i = 0; i < 2; i++) {
+    counter.state = 0;
+    ece_set_rand_source(&source);
+    err = ece_webpush_generate_keys_bulk(
+      3, bulkPrivKeys[i], sizeof(bulkPrivKeys[i]), bulkPubKeys[i],
+      sizeof(bulkPubKeys[i]), bulkSecrets[i], sizeof(bulkSecrets[i]));
+    ece_assert(!err, "Got %d generating keys with deterministic source", err);
+  }
+  ece_assert(
+    !memcmp(bulkPrivKeys[0], bulkPrivKeys[1], sizeof(bulkPrivKeys[0])) &&
+      !memcmp(bulkPubKeys[0], bulkPubKeys[1], sizeof(bulkPubKeys[0])) &&
+      !memcmp(bulkSecrets[0], bulkSecrets[1], sizeof(bulkSecrets[0])),
+    "Want same bulk keys after resetting source%s", "");
+
+  // A failing source fails encryption and key generation.
+  ece_rand_source_t failSource = {.fill = &rand_fail_fill, .opaque = NULL};
+  ece_set_rand_source(&failSource);
+  size_t payloadLen = sizeof(first);
+  err = rand_encrypt(rawRecvPubKey, authSecret, first, &payloadLen);
+  ece_assert(err == ECE_ERROR_INVALID_SALT,
+             "Got %d encrypting with failing source; want %d", err,
+             ECE_ERROR_INVALID_SALT);
+  err = ece_webpush_generate_keys_bulk(
+    3, bulkPrivKeys[0], sizeof(bulkPrivKeys[0]), bulkPubKeys[0],
+    sizeof(bulkPubKeys[0]), bulkSecrets[0], sizeof(bulkSecrets[0]));
+  ece_assert(err == ECE_ERROR_GENERATE_KEYS,
+             "Got %d generating keys with failing source; want %d", err,
+             ECE_ERROR_GENERATE_KEYS);
+
+  // A source that never yields a valid scalar gives up instead of looping.
+  ece_rand_source_t onesSource = {.fill = &rand_ones_fill, .opaque = NULL};
+  ece_set_rand_source(&onesSource);
+  payloadLen = sizeof(first);
+  err = rand_encrypt(rawRecvPubKey, authSecret, first, &payloadLen);
+  ece_assert(err == ECE_ERROR_INVALID_PRIVATE_KEY,
+             "Got %d encrypting with out-of-range scalars; want %d", err,
+             ECE_ERROR_INVALID_PRIVATE_KEY);
+
+  ece_set_rand_source(NULL);
+}
+
+void
+test_rand_fork(void) {
+#if !defined(_WIN32)
+  // Prime this thread's buffer, so that the child inherits unused bytes.
+  uint8_t bytes[ECE_SALT_LENGTH];
+  ece_assert(ece_rand_bytes(bytes, ECE_SALT_LENGTH), "Want random bytes%s",
+             "");
+
+  int fds[2];
+  ece_assert(!pipe(fds), "Want pipe for child%s", "");
+  pid_t pid = fork();
+  ece_assert(pid >= 0, "Want child process%s", "");
+  if (!pid) {
+    uint8_t childBytes[ECE_SALT_LENGTH];
+    int status = ece_rand_bytes(childBytes, ECE_SALT_LENGTH) &&
+                     write(fds[1], childBytes, ECE_SALT_LENGTH) ==
+                       ECE_SALT_LENGTH
+                   ? 0
+                   : 1;
+    _exit(status);
+  }
+  close(fds[1]);
+  uint8_t childBytes[ECE_SALT_LENGTH];
+  ssize_t readLen = read(fds[0], childBytes, ECE_SALT_LENGTH);
+  close(fds[0]);
+  int status;
+  ece_assert(waitpid(pid, &status, 0) == pid && WIFEXITED(status) &&
+               !WEXITSTATUS(status),
+             "Want child to draw random bytes%s", "");
+  ece_assert(readLen == ECE_SALT_LENGTH, "Got %zd bytes from child; want %d",
+             readLen, ECE_SALT_LENGTH);
+
+  // Without discarding its inherited buffer, the child would draw the same
+  // bytes as the parent's next draw.
+  ece_assert(ece_rand_bytes(bytes, ECE_SALT_LENGTH), "Want random bytes%s",
+             "");
+  ece_assert(memcmp(bytes, childBytes, ECE_SALT_LENGTH),
+             "Want different bytes in parent and child%s", "");
+#endif
+}
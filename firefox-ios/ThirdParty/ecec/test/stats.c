@@ -0,0 +1,213 @@
+#include "test.h"
+
+#include <inttypes.h>
+#include <string.h>
+
+#ifdef ECE_HAVE_PTHREADS
+#include <pthread.h>
+#endif
+
+typedef struct stats_keys_s {
+  uint8_t senderPrivKey[ECE_WEBPUSH_PRIVATE_KEY_LENGTH];
+  uint8_t senderPubKey[ECE_WEBPUSH_PUBLIC_KEY_LENGTH];
+  uint8_t recvPrivKey[ECE_WEBPUSH_PRIVATE_KEY_LENGTH];
+  uint8_t recvPubKey[ECE_WEBPUSH_PUBLIC_KEY_LENGTH];
+  uint8_t authSecret[ECE_WEBPUSH_AUTH_SECRET_LENGTH];
+  uint8_t salt[ECE_SALT_LENGTH];
+} stats_keys_t;
+
+static void
+stats_generate_keys(stats_keys_t* keys) {
+  // The sender's auth secret isn't used, so we use it as the salt.
+  int err = ece_webpush_generate_keys(
+    keys->senderPrivKey, ECE_WEBPUSH_PRIVATE_KEY_LENGTH, keys->senderPubKey,
+    ECE_WEBPUSH_PUBLIC_KEY_LENGTH, keys->salt, ECE_SALT_LENGTH);
+  ece_assert(!err, "Got %d generating sender keys", err);
+  err = ece_webpush_generate_keys(
+    keys->recvPrivKey, ECE_WEBPUSH_PRIVATE_KEY_LENGTH, keys->recvPubKey,
+    ECE_WEBPUSH_PUBLIC_KEY_LENGTH, keys->authSecret,
+    ECE_WEBPUSH_AUTH_SECRET_LENGTH);
+  ece_assert(!err, "Got %d generating receiver keys", err);
+}
+
+// Encrypts `plaintextLen` bytes in records of `rs` bytes, and returns the
+// payload. The caller must free it.
+static uint8_t*
+stats_encrypt(const stats_keys_t* keys, size_t plaintextLen, uint32_t rs,
+              size_t* payloadLen) {
+  uint8_t* plaintext = malloc(plaintextLen);
+  ece_assert(plaintext, "Want plaintext buffer for %zu bytes", plaintextLen);
+  memset(plaintext, 0x61, plaintextLen);
+
+  ece_encrypt_ctx_t* ctx = ece_encrypt_ctx_new();
+  ece_assert(ctx, "Want encryption context for %zu bytes", plaintextLen);
+  int err = ece_webpush_aes128gcm_encrypt_init_with_keys(
+    ctx, keys->senderPrivKey, ECE_WEBPUSH_PRIVATE_KEY_LENGTH, keys->authSecret,
+    ECE_WEBPUSH_AUTH_SECRET_LENGTH, keys->salt, ECE_SALT_LENGTH,
+    keys->recvPubKey, ECE_WEBPUSH_PUBLIC_KEY_LENGTH, rs, 0);
+  ece_assert(!err, "Got %d initializing encryption context", err);
+
+  uint8_t* payload = NULL;
+  err = ece_test_encrypt_stream(ctx, plaintext, plaintextLen, plaintextLen,
+                                &payload, payloadLen);
+  ece_assert(!err, "Got %d encrypting %zu bytes", err, plaintextLen);
+
+  ece_encrypt_ctx_free(ctx);
+  free(plaintext);
+  return payload;
+}
+
+// Decrypts `payload`, and returns the result.
+static int
+stats_decrypt(const stats_keys_t* keys, uint8_t* payload, size_t payloadLen,
+              size_t* plaintextLen) {
+  size_t maxPlaintextLen =
+    ece_aes128gcm_plaintext_max_length(payload, payloadLen);
+  ece_assert(maxPlaintextLen, "Want plaintext length for %zu-byte payload",
+             payloadLen);
+  uint8_t* plaintext = malloc(maxPlaintextLen);
+  ece_assert(plaintext, "Want plaintext buffer for %zu bytes",
+             maxPlaintextLen);
+  ece_iovec_t payloadIov = {.base = payload, .len = payloadLen};
+  ece_iovec_t plaintextIov = {.base = plaintext, .len = maxPlaintextLen};
+  int err = ece_webpush_aes128gcm_decrypt_iov(
+    keys->recvPrivKey, ECE_WEBPUSH_PRIVATE_KEY_LENGTH, keys->authSecret,
+    ECE_WEBPUSH_AUTH_SECRET_LENGTH, &payloadIov, 1, &plaintextIov, 1,
+    plaintextLen);
+  free(plaintext);
+  return err;
+}
+
+static uint64_t
+stats_histogram_sum(const ece_stats_stage_counters_t* counters) {
+  uint64_t sum = 0;
+  for (size_t i = 0; i < ECE_STATS_HISTOGRAM_BUCKETS; i++) {
+    sum += counters->histogram[i];
+  }
+  return sum;
+}
+
+static void
+stats_assert_empty(const ece_stats_t* stats) {
+  for (size_t i = 0; i < ECE_STATS_STAGES; i++) {
+    const ece_stats_stage_counters_t* counters = &stats->stages[i];
+    ece_assert(!counters->calls && !counters->bytes && !counters->errors &&
+                 !stats_histogram_sum(counters),
+               "Got %" PRIu64 " calls for stage %zu; want 0", counters->calls,
+               i);
+  }
+  for (size_t i = 0; i < ECE_STATS_ERROR_CODES; i++) {
+    ece_assert(!stats->errors[i], "Got %" PRIu64 " errors for code -%zu",
+               stats->errors[i], i);
+  }
+}
+
+#ifdef ECE_HAVE_PTHREADS
+static void*
+stats_thread_run(void* arg) {
+  const stats_keys_t* keys = arg;
+  size_t payloadLen;
+  uint8_t* payload = stats_encrypt(keys, 100, 4096, &payloadLen);
+  free(payload);
+  return NULL;
+}
+#endif
+
+void
+test_stats(void) {
+  stats_keys_t keys;
+  stats_generate_keys(&keys);
+
+  // Nothing is recorded while statistics are disabled.
+  ece_assert(!ece_stats_enabled(), "Want statistics disabled by default%s",
+             "");
+  ece_stats_reset();
+  size_t payloadLen;
+  uint8_t* payload = stats_encrypt(&keys, 100, 4096, &payloadLen);
+  free(payload);
+  ece_stats_t stats;
+  ece_stats_snapshot(&stats);
+  stats_assert_empty(&stats);
+
+  ece_stats_enable(true);
+  ece_assert(ece_stats_enabled(), "Want statistics enabled%s", "");
+
+  // Each 48-byte record holds 31 bytes of plaintext, so this encrypts 2 full
+  // records and a last record with 8 bytes.
+  payload = stats_encrypt(&keys, 70, 48, &payloadLen);
+  size_t plaintextLen;
+  int err = stats_decrypt(&keys, payload, payloadLen, &plaintextLen);
+  ece_assert(!err, "Got %d decrypting payload", err);
+  ece_assert(plaintextLen == 70, "Got plaintext length %zu; want 70",
+             plaintextLen);
+
+  ece_stats_snapshot(&stats);
+  const ece_stats_stage_counters_t* encrypt =
+    &stats.stages[ECE_STATS_STAGE_ENCRYPT_RECORD];
+  ece_assert(encrypt->calls == 3, "Got %" PRIu64 " encrypt calls; want 3",
+             encrypt->calls);
+  const ece_stats_stage_counters_t* decrypt =
+    &stats.stages[ECE_STATS_STAGE_DECRYPT_RECORD];
+  ece_assert(decrypt->calls == 3, "Got %" PRIu64 " decrypt calls; want 3",
+             decrypt->calls);
+  // The header includes the sender's public key as the key ID.
+  size_t ciphertextLen = payloadLen - ECE_AES128GCM_HEADER_LENGTH -
+                         ECE_WEBPUSH_PUBLIC_KEY_LENGTH;
+  ece_assert(decrypt->bytes == ciphertextLen,
+             "Got %" PRIu64 " decrypted bytes; want %zu", decrypt->bytes,
+             ciphertextLen);
+  const ece_stats_stage_counters_t* unpad =
+    &stats.stages[ECE_STATS_STAGE_UNPAD];
+  ece_assert(unpad->calls == 3, "Got %" PRIu64 " unpad calls; want 3",
+             unpad->calls);
+  // Both sides import keys and derive a key and nonce.
+  ece_assert(stats.stages[ECE_STATS_STAGE_IMPORT_KEY].calls >= 2,
+             "Got %" PRIu64 " key imports; want at least 2",
+             stats.stages[ECE_STATS_STAGE_IMPORT_KEY].calls);
+  ece_assert(stats.stages[ECE_STATS_STAGE_DERIVE_KEY].calls == 2,
+             "Got %" PRIu64 " key derivations; want 2",
+             stats.stages[ECE_STATS_STAGE_DERIVE_KEY].calls);
+  for (size_t i = 0; i < ECE_STATS_STAGES; i++) {
+    const ece_stats_stage_counters_t* counters = &stats.stages[i];
+    uint64_t sum = stats_histogram_sum(counters);
+    ece_assert(sum == counters->calls,
+               "Got %" PRIu64 " histogram entries for stage %zu; want %" PRIu64,
+               sum, i, counters->calls);
+    ece_assert(!counters->errors, "Got %" PRIu64 " errors for stage %zu",
+               counters->errors, i);
+  }
+
+  // A corrupted record fails to decrypt, and is counted as an error.
+  payload[payloadLen - 1] ^= 1;
+  err = stats_decrypt(&keys, payload, payloadLen, &plaintextLen);
+  ece_assert(err == ECE_ERROR_DECRYPT, "Got %d decrypting corrupted payload",
+             err);
+  free(payload);
+  ece_stats_snapshot(&stats);
+  ece_assert(stats.stages[ECE_STATS_STAGE_DECRYPT_RECORD].errors == 1,
+             "Got %" PRIu64 " decrypt errors; want 1",
+             stats.stages[ECE_STATS_STAGE_DECRYPT_RECORD].errors);
+  ece_assert(stats.errors[-ECE_ERROR_DECRYPT] == 1,
+             "Got %" PRIu64 " errors for code %d; want 1",
+             stats.errors[-ECE_ERROR_DECRYPT], ECE_ERROR_DECRYPT);
+
+  ece_stats_reset();
+  ece_stats_snapshot(&stats);
+  stats_assert_empty(&stats);
+
+#ifdef ECE_HAVE_PTHREADS
+  // Counters from other threads are included in snapshots, even after those
+  // threads exit.
+  pthread_t thread;
+  int threadErr = pthread_create(&thread, NULL, &stats_thread_run, &keys);
+  ece_assert(!threadErr, "Got %d creating thread", threadErr);
+  pthread_join(thread, NULL);
+  ece_stats_snapshot(&stats);
+  ece_assert(stats.stages[ECE_STATS_STAGE_ENCRYPT_RECORD].calls == 1,
+             "Got %" PRIu64 " encrypt calls from thread; want 1",
+             stats.stages[ECE_STATS_STAGE_ENCRYPT_RECORD].calls);
+  ece_stats_reset();
+#endif
+
+  ece_stats_enable(false);
+}
@@ -2,32 +2,80 @@
 
 #include <inttypes.h>
 #include <stdarg.h>
+#include <stdbool.h>
 #include <stdio.h>
 #include <string.h>
 
 int
 main() {
+  ece_test_set_heap_allocator();
+
   test_webpush_aesgcm_headers_from_params();
   test_webpush_aesgcm_headers_extract_params_ok();
   test_webpush_aesgcm_headers_extract_params_err();
+  test_webpush_aesgcm_headers_extract_params_slices();
 
   test_webpush_aesgcm_encrypt_ok();
   test_webpush_aesgcm_encrypt_pad();
+  test_webpush_aesgcm_encrypt_stream();
+  test_webpush_aesgcm_encrypt_in_place();
+  test_webpush_aesgcm_encrypt_iov();
+  test_webpush_aesgcm_encrypt_large_pad();
   test_webpush_aesgcm_decrypt_ok();
   test_webpush_aesgcm_decrypt_err();
+  test_webpush_aesgcm_decrypt_subscription();
+  test_webpush_aesgcm_decrypt_in_place();
+  test_webpush_aesgcm_decrypt_iov();
+  test_webpush_aesgcm_decrypt_stream();
 
   test_webpush_aes128gcm_encrypt_ok();
   test_webpush_aes128gcm_encrypt_pad();
+  test_webpush_aes128gcm_encrypt_stream();
+  test_webpush_aes128gcm_encrypt_in_place();
+  test_webpush_aes128gcm_encrypt_iov();
+  test_webpush_aes128gcm_encrypt_base64url();
+  test_webpush_aes128gcm_encrypt_large_pad();
   test_webpush_aes128gcm_decrypt_ok();
   test_webpush_aes128gcm_decrypt_err();
   test_aes128gcm_decrypt_ok();
   test_aes128gcm_decrypt_err();
+  test_webpush_aes128gcm_decrypt_stream();
+  test_aes128gcm_decrypt_stream();
+  test_webpush_aes128gcm_decrypt_batch();
+  test_webpush_aes128gcm_decrypt_subscription();
+  test_webpush_aes128gcm_decrypt_cipher_pool();
+  test_webpush_aes128gcm_decrypt_in_place();
+  test_webpush_aes128gcm_decrypt_iov();
+  test_webpush_aes128gcm_decrypt_base64url();
+  test_aes128gcm_unpad_large();
 
   test_webpush_aes128gcm_e2e();
   test_webpush_aesgcm_e2e();
+  test_webpush_recipient_e2e();
+  test_webpush_recipient_threads();
+  test_webpush_generate_keys_bulk();
+  test_webpush_encrypt_request();
+
+  test_webpush_encrypt_parallel();
+  test_webpush_decrypt_parallel();
+  test_webpush_aes128gcm_encrypt_fanout();
+  test_rand_source();
+  test_rand_fork();
+
+  test_gcm_vectors();
+  test_gcm_equivalence();
+  test_webpush_aes128gcm_decrypt_batch_lanes();
+
+  test_alloc_hooks();
+  test_alloc_arena();
 
   test_base64url_encode();
   test_base64url_decode();
+  test_base64url_simd();
+  test_base64url_stream();
+  test_base64url_stream_random();
+
+  test_stats();
 
   return 0;
 }
@@ -64,3 +112,153 @@ end:
   va_end(args);
   free(message);
 }
+
+static void*
+ece_test_heap_alloc(void* opaque, size_t size) {
+  ECE_UNUSED(opaque);
+  return malloc(size);
+}
+
+static void*
+ece_test_heap_realloc(void* opaque, void* ptr, size_t size) {
+  ECE_UNUSED(opaque);
+  return realloc(ptr, size);
+}
+
+static void
+ece_test_heap_free(void* opaque, void* ptr) {
+  ECE_UNUSED(opaque);
+  free(ptr);
+}
+
+void
+ece_test_set_heap_allocator(void) {
+  ece_allocator_t allocator = {
+    .alloc = &ece_test_heap_alloc,
+    .realloc = &ece_test_heap_realloc,
+    .free = &ece_test_heap_free,
+    .opaque = NULL,
+  };
+  ece_set_allocator(&allocator);
+}
+
+int
+ece_test_encrypt_stream(ece_encrypt_ctx_t* ctx, const uint8_t* plaintext,
+                        size_t plaintextLen, size_t chunkLen,
+                        uint8_t** ciphertext, size_t* ciphertextLen) {
+  uint8_t* result = NULL;
+  size_t resultLen = 0;
+  int err = ECE_OK;
+
+  size_t plaintextStart = 0;
+  bool isFinal = false;
+  while (!isFinal) {
+    size_t plaintextEnd = plaintextLen;
+    if (plaintextLen - plaintextStart > chunkLen) {
+      plaintextEnd = plaintextStart + chunkLen;
+    }
+    isFinal = plaintextStart == plaintextLen;
+
+    // Grow the result buffer to hold the largest possible output for the next
+    // call.
+    size_t maxLen =
+      ece_encrypt_update_max_length(ctx, plaintextEnd - plaintextStart);
+    uint8_t* newResult = realloc(result, resultLen + maxLen + 1);
+    ece_assert(newResult, "Want buffer for %zu bytes", resultLen + maxLen);
+    result = newResult;
+
+    size_t blockLen = maxLen;
+    if (isFinal) {
+      err = ece_encrypt_final(ctx, &result[resultLen], &blockLen);
+    } else {
+      err = ece_encrypt_update(ctx, &plaintext[plaintextStart],
+                               plaintextEnd - plaintextStart,
+                               &result[resultLen], &blockLen);
+    }
+    if (err) {
+      free(result);
+      return err;
+    }
+    ece_assert(blockLen <= maxLen, "Got %zu bytes of output; want at most %zu",
+               blockLen, maxLen);
+    resultLen += blockLen;
+    plaintextStart = plaintextEnd;
+  }
+
+  *ciphertext = result;
+  *ciphertextLen = resultLen;
+  return ECE_OK;
+}
+
+int
+ece_test_encrypt_in_place(ece_encrypt_ctx_t* ctx, const uint8_t* plaintext,
+                          size_t plaintextLen, size_t slackLen,
+                          uint8_t** ciphertext, size_t* ciphertextLen) {
+  size_t bufferLen =
+    ece_encrypt_update_max_length(ctx, plaintextLen) + slackLen;
+  uint8_t* buffer = malloc(bufferLen);
+  ece_assert(buffer, "Want buffer for %zu bytes", bufferLen);
+  memset(buffer, 0xaa, bufferLen);
+  memcpy(&buffer[bufferLen - plaintextLen], plaintext, plaintextLen);
+
+  size_t resultLen = 0;
+  int err =
+    ece_encrypt_in_place(ctx, buffer, bufferLen, plaintextLen, &resultLen);
+  if (err) {
+    free(buffer);
+    return err;
+  }
+  ece_assert(resultLen <= bufferLen,
+             "Got %zu bytes of output; want at most %zu", resultLen, bufferLen);
+
+  *ciphertext = buffer;
+  *ciphertextLen = resultLen;
+  return ECE_OK;
+}
+
+ece_iovec_t*
+ece_test_iov_new(const uint8_t* bytes, size_t len, size_t segmentLen,
+                 size_t* count) {
+  size_t numSegments = 1 + len / segmentLen + (len % segmentLen ? 1 : 0);
+  ece_iovec_t* iov = calloc(numSegments, sizeof(ece_iovec_t));
+  ece_assert(iov, "Want %zu segments", numSegments);
+  // Start with an empty segment, to check that it's skipped.
+  size_t start = 0;
+  for (size_t i = 1; i < numSegments; i++) {
+    size_t chunkLen = len - start > segmentLen ? segmentLen : len - start;
+    uint8_t* segment = malloc(chunkLen);
+    ece_assert(segment, "Want segment for %zu bytes", chunkLen);
+    if (bytes) {
+      memcpy(segment, &bytes[start], chunkLen);
+    } else {
+      memset(segment, 0xaa, chunkLen);
+    }
+    iov[i].base = segment;
+    iov[i].len = chunkLen;
+    start += chunkLen;
+  }
+  *count = numSegments;
+  return iov;
+}
+
+void
+ece_test_iov_flatten(const ece_iovec_t* iov, size_t count, uint8_t* bytes,
+                     size_t len) {
+  size_t start = 0;
+  for (size_t i = 0; i < count && start < len; i++) {
+    size_t chunkLen = len - start > iov[i].len ? iov[i].len : len - start;
+    if (!chunkLen) {
+      continue;
+    }
+    memcpy(&bytes[start], iov[i].base, chunkLen);
+    start += chunkLen;
+  }
+}
+
+void
+ece_test_iov_free(ece_iovec_t* iov, size_t count) {
+  for (size_t i = 0; i < count; i++) {
+    free(iov[i].base);
+  }
+  free(iov);
+}
@@ -18,6 +18,46 @@ void
 ece_log(const char* funcName, int line, const char* expr, const char* format,
         ...);
 
+// Sets the global allocator to one that uses the C heap. The tests install it
+// on startup, so that they also run when the library is built with
+// `ECE_NO_HEAP`.
+void
+ece_test_set_heap_allocator(void);
+
+// Encrypts `plaintext` with an initialized streaming encryption context,
+// passing `chunkLen` bytes at a time. On success, `ciphertext` is set to a
+// buffer that the caller must free.
+int
+ece_test_encrypt_stream(ece_encrypt_ctx_t* ctx, const uint8_t* plaintext,
+                        size_t plaintextLen, size_t chunkLen,
+                        uint8_t** ciphertext, size_t* ciphertextLen);
+
+// Encrypts `plaintext` in place with an initialized streaming encryption
+// context. The plaintext is copied to the end of a buffer with room for
+// `ece_encrypt_update_max_length` bytes, plus `slackLen` extra bytes. On
+// success, `ciphertext` is set to the buffer, which the caller must free.
+int
+ece_test_encrypt_in_place(ece_encrypt_ctx_t* ctx, const uint8_t* plaintext,
+                          size_t plaintextLen, size_t slackLen,
+                          uint8_t** ciphertext, size_t* ciphertextLen);
+
+// Splits `bytes` into separately allocated segments of at most `segmentLen`
+// bytes, preceded by an empty segment. If `bytes` is `NULL`, the segments are
+// filled with a placeholder byte. The caller must free the segments with
+// `ece_test_iov_free`.
+ece_iovec_t*
+ece_test_iov_new(const uint8_t* bytes, size_t len, size_t segmentLen,
+                 size_t* count);
+
+// Copies the first `len` bytes of the segments into `bytes`.
+void
+ece_test_iov_flatten(const ece_iovec_t* iov, size_t count, uint8_t* bytes,
+                     size_t len);
+
+// Frees segments allocated with `ece_test_iov_new`.
+void
+ece_test_iov_free(ece_iovec_t* iov, size_t count);
+
 void
 test_webpush_aesgcm_headers_from_params(void);
 
@@ -27,24 +67,66 @@ test_webpush_aesgcm_headers_extract_params_ok(void);
 void
 test_webpush_aesgcm_headers_extract_params_err(void);
 
+void
+test_webpush_aesgcm_headers_extract_params_slices(void);
+
 void
 test_webpush_aesgcm_encrypt_ok(void);
 
 void
 test_webpush_aesgcm_encrypt_pad(void);
 
+void
+test_webpush_aesgcm_encrypt_stream(void);
+
+void
+test_webpush_aesgcm_encrypt_in_place(void);
+
+void
+test_webpush_aesgcm_encrypt_iov(void);
+
+void
+test_webpush_aesgcm_encrypt_large_pad(void);
+
 void
 test_webpush_aesgcm_decrypt_ok(void);
 
 void
 test_webpush_aesgcm_decrypt_err(void);
 
+void
+test_webpush_aesgcm_decrypt_subscription(void);
+
+void
+test_webpush_aesgcm_decrypt_in_place(void);
+
+void
+test_webpush_aesgcm_decrypt_iov(void);
+
+void
+test_webpush_aesgcm_decrypt_stream(void);
+
 void
 test_webpush_aes128gcm_encrypt_ok(void);
 
 void
 test_webpush_aes128gcm_encrypt_pad(void);
 
+void
+test_webpush_aes128gcm_encrypt_stream(void);
+
+void
+test_webpush_aes128gcm_encrypt_in_place(void);
+
+void
+test_webpush_aes128gcm_encrypt_iov(void);
+
+void
+test_webpush_aes128gcm_encrypt_base64url(void);
+
+void
+test_webpush_aes128gcm_encrypt_large_pad(void);
+
 void
 test_aes128gcm_decrypt_ok(void);
 
@@ -57,14 +139,95 @@ test_aes128gcm_decrypt_err(void);
 void
 test_webpush_aes128gcm_decrypt_err(void);
 
+void
+test_aes128gcm_decrypt_stream(void);
+
+void
+test_webpush_aes128gcm_decrypt_stream(void);
+
+void
+test_webpush_aes128gcm_decrypt_batch(void);
+
+void
+test_webpush_aes128gcm_decrypt_subscription(void);
+
+void
+test_webpush_aes128gcm_decrypt_cipher_pool(void);
+
+void
+test_webpush_aes128gcm_decrypt_in_place(void);
+
+void
+test_webpush_aes128gcm_decrypt_iov(void);
+
+void
+test_webpush_aes128gcm_decrypt_base64url(void);
+
+void
+test_aes128gcm_unpad_large(void);
+
 void
 test_webpush_aes128gcm_e2e(void);
 
 void
 test_webpush_aesgcm_e2e(void);
 
+void
+test_webpush_recipient_e2e(void);
+
+void
+test_webpush_recipient_threads(void);
+
+void
+test_webpush_generate_keys_bulk(void);
+
+void
+test_webpush_encrypt_request(void);
+
+void
+test_webpush_encrypt_parallel(void);
+
+void
+test_webpush_decrypt_parallel(void);
+
+void
+test_webpush_aes128gcm_encrypt_fanout(void);
+
+void
+test_rand_source(void);
+
+void
+test_rand_fork(void);
+
+void
+test_gcm_vectors(void);
+
+void
+test_gcm_equivalence(void);
+
+void
+test_webpush_aes128gcm_decrypt_batch_lanes(void);
+
+void
+test_alloc_hooks(void);
+
+void
+test_alloc_arena(void);
+
 void
 test_base64url_encode(void);
 
 void
 test_base64url_decode(void);
+
+void
+test_base64url_simd(void);
+
+void
+test_base64url_stream(void);
+
+void
+test_base64url_stream_random(void);
+
+void
+test_stats(void);
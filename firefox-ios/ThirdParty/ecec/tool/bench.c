@@ -0,0 +1,1302 @@
+// Measures the speed of key generation, encryption, decryption, header
+// handling, and Base64url coding, through each of the library's entry points:
+// one-shot, streaming, scatter-gather, in-place, parallel, and with
+// subscription and recipient contexts. Each case runs in batches of doubling
+// size until it has taken at least the minimum time, then reports the mean
+// and best per-call latency, and the throughput for cases that process a
+// plaintext or binary input. Results are printed as a JSON array with one
+// object per line, or as CSV, so that runs from different builds can be
+// diffed.
+
+#if !defined(_WIN32) && !defined(_POSIX_C_SOURCE)
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+#include <ece.h>
+
+#include "heap.h"
+
+#define ECE_BENCH_NS_PER_SEC 1000000000ULL
+
+// The Crypto-Key and Encryption headers for "aesgcm" are short; these hold
+// the headers with a trailing null byte.
+#define ECE_BENCH_HEADER_LENGTH 256
+
+// The chunk length for the streaming cases, and the number of segments for
+// the scatter-gather cases.
+#define ECE_BENCH_CHUNK_LENGTH 4096
+#define ECE_BENCH_IOV_COUNT 4
+
+// The number of workers in the pool for the parallel cases, including the
+// calling thread.
+#define ECE_BENCH_POOL_WORKERS 4
+
+// The number of messages in each batch and fan-out call, and the number of
+// key pairs in each bulk key generation call. The bulk count matches the
+// batch size for the shared field inversion. Each of these cases is paired
+// with a loop over the equivalent single-message function, so that the two
+// report the time for the same amount of work.
+#define ECE_BENCH_MULTI_COUNT 8
+#define ECE_BENCH_BULK_COUNT 256
+
+static const size_t ece_bench_plaintext_lens[] = {16, 256, 4096, 65536,
+                                                  1048576};
+static const uint32_t ece_bench_rs[] = {256, 4096, 65536};
+static const size_t ece_bench_pad_lens[] = {0, 1024};
+
+// Messages that are mostly padding, like short messages padded to hide their
+// length. Decryption time for these is dominated by the padding scan.
+static const struct {
+  size_t plaintextLen;
+  uint32_t rs;
+  size_t padLen;
+} ece_bench_padded[] = {
+  {16, 4096, 4000},
+  {256, 65536, 65000},
+  {4096, 4096, 200000},
+};
+
+#define ECE_BENCH_COUNT(array) (sizeof(array) / sizeof((array)[0]))
+
+typedef enum ece_bench_format_e {
+  ECE_BENCH_FORMAT_JSON,
+  ECE_BENCH_FORMAT_CSV,
+} ece_bench_format_t;
+
+typedef struct ece_bench_opts_s {
+  ece_bench_format_t format;
+  uint64_t minTimeNs;
+  const char* filter;
+} ece_bench_opts_t;
+
+// The inputs and outputs shared by all cases. Each case reads the fields set
+// up for it, and writes its output to a buffer that later cases can use as
+// their input.
+typedef struct ece_bench_state_s {
+  uint8_t rawRecvPrivKey[ECE_WEBPUSH_PRIVATE_KEY_LENGTH];
+  uint8_t rawRecvPubKey[ECE_WEBPUSH_PUBLIC_KEY_LENGTH];
+  uint8_t authSecret[ECE_WEBPUSH_AUTH_SECRET_LENGTH];
+  uint8_t salt[ECE_SALT_LENGTH];
+  uint8_t rawSenderPubKey[ECE_WEBPUSH_PUBLIC_KEY_LENGTH];
+  char cryptoKeyHeader[ECE_BENCH_HEADER_LENGTH];
+  size_t cryptoKeyHeaderLen;
+  char encryptionHeader[ECE_BENCH_HEADER_LENGTH];
+  size_t encryptionHeaderLen;
+
+  uint32_t rs;
+  size_t padLen;
+
+  uint8_t* plaintext;
+  size_t plaintextLen;
+  // The "aes128gcm" payload, or "aesgcm" ciphertext.
+  uint8_t* payload;
+  size_t payloadCapacity;
+  size_t payloadLen;
+  // The Base64url-encoded payload.
+  char* base64;
+  size_t base64Capacity;
+  size_t base64Len;
+  // The decrypted or decoded output.
+  uint8_t* output;
+  size_t outputCapacity;
+  // The push request header block and body, built with a reused context.
+  ece_encrypt_ctx_t* encryptCtx;
+  uint8_t* request;
+  size_t requestCapacity;
+
+  // Contexts for the streaming, parallel, subscription, and recipient cases.
+  ece_aes128gcm_decrypt_ctx_t* decryptCtx;
+  ece_pool_t* pool;
+  ece_subscription_t* subscription;
+  ece_recipient_t* recipient;
+  ece_recipient_cache_t* recipientCache;
+
+  // The outputs of the batch and fan-out cases, one every `multiStride`
+  // bytes.
+  uint8_t* multi;
+  size_t multiCapacity;
+  size_t multiStride;
+
+  // The key pairs written by the bulk key generation cases.
+  uint8_t bulkPrivKeys[ECE_BENCH_BULK_COUNT * ECE_WEBPUSH_PRIVATE_KEY_LENGTH];
+  uint8_t bulkPubKeys[ECE_BENCH_BULK_COUNT * ECE_WEBPUSH_PUBLIC_KEY_LENGTH];
+  uint8_t bulkAuthSecrets[ECE_BENCH_BULK_COUNT *
+                          ECE_WEBPUSH_AUTH_SECRET_LENGTH];
+} ece_bench_state_t;
+
+typedef int (*ece_bench_fn_t)(ece_bench_state_t* state);
+
+// Describes a case in the results. `bytesPerCall` is 0 for cases that don't
+// have a meaningful throughput.
+typedef struct ece_bench_case_s {
+  const char* name;
+  ece_bench_fn_t fn;
+  size_t bytesPerCall;
+} ece_bench_case_t;
+
+static uint64_t
+ece_bench_now_ns(void) {
+#ifdef _WIN32
+  LARGE_INTEGER freq, counter;
+  QueryPerformanceFrequency(&freq);
+  QueryPerformanceCounter(&counter);
+  return (uint64_t)((double) counter.QuadPart * ECE_BENCH_NS_PER_SEC /
+                    (double) freq.QuadPart);
+#else
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * ECE_BENCH_NS_PER_SEC + (uint64_t) ts.tv_nsec;
+#endif
+}
+
+static int
+ece_bench_generate_keys(ece_bench_state_t* state) {
+  return ece_webpush_generate_keys(
+    state->rawRecvPrivKey, ECE_WEBPUSH_PRIVATE_KEY_LENGTH, state->rawRecvPubKey,
+    ECE_WEBPUSH_PUBLIC_KEY_LENGTH, state->authSecret,
+    ECE_WEBPUSH_AUTH_SECRET_LENGTH);
+}
+
+static int
+ece_bench_generate_keys_loop(ece_bench_state_t* state) {
+  for (size_t i = 0; i < ECE_BENCH_BULK_COUNT; i++) {
+    int err = ece_webpush_generate_keys(
+      &state->bulkPrivKeys[i * ECE_WEBPUSH_PRIVATE_KEY_LENGTH],
+      ECE_WEBPUSH_PRIVATE_KEY_LENGTH,
+      &state->bulkPubKeys[i * ECE_WEBPUSH_PUBLIC_KEY_LENGTH],
+      ECE_WEBPUSH_PUBLIC_KEY_LENGTH,
+      &state->bulkAuthSecrets[i * ECE_WEBPUSH_AUTH_SECRET_LENGTH],
+      ECE_WEBPUSH_AUTH_SECRET_LENGTH);
+    if (err) {
+      return err;
+    }
+  }
+  return ECE_OK;
+}
+
+static int
+ece_bench_generate_keys_bulk(ece_bench_state_t* state) {
+  return ece_webpush_generate_keys_bulk(
+    ECE_BENCH_BULK_COUNT, state->bulkPrivKeys, sizeof(state->bulkPrivKeys),
+    state->bulkPubKeys, sizeof(state->bulkPubKeys), state->bulkAuthSecrets,
+    sizeof(state->bulkAuthSecrets));
+}
+
+// Splits `len` bytes of `buffer` into `ECE_BENCH_IOV_COUNT` segments of about
+// the same length.
+static void
+ece_bench_split_iov(uint8_t* buffer, size_t len, ece_iovec_t* iov) {
+  size_t segmentLen = len / ECE_BENCH_IOV_COUNT;
+  for (size_t i = 0; i < ECE_BENCH_IOV_COUNT; i++) {
+    iov[i].base = &buffer[i * segmentLen];
+    iov[i].len = i + 1 < ECE_BENCH_IOV_COUNT ? segmentLen
+                                             : len - i * segmentLen;
+  }
+}
+
+// Encrypts the plaintext with the initialized `encryptCtx`, one chunk at a
+// time.
+static int
+ece_bench_encrypt_stream(ece_bench_state_t* state) {
+  size_t payloadLen = 0;
+  for (size_t i = 0; i < state->plaintextLen; i += ECE_BENCH_CHUNK_LENGTH) {
+    size_t chunkLen = state->plaintextLen - i;
+    if (chunkLen > ECE_BENCH_CHUNK_LENGTH) {
+      chunkLen = ECE_BENCH_CHUNK_LENGTH;
+    }
+    size_t outputLen = state->payloadCapacity - payloadLen;
+    int err = ece_encrypt_update(state->encryptCtx, &state->plaintext[i],
+                                 chunkLen, &state->payload[payloadLen],
+                                 &outputLen);
+    if (err) {
+      return err;
+    }
+    payloadLen += outputLen;
+  }
+  size_t outputLen = state->payloadCapacity - payloadLen;
+  int err = ece_encrypt_final(state->encryptCtx, &state->payload[payloadLen],
+                              &outputLen);
+  state->payloadLen = payloadLen + outputLen;
+  return err;
+}
+
+// Decrypts the payload with the initialized `decryptCtx`, one chunk at a time.
+static int
+ece_bench_decrypt_stream(ece_bench_state_t* state) {
+  size_t plaintextLen = 0;
+  for (size_t i = 0; i < state->payloadLen; i += ECE_BENCH_CHUNK_LENGTH) {
+    size_t chunkLen = state->payloadLen - i;
+    if (chunkLen > ECE_BENCH_CHUNK_LENGTH) {
+      chunkLen = ECE_BENCH_CHUNK_LENGTH;
+    }
+    size_t outputLen = state->outputCapacity - plaintextLen;
+    int err = ece_aes128gcm_decrypt_update(
+      state->decryptCtx, &state->payload[i], chunkLen,
+      &state->output[plaintextLen], &outputLen);
+    if (err) {
+      return err;
+    }
+    plaintextLen += outputLen;
+  }
+  size_t outputLen = state->outputCapacity - plaintextLen;
+  return ece_aes128gcm_decrypt_final(state->decryptCtx,
+                                     &state->output[plaintextLen], &outputLen);
+}
+
+// Encrypts the plaintext with the initialized `encryptCtx`, reading and
+// writing `ECE_BENCH_IOV_COUNT` segments.
+static int
+ece_bench_encrypt_iov(ece_bench_state_t* state) {
+  ece_iovec_t plaintext[ECE_BENCH_IOV_COUNT];
+  ece_iovec_t payload[ECE_BENCH_IOV_COUNT];
+  ece_bench_split_iov(state->plaintext, state->plaintextLen, plaintext);
+  ece_bench_split_iov(state->payload, state->payloadCapacity, payload);
+  return ece_encrypt_iov(state->encryptCtx, plaintext, ECE_BENCH_IOV_COUNT,
+                         payload, ECE_BENCH_IOV_COUNT, &state->payloadLen);
+}
+
+// Encrypts the plaintext with the initialized `encryptCtx`, after copying it
+// to the end of the payload buffer. The copy is included in the time.
+static int
+ece_bench_encrypt_in_place(ece_bench_state_t* state) {
+  memcpy(&state->payload[state->payloadCapacity - state->plaintextLen],
+         state->plaintext, state->plaintextLen);
+  return ece_encrypt_in_place(state->encryptCtx, state->payload,
+                              state->payloadCapacity, state->plaintextLen,
+                              &state->payloadLen);
+}
+
+static int
+ece_bench_encrypt_parallel(ece_bench_state_t* state) {
+  state->payloadLen = state->payloadCapacity;
+  return ece_encrypt_parallel(state->encryptCtx, state->pool,
+                              state->plaintext, state->plaintextLen,
+                              state->payload, &state->payloadLen);
+}
+
+static int
+ece_bench_aes128gcm_encrypt(ece_bench_state_t* state) {
+  state->payloadLen = state->payloadCapacity;
+  return ece_webpush_aes128gcm_encrypt(
+    state->rawRecvPubKey, ECE_WEBPUSH_PUBLIC_KEY_LENGTH, state->authSecret,
+    ECE_WEBPUSH_AUTH_SECRET_LENGTH, state->rs, state->padLen, state->plaintext,
+    state->plaintextLen, state->payload, &state->payloadLen);
+}
+
+static int
+ece_bench_aes128gcm_encrypt_request(ece_bench_state_t* state) {
+  size_t requestLen = state->requestCapacity;
+  return ece_webpush_aes128gcm_encrypt_request(
+    state->encryptCtx, state->rawRecvPubKey, ECE_WEBPUSH_PUBLIC_KEY_LENGTH,
+    state->authSecret, ECE_WEBPUSH_AUTH_SECRET_LENGTH, state->rs,
+    state->padLen, 86400, state->plaintext, state->plaintextLen,
+    state->request, &requestLen);
+}
+
+static int
+ece_bench_aes128gcm_encrypt_base64url(ece_bench_state_t* state) {
+  state->base64Len = state->base64Capacity;
+  return ece_webpush_aes128gcm_encrypt_base64url(
+    state->rawRecvPubKey, ECE_WEBPUSH_PUBLIC_KEY_LENGTH, state->authSecret,
+    ECE_WEBPUSH_AUTH_SECRET_LENGTH, state->rs, state->padLen, state->plaintext,
+    state->plaintextLen, ECE_BASE64URL_OMIT_PADDING, state->base64,
+    &state->base64Len);
+}
+
+static int
+ece_bench_aes128gcm_decrypt(ece_bench_state_t* state) {
+  size_t outputLen = state->outputCapacity;
+  return ece_webpush_aes128gcm_decrypt(
+    state->rawRecvPrivKey, ECE_WEBPUSH_PRIVATE_KEY_LENGTH, state->authSecret,
+    ECE_WEBPUSH_AUTH_SECRET_LENGTH, state->payload, state->payloadLen,
+    state->output, &outputLen);
+}
+
+static int
+ece_bench_aes128gcm_decrypt_base64url(ece_bench_state_t* state) {
+  size_t outputLen = state->outputCapacity;
+  return ece_webpush_aes128gcm_decrypt_base64url(
+    state->rawRecvPrivKey, ECE_WEBPUSH_PRIVATE_KEY_LENGTH, state->authSecret,
+    ECE_WEBPUSH_AUTH_SECRET_LENGTH, state->base64, state->base64Len,
+    ECE_BASE64URL_REJECT_PADDING, state->output, &outputLen);
+}
+
+static int
+ece_bench_aes128gcm_encrypt_init(ece_bench_state_t* state) {
+  return ece_webpush_aes128gcm_encrypt_init(
+    state->encryptCtx, state->rawRecvPubKey, ECE_WEBPUSH_PUBLIC_KEY_LENGTH,
+    state->authSecret, ECE_WEBPUSH_AUTH_SECRET_LENGTH, state->rs,
+    state->padLen);
+}
+
+static int
+ece_bench_aes128gcm_encrypt_stream(ece_bench_state_t* state) {
+  int err = ece_bench_aes128gcm_encrypt_init(state);
+  return err ? err : ece_bench_encrypt_stream(state);
+}
+
+static int
+ece_bench_aes128gcm_encrypt_iov(ece_bench_state_t* state) {
+  int err = ece_bench_aes128gcm_encrypt_init(state);
+  return err ? err : ece_bench_encrypt_iov(state);
+}
+
+static int
+ece_bench_aes128gcm_encrypt_in_place(ece_bench_state_t* state) {
+  int err = ece_bench_aes128gcm_encrypt_init(state);
+  return err ? err : ece_bench_encrypt_in_place(state);
+}
+
+static int
+ece_bench_aes128gcm_encrypt_parallel(ece_bench_state_t* state) {
+  int err = ece_bench_aes128gcm_encrypt_init(state);
+  return err ? err : ece_bench_encrypt_parallel(state);
+}
+
+static int
+ece_bench_recipient_aes128gcm_encrypt(ece_bench_state_t* state) {
+  state->payloadLen = state->payloadCapacity;
+  return ece_recipient_aes128gcm_encrypt(
+    state->recipient, state->rs, state->padLen, state->plaintext,
+    state->plaintextLen, state->payload, &state->payloadLen);
+}
+
+// Looks up the recipient in a warm cache for each message, as a sender that
+// doesn't keep its own recipient handles would.
+static int
+ece_bench_recipient_cache_aes128gcm_encrypt(ece_bench_state_t* state) {
+  ece_recipient_t* recipient = NULL;
+  int err = ece_recipient_cache_get(
+    state->recipientCache, state->rawRecvPubKey, ECE_WEBPUSH_PUBLIC_KEY_LENGTH,
+    state->authSecret, ECE_WEBPUSH_AUTH_SECRET_LENGTH, &recipient);
+  if (err) {
+    return err;
+  }
+  state->payloadLen = state->payloadCapacity;
+  err = ece_recipient_aes128gcm_encrypt(recipient, state->rs, state->padLen,
+                                        state->plaintext, state->plaintextLen,
+                                        state->payload, &state->payloadLen);
+  ece_recipient_destroy(recipient);
+  return err;
+}
+
+static int
+ece_bench_aes128gcm_decrypt_stream(ece_bench_state_t* state) {
+  int err = ece_webpush_aes128gcm_decrypt_init(
+    state->decryptCtx, state->rawRecvPrivKey, ECE_WEBPUSH_PRIVATE_KEY_LENGTH,
+    state->authSecret, ECE_WEBPUSH_AUTH_SECRET_LENGTH);
+  return err ? err : ece_bench_decrypt_stream(state);
+}
+
+static int
+ece_bench_aes128gcm_decrypt_iov(ece_bench_state_t* state) {
+  ece_iovec_t payload[ECE_BENCH_IOV_COUNT];
+  ece_iovec_t plaintext[ECE_BENCH_IOV_COUNT];
+  ece_bench_split_iov(state->payload, state->payloadLen, payload);
+  ece_bench_split_iov(state->output, state->outputCapacity, plaintext);
+  size_t plaintextLen;
+  return ece_webpush_aes128gcm_decrypt_iov(
+    state->rawRecvPrivKey, ECE_WEBPUSH_PRIVATE_KEY_LENGTH, state->authSecret,
+    ECE_WEBPUSH_AUTH_SECRET_LENGTH, payload, ECE_BENCH_IOV_COUNT, plaintext,
+    ECE_BENCH_IOV_COUNT, &plaintextLen);
+}
+
+// The in-place cases decrypt a copy of the payload in the output buffer, so
+// that the next call has a payload to decrypt. The copy is included in the
+// time.
+static int
+ece_bench_aes128gcm_decrypt_in_place(ece_bench_state_t* state) {
+  memcpy(state->output, state->payload, state->payloadLen);
+  size_t plaintextOffset;
+  size_t plaintextLen;
+  return ece_webpush_aes128gcm_decrypt_in_place(
+    state->rawRecvPrivKey, ECE_WEBPUSH_PRIVATE_KEY_LENGTH, state->authSecret,
+    ECE_WEBPUSH_AUTH_SECRET_LENGTH, state->output, state->payloadLen,
+    &plaintextOffset, &plaintextLen);
+}
+
+static int
+ece_bench_subscription_aes128gcm_decrypt(ece_bench_state_t* state) {
+  size_t outputLen = state->outputCapacity;
+  return ece_subscription_aes128gcm_decrypt(state->subscription,
+                                            state->payload, state->payloadLen,
+                                            state->output, &outputLen);
+}
+
+static int
+ece_bench_subscription_aes128gcm_decrypt_parallel(ece_bench_state_t* state) {
+  size_t outputLen = state->outputCapacity;
+  return ece_subscription_aes128gcm_decrypt_parallel(
+    state->subscription, state->pool, state->payload, state->payloadLen,
+    state->output, &outputLen);
+}
+
+static int
+ece_bench_subscription_aes128gcm_decrypt_in_place(ece_bench_state_t* state) {
+  memcpy(state->output, state->payload, state->payloadLen);
+  size_t plaintextOffset;
+  size_t plaintextLen;
+  return ece_subscription_aes128gcm_decrypt_in_place(
+    state->subscription, state->output, state->payloadLen, &plaintextOffset,
+    &plaintextLen);
+}
+
+// Decrypts the payload once for each slot in `multi`, with a separate call
+// for each message. This is the baseline for the batch case.
+static int
+ece_bench_aes128gcm_decrypt_loop(ece_bench_state_t* state) {
+  for (size_t i = 0; i < ECE_BENCH_MULTI_COUNT; i++) {
+    size_t outputLen = state->multiStride;
+    int err = ece_webpush_aes128gcm_decrypt(
+      state->rawRecvPrivKey, ECE_WEBPUSH_PRIVATE_KEY_LENGTH, state->authSecret,
+      ECE_WEBPUSH_AUTH_SECRET_LENGTH, state->payload, state->payloadLen,
+      &state->multi[i * state->multiStride], &outputLen);
+    if (err) {
+      return err;
+    }
+  }
+  return ECE_OK;
+}
+
+static int
+ece_bench_aes128gcm_decrypt_batch(ece_bench_state_t* state) {
+  const uint8_t* payloads[ECE_BENCH_MULTI_COUNT];
+  size_t payloadLens[ECE_BENCH_MULTI_COUNT];
+  uint8_t* plaintexts[ECE_BENCH_MULTI_COUNT];
+  size_t plaintextLens[ECE_BENCH_MULTI_COUNT];
+  int errs[ECE_BENCH_MULTI_COUNT];
+  for (size_t i = 0; i < ECE_BENCH_MULTI_COUNT; i++) {
+    payloads[i] = state->payload;
+    payloadLens[i] = state->payloadLen;
+    plaintexts[i] = &state->multi[i * state->multiStride];
+    plaintextLens[i] = state->multiStride;
+  }
+  return ece_webpush_aes128gcm_decrypt_batch(
+    state->rawRecvPrivKey, ECE_WEBPUSH_PRIVATE_KEY_LENGTH, state->authSecret,
+    ECE_WEBPUSH_AUTH_SECRET_LENGTH, ECE_BENCH_MULTI_COUNT, payloads,
+    payloadLens, plaintexts, plaintextLens, errs);
+}
+
+// Encrypts the plaintext once for each slot in `multi`, with a separate call
+// for each subscriber. This is the baseline for the fan-out cases.
+static int
+ece_bench_aes128gcm_encrypt_loop(ece_bench_state_t* state) {
+  for (size_t i = 0; i < ECE_BENCH_MULTI_COUNT; i++) {
+    size_t payloadLen = state->multiStride;
+    int err = ece_webpush_aes128gcm_encrypt(
+      state->rawRecvPubKey, ECE_WEBPUSH_PUBLIC_KEY_LENGTH, state->authSecret,
+      ECE_WEBPUSH_AUTH_SECRET_LENGTH, state->rs, state->padLen,
+      state->plaintext, state->plaintextLen,
+      &state->multi[i * state->multiStride], &payloadLen);
+    if (err) {
+      return err;
+    }
+  }
+  return ECE_OK;
+}
+
+// Encrypts the plaintext to `ECE_BENCH_MULTI_COUNT` subscribers in one call.
+// The subscribers share a key pair, which doesn't change the work done for
+// each of them.
+static int
+ece_bench_aes128gcm_encrypt_fanout_with(ece_bench_state_t* state,
+                                        ece_pool_t* pool,
+                                        ece_sender_key_policy_t policy) {
+  const uint8_t* rawRecvPubKeys[ECE_BENCH_MULTI_COUNT];
+  const uint8_t* authSecrets[ECE_BENCH_MULTI_COUNT];
+  uint8_t* payloads[ECE_BENCH_MULTI_COUNT];
+  size_t payloadLens[ECE_BENCH_MULTI_COUNT];
+  int errs[ECE_BENCH_MULTI_COUNT];
+  for (size_t i = 0; i < ECE_BENCH_MULTI_COUNT; i++) {
+    rawRecvPubKeys[i] = state->rawRecvPubKey;
+    authSecrets[i] = state->authSecret;
+    payloads[i] = &state->multi[i * state->multiStride];
+    payloadLens[i] = state->multiStride;
+  }
+  return ece_webpush_aes128gcm_encrypt_fanout(
+    pool, policy, state->rs, state->padLen, state->plaintext,
+    state->plaintextLen, ECE_BENCH_MULTI_COUNT, rawRecvPubKeys, authSecrets,
+    payloads, payloadLens, errs);
+}
+
+static int
+ece_bench_aes128gcm_encrypt_fanout(ece_bench_state_t* state) {
+  return ece_bench_aes128gcm_encrypt_fanout_with(state, NULL,
+                                                 ECE_SENDER_KEY_PER_RECIPIENT);
+}
+
+static int
+ece_bench_aes128gcm_encrypt_fanout_shared_key(ece_bench_state_t* state) {
+  return ece_bench_aes128gcm_encrypt_fanout_with(state, NULL,
+                                                 ECE_SENDER_KEY_PER_CALL);
+}
+
+static int
+ece_bench_aes128gcm_encrypt_fanout_parallel(ece_bench_state_t* state) {
+  return ece_bench_aes128gcm_encrypt_fanout_with(state, state->pool,
+                                                 ECE_SENDER_KEY_PER_RECIPIENT);
+}
+
+static int
+ece_bench_aes128gcm_extract_params(ece_bench_state_t* state) {
+  const uint8_t* salt;
+  size_t saltLen;
+  const uint8_t* keyId;
+  size_t keyIdLen;
+  uint32_t rs;
+  const uint8_t* ciphertext;
+  size_t ciphertextLen;
+  return ece_aes128gcm_payload_extract_params(
+    state->payload, state->payloadLen, &salt, &saltLen, &keyId, &keyIdLen, &rs,
+    &ciphertext, &ciphertextLen);
+}
+
+static int
+ece_bench_aesgcm_encrypt(ece_bench_state_t* state) {
+  state->payloadLen = state->payloadCapacity;
+  return ece_webpush_aesgcm_encrypt(
+    state->rawRecvPubKey, ECE_WEBPUSH_PUBLIC_KEY_LENGTH, state->authSecret,
+    ECE_WEBPUSH_AUTH_SECRET_LENGTH, state->rs, state->padLen, state->plaintext,
+    state->plaintextLen, state->salt, ECE_SALT_LENGTH, state->rawSenderPubKey,
+    ECE_WEBPUSH_PUBLIC_KEY_LENGTH, state->payload, &state->payloadLen);
+}
+
+static int
+ece_bench_aesgcm_encrypt_request(ece_bench_state_t* state) {
+  size_t requestLen = state->requestCapacity;
+  return ece_webpush_aesgcm_encrypt_request(
+    state->encryptCtx, state->rawRecvPubKey, ECE_WEBPUSH_PUBLIC_KEY_LENGTH,
+    state->authSecret, ECE_WEBPUSH_AUTH_SECRET_LENGTH, state->rs,
+    state->padLen, 86400, state->plaintext, state->plaintextLen,
+    state->request, &requestLen);
+}
+
+static int
+ece_bench_aesgcm_decrypt(ece_bench_state_t* state) {
+  size_t outputLen = state->outputCapacity;
+  return ece_webpush_aesgcm_decrypt(
+    state->rawRecvPrivKey, ECE_WEBPUSH_PRIVATE_KEY_LENGTH, state->authSecret,
+    ECE_WEBPUSH_AUTH_SECRET_LENGTH, state->salt, ECE_SALT_LENGTH,
+    state->rawSenderPubKey, ECE_WEBPUSH_PUBLIC_KEY_LENGTH, state->rs,
+    state->payload, state->payloadLen, state->output, &outputLen);
+}
+
+// The "aesgcm" encryption cases write the salt and sender public key to
+// `state`, so that the decryption cases can use them.
+static int
+ece_bench_aesgcm_encrypt_init(ece_bench_state_t* state) {
+  return ece_webpush_aesgcm_encrypt_init(
+    state->encryptCtx, state->rawRecvPubKey, ECE_WEBPUSH_PUBLIC_KEY_LENGTH,
+    state->authSecret, ECE_WEBPUSH_AUTH_SECRET_LENGTH, state->rs,
+    state->padLen, state->salt, ECE_SALT_LENGTH, state->rawSenderPubKey,
+    ECE_WEBPUSH_PUBLIC_KEY_LENGTH);
+}
+
+static int
+ece_bench_aesgcm_encrypt_stream(ece_bench_state_t* state) {
+  int err = ece_bench_aesgcm_encrypt_init(state);
+  return err ? err : ece_bench_encrypt_stream(state);
+}
+
+static int
+ece_bench_aesgcm_encrypt_iov(ece_bench_state_t* state) {
+  int err = ece_bench_aesgcm_encrypt_init(state);
+  return err ? err : ece_bench_encrypt_iov(state);
+}
+
+static int
+ece_bench_aesgcm_encrypt_in_place(ece_bench_state_t* state) {
+  int err = ece_bench_aesgcm_encrypt_init(state);
+  return err ? err : ece_bench_encrypt_in_place(state);
+}
+
+static int
+ece_bench_aesgcm_encrypt_parallel(ece_bench_state_t* state) {
+  int err = ece_bench_aesgcm_encrypt_init(state);
+  return err ? err : ece_bench_encrypt_parallel(state);
+}
+
+static int
+ece_bench_recipient_aesgcm_encrypt(ece_bench_state_t* state) {
+  state->payloadLen = state->payloadCapacity;
+  return ece_recipient_aesgcm_encrypt(
+    state->recipient, state->rs, state->padLen, state->plaintext,
+    state->plaintextLen, state->salt, ECE_SALT_LENGTH, state->rawSenderPubKey,
+    ECE_WEBPUSH_PUBLIC_KEY_LENGTH, state->payload, &state->payloadLen);
+}
+
+static int
+ece_bench_aesgcm_decrypt_stream(ece_bench_state_t* state) {
+  int err = ece_webpush_aesgcm_decrypt_init(
+    state->decryptCtx, state->rawRecvPrivKey, ECE_WEBPUSH_PRIVATE_KEY_LENGTH,
+    state->authSecret, ECE_WEBPUSH_AUTH_SECRET_LENGTH, state->salt,
+    ECE_SALT_LENGTH, state->rawSenderPubKey, ECE_WEBPUSH_PUBLIC_KEY_LENGTH,
+    state->rs);
+  return err ? err : ece_bench_decrypt_stream(state);
+}
+
+static int
+ece_bench_aesgcm_decrypt_iov(ece_bench_state_t* state) {
+  ece_iovec_t ciphertext[ECE_BENCH_IOV_COUNT];
+  ece_iovec_t plaintext[ECE_BENCH_IOV_COUNT];
+  ece_bench_split_iov(state->payload, state->payloadLen, ciphertext);
+  ece_bench_split_iov(state->output, state->outputCapacity, plaintext);
+  size_t plaintextLen;
+  return ece_webpush_aesgcm_decrypt_iov(
+    state->rawRecvPrivKey, ECE_WEBPUSH_PRIVATE_KEY_LENGTH, state->authSecret,
+    ECE_WEBPUSH_AUTH_SECRET_LENGTH, state->salt, ECE_SALT_LENGTH,
+    state->rawSenderPubKey, ECE_WEBPUSH_PUBLIC_KEY_LENGTH, state->rs,
+    ciphertext, ECE_BENCH_IOV_COUNT, plaintext, ECE_BENCH_IOV_COUNT,
+    &plaintextLen);
+}
+
+static int
+ece_bench_aesgcm_decrypt_in_place(ece_bench_state_t* state) {
+  memcpy(state->output, state->payload, state->payloadLen);
+  size_t plaintextLen;
+  return ece_webpush_aesgcm_decrypt_in_place(
+    state->rawRecvPrivKey, ECE_WEBPUSH_PRIVATE_KEY_LENGTH, state->authSecret,
+    ECE_WEBPUSH_AUTH_SECRET_LENGTH, state->salt, ECE_SALT_LENGTH,
+    state->rawSenderPubKey, ECE_WEBPUSH_PUBLIC_KEY_LENGTH, state->rs,
+    state->output, state->payloadLen, &plaintextLen);
+}
+
+static int
+ece_bench_subscription_aesgcm_decrypt(ece_bench_state_t* state) {
+  size_t outputLen = state->outputCapacity;
+  return ece_subscription_aesgcm_decrypt(
+    state->subscription, state->salt, ECE_SALT_LENGTH, state->rawSenderPubKey,
+    ECE_WEBPUSH_PUBLIC_KEY_LENGTH, state->rs, state->payload,
+    state->payloadLen, state->output, &outputLen);
+}
+
+static int
+ece_bench_subscription_aesgcm_decrypt_parallel(ece_bench_state_t* state) {
+  size_t outputLen = state->outputCapacity;
+  return ece_subscription_aesgcm_decrypt_parallel(
+    state->subscription, state->pool, state->salt, ECE_SALT_LENGTH,
+    state->rawSenderPubKey, ECE_WEBPUSH_PUBLIC_KEY_LENGTH, state->rs,
+    state->payload, state->payloadLen, state->output, &outputLen);
+}
+
+static int
+ece_bench_subscription_aesgcm_decrypt_in_place(ece_bench_state_t* state) {
+  memcpy(state->output, state->payload, state->payloadLen);
+  size_t plaintextLen;
+  return ece_subscription_aesgcm_decrypt_in_place(
+    state->subscription, state->salt, ECE_SALT_LENGTH, state->rawSenderPubKey,
+    ECE_WEBPUSH_PUBLIC_KEY_LENGTH, state->rs, state->output,
+    state->payloadLen, &plaintextLen);
+}
+
+static int
+ece_bench_aesgcm_headers_from_params(ece_bench_state_t* state) {
+  size_t cryptoKeyHeaderLen = ECE_BENCH_HEADER_LENGTH - 1;
+  size_t encryptionHeaderLen = ECE_BENCH_HEADER_LENGTH - 1;
+  int err = ece_webpush_aesgcm_headers_from_params(
+    state->salt, ECE_SALT_LENGTH, state->rawSenderPubKey,
+    ECE_WEBPUSH_PUBLIC_KEY_LENGTH, state->rs, state->cryptoKeyHeader,
+    &cryptoKeyHeaderLen, state->encryptionHeader, &encryptionHeaderLen);
+  if (err) {
+    return err;
+  }
+  state->cryptoKeyHeader[cryptoKeyHeaderLen] = '\0';
+  state->cryptoKeyHeaderLen = cryptoKeyHeaderLen;
+  state->encryptionHeader[encryptionHeaderLen] = '\0';
+  state->encryptionHeaderLen = encryptionHeaderLen;
+  return ECE_OK;
+}
+
+static int
+ece_bench_aesgcm_headers_extract_params(ece_bench_state_t* state) {
+  uint8_t salt[ECE_SALT_LENGTH];
+  uint8_t rawSenderPubKey[ECE_WEBPUSH_PUBLIC_KEY_LENGTH];
+  uint32_t rs;
+  return ece_webpush_aesgcm_headers_extract_params(
+    state->cryptoKeyHeader, state->encryptionHeader, salt, ECE_SALT_LENGTH,
+    rawSenderPubKey, ECE_WEBPUSH_PUBLIC_KEY_LENGTH, &rs);
+}
+
+static int
+ece_bench_aesgcm_headers_extract_params_slices(ece_bench_state_t* state) {
+  uint8_t salt[ECE_SALT_LENGTH];
+  uint8_t rawSenderPubKey[ECE_WEBPUSH_PUBLIC_KEY_LENGTH];
+  uint32_t rs;
+  return ece_webpush_aesgcm_headers_extract_params_slices(
+    state->cryptoKeyHeader, state->cryptoKeyHeaderLen, state->encryptionHeader,
+    state->encryptionHeaderLen, salt, ECE_SALT_LENGTH, rawSenderPubKey,
+    ECE_WEBPUSH_PUBLIC_KEY_LENGTH, &rs);
+}
+
+static int
+ece_bench_base64url_encode(ece_bench_state_t* state) {
+  state->base64Len =
+    ece_base64url_encode(state->plaintext, state->plaintextLen,
+                         ECE_BASE64URL_OMIT_PADDING, state->base64,
+                         state->base64Capacity);
+  return state->base64Len ? ECE_OK : ECE_ERROR_OUT_OF_MEMORY;
+}
+
+static int
+ece_bench_base64url_decode(ece_bench_state_t* state) {
+  size_t outputLen =
+    ece_base64url_decode(state->base64, state->base64Len,
+                         ECE_BASE64URL_REJECT_PADDING, state->output,
+                         state->outputCapacity);
+  return outputLen ? ECE_OK : ECE_ERROR_INVALID_BASE64URL;
+}
+
+static bool
+ece_bench_is_selected(const ece_bench_opts_t* opts, const char* name) {
+  return !opts->filter || strstr(name, opts->filter);
+}
+
+static void
+ece_bench_print_header(const ece_bench_opts_t* opts) {
+  if (opts->format == ECE_BENCH_FORMAT_CSV) {
+    printf("name,plaintext_len,rs,pad_len,iterations,mean_ns,best_ns,"
+           "mb_per_sec,error\n");
+  } else {
+    printf("[\n");
+  }
+}
+
+static void
+ece_bench_print_footer(const ece_bench_opts_t* opts) {
+  if (opts->format == ECE_BENCH_FORMAT_JSON) {
+    printf("\n]\n");
+  }
+}
+
+static void
+ece_bench_print_result(const ece_bench_opts_t* opts, bool isFirst,
+                       const ece_bench_case_t* c,
+                       const ece_bench_state_t* state, uint64_t iterations,
+                       double meanNs, double bestNs, int err) {
+  double mbPerSec = 0;
+  if (c->bytesPerCall && meanNs > 0) {
+    mbPerSec = c->bytesPerCall * 1e3 / meanNs;
+  }
+  if (opts->format == ECE_BENCH_FORMAT_CSV) {
+    printf("%s,%zu,%u,%zu,%llu,%.1f,%.1f,%.2f,%d\n", c->name,
+           state->plaintextLen, (unsigned int) state->rs, state->padLen,
+           (unsigned long long) iterations, meanNs, bestNs, mbPerSec, err);
+    return;
+  }
+  printf("%s  {\"name\": \"%s\", \"plaintext_len\": %zu, \"rs\": %u, "
+         "\"pad_len\": %zu, \"iterations\": %llu, \"mean_ns\": %.1f, "
+         "\"best_ns\": %.1f, \"mb_per_sec\": %.2f, \"error\": %d}",
+         isFirst ? "" : ",\n", c->name, state->plaintextLen,
+         (unsigned int) state->rs, state->padLen,
+         (unsigned long long) iterations, meanNs, bestNs, mbPerSec, err);
+}
+
+// Runs a case until it has taken at least the minimum time, and prints the
+// result. Returns the first error from the case, if any.
+static int
+ece_bench_run(const ece_bench_opts_t* opts, bool* isFirst,
+              const ece_bench_case_t* c, ece_bench_state_t* state) {
+  if (!ece_bench_is_selected(opts, c->name)) {
+    return ECE_OK;
+  }
+  // The first call warms up caches and lazily initialized state, like the
+  // cipher context pool and Base64url kernel dispatch.
+  int err = c->fn(state);
+  uint64_t iterations = 0;
+  uint64_t totalNs = 0;
+  double bestNs = 0;
+  for (uint64_t batchLen = 1; !err && totalNs < opts->minTimeNs;
+       batchLen *= 2) {
+    uint64_t start = ece_bench_now_ns();
+    for (uint64_t i = 0; i < batchLen; i++) {
+      err = c->fn(state);
+      if (err) {
+        break;
+      }
+    }
+    uint64_t batchNs = ece_bench_now_ns() - start;
+    double batchMeanNs = (double) batchNs / batchLen;
+    if (!iterations || batchMeanNs < bestNs) {
+      bestNs = batchMeanNs;
+    }
+    iterations += batchLen;
+    totalNs += batchNs;
+  }
+  double meanNs = iterations ? (double) totalNs / iterations : 0;
+  ece_bench_print_result(opts, *isFirst, c, state, iterations, meanNs, bestNs,
+                         err);
+  *isFirst = false;
+  if (err) {
+    fprintf(stderr, "Error: `%s` failed for plaintext length %zu: %d\n",
+            c->name, state->plaintextLen, err);
+  }
+  return err;
+}
+
+// Grows `*buffer` to hold at least `len` bytes.
+static bool
+ece_bench_reserve(void** buffer, size_t* capacity, size_t len) {
+  if (*capacity >= len) {
+    return true;
+  }
+  void* resized = realloc(*buffer, len);
+  if (!resized) {
+    return false;
+  }
+  *buffer = resized;
+  *capacity = len;
+  return true;
+}
+
+// Grows the payload and output buffers to hold a message with the plaintext
+// length, record size, and padding length in `state`, for either scheme. The
+// streaming encryption functions can ask for one more record than the
+// payload needs, so the buffers have room for it.
+static int
+ece_bench_reserve_payload(ece_bench_state_t* state) {
+  size_t payloadLen = ece_aes128gcm_payload_max_length(
+    state->rs, state->padLen, state->plaintextLen);
+  size_t ciphertextLen = ece_aesgcm_ciphertext_max_length(
+    state->rs, state->padLen, state->plaintextLen);
+  size_t maxLen = payloadLen > ciphertextLen ? payloadLen : ciphertextLen;
+  maxLen += state->rs;
+  size_t base64Len =
+    ece_base64url_encode(NULL, maxLen, ECE_BASE64URL_OMIT_PADDING, NULL, 0);
+  size_t aes128gcmRequestLen = ece_webpush_aes128gcm_request_length(
+    state->rs, state->padLen, state->plaintextLen, 86400);
+  size_t aesgcmRequestLen = ece_webpush_aesgcm_request_length(
+    state->rs, state->padLen, state->plaintextLen, 86400);
+  size_t requestLen = aes128gcmRequestLen > aesgcmRequestLen
+                        ? aes128gcmRequestLen
+                        : aesgcmRequestLen;
+  if (!ece_bench_reserve((void**) &state->payload, &state->payloadCapacity,
+                         maxLen) ||
+      !ece_bench_reserve((void**) &state->base64, &state->base64Capacity,
+                         base64Len) ||
+      !ece_bench_reserve((void**) &state->output, &state->outputCapacity,
+                         maxLen) ||
+      !ece_bench_reserve((void**) &state->request, &state->requestCapacity,
+                         requestLen)) {
+    fprintf(stderr, "Error: Failed to allocate buffers for length %zu\n",
+            maxLen);
+    return ECE_ERROR_OUT_OF_MEMORY;
+  }
+  return ECE_OK;
+}
+
+// Runs all encryption and decryption cases for the plaintext length, record
+// size, and padding length in `state`.
+static int
+ece_bench_run_matrix(const ece_bench_opts_t* opts, bool* isFirst,
+                     ece_bench_state_t* state) {
+  size_t plaintextLen = state->plaintextLen;
+  int err = ece_bench_reserve_payload(state);
+  if (err) {
+    return err;
+  }
+
+  static const ece_bench_case_t aes128gcmCases[] = {
+    {"aes128gcm_encrypt", &ece_bench_aes128gcm_encrypt, 0},
+    {"aes128gcm_encrypt_base64url", &ece_bench_aes128gcm_encrypt_base64url, 0},
+    {"aes128gcm_encrypt_request", &ece_bench_aes128gcm_encrypt_request, 0},
+    {"aes128gcm_encrypt_stream", &ece_bench_aes128gcm_encrypt_stream, 0},
+    {"aes128gcm_encrypt_iov", &ece_bench_aes128gcm_encrypt_iov, 0},
+    {"aes128gcm_encrypt_in_place", &ece_bench_aes128gcm_encrypt_in_place, 0},
+    {"aes128gcm_encrypt_parallel", &ece_bench_aes128gcm_encrypt_parallel, 0},
+    {"recipient_aes128gcm_encrypt", &ece_bench_recipient_aes128gcm_encrypt, 0},
+    {"recipient_cache_aes128gcm_encrypt",
+     &ece_bench_recipient_cache_aes128gcm_encrypt, 0},
+    {"aes128gcm_decrypt", &ece_bench_aes128gcm_decrypt, 0},
+    {"aes128gcm_decrypt_base64url", &ece_bench_aes128gcm_decrypt_base64url, 0},
+    {"aes128gcm_decrypt_stream", &ece_bench_aes128gcm_decrypt_stream, 0},
+    {"aes128gcm_decrypt_iov", &ece_bench_aes128gcm_decrypt_iov, 0},
+    {"aes128gcm_decrypt_in_place", &ece_bench_aes128gcm_decrypt_in_place, 0},
+    {"subscription_aes128gcm_decrypt",
+     &ece_bench_subscription_aes128gcm_decrypt, 0},
+    {"subscription_aes128gcm_decrypt_parallel",
+     &ece_bench_subscription_aes128gcm_decrypt_parallel, 0},
+    {"subscription_aes128gcm_decrypt_in_place",
+     &ece_bench_subscription_aes128gcm_decrypt_in_place, 0},
+  };
+  static const ece_bench_case_t aesgcmCases[] = {
+    {"aesgcm_encrypt", &ece_bench_aesgcm_encrypt, 0},
+    {"aesgcm_encrypt_request", &ece_bench_aesgcm_encrypt_request, 0},
+    {"aesgcm_encrypt_stream", &ece_bench_aesgcm_encrypt_stream, 0},
+    {"aesgcm_encrypt_iov", &ece_bench_aesgcm_encrypt_iov, 0},
+    {"aesgcm_encrypt_in_place", &ece_bench_aesgcm_encrypt_in_place, 0},
+    {"aesgcm_encrypt_parallel", &ece_bench_aesgcm_encrypt_parallel, 0},
+    {"recipient_aesgcm_encrypt", &ece_bench_recipient_aesgcm_encrypt, 0},
+    {"aesgcm_decrypt", &ece_bench_aesgcm_decrypt, 0},
+    {"aesgcm_decrypt_stream", &ece_bench_aesgcm_decrypt_stream, 0},
+    {"aesgcm_decrypt_iov", &ece_bench_aesgcm_decrypt_iov, 0},
+    {"aesgcm_decrypt_in_place", &ece_bench_aesgcm_decrypt_in_place, 0},
+    {"subscription_aesgcm_decrypt", &ece_bench_subscription_aesgcm_decrypt,
+     0},
+    {"subscription_aesgcm_decrypt_parallel",
+     &ece_bench_subscription_aesgcm_decrypt_parallel, 0},
+    {"subscription_aesgcm_decrypt_in_place",
+     &ece_bench_subscription_aesgcm_decrypt_in_place, 0},
+  };
+
+  // The decryption cases need a payload, even if the encryption cases are
+  // filtered out.
+  err = ece_bench_aes128gcm_encrypt_base64url(state);
+  if (!err) {
+    err = ece_bench_aes128gcm_encrypt(state);
+  }
+  if (err) {
+    fprintf(stderr, "Error: Failed to encrypt \"aes128gcm\" payload: %d\n",
+            err);
+    return err;
+  }
+  int firstErr = ECE_OK;
+  for (size_t i = 0; i < ECE_BENCH_COUNT(aes128gcmCases); i++) {
+    ece_bench_case_t c = aes128gcmCases[i];
+    c.bytesPerCall = plaintextLen;
+    err = ece_bench_run(opts, isFirst, &c, state);
+    if (err && !firstErr) {
+      firstErr = err;
+    }
+  }
+
+  err = ece_bench_aesgcm_encrypt(state);
+  if (err) {
+    fprintf(stderr, "Error: Failed to encrypt \"aesgcm\" ciphertext: %d\n",
+            err);
+    return err;
+  }
+  for (size_t i = 0; i < ECE_BENCH_COUNT(aesgcmCases); i++) {
+    ece_bench_case_t c = aesgcmCases[i];
+    c.bytesPerCall = plaintextLen;
+    err = ece_bench_run(opts, isFirst, &c, state);
+    if (err && !firstErr) {
+      firstErr = err;
+    }
+  }
+  return firstErr;
+}
+
+// Runs the cases that handle `ECE_BENCH_MULTI_COUNT` messages per call, each
+// after the loop that it replaces. The throughput counts the plaintext of
+// every message.
+static int
+ece_bench_run_multi(const ece_bench_opts_t* opts, bool* isFirst,
+                    ece_bench_state_t* state) {
+  int err = ece_bench_reserve_payload(state);
+  if (err) {
+    return err;
+  }
+  state->multiStride = state->payloadCapacity;
+  if (!ece_bench_reserve((void**) &state->multi, &state->multiCapacity,
+                         ECE_BENCH_MULTI_COUNT * state->multiStride)) {
+    fprintf(stderr, "Error: Failed to allocate buffers for %d messages\n",
+            ECE_BENCH_MULTI_COUNT);
+    return ECE_ERROR_OUT_OF_MEMORY;
+  }
+  size_t bytesPerCall = ECE_BENCH_MULTI_COUNT * state->plaintextLen;
+  ece_bench_case_t cases[] = {
+    {"aes128gcm_encrypt_loop", &ece_bench_aes128gcm_encrypt_loop,
+     bytesPerCall},
+    {"aes128gcm_encrypt_fanout", &ece_bench_aes128gcm_encrypt_fanout,
+     bytesPerCall},
+    {"aes128gcm_encrypt_fanout_shared_key",
+     &ece_bench_aes128gcm_encrypt_fanout_shared_key, bytesPerCall},
+    {"aes128gcm_encrypt_fanout_parallel",
+     &ece_bench_aes128gcm_encrypt_fanout_parallel, bytesPerCall},
+    {"aes128gcm_decrypt_loop", &ece_bench_aes128gcm_decrypt_loop,
+     bytesPerCall},
+    {"aes128gcm_decrypt_batch", &ece_bench_aes128gcm_decrypt_batch,
+     bytesPerCall},
+  };
+  err = ece_bench_aes128gcm_encrypt(state);
+  if (err) {
+    fprintf(stderr, "Error: Failed to encrypt \"aes128gcm\" payload: %d\n",
+            err);
+    return err;
+  }
+  int firstErr = ECE_OK;
+  for (size_t i = 0; i < ECE_BENCH_COUNT(cases); i++) {
+    err = ece_bench_run(opts, isFirst, &cases[i], state);
+    if (err && !firstErr) {
+      firstErr = err;
+    }
+  }
+  return firstErr;
+}
+
+// Runs the cases that don't depend on the record size or padding: key
+// generation, header handling, and Base64url coding.
+static int
+ece_bench_run_single(const ece_bench_opts_t* opts, bool* isFirst,
+                     ece_bench_state_t* state) {
+  static const ece_bench_case_t cases[] = {
+    {"aes128gcm_extract_params", &ece_bench_aes128gcm_extract_params, 0},
+    {"aesgcm_headers_from_params", &ece_bench_aesgcm_headers_from_params, 0},
+    {"aesgcm_headers_extract_params", &ece_bench_aesgcm_headers_extract_params,
+     0},
+    {"aesgcm_headers_extract_params_slices",
+     &ece_bench_aesgcm_headers_extract_params_slices, 0},
+  };
+  int firstErr = ECE_OK;
+  int err = ece_bench_reserve_payload(state);
+  if (!err) {
+    err = ece_bench_aes128gcm_encrypt(state);
+  }
+  if (!err) {
+    err = ece_bench_aesgcm_encrypt(state);
+  }
+  if (!err) {
+    err = ece_bench_aesgcm_headers_from_params(state);
+  }
+  if (err) {
+    fprintf(stderr, "Error: Failed to set up header cases: %d\n", err);
+    return err;
+  }
+  for (size_t i = 0; i < ECE_BENCH_COUNT(cases); i++) {
+    err = ece_bench_run(opts, isFirst, &cases[i], state);
+    if (err && !firstErr) {
+      firstErr = err;
+    }
+  }
+  return firstErr;
+}
+
+static int
+ece_bench_run_base64url(const ece_bench_opts_t* opts, bool* isFirst,
+                        ece_bench_state_t* state) {
+  size_t base64Len = ece_base64url_encode(NULL, state->plaintextLen,
+                                          ECE_BASE64URL_OMIT_PADDING, NULL, 0);
+  if (!ece_bench_reserve((void**) &state->base64, &state->base64Capacity,
+                         base64Len) ||
+      !ece_bench_reserve((void**) &state->output, &state->outputCapacity,
+                         state->plaintextLen)) {
+    fprintf(stderr, "Error: Failed to allocate buffers for length %zu\n",
+            state->plaintextLen);
+    return ECE_ERROR_OUT_OF_MEMORY;
+  }
+  ece_bench_case_t cases[] = {
+    {"base64url_encode", &ece_bench_base64url_encode, state->plaintextLen},
+    {"base64url_decode", &ece_bench_base64url_decode, state->plaintextLen},
+  };
+  int err = ece_bench_base64url_encode(state);
+  if (err) {
+    fprintf(stderr, "Error: Failed to encode input: %d\n", err);
+    return err;
+  }
+  int firstErr = ECE_OK;
+  for (size_t i = 0; i < ECE_BENCH_COUNT(cases); i++) {
+    err = ece_bench_run(opts, isFirst, &cases[i], state);
+    if (err && !firstErr) {
+      firstErr = err;
+    }
+  }
+  return firstErr;
+}
+
+// A fast, deterministic randomness source for `--seed`, so that runs draw the
+// same salts and keys, and the time spent refilling the buffer doesn't depend
+// on the system DRBG. This is SplitMix64; it's not suitable for real keys.
+static bool
+ece_bench_seeded_fill(void* opaque, uint8_t* bytes, size_t len) {
+  uint64_t* state = opaque;
+  for (size_t i = 0; i < len; i += 8) {
+    uint64_t z = (*state += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    z ^= z >> 31;
+    for (size_t j = 0; j < 8 && i + j < len; j++) {
+      bytes[i + j] = (uint8_t)(z >> (j * 8));
+    }
+  }
+  return true;
+}
+
+static void
+ece_bench_usage(const char* name) {
+  fprintf(stderr,
+          "Usage: %s [--format json|csv] [--min-time-ms <ms>] "
+          "[--filter <substring>] [--seed <n>]\n",
+          name);
+}
+
+int
+main(int argc, char** argv) {
+  ece_heap_set_allocator();
+  ece_bench_opts_t opts = {
+    .format = ECE_BENCH_FORMAT_JSON,
+    .minTimeNs = 200 * (ECE_BENCH_NS_PER_SEC / 1000),
+    .filter = NULL,
+  };
+  uint64_t seed = 0;
+  ece_rand_source_t seededSource = {
+    .fill = &ece_bench_seeded_fill,
+    .opaque = &seed,
+  };
+  for (int i = 1; i < argc; i++) {
+    if (i + 1 == argc) {
+      ece_bench_usage(argv[0]);
+      return 2;
+    }
+    const char* value = argv[++i];
+    if (!strcmp(argv[i - 1], "--format")) {
+      if (!strcmp(value, "json")) {
+        opts.format = ECE_BENCH_FORMAT_JSON;
+      } else if (!strcmp(value, "csv")) {
+        opts.format = ECE_BENCH_FORMAT_CSV;
+      } else {
+        ece_bench_usage(argv[0]);
+        return 2;
+      }
+    } else if (!strcmp(argv[i - 1], "--min-time-ms")) {
+      opts.minTimeNs =
+        strtoull(value, NULL, 10) * (ECE_BENCH_NS_PER_SEC / 1000);
+    } else if (!strcmp(argv[i - 1], "--filter")) {
+      opts.filter = value;
+    } else if (!strcmp(argv[i - 1], "--seed")) {
+      seed = strtoull(value, NULL, 10);
+      ece_set_rand_source(&seededSource);
+    } else {
+      ece_bench_usage(argv[0]);
+      return 2;
+    }
+  }
+
+  int err = 0;
+  ece_bench_state_t state;
+  memset(&state, 0, sizeof(ece_bench_state_t));
+
+  size_t maxPlaintextLen = 0;
+  for (size_t i = 0; i < ECE_BENCH_COUNT(ece_bench_plaintext_lens); i++) {
+    if (ece_bench_plaintext_lens[i] > maxPlaintextLen) {
+      maxPlaintextLen = ece_bench_plaintext_lens[i];
+    }
+  }
+  state.plaintext = malloc(maxPlaintextLen);
+  if (!state.plaintext) {
+    fprintf(stderr, "Error: Failed to allocate %zu bytes for plaintext\n",
+            maxPlaintextLen);
+    goto error;
+  }
+  // The contents don't affect the speed of any case, but shouldn't be all
+  // zeros.
+  for (size_t i = 0; i < maxPlaintextLen; i++) {
+    state.plaintext[i] = (uint8_t)(i * 131 + 7);
+  }
+
+  state.encryptCtx = ece_encrypt_ctx_new();
+  state.decryptCtx = ece_aes128gcm_decrypt_ctx_new();
+  if (!state.encryptCtx || !state.decryptCtx) {
+    fprintf(stderr, "Error: Failed to allocate encryption contexts\n");
+    goto error;
+  }
+  state.pool = ece_pool_new(ECE_BENCH_POOL_WORKERS);
+  if (!state.pool) {
+    fprintf(stderr, "Error: Failed to start %d workers\n",
+            ECE_BENCH_POOL_WORKERS);
+    goto error;
+  }
+  // Holds one recipient, so that every lookup after the first is a hit.
+  state.recipientCache = ece_recipient_cache_new(1);
+  if (!state.recipientCache) {
+    fprintf(stderr, "Error: Failed to allocate recipient cache\n");
+    goto error;
+  }
+
+  bool isFirst = true;
+  ece_bench_print_header(&opts);
+
+  static const ece_bench_case_t keygenCases[] = {
+    {"generate_keys", &ece_bench_generate_keys, 0},
+    {"generate_keys_loop", &ece_bench_generate_keys_loop, 0},
+    {"generate_keys_bulk", &ece_bench_generate_keys_bulk, 0},
+  };
+  for (size_t i = 0; i < ECE_BENCH_COUNT(keygenCases); i++) {
+    if (ece_bench_run(&opts, &isFirst, &keygenCases[i], &state)) {
+      err = 1;
+    }
+  }
+  // The remaining cases need a key pair, even if the key generation cases are
+  // filtered out.
+  if (ece_bench_generate_keys(&state)) {
+    fprintf(stderr, "Error: Failed to generate subscription keys\n");
+    goto error;
+  }
+  if (ece_subscription_create(
+        state.rawRecvPrivKey, ECE_WEBPUSH_PRIVATE_KEY_LENGTH, state.authSecret,
+        ECE_WEBPUSH_AUTH_SECRET_LENGTH, &state.subscription) ||
+      ece_recipient_create(state.rawRecvPubKey, ECE_WEBPUSH_PUBLIC_KEY_LENGTH,
+                           state.authSecret, ECE_WEBPUSH_AUTH_SECRET_LENGTH,
+                           &state.recipient)) {
+    fprintf(stderr, "Error: Failed to import subscription keys\n");
+    goto error;
+  }
+
+  state.rs = 4096;
+  state.plaintextLen = 256;
+  if (ece_bench_run_single(&opts, &isFirst, &state)) {
+    err = 1;
+  }
+
+  for (size_t i = 0; i < ECE_BENCH_COUNT(ece_bench_plaintext_lens); i++) {
+    state.plaintextLen = ece_bench_plaintext_lens[i];
+    state.rs = 0;
+    state.padLen = 0;
+    if (ece_bench_run_base64url(&opts, &isFirst, &state)) {
+      err = 1;
+    }
+    state.rs = 4096;
+    if (ece_bench_run_multi(&opts, &isFirst, &state)) {
+      err = 1;
+    }
+    for (size_t j = 0; j < ECE_BENCH_COUNT(ece_bench_rs); j++) {
+      state.rs = ece_bench_rs[j];
+      for (size_t k = 0; k < ECE_BENCH_COUNT(ece_bench_pad_lens); k++) {
+        state.padLen = ece_bench_pad_lens[k];
+        if (ece_bench_run_matrix(&opts, &isFirst, &state)) {
+          err = 1;
+        }
+      }
+    }
+  }
+  for (size_t i = 0; i < ECE_BENCH_COUNT(ece_bench_padded); i++) {
+    state.plaintextLen = ece_bench_padded[i].plaintextLen;
+    state.rs = ece_bench_padded[i].rs;
+    state.padLen = ece_bench_padded[i].padLen;
+    if (ece_bench_run_matrix(&opts, &isFirst, &state)) {
+      err = 1;
+    }
+  }
+
+  ece_bench_print_footer(&opts);
+  fflush(stdout);
+  goto end;
+
+error:
+  err = 1;
+
+end:
+  free(state.plaintext);
+  free(state.payload);
+  free(state.base64);
+  free(state.output);
+  free(state.request);
+  free(state.multi);
+  ece_encrypt_ctx_free(state.encryptCtx);
+  ece_aes128gcm_decrypt_ctx_free(state.decryptCtx);
+  ece_pool_free(state.pool);
+  ece_subscription_destroy(state.subscription);
+  ece_recipient_destroy(state.recipient);
+  ece_recipient_cache_free(state.recipientCache);
+  return err;
+}
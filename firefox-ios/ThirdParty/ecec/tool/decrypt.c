@@ -1,64 +1,135 @@
+// Decrypts a Web Push message. With three arguments, this decrypts a short
+// Base64url-encoded "aes128gcm" message, and prints it. With options, it
+// decrypts a file in constant memory: the input is read in chunks and passed
+// to a streaming decryption context, and each record is written as soon as
+// it's authenticated. The throughput is printed to standard error.
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
 #include <ece.h>
 
-int
-main(int argc, char** argv) {
-  if (argc < 4) {
-    fprintf(stderr, "Usage: %s <auth-secret> <receiver-private> <message>",
-            argv[0]);
-    return 2;
-  }
+#include "file.h"
+#include "heap.h"
 
-  int err = 0;
-  uint8_t* payload = NULL;
-  uint8_t* plaintext = NULL;
+typedef enum ece_decrypt_scheme_e {
+  ECE_DECRYPT_SCHEME_AES128GCM,
+  ECE_DECRYPT_SCHEME_AESGCM,
+} ece_decrypt_scheme_t;
 
-  uint8_t authSecret[ECE_WEBPUSH_AUTH_SECRET_LENGTH];
-  if (!ece_base64url_decode(argv[1], strlen(argv[1]),
+typedef struct ece_decrypt_opts_s {
+  ece_decrypt_scheme_t scheme;
+  const char* rawRecvPrivKey;
+  const char* authSecret;
+  const char* cryptoKeyHeader;
+  const char* encryptionHeader;
+  ece_file_format_t inputFormat;
+  ece_file_format_t outputFormat;
+  const char* inputPath;
+  const char* outputPath;
+} ece_decrypt_opts_t;
+
+static void
+ece_decrypt_usage(const char* name) {
+  fprintf(stderr,
+          "Usage: %s <auth-secret> <receiver-private> <message>\n"
+          "   or: %s --private-key <key> --auth-secret <secret>\n"
+          "  [--scheme aes128gcm|aesgcm] [--crypto-key <header>]\n"
+          "  [--encryption <header>] [--input-format raw|base64url]\n"
+          "  [--output-format raw|base64url] [--in <path>] [--out <path>]\n",
+          name, name);
+}
+
+static bool
+ece_decrypt_parse_opts(int argc, char** argv, ece_decrypt_opts_t* opts) {
+  for (int i = 1; i < argc; i++) {
+    if (i + 1 == argc) {
+      return false;
+    }
+    const char* name = argv[i];
+    const char* value = argv[++i];
+    if (!strcmp(name, "--scheme")) {
+      if (!strcmp(value, "aes128gcm")) {
+        opts->scheme = ECE_DECRYPT_SCHEME_AES128GCM;
+      } else if (!strcmp(value, "aesgcm")) {
+        opts->scheme = ECE_DECRYPT_SCHEME_AESGCM;
+      } else {
+        return false;
+      }
+    } else if (!strcmp(name, "--private-key")) {
+      opts->rawRecvPrivKey = value;
+    } else if (!strcmp(name, "--auth-secret")) {
+      opts->authSecret = value;
+    } else if (!strcmp(name, "--crypto-key")) {
+      opts->cryptoKeyHeader = value;
+    } else if (!strcmp(name, "--encryption")) {
+      opts->encryptionHeader = value;
+    } else if (!strcmp(name, "--input-format")) {
+      if (!ece_file_parse_format(value, &opts->inputFormat)) {
+        return false;
+      }
+    } else if (!strcmp(name, "--output-format")) {
+      if (!ece_file_parse_format(value, &opts->outputFormat)) {
+        return false;
+      }
+    } else if (!strcmp(name, "--in")) {
+      opts->inputPath = value;
+    } else if (!strcmp(name, "--out")) {
+      opts->outputPath = value;
+    } else {
+      return false;
+    }
+  }
+  if (!opts->rawRecvPrivKey || !opts->authSecret) {
+    return false;
+  }
+  // "aesgcm" sends the salt, record size, and sender key in headers.
+  return opts->scheme == ECE_DECRYPT_SCHEME_AES128GCM ||
+         (opts->cryptoKeyHeader && opts->encryptionHeader);
+}
+
+static bool
+ece_decrypt_decode_keys(const char* authSecretBase64,
+                        const char* rawRecvPrivKeyBase64, uint8_t* authSecret,
+                        uint8_t* rawRecvPrivKey) {
+  if (!ece_base64url_decode(authSecretBase64, strlen(authSecretBase64),
                             ECE_BASE64URL_REJECT_PADDING, authSecret,
                             ECE_WEBPUSH_AUTH_SECRET_LENGTH)) {
     fprintf(stderr, "Error: Failed to Base64url-decode auth secret\n");
-    goto error;
+    return false;
   }
-  uint8_t rawRecvPrivKey[ECE_WEBPUSH_PRIVATE_KEY_LENGTH];
-  if (!ece_base64url_decode(argv[2], strlen(argv[2]),
+  if (!ece_base64url_decode(rawRecvPrivKeyBase64, strlen(rawRecvPrivKeyBase64),
                             ECE_BASE64URL_REJECT_PADDING, rawRecvPrivKey,
                             ECE_WEBPUSH_PRIVATE_KEY_LENGTH)) {
     fprintf(stderr, "Error: Failed to Base64url-decode private key\n");
-    goto error;
-  }
-  size_t payloadBase64Len = strlen(argv[3]);
-  size_t payloadLen = ece_base64url_decode(
-    argv[3], payloadBase64Len, ECE_BASE64URL_REJECT_PADDING, NULL, 0);
-  if (!payloadLen) {
-    fprintf(stderr, "Error: Empty or invalid Base64url-encoded message\n");
-    goto error;
-  }
-  payload = calloc(payloadLen, sizeof(uint8_t));
-  if (!payload) {
-    fprintf(
-      stderr,
-      "Error: Failed to allocate %zu bytes for Base64url-decoded message\n",
-      payloadLen);
-    goto error;
+    return false;
   }
-  payloadLen =
-    ece_base64url_decode(argv[3], payloadBase64Len,
-                         ECE_BASE64URL_REJECT_PADDING, payload, payloadLen);
-  if (!payloadLen) {
-    fprintf(stderr, "Error: Failed to Base64url-decode message\n");
+  return true;
+}
+
+// Decrypts a message passed on the command line, and prints it.
+static int
+ece_decrypt_message(const char* authSecretBase64,
+                    const char* rawRecvPrivKeyBase64, const char* message) {
+  int err = 0;
+  uint8_t* plaintext = NULL;
+
+  uint8_t authSecret[ECE_WEBPUSH_AUTH_SECRET_LENGTH];
+  uint8_t rawRecvPrivKey[ECE_WEBPUSH_PRIVATE_KEY_LENGTH];
+  if (!ece_decrypt_decode_keys(authSecretBase64, rawRecvPrivKeyBase64,
+                               authSecret, rawRecvPrivKey)) {
     goto error;
   }
-
-  size_t plaintextLen = ece_aes128gcm_plaintext_max_length(payload, payloadLen);
+  // Decode and decrypt the message in one pass, without a buffer for the
+  // decoded payload.
+  size_t payloadBase64Len = strlen(message);
+  size_t plaintextLen =
+    ece_aes128gcm_plaintext_max_length_base64url(message, payloadBase64Len);
   if (!plaintextLen) {
-    fprintf(stderr, "Error: Encrypted message too short\n");
+    fprintf(stderr, "Error: Empty, invalid, or truncated message\n");
     goto error;
   }
-  plaintextLen++;
   plaintext = calloc(plaintextLen, sizeof(uint8_t));
   if (!plaintext) {
     fprintf(stderr,
@@ -66,23 +137,162 @@ main(int argc, char** argv) {
             plaintextLen);
     goto error;
   }
-  err = ece_webpush_aes128gcm_decrypt(
+  err = ece_webpush_aes128gcm_decrypt_base64url(
     rawRecvPrivKey, ECE_WEBPUSH_PRIVATE_KEY_LENGTH, authSecret,
-    ECE_WEBPUSH_AUTH_SECRET_LENGTH, payload, payloadLen, plaintext,
-    &plaintextLen);
+    ECE_WEBPUSH_AUTH_SECRET_LENGTH, message, payloadBase64Len,
+    ECE_BASE64URL_REJECT_PADDING, plaintext, &plaintextLen);
   if (err) {
     fprintf(stderr, "Error: Failed to decrypt message: %d\n", err);
     goto error;
   }
-  plaintext[plaintextLen] = '\0';
-  printf("Decrypted message: %s\n", plaintext);
+  // The plaintext may contain null bytes, so we write all of it instead of
+  // printing it as a string.
+  if (fputs("Decrypted message: ", stdout) < 0 ||
+      fwrite(plaintext, sizeof(uint8_t), plaintextLen, stdout) !=
+        plaintextLen ||
+      fputs("\n", stdout) < 0) {
+    fprintf(stderr, "Error: Failed to write decrypted message\n");
+    goto error;
+  }
   goto end;
 
 error:
   err = 1;
 
 end:
-  free(payload);
   free(plaintext);
   return err;
 }
+
+static int
+ece_decrypt_init(ece_aes128gcm_decrypt_ctx_t* ctx,
+                 const ece_decrypt_opts_t* opts, const uint8_t* rawRecvPrivKey,
+                 const uint8_t* authSecret) {
+  if (opts->scheme == ECE_DECRYPT_SCHEME_AES128GCM) {
+    return ece_webpush_aes128gcm_decrypt_init(
+      ctx, rawRecvPrivKey, ECE_WEBPUSH_PRIVATE_KEY_LENGTH, authSecret,
+      ECE_WEBPUSH_AUTH_SECRET_LENGTH);
+  }
+  uint8_t salt[ECE_SALT_LENGTH];
+  uint8_t rawSenderPubKey[ECE_WEBPUSH_PUBLIC_KEY_LENGTH];
+  uint32_t rs;
+  int err = ece_webpush_aesgcm_headers_extract_params(
+    opts->cryptoKeyHeader, opts->encryptionHeader, salt, ECE_SALT_LENGTH,
+    rawSenderPubKey, ECE_WEBPUSH_PUBLIC_KEY_LENGTH, &rs);
+  if (err) {
+    return err;
+  }
+  return ece_webpush_aesgcm_decrypt_init(
+    ctx, rawRecvPrivKey, ECE_WEBPUSH_PRIVATE_KEY_LENGTH, authSecret,
+    ECE_WEBPUSH_AUTH_SECRET_LENGTH, salt, ECE_SALT_LENGTH, rawSenderPubKey,
+    ECE_WEBPUSH_PUBLIC_KEY_LENGTH, rs);
+}
+
+// Decrypts a file. If decryption fails partway through, the output file is
+// removed; the caller should discard any partial output written to standard
+// output.
+static int
+ece_decrypt_file(const ece_decrypt_opts_t* opts) {
+  int err = 0;
+  ece_aes128gcm_decrypt_ctx_t* ctx = NULL;
+  uint8_t* plaintext = NULL;
+  size_t plaintextCapacity = 0;
+  ece_file_reader_t reader = {0};
+  ece_file_writer_t writer = {0};
+
+  uint8_t authSecret[ECE_WEBPUSH_AUTH_SECRET_LENGTH];
+  uint8_t rawRecvPrivKey[ECE_WEBPUSH_PRIVATE_KEY_LENGTH];
+  if (!ece_decrypt_decode_keys(opts->authSecret, opts->rawRecvPrivKey,
+                               authSecret, rawRecvPrivKey)) {
+    goto error;
+  }
+  ctx = ece_aes128gcm_decrypt_ctx_new();
+  if (!ctx) {
+    fprintf(stderr, "Error: Failed to allocate decryption context\n");
+    goto error;
+  }
+  int decryptErr = ece_decrypt_init(ctx, opts, rawRecvPrivKey, authSecret);
+  if (decryptErr) {
+    fprintf(stderr, "Error: Failed to initialize decryption: %d\n",
+            decryptErr);
+    goto error;
+  }
+  if (ece_file_reader_open(&reader, opts->inputPath, opts->inputFormat) ||
+      ece_file_writer_open(&writer, opts->outputPath, opts->outputFormat)) {
+    goto error;
+  }
+
+  uint64_t start = ece_file_now_ns();
+  for (;;) {
+    const uint8_t* payload;
+    size_t chunkLen;
+    if (ece_file_reader_next(&reader, &payload, &chunkLen)) {
+      goto error;
+    }
+    if (!chunkLen) {
+      break;
+    }
+    // The context holds back at most one record, so the buffer only grows
+    // past the chunk size for record sizes larger than a chunk.
+    size_t plaintextLen =
+      ece_aes128gcm_decrypt_update_max_length(ctx, chunkLen);
+    if (ece_file_reserve(&plaintext, &plaintextCapacity, plaintextLen)) {
+      goto error;
+    }
+    decryptErr = ece_aes128gcm_decrypt_update(ctx, payload, chunkLen,
+                                              plaintext, &plaintextLen);
+    if (decryptErr) {
+      fprintf(stderr, "Error: Failed to decrypt input: %d\n", decryptErr);
+      goto error;
+    }
+    if (ece_file_writer_write(&writer, plaintext, plaintextLen)) {
+      goto error;
+    }
+  }
+  size_t plaintextLen = ece_aes128gcm_decrypt_update_max_length(ctx, 0);
+  if (ece_file_reserve(&plaintext, &plaintextCapacity, plaintextLen)) {
+    goto error;
+  }
+  decryptErr = ece_aes128gcm_decrypt_final(ctx, plaintext, &plaintextLen);
+  if (decryptErr) {
+    fprintf(stderr, "Error: Failed to decrypt input: %d\n", decryptErr);
+    goto error;
+  }
+  if (ece_file_writer_write(&writer, plaintext, plaintextLen) ||
+      ece_file_writer_finish(&writer)) {
+    goto error;
+  }
+  ece_file_report("Decrypted", reader.readLen, writer.writtenLen,
+                  ece_file_now_ns() - start);
+  goto end;
+
+error:
+  err = 1;
+  ece_file_writer_abort(&writer);
+
+end:
+  ece_file_reader_close(&reader);
+  ece_aes128gcm_decrypt_ctx_free(ctx);
+  free(plaintext);
+  return err;
+}
+
+int
+main(int argc, char** argv) {
+  ece_heap_set_allocator();
+  // Options always start with "--", so anything else is the original
+  // positional form. Like the original, this ignores extra arguments.
+  if (argc >= 4 && strncmp(argv[1], "--", 2)) {
+    return ece_decrypt_message(argv[1], argv[2], argv[3]);
+  }
+  ece_decrypt_opts_t opts = {
+    .scheme = ECE_DECRYPT_SCHEME_AES128GCM,
+    .inputFormat = ECE_FILE_FORMAT_RAW,
+    .outputFormat = ECE_FILE_FORMAT_RAW,
+  };
+  if (argc < 2 || !ece_decrypt_parse_opts(argc, argv, &opts)) {
+    ece_decrypt_usage(argv[0]);
+    return 2;
+  }
+  return ece_decrypt_file(&opts);
+}
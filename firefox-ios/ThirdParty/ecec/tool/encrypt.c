@@ -0,0 +1,247 @@
+// Encrypts a file for a Web Push subscription, in constant memory. The input
+// is read in chunks and passed to a streaming encryption context, and each
+// sealed record is written as soon as it's ready. For "aesgcm", the
+// `Crypto-Key` and `Encryption` headers are printed to standard error, along
+// with the throughput.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <ece.h>
+
+#include "file.h"
+#include "heap.h"
+
+// Large enough for the "aesgcm" headers, with a trailing null byte.
+#define ECE_ENCRYPT_HEADER_LENGTH 256
+
+typedef enum ece_encrypt_scheme_e {
+  ECE_ENCRYPT_SCHEME_AES128GCM,
+  ECE_ENCRYPT_SCHEME_AESGCM,
+} ece_encrypt_scheme_t;
+
+typedef struct ece_encrypt_opts_s {
+  ece_encrypt_scheme_t scheme;
+  const char* rawRecvPubKey;
+  const char* authSecret;
+  uint32_t rs;
+  size_t padLen;
+  ece_file_format_t inputFormat;
+  ece_file_format_t outputFormat;
+  const char* inputPath;
+  const char* outputPath;
+} ece_encrypt_opts_t;
+
+static void
+ece_encrypt_usage(const char* name) {
+  fprintf(stderr,
+          "Usage: %s --public-key <key> --auth-secret <secret>\n"
+          "  [--scheme aes128gcm|aesgcm] [--rs <n>] [--pad <n>]\n"
+          "  [--input-format raw|base64url] [--output-format raw|base64url]\n"
+          "  [--in <path>] [--out <path>]\n",
+          name);
+}
+
+static bool
+ece_encrypt_parse_size(const char* value, unsigned long long max,
+                       unsigned long long* result) {
+  char* end;
+  unsigned long long parsed = strtoull(value, &end, 10);
+  if (!*value || *end || parsed > max) {
+    return false;
+  }
+  *result = parsed;
+  return true;
+}
+
+static bool
+ece_encrypt_parse_opts(int argc, char** argv, ece_encrypt_opts_t* opts) {
+  for (int i = 1; i < argc; i++) {
+    if (i + 1 == argc) {
+      return false;
+    }
+    const char* name = argv[i];
+    const char* value = argv[++i];
+    unsigned long long size;
+    if (!strcmp(name, "--scheme")) {
+      if (!strcmp(value, "aes128gcm")) {
+        opts->scheme = ECE_ENCRYPT_SCHEME_AES128GCM;
+      } else if (!strcmp(value, "aesgcm")) {
+        opts->scheme = ECE_ENCRYPT_SCHEME_AESGCM;
+      } else {
+        return false;
+      }
+    } else if (!strcmp(name, "--public-key")) {
+      opts->rawRecvPubKey = value;
+    } else if (!strcmp(name, "--auth-secret")) {
+      opts->authSecret = value;
+    } else if (!strcmp(name, "--rs")) {
+      if (!ece_encrypt_parse_size(value, UINT32_MAX, &size)) {
+        return false;
+      }
+      opts->rs = (uint32_t) size;
+    } else if (!strcmp(name, "--pad")) {
+      if (!ece_encrypt_parse_size(value, SIZE_MAX, &size)) {
+        return false;
+      }
+      opts->padLen = (size_t) size;
+    } else if (!strcmp(name, "--input-format")) {
+      if (!ece_file_parse_format(value, &opts->inputFormat)) {
+        return false;
+      }
+    } else if (!strcmp(name, "--output-format")) {
+      if (!ece_file_parse_format(value, &opts->outputFormat)) {
+        return false;
+      }
+    } else if (!strcmp(name, "--in")) {
+      opts->inputPath = value;
+    } else if (!strcmp(name, "--out")) {
+      opts->outputPath = value;
+    } else {
+      return false;
+    }
+  }
+  return opts->rawRecvPubKey && opts->authSecret;
+}
+
+// Initializes the context, and prints the "aesgcm" headers.
+static int
+ece_encrypt_init(ece_encrypt_ctx_t* ctx, const ece_encrypt_opts_t* opts,
+                 const uint8_t* rawRecvPubKey, const uint8_t* authSecret) {
+  if (opts->scheme == ECE_ENCRYPT_SCHEME_AES128GCM) {
+    return ece_webpush_aes128gcm_encrypt_init(
+      ctx, rawRecvPubKey, ECE_WEBPUSH_PUBLIC_KEY_LENGTH, authSecret,
+      ECE_WEBPUSH_AUTH_SECRET_LENGTH, opts->rs, opts->padLen);
+  }
+  uint8_t salt[ECE_SALT_LENGTH];
+  uint8_t rawSenderPubKey[ECE_WEBPUSH_PUBLIC_KEY_LENGTH];
+  int err = ece_webpush_aesgcm_encrypt_init(
+    ctx, rawRecvPubKey, ECE_WEBPUSH_PUBLIC_KEY_LENGTH, authSecret,
+    ECE_WEBPUSH_AUTH_SECRET_LENGTH, opts->rs, opts->padLen, salt,
+    ECE_SALT_LENGTH, rawSenderPubKey, ECE_WEBPUSH_PUBLIC_KEY_LENGTH);
+  if (err) {
+    return err;
+  }
+  char cryptoKeyHeader[ECE_ENCRYPT_HEADER_LENGTH];
+  size_t cryptoKeyHeaderLen = ECE_ENCRYPT_HEADER_LENGTH - 1;
+  char encryptionHeader[ECE_ENCRYPT_HEADER_LENGTH];
+  size_t encryptionHeaderLen = ECE_ENCRYPT_HEADER_LENGTH - 1;
+  err = ece_webpush_aesgcm_headers_from_params(
+    salt, ECE_SALT_LENGTH, rawSenderPubKey, ECE_WEBPUSH_PUBLIC_KEY_LENGTH,
+    opts->rs, cryptoKeyHeader, &cryptoKeyHeaderLen, encryptionHeader,
+    &encryptionHeaderLen);
+  if (err) {
+    return err;
+  }
+  cryptoKeyHeader[cryptoKeyHeaderLen] = '\0';
+  encryptionHeader[encryptionHeaderLen] = '\0';
+  fprintf(stderr, "Crypto-Key: %s\nEncryption: %s\n", cryptoKeyHeader,
+          encryptionHeader);
+  return ECE_OK;
+}
+
+int
+main(int argc, char** argv) {
+  ece_heap_set_allocator();
+  ece_encrypt_opts_t opts = {
+    .scheme = ECE_ENCRYPT_SCHEME_AES128GCM,
+    .rs = 4096,
+    .inputFormat = ECE_FILE_FORMAT_RAW,
+    .outputFormat = ECE_FILE_FORMAT_RAW,
+  };
+  if (!ece_encrypt_parse_opts(argc, argv, &opts)) {
+    ece_encrypt_usage(argv[0]);
+    return 2;
+  }
+
+  int err = 0;
+  ece_encrypt_ctx_t* ctx = NULL;
+  uint8_t* ciphertext = NULL;
+  size_t ciphertextCapacity = 0;
+  ece_file_reader_t reader = {0};
+  ece_file_writer_t writer = {0};
+
+  uint8_t rawRecvPubKey[ECE_WEBPUSH_PUBLIC_KEY_LENGTH];
+  if (!ece_base64url_decode(opts.rawRecvPubKey, strlen(opts.rawRecvPubKey),
+                            ECE_BASE64URL_REJECT_PADDING, rawRecvPubKey,
+                            ECE_WEBPUSH_PUBLIC_KEY_LENGTH)) {
+    fprintf(stderr, "Error: Failed to Base64url-decode public key\n");
+    goto error;
+  }
+  uint8_t authSecret[ECE_WEBPUSH_AUTH_SECRET_LENGTH];
+  if (!ece_base64url_decode(opts.authSecret, strlen(opts.authSecret),
+                            ECE_BASE64URL_REJECT_PADDING, authSecret,
+                            ECE_WEBPUSH_AUTH_SECRET_LENGTH)) {
+    fprintf(stderr, "Error: Failed to Base64url-decode auth secret\n");
+    goto error;
+  }
+  ctx = ece_encrypt_ctx_new();
+  if (!ctx) {
+    fprintf(stderr, "Error: Failed to allocate encryption context\n");
+    goto error;
+  }
+  int encryptErr = ece_encrypt_init(ctx, &opts, rawRecvPubKey, authSecret);
+  if (encryptErr) {
+    fprintf(stderr, "Error: Failed to initialize encryption: %d\n",
+            encryptErr);
+    goto error;
+  }
+  if (ece_file_reader_open(&reader, opts.inputPath, opts.inputFormat) ||
+      ece_file_writer_open(&writer, opts.outputPath, opts.outputFormat)) {
+    goto error;
+  }
+
+  uint64_t start = ece_file_now_ns();
+  for (;;) {
+    const uint8_t* plaintext;
+    size_t chunkLen;
+    if (ece_file_reader_next(&reader, &plaintext, &chunkLen)) {
+      goto error;
+    }
+    if (!chunkLen) {
+      break;
+    }
+    size_t ciphertextLen = ece_encrypt_update_max_length(ctx, chunkLen);
+    if (ece_file_reserve(&ciphertext, &ciphertextCapacity, ciphertextLen)) {
+      goto error;
+    }
+    encryptErr = ece_encrypt_update(ctx, plaintext, chunkLen, ciphertext,
+                                    &ciphertextLen);
+    if (encryptErr) {
+      fprintf(stderr, "Error: Failed to encrypt input: %d\n", encryptErr);
+      goto error;
+    }
+    if (ece_file_writer_write(&writer, ciphertext, ciphertextLen)) {
+      goto error;
+    }
+  }
+  size_t ciphertextLen = ece_encrypt_update_max_length(ctx, 0);
+  if (ece_file_reserve(&ciphertext, &ciphertextCapacity, ciphertextLen)) {
+    goto error;
+  }
+  encryptErr = ece_encrypt_final(ctx, ciphertext, &ciphertextLen);
+  if (encryptErr) {
+    fprintf(stderr, "Error: Failed to encrypt input: %d\n", encryptErr);
+    goto error;
+  }
+  if (ece_file_writer_write(&writer, ciphertext, ciphertextLen)) {
+    goto error;
+  }
+  if (ece_file_writer_finish(&writer)) {
+    goto error;
+  }
+  ece_file_report("Encrypted", reader.readLen, writer.writtenLen,
+                  ece_file_now_ns() - start);
+  goto end;
+
+error:
+  err = 1;
+  ece_file_writer_abort(&writer);
+
+end:
+  ece_file_reader_close(&reader);
+  ece_encrypt_ctx_free(ctx);
+  free(ciphertext);
+  return err;
+}
@@ -0,0 +1,406 @@
+#if !defined(_WIN32)
+// `fileno`, `mmap`, and `clock_gettime` need POSIX declarations, and
+// `_FILE_OFFSET_BITS` lets 32-bit systems map windows past 2 GB.
+#define _POSIX_C_SOURCE 200809L
+#define _FILE_OFFSET_BITS 64
+#define ECE_FILE_HAVE_MMAP
+#endif
+
+#include "file.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <time.h>
+#endif
+
+#define ECE_FILE_NS_PER_SEC 1000000000ULL
+
+// The size of each mapped window. Only one window is mapped at a time, so
+// this bounds the address space that a large file uses, and the pages that
+// count against the process until the window is unmapped. It's a multiple of
+// every supported page size, so each window starts at an aligned offset.
+#define ECE_FILE_WINDOW_SIZE (16 * 1024 * 1024)
+
+// A full chunk of Base64url characters, plus up to 3 characters of an
+// incomplete quantum from the previous chunk, decode to at most this many
+// bytes.
+#define ECE_FILE_DECODED_SIZE ((ECE_FILE_CHUNK_SIZE + 3) / 4 * 3)
+
+// A full chunk of bytes, plus up to 2 bytes of an incomplete group from the
+// previous chunk, encode to at most this many characters.
+#define ECE_FILE_ENCODED_SIZE ((ECE_FILE_CHUNK_SIZE + 2) / 3 * 4)
+
+static bool
+ece_file_is_std(const char* path) {
+  return !path || !strcmp(path, "-");
+}
+
+bool
+ece_file_parse_format(const char* value, ece_file_format_t* format) {
+  if (!strcmp(value, "raw")) {
+    *format = ECE_FILE_FORMAT_RAW;
+    return true;
+  }
+  if (!strcmp(value, "base64url")) {
+    *format = ECE_FILE_FORMAT_BASE64URL;
+    return true;
+  }
+  return false;
+}
+
+int
+ece_file_reader_open(ece_file_reader_t* reader, const char* path,
+                     ece_file_format_t format) {
+  memset(reader, 0, sizeof(ece_file_reader_t));
+  reader->format = format;
+  if (ece_file_is_std(path)) {
+#ifdef _WIN32
+    _setmode(_fileno(stdin), _O_BINARY);
+#endif
+    reader->file = stdin;
+  } else {
+    reader->file = fopen(path, "rb");
+    if (!reader->file) {
+      fprintf(stderr, "Error: Failed to open %s: %s\n", path, strerror(errno));
+      return 1;
+    }
+  }
+#ifdef ECE_FILE_HAVE_MMAP
+  // Empty files can't be mapped, and pipes and terminals don't support it.
+  struct stat st;
+  if (!fstat(fileno(reader->file), &st) && S_ISREG(st.st_mode) &&
+      st.st_size > 0) {
+    reader->isMapped = true;
+    reader->fileLen = (uint64_t) st.st_size;
+  }
+#endif
+  if (!reader->isMapped) {
+    reader->buffer = malloc(ECE_FILE_CHUNK_SIZE);
+    if (!reader->buffer) {
+      fprintf(stderr, "Error: Failed to allocate input buffer\n");
+      return 1;
+    }
+  }
+  if (format == ECE_FILE_FORMAT_BASE64URL) {
+    ece_base64url_decoder_init(&reader->decoder, ECE_BASE64URL_IGNORE_PADDING);
+    reader->decoded = malloc(ECE_FILE_DECODED_SIZE);
+    if (!reader->decoded) {
+      fprintf(stderr, "Error: Failed to allocate decoding buffer\n");
+      return 1;
+    }
+  }
+  return 0;
+}
+
+#ifdef ECE_FILE_HAVE_MMAP
+// Unmaps the current window, and maps the next one. Sets `windowLen` to 0 at
+// the end of the file.
+static int
+ece_file_reader_map_next(ece_file_reader_t* reader) {
+  if (reader->window) {
+    munmap(reader->window, reader->windowLen);
+    reader->window = NULL;
+    reader->windowLen = 0;
+    reader->windowStart = 0;
+  }
+  uint64_t windowLen = reader->fileLen - reader->mapOffset;
+  if (!windowLen) {
+    return 0;
+  }
+  if (windowLen > ECE_FILE_WINDOW_SIZE) {
+    windowLen = ECE_FILE_WINDOW_SIZE;
+  }
+  void* window = mmap(NULL, (size_t) windowLen, PROT_READ, MAP_PRIVATE,
+                      fileno(reader->file), (off_t) reader->mapOffset);
+  if (window == MAP_FAILED) {
+    fprintf(stderr, "Error: Failed to map input: %s\n", strerror(errno));
+    return 1;
+  }
+  // We read each window once, front to back, so the kernel can read ahead
+  // aggressively and drop pages behind us.
+  posix_madvise(window, (size_t) windowLen, POSIX_MADV_SEQUENTIAL);
+  reader->window = window;
+  reader->windowLen = (size_t) windowLen;
+  reader->mapOffset += windowLen;
+  return 0;
+}
+#endif
+
+// Returns the next chunk of the input, before decoding.
+static int
+ece_file_reader_next_raw(ece_file_reader_t* reader, const uint8_t** chunk,
+                         size_t* chunkLen) {
+#ifdef ECE_FILE_HAVE_MMAP
+  if (reader->isMapped) {
+    if (reader->windowStart == reader->windowLen &&
+        ece_file_reader_map_next(reader)) {
+      return 1;
+    }
+    size_t len = reader->windowLen - reader->windowStart;
+    if (len > ECE_FILE_CHUNK_SIZE) {
+      len = ECE_FILE_CHUNK_SIZE;
+    }
+    *chunk = &reader->window[reader->windowStart];
+    *chunkLen = len;
+    reader->windowStart += len;
+    reader->readLen += len;
+    return 0;
+  }
+#endif
+  size_t len = fread(reader->buffer, 1, ECE_FILE_CHUNK_SIZE, reader->file);
+  if (!len && ferror(reader->file)) {
+    fprintf(stderr, "Error: Failed to read input\n");
+    return 1;
+  }
+  *chunk = reader->buffer;
+  *chunkLen = len;
+  reader->readLen += len;
+  return 0;
+}
+
+// Decodes a chunk of Base64url input into `decoded`, skipping line breaks so
+// that wrapped input and trailing newlines are accepted. Most inputs are one
+// long line, so we find the breaks with `memchr`, and decode everything
+// between them in one call.
+static int
+ece_file_reader_decode(ece_file_reader_t* reader, const uint8_t* chunk,
+                       size_t chunkLen, size_t* decodedLen) {
+  *decodedLen = 0;
+  size_t start = 0;
+  while (start < chunkLen) {
+    const uint8_t* newline = memchr(&chunk[start], '\n', chunkLen - start);
+    size_t lineEnd = newline ? (size_t)(newline - chunk) : chunkLen;
+    // A "\r\n" pair may straddle two chunks, so we also drop a "\r" at the
+    // end of a chunk.
+    size_t end = lineEnd;
+    if (end > start && chunk[end - 1] == '\r') {
+      end--;
+    }
+    if (end > start) {
+      size_t len = ECE_FILE_DECODED_SIZE - *decodedLen;
+      int err = ece_base64url_decode_update(
+        &reader->decoder, (const char*) &chunk[start], end - start,
+        &reader->decoded[*decodedLen], &len);
+      if (err) {
+        return err;
+      }
+      *decodedLen += len;
+    }
+    start = lineEnd + 1;
+  }
+  return ECE_OK;
+}
+
+int
+ece_file_reader_next(ece_file_reader_t* reader, const uint8_t** chunk,
+                     size_t* chunkLen) {
+  if (reader->format == ECE_FILE_FORMAT_RAW) {
+    return ece_file_reader_next_raw(reader, chunk, chunkLen);
+  }
+  *chunk = reader->decoded;
+  *chunkLen = 0;
+  while (!reader->isDone) {
+    const uint8_t* raw;
+    size_t rawLen;
+    if (ece_file_reader_next_raw(reader, &raw, &rawLen)) {
+      return 1;
+    }
+    int err;
+    if (rawLen) {
+      err = ece_file_reader_decode(reader, raw, rawLen, chunkLen);
+    } else {
+      *chunkLen = ECE_FILE_DECODED_SIZE;
+      err = ece_base64url_decode_final(&reader->decoder, reader->decoded,
+                                       chunkLen);
+      reader->isDone = true;
+    }
+    if (err) {
+      fprintf(stderr, "Error: Failed to Base64url-decode input: %d\n", err);
+      return 1;
+    }
+    if (*chunkLen) {
+      break;
+    }
+    // The chunk only held line breaks, or part of a quantum; keep reading.
+  }
+  return 0;
+}
+
+void
+ece_file_reader_close(ece_file_reader_t* reader) {
+#ifdef ECE_FILE_HAVE_MMAP
+  if (reader->window) {
+    munmap(reader->window, reader->windowLen);
+  }
+#endif
+  if (reader->file && reader->file != stdin) {
+    fclose(reader->file);
+  }
+  free(reader->buffer);
+  free(reader->decoded);
+  memset(reader, 0, sizeof(ece_file_reader_t));
+}
+
+int
+ece_file_writer_open(ece_file_writer_t* writer, const char* path,
+                     ece_file_format_t format) {
+  memset(writer, 0, sizeof(ece_file_writer_t));
+  writer->format = format;
+  if (ece_file_is_std(path)) {
+#ifdef _WIN32
+    if (format == ECE_FILE_FORMAT_RAW) {
+      _setmode(_fileno(stdout), _O_BINARY);
+    }
+#endif
+    writer->file = stdout;
+  } else {
+    writer->file = fopen(path, "wb");
+    if (!writer->file) {
+      fprintf(stderr, "Error: Failed to open %s: %s\n", path, strerror(errno));
+      return 1;
+    }
+    writer->path = path;
+  }
+  if (format == ECE_FILE_FORMAT_BASE64URL) {
+    ece_base64url_encoder_init(&writer->encoder, ECE_BASE64URL_OMIT_PADDING);
+    writer->encoded = malloc(ECE_FILE_ENCODED_SIZE);
+    if (!writer->encoded) {
+      fprintf(stderr, "Error: Failed to allocate encoding buffer\n");
+      return 1;
+    }
+  }
+  return 0;
+}
+
+static int
+ece_file_writer_put(ece_file_writer_t* writer, const void* data, size_t len) {
+  if (len && fwrite(data, len, 1, writer->file) != 1) {
+    fprintf(stderr, "Error: Failed to write output\n");
+    return 1;
+  }
+  writer->writtenLen += len;
+  return 0;
+}
+
+int
+ece_file_writer_write(ece_file_writer_t* writer, const uint8_t* binary,
+                      size_t binaryLen) {
+  if (writer->format == ECE_FILE_FORMAT_RAW) {
+    return ece_file_writer_put(writer, binary, binaryLen);
+  }
+  while (binaryLen) {
+    size_t len = binaryLen < ECE_FILE_CHUNK_SIZE ? binaryLen
+                                                 : ECE_FILE_CHUNK_SIZE;
+    size_t encodedLen = ECE_FILE_ENCODED_SIZE;
+    int err = ece_base64url_encode_update(&writer->encoder, binary, len,
+                                          writer->encoded, &encodedLen);
+    if (err) {
+      fprintf(stderr, "Error: Failed to Base64url-encode output: %d\n", err);
+      return 1;
+    }
+    if (ece_file_writer_put(writer, writer->encoded, encodedLen)) {
+      return 1;
+    }
+    binary += len;
+    binaryLen -= len;
+  }
+  return 0;
+}
+
+// Closes the output file. Standard output is only flushed, since the caller
+// may still print to it.
+static int
+ece_file_writer_close(ece_file_writer_t* writer) {
+  int err = 0;
+  if (writer->file == stdout) {
+    err = fflush(stdout);
+  } else if (writer->file) {
+    err = fclose(writer->file);
+  }
+  writer->file = NULL;
+  free(writer->encoded);
+  writer->encoded = NULL;
+  return err ? 1 : 0;
+}
+
+int
+ece_file_writer_finish(ece_file_writer_t* writer) {
+  if (writer->format == ECE_FILE_FORMAT_BASE64URL) {
+    size_t encodedLen = ECE_FILE_ENCODED_SIZE;
+    int err = ece_base64url_encode_final(&writer->encoder, writer->encoded,
+                                         &encodedLen);
+    if (err) {
+      fprintf(stderr, "Error: Failed to Base64url-encode output: %d\n", err);
+      return 1;
+    }
+    if (ece_file_writer_put(writer, writer->encoded, encodedLen) ||
+        ece_file_writer_put(writer, "\n", 1)) {
+      return 1;
+    }
+  }
+  if (ece_file_writer_close(writer)) {
+    fprintf(stderr, "Error: Failed to write output\n");
+    return 1;
+  }
+  return 0;
+}
+
+void
+ece_file_writer_abort(ece_file_writer_t* writer) {
+  ece_file_writer_close(writer);
+  if (writer->path) {
+    remove(writer->path);
+  }
+}
+
+int
+ece_file_reserve(uint8_t** buffer, size_t* capacity, size_t len) {
+  if (len <= *capacity) {
+    return 0;
+  }
+  uint8_t* newBuffer = realloc(*buffer, len);
+  if (!newBuffer) {
+    fprintf(stderr, "Error: Failed to allocate %zu bytes for output\n", len);
+    return 1;
+  }
+  *buffer = newBuffer;
+  *capacity = len;
+  return 0;
+}
+
+uint64_t
+ece_file_now_ns(void) {
+#ifdef _WIN32
+  LARGE_INTEGER freq, counter;
+  QueryPerformanceFrequency(&freq);
+  QueryPerformanceCounter(&counter);
+  return (uint64_t)((double) counter.QuadPart * ECE_FILE_NS_PER_SEC /
+                    (double) freq.QuadPart);
+#else
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * ECE_FILE_NS_PER_SEC + (uint64_t) ts.tv_nsec;
+#endif
+}
+
+void
+ece_file_report(const char* verb, uint64_t inputLen, uint64_t outputLen,
+                uint64_t elapsedNs) {
+  double seconds = (double) elapsedNs / ECE_FILE_NS_PER_SEC;
+  double mibPerSec =
+    seconds > 0 ? (double) inputLen / (1024.0 * 1024.0) / seconds : 0;
+  fprintf(stderr,
+          "%s %llu bytes into %llu bytes in %.3f s (%.1f MiB/s)\n", verb,
+          (unsigned long long) inputLen, (unsigned long long) outputLen,
+          seconds, mibPerSec);
+}
@@ -0,0 +1,121 @@
+#ifndef ECE_TOOL_FILE_H
+#define ECE_TOOL_FILE_H
+
+// Reads and writes the files for `ece-encrypt` and `ece-decrypt` in bounded
+// chunks, so that memory use doesn't depend on the file size. On POSIX
+// systems, regular files are read through a sliding `mmap` window; standard
+// input, pipes, and all files on Windows are read into a fixed buffer.
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include <ece.h>
+
+// The most bytes that `ece_file_reader_next` returns at once, and that the
+// tools pass to each update call.
+#define ECE_FILE_CHUNK_SIZE (1024 * 1024)
+
+typedef enum ece_file_format_e {
+  ECE_FILE_FORMAT_RAW,
+  ECE_FILE_FORMAT_BASE64URL,
+} ece_file_format_t;
+
+typedef struct ece_file_reader_s {
+  FILE* file;
+  ece_file_format_t format;
+
+  // The mapped window, for regular files. `mapOffset` is the file offset of
+  // the next window, and `windowStart` is the next unread byte in the current
+  // one.
+  bool isMapped;
+  uint64_t fileLen;
+  uint64_t mapOffset;
+  uint8_t* window;
+  size_t windowLen;
+  size_t windowStart;
+
+  // The read buffer, for everything else.
+  uint8_t* buffer;
+
+  // Base64url input is decoded into `decoded` one chunk at a time.
+  ece_base64url_decoder_t decoder;
+  uint8_t* decoded;
+  bool isDone;
+
+  // The number of bytes read from the file, before decoding.
+  uint64_t readLen;
+} ece_file_reader_t;
+
+typedef struct ece_file_writer_s {
+  FILE* file;
+  const char* path;
+  ece_file_format_t format;
+
+  // Base64url output is encoded into `encoded` before it's written.
+  ece_base64url_encoder_t encoder;
+  char* encoded;
+  size_t encodedLen;
+
+  // The number of bytes written to the file, after encoding.
+  uint64_t writtenLen;
+} ece_file_writer_t;
+
+// Parses a `--input-format` or `--output-format` value.
+bool
+ece_file_parse_format(const char* value, ece_file_format_t* format);
+
+// Opens `path` for reading, or standard input if `path` is `NULL` or "-".
+// Prints an error and returns 1 on failure.
+int
+ece_file_reader_open(ece_file_reader_t* reader, const char* path,
+                     ece_file_format_t format);
+
+// Returns the next chunk of the input in `chunk`, decoded if the input is
+// Base64url. The chunk is valid until the next call. `chunkLen` is set to 0
+// at the end of the input. Prints an error and returns 1 on failure.
+int
+ece_file_reader_next(ece_file_reader_t* reader, const uint8_t** chunk,
+                     size_t* chunkLen);
+
+void
+ece_file_reader_close(ece_file_reader_t* reader);
+
+// Opens `path` for writing, or standard output if `path` is `NULL` or "-".
+// Prints an error and returns 1 on failure.
+int
+ece_file_writer_open(ece_file_writer_t* writer, const char* path,
+                     ece_file_format_t format);
+
+// Writes `binary`, encoding it if the output is Base64url. Prints an error and
+// returns 1 on failure.
+int
+ece_file_writer_write(ece_file_writer_t* writer, const uint8_t* binary,
+                      size_t binaryLen);
+
+// Finishes encoding, flushes, and closes the output. Prints an error and
+// returns 1 on failure.
+int
+ece_file_writer_finish(ece_file_writer_t* writer);
+
+// Closes the output without finishing it, and removes the file, so that a
+// failed run doesn't leave a partial result behind.
+void
+ece_file_writer_abort(ece_file_writer_t* writer);
+
+// Grows `*buffer` to hold at least `len` bytes. Prints an error and returns 1
+// on failure.
+int
+ece_file_reserve(uint8_t** buffer, size_t* capacity, size_t len);
+
+// Returns a monotonic timestamp, in nanoseconds.
+uint64_t
+ece_file_now_ns(void);
+
+// Prints the input and output lengths, and the input throughput, to standard
+// error.
+void
+ece_file_report(const char* verb, uint64_t inputLen, uint64_t outputLen,
+                uint64_t elapsedNs);
+
+#endif /* ECE_TOOL_FILE_H */
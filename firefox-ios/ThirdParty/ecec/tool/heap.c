@@ -0,0 +1,34 @@
+#include "heap.h"
+
+#include <stdlib.h>
+
+#include <ece.h>
+
+static void*
+ece_heap_alloc(void* opaque, size_t size) {
+  ECE_UNUSED(opaque);
+  return malloc(size);
+}
+
+static void*
+ece_heap_realloc(void* opaque, void* ptr, size_t size) {
+  ECE_UNUSED(opaque);
+  return realloc(ptr, size);
+}
+
+static void
+ece_heap_free(void* opaque, void* ptr) {
+  ECE_UNUSED(opaque);
+  free(ptr);
+}
+
+void
+ece_heap_set_allocator(void) {
+  ece_allocator_t allocator = {
+    .alloc = &ece_heap_alloc,
+    .realloc = &ece_heap_realloc,
+    .free = &ece_heap_free,
+    .opaque = NULL,
+  };
+  ece_set_allocator(&allocator);
+}
@@ -0,0 +1,11 @@
+#ifndef ECE_TOOL_HEAP_H
+#define ECE_TOOL_HEAP_H
+
+// Routes the library's allocations to the C heap. Libraries built with
+// `ECE_NO_HEAP` have no default allocator, so each tool calls this before
+// using the library; in other builds, it's equivalent to the default.
+
+void
+ece_heap_set_allocator(void);
+
+#endif /* ECE_TOOL_HEAP_H */
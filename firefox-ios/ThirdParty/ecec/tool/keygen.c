@@ -1,10 +1,49 @@
+// Generates subscription keys. By default, this prints one key pair and auth
+// secret. With `--count N`, it generates N sets in bulk, and writes them to
+// standard output as CSV with hex-encoded fields, or as fixed-size binary
+// records: the private key, public key, and auth secret, back to back.
+
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include <ece.h>
 
+#include "heap.h"
+
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#endif
+
+// The number of key sets generated per call in bulk mode. Output is written
+// after each call, so memory use doesn't depend on the count.
+#define ECE_KEYGEN_CHUNK_SIZE 4096
+
+#define ECE_KEYGEN_RECORD_LENGTH                                               \
+  (ECE_WEBPUSH_PRIVATE_KEY_LENGTH + ECE_WEBPUSH_PUBLIC_KEY_LENGTH +            \
+   ECE_WEBPUSH_AUTH_SECRET_LENGTH)
+
+// A CSV line holds each field in hex, two commas, and a newline.
+#define ECE_KEYGEN_CSV_LINE_LENGTH (ECE_KEYGEN_RECORD_LENGTH * 2 + 3)
+
+typedef enum ece_keygen_format_e {
+  ECE_KEYGEN_FORMAT_CSV,
+  ECE_KEYGEN_FORMAT_BINARY,
+} ece_keygen_format_t;
+
 static const char ece_keygen_hex_alphabet[] = "0123456789abcdef";
 
+// Writes `binaryLen * 2` hex characters to `hex`, and returns the end.
+static char*
+ece_keygen_hex_write(const uint8_t* binary, size_t binaryLen, char* hex) {
+  for (size_t i = 0; i < binaryLen; i++) {
+    *hex++ = ece_keygen_hex_alphabet[(binary[i] >> 4) & 0xf];
+    *hex++ = ece_keygen_hex_alphabet[binary[i] & 0xf];
+  }
+  return hex;
+}
+
 char*
 ece_keygen_hex_encode(const uint8_t* binary, size_t binaryLen) {
   if (binaryLen > SIZE_MAX / 2 - 1) {
@@ -14,17 +53,145 @@ ece_keygen_hex_encode(const uint8_t* binary, size_t binaryLen) {
   if (!encoded) {
     return NULL;
   }
-  char* hex = encoded;
-  for (size_t i = 0; i < binaryLen; i++) {
-    *hex++ = ece_keygen_hex_alphabet[(binary[i] >> 4) & 0xf];
-    *hex++ = ece_keygen_hex_alphabet[binary[i] & 0xf];
-  }
+  char* hex = ece_keygen_hex_write(binary, binaryLen, encoded);
   *hex = '\0';
   return encoded;
 }
 
+// Writes `count` key sets from the bulk arrays to `out`.
+static int
+ece_keygen_write(FILE* out, ece_keygen_format_t format, size_t count,
+                 const uint8_t* rawRecvPrivKeys, const uint8_t* rawRecvPubKeys,
+                 const uint8_t* authSecrets) {
+  for (size_t i = 0; i < count; i++) {
+    const uint8_t* rawRecvPrivKey =
+      &rawRecvPrivKeys[i * ECE_WEBPUSH_PRIVATE_KEY_LENGTH];
+    const uint8_t* rawRecvPubKey =
+      &rawRecvPubKeys[i * ECE_WEBPUSH_PUBLIC_KEY_LENGTH];
+    const uint8_t* authSecret =
+      &authSecrets[i * ECE_WEBPUSH_AUTH_SECRET_LENGTH];
+    if (format == ECE_KEYGEN_FORMAT_BINARY) {
+      if (fwrite(rawRecvPrivKey, ECE_WEBPUSH_PRIVATE_KEY_LENGTH, 1, out) != 1 ||
+          fwrite(rawRecvPubKey, ECE_WEBPUSH_PUBLIC_KEY_LENGTH, 1, out) != 1 ||
+          fwrite(authSecret, ECE_WEBPUSH_AUTH_SECRET_LENGTH, 1, out) != 1) {
+        return 1;
+      }
+      continue;
+    }
+    char line[ECE_KEYGEN_CSV_LINE_LENGTH];
+    char* hex = ece_keygen_hex_write(rawRecvPrivKey,
+                                     ECE_WEBPUSH_PRIVATE_KEY_LENGTH, line);
+    *hex++ = ',';
+    hex =
+      ece_keygen_hex_write(rawRecvPubKey, ECE_WEBPUSH_PUBLIC_KEY_LENGTH, hex);
+    *hex++ = ',';
+    hex = ece_keygen_hex_write(authSecret, ECE_WEBPUSH_AUTH_SECRET_LENGTH, hex);
+    *hex++ = '\n';
+    if (fwrite(line, (size_t)(hex - line), 1, out) != 1) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+static int
+ece_keygen_bulk(size_t count, ece_keygen_format_t format) {
+  int err = 0;
+  size_t chunkSize =
+    count < ECE_KEYGEN_CHUNK_SIZE ? count : ECE_KEYGEN_CHUNK_SIZE;
+  uint8_t* rawRecvPrivKeys = malloc(chunkSize * ECE_WEBPUSH_PRIVATE_KEY_LENGTH);
+  uint8_t* rawRecvPubKeys = malloc(chunkSize * ECE_WEBPUSH_PUBLIC_KEY_LENGTH);
+  uint8_t* authSecrets = malloc(chunkSize * ECE_WEBPUSH_AUTH_SECRET_LENGTH);
+  if (chunkSize && (!rawRecvPrivKeys || !rawRecvPubKeys || !authSecrets)) {
+    fprintf(stderr, "Error: Failed to allocate buffers for %zu keys\n",
+            chunkSize);
+    goto error;
+  }
+#ifdef _WIN32
+  if (format == ECE_KEYGEN_FORMAT_BINARY) {
+    _setmode(_fileno(stdout), _O_BINARY);
+  }
+#endif
+  if (format == ECE_KEYGEN_FORMAT_CSV &&
+      fputs("private_key,public_key,auth_secret\n", stdout) < 0) {
+    goto writeError;
+  }
+  for (size_t i = 0; i < count; i += chunkSize) {
+    size_t chunkLen = count - i < chunkSize ? count - i : chunkSize;
+    int genErr = ece_webpush_generate_keys_bulk(
+      chunkLen, rawRecvPrivKeys, chunkLen * ECE_WEBPUSH_PRIVATE_KEY_LENGTH,
+      rawRecvPubKeys, chunkLen * ECE_WEBPUSH_PUBLIC_KEY_LENGTH, authSecrets,
+      chunkLen * ECE_WEBPUSH_AUTH_SECRET_LENGTH);
+    if (genErr) {
+      fprintf(stderr, "Error: Failed to generate subscription keys: %d\n",
+              genErr);
+      goto error;
+    }
+    if (ece_keygen_write(stdout, format, chunkLen, rawRecvPrivKeys,
+                         rawRecvPubKeys, authSecrets)) {
+      goto writeError;
+    }
+  }
+  if (fflush(stdout)) {
+    goto writeError;
+  }
+  goto end;
+
+writeError:
+  fprintf(stderr, "Error: Failed to write keys\n");
+
+error:
+  err = 1;
+
+end:
+  free(rawRecvPrivKeys);
+  free(rawRecvPubKeys);
+  free(authSecrets);
+  return err;
+}
+
+static void
+ece_keygen_usage(const char* name) {
+  fprintf(stderr, "Usage: %s [--count <n>] [--format csv|binary]\n", name);
+}
+
 int
 main(int argc, char** argv) {
+  ece_heap_set_allocator();
+  size_t count = 0;
+  ece_keygen_format_t format = ECE_KEYGEN_FORMAT_CSV;
+  for (int i = 1; i < argc; i++) {
+    if (i + 1 == argc) {
+      ece_keygen_usage(argv[0]);
+      return 2;
+    }
+    const char* value = argv[++i];
+    if (!strcmp(argv[i - 1], "--count")) {
+      char* end;
+      unsigned long long parsed = strtoull(value, &end, 10);
+      if (!*value || *end || !parsed || parsed > SIZE_MAX) {
+        ece_keygen_usage(argv[0]);
+        return 2;
+      }
+      count = (size_t) parsed;
+    } else if (!strcmp(argv[i - 1], "--format")) {
+      if (!strcmp(value, "csv")) {
+        format = ECE_KEYGEN_FORMAT_CSV;
+      } else if (!strcmp(value, "binary")) {
+        format = ECE_KEYGEN_FORMAT_BINARY;
+      } else {
+        ece_keygen_usage(argv[0]);
+        return 2;
+      }
+    } else {
+      ece_keygen_usage(argv[0]);
+      return 2;
+    }
+  }
+  if (count) {
+    return ece_keygen_bulk(count, format);
+  }
+
   uint8_t rawRecvPrivKey[ECE_WEBPUSH_PRIVATE_KEY_LENGTH];
   uint8_t rawRecvPubKey[ECE_WEBPUSH_PUBLIC_KEY_LENGTH];
   uint8_t authSecret[ECE_WEBPUSH_AUTH_SECRET_LENGTH];